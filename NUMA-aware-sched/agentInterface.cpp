@@ -0,0 +1,350 @@
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "agentInterface.h"
+#include "controlPlane.h"
+#include "server/sampleCodec.h"
+
+// Wake whoever waits in readCounters() for the host
+static void notify(agentStream* host)
+{
+	uint64_t one = 1;
+
+	if ( write(host->ready, &one, sizeof(one)) < 0 && errno != EAGAIN )
+		perror("write() error");
+}
+
+AgentInterface::AgentInterface(RemoteInterface* driver, unsigned int nHosts, const string& hostPrefix, const string& agentHost)
+{
+	m_driver = driver;
+	m_numHosts = nHosts;
+	m_hostPrefix = hostPrefix;
+	m_agentHost = agentHost;
+
+	// hostID starts from 1
+	m_hosts = new agentStream [nHosts+1];
+
+	for ( unsigned int i = 0; i <= nHosts; i++ ) {
+		m_hosts[i].sock = -1;
+		m_hosts[i].numOfBatches = 0;
+		pthread_mutex_init(&m_hosts[i].mutex, NULL);
+		m_hosts[i].ready = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if ( m_hosts[i].ready < 0 )
+			perror("eventfd() error");
+	}
+
+	m_epoll = epoll_create1(EPOLL_CLOEXEC);
+	if ( m_epoll < 0 ) {
+		perror("epoll_create1() error");
+		return;
+	}
+
+	if ( pthread_create(&m_reader, NULL, readerThread, this) != 0 ) {
+		perror("pthread_create() error");
+	}
+}
+
+AgentInterface::~AgentInterface()
+{
+	pthread_cancel(m_reader);
+	pthread_join(m_reader, NULL);
+
+	for ( unsigned int i = 0; i <= m_numHosts; i++ ) {
+		closeAgent(i);
+		pthread_mutex_destroy(&m_hosts[i].mutex);
+		close(m_hosts[i].ready);
+	}
+
+	close(m_epoll);
+	delete [] m_hosts;
+	delete m_driver;
+}
+
+int AgentInterface::connectAgent(unsigned int hostID)
+{
+	struct addrinfo hints, *res, *ai;
+	struct epoll_event event;
+	ostringstream host, port;
+	socklen_t len;
+	int sock = -1, error;
+
+	if ( m_agentHost.empty() ) {
+		host << m_hostPrefix << setw(2) << setfill('0') << hostID;
+	} else {
+		host << m_agentHost;
+	}
+	port << AGENT_PORT_BASE + hostID;
+
+	memset(&hints, 0x00, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	if ( getaddrinfo(host.str().c_str(), port.str().c_str(), &hints, &res) != 0 ) {
+		cerr << "[" << hostID << "] Cannot resolve agent " << host.str() << endl;
+		return -1;
+	}
+
+	// non-blocking from the start, the reader thread drains it until EAGAIN;
+	// the connect waits on control_poll(), so a dead host parks only its round
+	for ( ai = res; ai != NULL; ai = ai->ai_next ) {
+		sock = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+		if ( sock < 0 )
+			continue;
+		if ( connect(sock, ai->ai_addr, ai->ai_addrlen) == 0 )
+			break;
+		if ( errno == EINPROGRESS && control_poll(sock, POLLOUT, AGENT_CONNECT_TIMEOUT) > 0 ) {
+			len = sizeof(error);
+			if ( getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error == 0 )
+				break;
+		}
+		close(sock);
+		sock = -1;
+	}
+	freeaddrinfo(res);
+
+	if ( sock < 0 ) {
+		cerr << "[" << hostID << "] Cannot connect to agent " << host.str() << ":" << port.str() << endl;
+		return -1;
+	}
+
+	pthread_mutex_lock(&m_hosts[hostID].mutex);
+	m_hosts[hostID].sock = sock;
+	m_hosts[hostID].buffer.clear();
+	m_hosts[hostID].delta.clear();
+	m_hosts[hostID].numOfBatches = 0;
+	pthread_mutex_unlock(&m_hosts[hostID].mutex);
+
+	memset(&event, 0x00, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.u32 = hostID;
+
+	if ( epoll_ctl(m_epoll, EPOLL_CTL_ADD, sock, &event) != 0 ) {
+		perror("epoll_ctl() error");
+		closeAgent(hostID);
+		return -1;
+	}
+
+	return 0;
+}
+
+void AgentInterface::closeAgent(unsigned int hostID)
+{
+	agentStream* host = &m_hosts[hostID];
+
+	pthread_mutex_lock(&host->mutex);
+	if ( host->sock >= 0 ) {
+		epoll_ctl(m_epoll, EPOLL_CTL_DEL, host->sock, NULL);
+		close(host->sock);
+		host->sock = -1;
+		host->buffer.clear();
+		notify(host);
+	}
+	pthread_mutex_unlock(&host->mutex);
+}
+
+int AgentInterface::startMonitoring(unsigned int hostID)
+{
+	int sock;
+
+	if ( hostID > m_numHosts )
+		return -1;
+
+	pthread_mutex_lock(&m_hosts[hostID].mutex);
+	sock = m_hosts[hostID].sock;
+	pthread_mutex_unlock(&m_hosts[hostID].mutex);
+
+	if ( sock >= 0 )
+		return 0;
+
+	return connectAgent(hostID);
+}
+
+int AgentInterface::stopMonitoring(unsigned int hostID)
+{
+	if ( hostID > m_numHosts )
+		return -1;
+
+	closeAgent(hostID);
+	return 0;
+}
+
+/*
+ *	Consume every complete batch in the buffer and add it to delta.
+ *	Returns the number of batches consumed, or -1 if the stream is corrupt.
+ */
+int AgentInterface::parseBatches(agentStream* host)
+{
+	string& buffer = host->buffer;
+	const uint8_t* data = reinterpret_cast<const uint8_t*>(buffer.data());
+	size_t pos = 0;
+	int nBatches = 0;
+	long size;
+
+	sample_batch_t batch;
+	uint32_t localID;
+	uint64_t insts, misses;
+	int status;
+
+	while ( (size = decode_batch(data + pos, buffer.size() - pos, &batch)) > 0 ) {
+
+		while ( (status = decode_record(&batch, &localID, &insts, &misses)) > 0 ) {
+			counterSample& acc = host->delta[localID];
+			acc.localID = localID;
+			acc.numRetiredInsts += insts;
+			acc.numLLCMisses += misses;
+		}
+		if ( status < 0 )
+			return -1;
+
+		pos += size;
+		nBatches++;
+	}
+
+	if ( size < 0 )
+		return -1;
+
+	buffer.erase(0, pos);
+	return nBatches;
+}
+
+/*
+ *	Drain the socket of a readable host. Returns -1 if the stream closed.
+ */
+int AgentInterface::receive(unsigned int hostID)
+{
+	agentStream* host = &m_hosts[hostID];
+	char	buffer[4096];
+	ssize_t	nRead;
+	int		parsed, status = 0;
+
+	pthread_mutex_lock(&host->mutex);
+
+	while ( host->sock >= 0 ) {
+		nRead = read(host->sock, buffer, sizeof(buffer));
+
+		if ( nRead < 0 && errno == EINTR )
+			continue;
+		if ( nRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) )
+			break;
+		if ( nRead <= 0 ) {
+			cerr << "[" << hostID << "] Agent connection closed" << endl;
+			status = -1;
+			break;
+		}
+
+		host->buffer.append(buffer, nRead);
+	}
+
+	if ( status == 0 ) {
+		parsed = parseBatches(host);
+		if ( parsed < 0 ) {
+			cerr << "[" << hostID << "] Corrupt agent stream" << endl;
+			status = -1;
+		} else if ( parsed > 0 ) {
+			host->numOfBatches += parsed;
+			notify(host);
+		}
+	}
+
+	pthread_mutex_unlock(&host->mutex);
+
+	if ( status != 0 ) {
+		closeAgent(hostID);
+	}
+
+	return status;
+}
+
+void* AgentInterface::readerThread(void* arg)
+{
+	AgentInterface* agent = static_cast<AgentInterface*>(arg);
+	struct epoll_event events[64];
+	int nEvents;
+
+	while ( true ) {
+		nEvents = epoll_wait(agent->m_epoll, events, 64, -1);
+
+		if ( nEvents < 0 ) {
+			if ( errno == EINTR )
+				continue;
+			perror("epoll_wait() error");
+			break;
+		}
+
+		for ( int i = 0; i < nEvents; i++ ) {
+			agent->receive(events[i].data.u32);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ *	Sum of the deltas streamed since the last call.
+ *	Waits for at most AGENT_READ_TIMEOUT if nothing has arrived yet.
+ */
+int AgentInterface::readCounters(unsigned int hostID, vector<counterSample>& samples)
+{
+	map<unsigned int, counterSample>::iterator it;
+	agentStream* host = &m_hosts[hostID];
+	struct timespec now;
+	double	deadline;
+	uint64_t	count;
+	int remaining;
+
+	samples.clear();
+
+	if ( startMonitoring(hostID) != 0 )
+		return -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	deadline = now.tv_sec + now.tv_nsec / 1e9 + AGENT_READ_TIMEOUT / 1000.0;
+
+	pthread_mutex_lock(&host->mutex);
+
+	// a batch that arrives once the mutex is released leaves the eventfd readable
+	while ( host->numOfBatches == 0 && host->sock >= 0 ) {
+		pthread_mutex_unlock(&host->mutex);
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		remaining = (int)((deadline - now.tv_sec - now.tv_nsec / 1e9) * 1000.0);
+		if ( remaining > 0 && control_poll(host->ready, POLLIN, remaining) > 0 ) {
+			if ( read(host->ready, &count, sizeof(count)) < 0 && errno != EAGAIN )
+				perror("read() error");
+		}
+
+		pthread_mutex_lock(&host->mutex);
+		if ( remaining <= 0 )
+			break;
+	}
+
+	if ( host->numOfBatches == 0 ) {
+		bool closed = ( host->sock < 0 );
+		pthread_mutex_unlock(&host->mutex);
+		cerr << "[" << hostID << "] " << (closed ? "Agent connection closed" : "Agent timeout") << endl;
+		return -1;
+	}
+
+	for ( it = host->delta.begin(); it != host->delta.end(); it++ ) {
+		samples.push_back(it->second);
+	}
+	host->delta.clear();
+	host->numOfBatches = 0;
+
+	pthread_mutex_unlock(&host->mutex);
+
+	return 0;
+}
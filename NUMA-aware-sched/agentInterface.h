@@ -0,0 +1,73 @@
+#ifndef _AGENT_INTERFACE_
+#define _AGENT_INTERFACE_
+
+#include <map>
+#include <pthread.h>
+#include "remoteInterface.h"
+
+#define AGENT_PORT_BASE			7700	// agent of host N listens on AGENT_PORT_BASE+N
+#define AGENT_READ_TIMEOUT		10000	// ms
+#define AGENT_CONNECT_TIMEOUT	3000	// ms
+
+// Stream state of the agent of one host
+struct agentStream {
+	int				sock;			// -1: not connected
+	string			buffer;			// unparsed stream data
+	map<unsigned int, counterSample>	delta;	// summed since the last read
+	int				numOfBatches;
+	pthread_mutex_t	mutex;
+	int				ready;			// eventfd: a batch arrived or the stream closed
+};
+
+/*
+ *	Driver that reads the performance counters from the resident monitoring
+ *	agents (server/agent) instead of polling xenonmon-do, and hands every
+ *	other call to the wrapped driver.
+ *
+ *	A single reader thread multiplexes the streams of all hosts with epoll
+ *	and sums the deltas per host; readCounters() only takes the sum. It
+ *	waits for the first batch on the eventfd of the host, so called from
+ *	the round of a host on the control plane it parks only that host.
+ */
+class AgentInterface : public RemoteInterface {
+
+public:
+	AgentInterface(RemoteInterface* driver, unsigned int nHosts, const string& hostPrefix, const string& agentHost);
+	~AgentInterface();
+
+	int	listVMs(unsigned int hostID, vector<vmInfo>& vms)	{ return m_driver->listVMs(hostID, vms); }
+	int	getLocalID(unsigned int hostID, const string& name, unsigned int& localID)	{ return m_driver->getLocalID(hostID, name, localID); }
+	int	getCPUAffinity(unsigned int hostID, const string& name, string& cpuAffinity)	{ return m_driver->getCPUAffinity(hostID, name, cpuAffinity); }
+	int	getTopology(unsigned int hostID, hostTopology& topology)	{ return m_driver->getTopology(hostID, topology); }
+
+	int	startMonitoring(unsigned int hostID);
+	int	stopMonitoring(unsigned int hostID);
+	int	readCounters(unsigned int hostID, vector<counterSample>& samples);
+
+	int	pinVCPU(unsigned int hostID, const string& name, unsigned int vcpu, const string& cpuAffinity)	{ return m_driver->pinVCPU(hostID, name, vcpu, cpuAffinity); }
+	int	pinVCPUs(unsigned int hostID, const string& name, const vector<string>& cpuAffinity)	{ return m_driver->pinVCPUs(hostID, name, cpuAffinity); }
+	int	migrate(unsigned int srcHostID, unsigned int destHostID, const string& name, int node = 0)	{ return m_driver->migrate(srcHostID, destHostID, name, node); }
+
+	int	getNUMAPages(unsigned int hostID, unsigned int localID, vector<int>& numOfPages)	{ return m_driver->getNUMAPages(hostID, localID, numOfPages); }
+	int	migratePages(unsigned int hostID, unsigned int localID, unsigned int node, int maxPages, int& moved)	{ return m_driver->migratePages(hostID, localID, node, maxPages, moved); }
+	int	getDirtyRates(unsigned int hostID, const vector<unsigned int>& localIDs, vector<dirtyRateSample>& rates)	{ return m_driver->getDirtyRates(hostID, localIDs, rates); }
+
+private:
+	static void*	readerThread(void* arg);
+
+	int		connectAgent(unsigned int hostID);
+	void	closeAgent(unsigned int hostID);
+	int		receive(unsigned int hostID);
+	int		parseBatches(agentStream* host);
+
+	RemoteInterface*	m_driver;
+	unsigned int		m_numHosts;
+	string				m_hostPrefix;
+	string				m_agentHost;	// empty: <hostPrefix><hostID>
+	agentStream*		m_hosts;		// [hostID]
+
+	int					m_epoll;
+	pthread_t			m_reader;
+};
+
+#endif
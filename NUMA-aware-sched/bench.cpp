@@ -0,0 +1,997 @@
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+#include <cstdlib>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/timerfd.h>
+#include <malloc.h>
+#include <float.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include "server/sampleCodec.h"
+#include "mockInterface.h"
+#include "controlPlane.h"
+#include "virtualMachine.h"
+#include "vmIndex.h"
+#include "socketHeap.h"
+#include "swapPlanner.h"
+#include "placementOptimizer.h"
+#include "missHistory.h"
+#include "processPages.h"
+#include "phaseMetrics.h"
+
+using namespace std;
+
+// Function prototype
+double	now();
+int		benchCodec(int nSamples);
+int		benchRounds(unsigned int maxHosts, int latency);
+int		benchIngest(unsigned int nVMs);
+int		benchRegistry(unsigned int nVMs);
+int		benchTopK(unsigned int nSockets, int degree);
+int		benchPlan(unsigned int nSockets, int degree);
+int		benchPlace(unsigned int nSockets, int budget);
+int		benchSmooth(unsigned int nSockets, int nRounds);
+int		benchPages(unsigned int megabytes, int batch);
+int		benchMetrics(unsigned int nThreads, int nLaps);
+
+/*
+ *	Micro benchmarks of the scheduler building blocks
+ */
+int main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		cerr << "usage: " << argv[0] << " codec [samples] | rounds [max hosts] [latency us] | ingest [VMs] | registry [VMs] | topk [sockets] [degree] | plan [sockets] [degree] | place [sockets] [migrations] | smooth [sockets] [rounds] | pages [MB] [batch pages] | metrics [threads] [laps]" << endl;
+		exit(1);
+	}
+
+	string which = argv[1];
+
+	if ( which == "codec" ) {
+		return benchCodec(argc > 2 ? atoi(argv[2]) : 1000000);
+	}
+	if ( which == "rounds" ) {
+		return benchRounds(argc > 2 ? atoi(argv[2]) : 4096, argc > 3 ? atoi(argv[3]) : 0);
+	}
+	if ( which == "ingest" ) {
+		return benchIngest(argc > 2 ? atoi(argv[2]) : 100000);
+	}
+	if ( which == "registry" ) {
+		return benchRegistry(argc > 2 ? atoi(argv[2]) : 1000000);
+	}
+	if ( which == "topk" ) {
+		return benchTopK(argc > 2 ? atoi(argv[2]) : 10000, argc > 3 ? atoi(argv[3]) : 64);
+	}
+	if ( which == "plan" ) {
+		return benchPlan(argc > 2 ? atoi(argv[2]) : 1000, argc > 3 ? atoi(argv[3]) : 64);
+	}
+	if ( which == "smooth" ) {
+		return benchSmooth(argc > 2 ? atoi(argv[2]) : 1000, argc > 3 ? atoi(argv[3]) : 720);
+	}
+	if ( which == "pages" ) {
+		return benchPages(argc > 2 ? atoi(argv[2]) : 256, argc > 3 ? atoi(argv[3]) : 4096);
+	}
+	if ( which == "metrics" ) {
+		return benchMetrics(argc > 2 ? atoi(argv[2]) : 8, argc > 3 ? atoi(argv[3]) : 1000000);
+	}
+	if ( which == "place" ) {
+		return benchPlace(argc > 2 ? atoi(argv[2]) : 1000, argc > 3 ? atoi(argv[3]) : 128);
+	}
+
+	cerr << "Unknown benchmark: " << which << endl;
+	return 1;
+}
+
+double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ *	Parse throughput of the text counter lines (istringstream, as in the
+ *	xenonmon-do path) against the binary batches of sampleCodec.h
+ */
+int benchCodec(int nSamples)
+{
+	const int	batchSize = 64;
+	unsigned int seed = 1;
+	double begin, elapsed, checksum;
+
+	vector<unsigned int>	localID(nSamples);
+	vector<unsigned long>	insts(nSamples), misses(nSamples);
+
+	for ( int i = 0; i < nSamples; i++ ) {
+		localID[i] = 1 + i % batchSize;
+		insts[i] = 800 + rand_r(&seed) % 400000;
+		misses[i] = rand_r(&seed) % 20000;
+	}
+
+	// 1. text lines
+	ostringstream oss;
+	for ( int i = 0; i < nSamples; i++ ) {
+		oss << localID[i] << " " << insts[i] << " " << misses[i] << "\n";
+	}
+	string text = oss.str();
+
+	begin = now();
+	checksum = 0;
+	{
+		istringstream result(text);
+		string line;
+
+		while (getline(result, line)) {
+			istringstream iss(line);
+			unsigned int id = 0;
+			double numOfRetiredInsts = 0.0, numOfLLCMisses = 0.0;
+
+			iss >> id >> numOfRetiredInsts >> numOfLLCMisses;
+			checksum += id + numOfRetiredInsts + numOfLLCMisses;
+		}
+	}
+	elapsed = now() - begin;
+
+	printf("text:   %9d samples %6.2f bytes/sample %12.0f samples/s (checksum %.0f)\n",
+			nSamples, (double)text.size() / nSamples, nSamples / elapsed, checksum);
+
+	// 2. binary batches
+	vector<uint8_t> stream(SAMPLE_BATCH_MAX(batchSize) * (nSamples / batchSize + 1));
+	size_t len = 0;
+
+	for ( int i = 0; i < nSamples; i += batchSize ) {
+		int count = ( nSamples - i < batchSize ) ? nSamples - i : batchSize;
+		size_t batchLen = encode_batch_begin(&stream[len], i / batchSize, 0);
+
+		for ( int j = i; j < i + count; j++ ) {
+			batchLen += encode_record(&stream[len + batchLen], localID[j], insts[j], misses[j]);
+		}
+		encode_batch_end(&stream[len], batchLen, count);
+		len += batchLen;
+	}
+
+	begin = now();
+	checksum = 0;
+	{
+		sample_batch_t batch;
+		uint32_t id;
+		uint64_t numOfRetiredInsts, numOfLLCMisses;
+		size_t pos = 0;
+		long size;
+
+		while ( (size = decode_batch(&stream[pos], len - pos, &batch)) > 0 ) {
+			while ( decode_record(&batch, &id, &numOfRetiredInsts, &numOfLLCMisses) > 0 ) {
+				checksum += id + numOfRetiredInsts + numOfLLCMisses;
+			}
+			pos += size;
+		}
+	}
+	elapsed = now() - begin;
+
+	printf("binary: %9d samples %6.2f bytes/sample %12.0f samples/s (checksum %.0f)\n",
+			nSamples, (double)len / nSamples, nSamples / elapsed, checksum);
+
+	return 0;
+}
+
+/*
+ *	Local rounds per second against the number of hosts: one thread per host
+ *	in lockstep on a barrier (the former local crew) against the control
+ *	plane with CONTROL_CREW_SIZE event loops. A round reads the counters of
+ *	every host from the mock driver; latency adds a remote call, a timerfd
+ *	of the host that turns readable after it as the output of an ssh
+ *	session would, waited for through control_poll() either way.
+ */
+static MockInterface*	s_mock;
+static int				s_latency;
+static vector<int>		s_remote;		// [hostID] timerfd
+static volatile bool	s_stop;
+static pthread_barrier_t	s_start, s_end;
+
+static void roundWork(unsigned int hostID, unsigned long round)
+{
+	vector<counterSample> samples;
+	struct itimerspec reply;
+	uint64_t count;
+
+	if ( s_latency > 0 ) {
+		memset(&reply, 0x00, sizeof(reply));
+		reply.it_value.tv_sec = s_latency / 1000000;
+		reply.it_value.tv_nsec = (s_latency % 1000000) * 1000L;
+		timerfd_settime(s_remote[hostID], 0, &reply, NULL);
+
+		while ( control_poll(s_remote[hostID], POLLIN, -1) <= 0 )
+			;
+		if ( read(s_remote[hostID], &count, sizeof(count)) < 0 )
+			perror("read() error");
+	}
+	s_mock->readCounters(hostID, samples);
+}
+
+static void* lockstepThread(void* arg)
+{
+	unsigned int hostID = (unsigned long)arg;
+
+	while ( true ) {
+		pthread_barrier_wait(&s_start);
+		if ( s_stop )
+			break;
+		roundWork(hostID, 0);
+		pthread_barrier_wait(&s_end);
+	}
+
+	return NULL;
+}
+
+int benchRounds(unsigned int maxHosts, int latency)
+{
+	const double	duration = 1.0;
+	const vector<unsigned int>	fleet(1, 2);		// two sockets of four cores
+
+	s_latency = latency;
+
+	printf("%6s %16s %16s   (latency %d us, %d loops)\n", "hosts", "lockstep r/s", "control r/s", latency, CONTROL_CREW_SIZE);
+
+	for ( unsigned int nHosts = 16; nHosts <= maxHosts; nHosts *= 4 ) {
+		vector<pthread_t>	threads(nHosts);
+		control_plane_t		cp;
+		double	begin, lockstep = 0.0, control;
+		long	rounds;
+		unsigned int	nThreads;
+		pthread_attr_t	attr;
+
+		s_mock = new MockInterface(nHosts, 4, fleet, 4);
+		s_remote.assign(nHosts + 1, -1);
+		for ( unsigned int h = 1; h <= nHosts; h++ ) {
+			s_remote[h] = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+			if ( s_remote[h] < 0 ) {
+				perror("timerfd_create() error");
+				break;
+			}
+		}
+		if ( find(s_remote.begin() + 1, s_remote.end(), -1) != s_remote.end() ) {
+			cerr << "Cannot create " << nHosts << " timers, raise ulimit -n" << endl;
+			for ( unsigned int h = 1; h <= nHosts && s_remote[h] >= 0; h++ ) {
+				close(s_remote[h]);
+			}
+			delete s_mock;
+			break;
+		}
+
+		// 1. one thread per host, barrier per round
+		s_stop = false;
+		pthread_barrier_init(&s_start, NULL, nHosts + 1);
+		pthread_barrier_init(&s_end, NULL, nHosts + 1);
+		pthread_attr_init(&attr);
+		pthread_attr_setstacksize(&attr, 256 * 1024);
+
+		for ( nThreads = 0; nThreads < nHosts; nThreads++ ) {
+			if ( pthread_create(&threads[nThreads], &attr, lockstepThread, (void*)(unsigned long)(nThreads + 1)) != 0 )
+				break;
+		}
+
+		if ( nThreads == nHosts ) {
+			begin = now();
+			for ( rounds = 0; now() - begin < duration; rounds++ ) {
+				pthread_barrier_wait(&s_start);
+				pthread_barrier_wait(&s_end);
+			}
+			lockstep = rounds / (now() - begin);
+
+			s_stop = true;
+			pthread_barrier_wait(&s_start);
+			for ( unsigned int i = 0; i < nThreads; i++ ) {
+				pthread_join(threads[i], NULL);
+			}
+		} else {
+			// threads already started are stuck on the barrier; leave them
+			cerr << "Cannot create " << nHosts << " threads" << endl;
+		}
+
+		pthread_attr_destroy(&attr);
+		if ( nThreads == nHosts ) {
+			pthread_barrier_destroy(&s_start);
+			pthread_barrier_destroy(&s_end);
+		}
+
+		// 2. control plane
+		create_control_plane(&cp, min(nHosts, (unsigned int)CONTROL_CREW_SIZE), nHosts, roundWork);
+
+		begin = now();
+		for ( rounds = 0; now() - begin < duration; rounds++ ) {
+			control_round(&cp, 60000, NULL);
+		}
+		control = rounds / (now() - begin);
+
+		destroy_control_plane(&cp);
+		delete s_mock;
+		for ( unsigned int h = 1; h <= nHosts; h++ ) {
+			close(s_remote[h]);
+		}
+
+		printf("%6u %16.1f %16.1f\n", nHosts, lockstep, control);
+
+		if ( nThreads != nHosts )
+			break;
+	}
+
+	return 0;
+}
+
+/*
+ *	Cost of matching the counter samples of a round to their VMs: the scan
+ *	of g_vmMap per sample against the (hostID, localID) index.
+ *	8 VMs per host; the scan is timed on a few hosts and projected.
+ */
+int benchIngest(unsigned int nVMs)
+{
+	const unsigned int	vmsPerHost = 8;
+	const unsigned int	scanHosts = 8;
+	unsigned int		nHosts = (nVMs + vmsPerHost - 1) / vmsPerHost;
+	VMRegistry	vms;
+	VMIndex		index(vms);
+	double		begin, scan, lookup;
+	unsigned long	found = 0;
+
+	vms.reserve(nVMs);
+	for ( unsigned int key = 0; key < nVMs; key++ ) {
+		ostringstream name;
+		name << "vm" << key;
+		index.insert(vms.add(name.str(), 1 + key / vmsPerHost, 1 + key % vmsPerHost, 0));
+	}
+
+	// 1. linear scan, as the local round did
+	begin = now();
+	for ( unsigned int hostID = 1; hostID <= scanHosts && hostID <= nHosts; hostID++ ) {
+		for ( unsigned int localID = 1; localID <= vmsPerHost; localID++ ) {
+			for ( unsigned int vm = 0; vm < vms.size(); vm++ ) {
+				if ( ( vms.hostID(vm) == hostID ) && ( vms.localID(vm) == localID ) ) {
+					found++;
+				}
+			}
+		}
+	}
+	scan = (now() - begin) / (min(scanHosts, nHosts) * vmsPerHost);
+
+	// 2. index, every host of the round
+	begin = now();
+	for ( unsigned int hostID = 1; hostID <= nHosts; hostID++ ) {
+		for ( unsigned int localID = 1; localID <= vmsPerHost; localID++ ) {
+			if ( index.lookup(hostID, localID) != VM_NONE ) {
+				found++;
+			}
+		}
+	}
+	lookup = (now() - begin) / (nHosts * vmsPerHost);
+
+	printf("%u VMs on %u hosts (found %lu)\n", nVMs, nHosts, found);
+	printf("scan:  %12.1f ns/sample %10.3f s/round (projected)\n", scan * 1e9, scan * nVMs);
+	printf("index: %12.1f ns/sample %10.3f s/round\n", lookup * 1e9, lookup * nVMs);
+
+	return 0;
+}
+
+// One heap object per VM, the layout the registry replaced
+struct vmObject {
+	unsigned int	key;
+	unsigned int	hostID;
+	unsigned int	localID;
+	unsigned int	cpuAffinity;
+	double			numRetiredInsts;
+	double			numLLCMisses;
+	int				state;
+};
+
+static size_t heapInUse()
+{
+	struct mallinfo2 info = mallinfo2();
+	return info.uordblks + info.hblkhd;
+}
+
+/*
+ *	Memory footprint of the VM registry against a map of heap objects plus
+ *	a map of names, and the time of a scoring pass (miss rate summed per
+ *	socket of every host) over each of them
+ */
+int benchRegistry(unsigned int nVMs)
+{
+	const unsigned int	vmsPerHost = 8;
+	const unsigned int	nSockets = 2;
+	unsigned int		nHosts = (nVMs + vmsPerHost - 1) / vmsPerHost;
+	unsigned int		seed = 1;
+	vector<double>		missRate(nHosts * nSockets + nSockets);
+	double	begin, elapsed, checksum;
+	size_t	base, used;
+
+	// 1. map of objects and map of names
+	map<unsigned int, vmObject*>	vmMap;
+	map<unsigned int, vmObject*>::iterator it;
+	map<unsigned int, string>		vmNameMap;
+
+	base = heapInUse();
+	for ( unsigned int key = 0; key < nVMs; key++ ) {
+		ostringstream name;
+		vmObject* vm = new vmObject;
+
+		name << "vm" << setw(7) << setfill('0') << key;
+		vm->key = key;
+		vm->hostID = 1 + key / vmsPerHost;
+		vm->localID = 1 + key % vmsPerHost;
+		vm->cpuAffinity = key % nSockets;
+		vm->numRetiredInsts = 800 + rand_r(&seed) % 400000;
+		vm->numLLCMisses = rand_r(&seed) % 20000;
+		vm->state = 0;
+
+		vmMap.insert(pair<unsigned int, vmObject*>(key, vm));
+		vmNameMap.insert(pair<unsigned int, string>(key, name.str()));
+	}
+	used = heapInUse() - base;
+
+	fill(missRate.begin(), missRate.end(), 0.0);
+	begin = now();
+	for ( it = vmMap.begin(); it != vmMap.end(); it++ ) {
+		vmObject* vm = it->second;
+		missRate[vm->hostID * nSockets + vm->cpuAffinity] += vm->numLLCMisses / vm->numRetiredInsts;
+	}
+	elapsed = now() - begin;
+
+	checksum = 0;
+	for ( unsigned int i = 0; i < missRate.size(); i++ )
+		checksum += missRate[i];
+
+	printf("objects:  %9u VMs %10.1f MB %6.1f bytes/VM %8.2f ms/pass (checksum %.3f)\n",
+			nVMs, used / 1048576.0, (double)used / nVMs, elapsed * 1e3, checksum);
+
+	for ( it = vmMap.begin(); it != vmMap.end(); it++ ) {
+		delete it->second;
+	}
+	vmMap.clear();
+	vmNameMap.clear();
+	malloc_trim(0);
+
+	// 2. registry
+	VMRegistry	vms;
+
+	seed = 1;
+	base = heapInUse();
+	vms.reserve(nVMs);
+	for ( unsigned int key = 0; key < nVMs; key++ ) {
+		ostringstream name;
+		unsigned int vm;
+
+		name << "vm" << setw(7) << setfill('0') << key;
+		vm = vms.add(name.str(), 1 + key / vmsPerHost, 1 + key % vmsPerHost, key % nSockets);
+		vms.setNumRetiredInsts(vm, 800 + rand_r(&seed) % 400000);
+		vms.setNumLLCMisses(vm, rand_r(&seed) % 20000);
+	}
+	used = heapInUse() - base;
+
+	fill(missRate.begin(), missRate.end(), 0.0);
+	begin = now();
+	for ( unsigned int vm = 0; vm < vms.size(); vm++ ) {
+		missRate[vms.hostID(vm) * nSockets + vms.cpuAffinity(vm)] += vms.numLLCMisses(vm) / vms.numRetiredInsts(vm);
+	}
+	elapsed = now() - begin;
+
+	checksum = 0;
+	for ( unsigned int i = 0; i < missRate.size(); i++ )
+		checksum += missRate[i];
+
+	printf("registry: %9u VMs %10.1f MB %6.1f bytes/VM %8.2f ms/pass (checksum %.3f, footprint() %.1f MB)\n",
+			nVMs, used / 1048576.0, (double)used / nVMs, elapsed * 1e3, checksum, vms.footprint() / 1048576.0);
+
+	return 0;
+}
+
+/*
+ *	Selection of the D most and least loaded socket pairs on distinct hosts:
+ *	the map rebuilt and sorted once per degree, as the global thread did,
+ *	against the indexed heaps of SocketHeap
+ */
+int benchTopK(unsigned int nSockets, int degree)
+{
+	const unsigned int	socketsPerHost = 2;
+	const int			nRounds = 20;
+	unsigned int		nHosts = nSockets / socketsPerHost;
+	unsigned int		seed = 1;
+	double	begin, sorting = 0, updating = 0, selecting = 0;
+	int		mismatch = 0;
+
+	map<socketKey, double>	missRatePerSocket;
+	map<socketKey, double>::iterator it_map;
+	SocketHeap	heap(nHosts, socketsPerHost);
+	vector<socketKey>	high, low, heapHigh, heapLow;
+
+	for ( int r = 0; r < nRounds; r++ ) {
+
+		for ( unsigned int h = 1; h <= nHosts; h++ ) {
+			for ( unsigned int j = 0; j < socketsPerHost; j++ ) {
+				missRatePerSocket[socketKey(h, j)] = rand_r(&seed) % 1000000 / 100.0;
+			}
+		}
+
+		// 1. D sorts of the sockets on hosts not chosen yet
+		begin = now();
+		high.assign(degree, socketKey(-1, -1));
+		low.assign(degree, socketKey(-1, -1));
+
+		for ( int i = 0; i < degree; i++ ) {
+			vector< pair<double, socketKey> > vt;
+
+			for ( it_map = missRatePerSocket.begin(); it_map != missRatePerSocket.end(); it_map++ ) {
+				bool insert = true;
+
+				for ( int j = 0; j < i; j++ ) {
+					if ( it_map->first.first == high[j].first || it_map->first.first == low[j].first )
+						insert = false;
+				}
+				if ( insert )
+					vt.push_back(make_pair(it_map->second, it_map->first));
+			}
+
+			sort(vt.rbegin(), vt.rend());
+			if ( vt.empty() )
+				break;
+
+			high[i] = vt.begin()->second;
+			low[i] = vt.rbegin()->second;
+		}
+		sorting += now() - begin;
+
+		// 2. heap: the scores of the round, then the selection
+		begin = now();
+		for ( it_map = missRatePerSocket.begin(); it_map != missRatePerSocket.end(); it_map++ ) {
+			heap.update(it_map->first.first, it_map->first.second, it_map->second);
+		}
+		updating += now() - begin;
+
+		begin = now();
+		heap.select(degree, heapHigh, heapLow);
+		selecting += now() - begin;
+
+		// equal scores may be broken the other way
+		for ( int i = 0; i < degree && i < (int)heapHigh.size(); i++ ) {
+			if ( missRatePerSocket[heapHigh[i]] != missRatePerSocket[high[i]] || missRatePerSocket[heapLow[i]] != missRatePerSocket[low[i]] )
+				mismatch++;
+		}
+	}
+
+	printf("%u sockets on %u hosts, D=%d, %d rounds (%d mismatches)\n", nSockets, nHosts, degree, nRounds, mismatch);
+	printf("sort:   %10.1f us/round\n", sorting / nRounds * 1e6);
+	printf("heap:   %10.1f us/round select, %10.1f us/round updating every socket\n",
+			selecting / nRounds * 1e6, updating / nRounds * 1e6);
+
+	return 0;
+}
+
+/*
+ *	Latency of the swap planner on the D pairs selected from the sockets,
+ *	and the peak it leaves behind against pairing the i-th highest socket
+ *	with the i-th lowest
+ */
+int benchPlan(unsigned int nSockets, int degree)
+{
+	const unsigned int	socketsPerHost = 2;
+	const unsigned int	vmsPerSocket = 4;
+	const int			nRounds = 20;
+	unsigned int		nHosts = nSockets / socketsPerHost;
+	unsigned int		seed = 1;
+	double	begin, selecting = 0, planning = 0, peakBefore = 0, peakGreedy = 0, peakPlan = 0;
+
+	SocketHeap	heap(nHosts, socketsPerHost);
+	vector<double>		hot(nSockets + socketsPerHost), cold(nSockets + socketsPerHost);
+	vector<socketKey>	high, low;
+	vector<swap_candidate_t>	highCandidates, lowCandidates;
+	vector<int>			partner;
+
+	for ( int r = 0; r < nRounds; r++ ) {
+
+		// 1. miss rates of the VMs on every socket; the hottest and the coldest are the candidates
+		for ( unsigned int h = 1; h <= nHosts; h++ ) {
+			for ( unsigned int j = 0; j < socketsPerHost; j++ ) {
+				unsigned int i = h * socketsPerHost + j;
+				double sum = 0, rate;
+
+				hot[i] = 0;
+				cold[i] = DBL_MAX;
+				for ( unsigned int k = 0; k < vmsPerSocket; k++ ) {
+					rate = rand_r(&seed) % 300000 / 100.0;
+					sum += rate;
+					hot[i] = max(hot[i], rate);
+					cold[i] = min(cold[i], rate);
+				}
+				heap.update(h, j, sum);
+			}
+		}
+
+		begin = now();
+		heap.select(degree, high, low);
+		selecting += now() - begin;
+
+		highCandidates.resize(high.size());
+		lowCandidates.resize(low.size());
+		for ( unsigned int i = 0; i < high.size(); i++ ) {
+			highCandidates[i].socket = high[i];
+			highCandidates[i].missRate = heap.score(high[i].first, high[i].second);
+			highCandidates[i].vm = i;
+			highCandidates[i].vmMissRate = hot[high[i].first * socketsPerHost + high[i].second];
+
+			lowCandidates[i].socket = low[i];
+			lowCandidates[i].missRate = heap.score(low[i].first, low[i].second);
+			lowCandidates[i].vm = i;
+			lowCandidates[i].vmMissRate = cold[low[i].first * socketsPerHost + low[i].second];
+		}
+
+		// 2. plan
+		begin = now();
+		peakPlan += plan_swaps(highCandidates, lowCandidates, partner);
+		planning += now() - begin;
+
+		// 3. i-th highest with the i-th lowest
+		double peak = 0;
+		for ( unsigned int i = 0; i < high.size(); i++ ) {
+			const swap_candidate_t& h = highCandidates[i];
+			const swap_candidate_t& l = lowCandidates[i];
+			peak = max(peak, max(h.missRate - h.vmMissRate + l.vmMissRate, l.missRate - l.vmMissRate + h.vmMissRate));
+		}
+		peakGreedy += peak;
+		peakBefore += highCandidates[0].missRate;
+	}
+
+	printf("%u sockets, D=%d, %d rounds\n", nSockets, degree, nRounds);
+	printf("select: %10.1f us/round\n", selecting / nRounds * 1e6);
+	printf("plan:   %10.1f us/round\n", planning / nRounds * 1e6);
+	printf("peak:   %10.1f before, %10.1f greedy pairs, %10.1f planned (mean)\n",
+			peakBefore / nRounds, peakGreedy / nRounds, peakPlan / nRounds);
+
+	return 0;
+}
+
+/*
+ *	Peak socket miss rate left by the placement search against the top-k
+ *	pairs and the swap planner, with the same budget of migrations, and the
+ *	migrations each spends per 1000 of peak removed; the search may also
+ *	move a VM one way, or rotate three, into sockets with vCPU slots free
+ */
+int benchPlace(unsigned int nSockets, int budget)
+{
+	const unsigned int	socketsPerHost = 2;
+	const unsigned int	vmsPerSocket = 4;
+	const int			nRounds = 5;
+	const int			slots = 32;		// vCPU slots of a socket
+	const unsigned int	widths[3] = { 2, 4, 8 };
+	unsigned int		nHosts = nSockets / socketsPerHost;
+	unsigned int		nBins = (nHosts + 1) * socketsPerHost;
+	unsigned int		seed = 1;
+	int					degree = budget / 2;
+	double	begin, planning = 0, searching = 0, peakBefore = 0, peakPlan = 0, peakSearch = 0;
+	unsigned long		iterations = 0, migrationsPlan = 0, migrationsSearch = 0;
+
+	SocketHeap	heap(nHosts, socketsPerHost);
+	vector<placement_vm_t>	vms;
+	vector<placement_move_t>	plan;
+	placement_stats_t	stats;
+	vector<double>		load(nBins), room(nBins);
+	vector<unsigned int>	hot(nBins), cold(nBins);
+	vector<socketKey>	high, low;
+	vector<swap_candidate_t>	highCandidates, lowCandidates;
+	vector<int>			partner;
+
+	for ( int r = 0; r < nRounds; r++ ) {
+
+		// 1. miss rates of the VMs on every socket
+		vms.clear();
+		for ( unsigned int h = 1; h <= nHosts; h++ ) {
+			for ( unsigned int j = 0; j < socketsPerHost; j++ ) {
+				unsigned int b = h * socketsPerHost + j;
+				placement_vm_t v;
+
+				load[b] = 0;
+				room[b] = slots;
+				for ( unsigned int k = 0; k < vmsPerSocket; k++ ) {
+					v.vm = vms.size();
+					v.bin = b;
+					v.missRate = rand_r(&seed) % 300000 / 100.0;
+					v.size = widths[rand_r(&seed) % 3];
+					v.pinned = false;
+					room[b] -= v.size;
+					if ( k == 0 || v.missRate > vms[hot[b]].missRate )
+						hot[b] = v.vm;
+					if ( k == 0 || v.missRate < vms[cold[b]].missRate )
+						cold[b] = v.vm;
+					load[b] += v.missRate;
+					vms.push_back(v);
+				}
+				heap.update(h, j, load[b]);
+			}
+		}
+
+		// 2. top-k pairs, planned
+		begin = now();
+		heap.select(degree, high, low);
+		highCandidates.resize(high.size());
+		lowCandidates.resize(low.size());
+		for ( unsigned int i = 0; i < high.size(); i++ ) {
+			unsigned int hb = high[i].first * socketsPerHost + high[i].second;
+			unsigned int lb = low[i].first * socketsPerHost + low[i].second;
+
+			highCandidates[i].socket = high[i];
+			highCandidates[i].missRate = load[hb];
+			highCandidates[i].vm = hot[hb];
+			highCandidates[i].vmMissRate = vms[hot[hb]].missRate;
+
+			lowCandidates[i].socket = low[i];
+			lowCandidates[i].missRate = load[lb];
+			lowCandidates[i].vm = cold[lb];
+			lowCandidates[i].vmMissRate = vms[cold[lb]].missRate;
+		}
+		plan_swaps(highCandidates, lowCandidates, partner);
+		planning += now() - begin;
+
+		vector<double> after = load;
+		for ( unsigned int i = 0; i < high.size(); i++ ) {
+			if ( partner[i] < 0 )
+				continue;
+			const swap_candidate_t& h = highCandidates[i];
+			const swap_candidate_t& l = lowCandidates[partner[i]];
+			after[h.socket.first * socketsPerHost + h.socket.second] += l.vmMissRate - h.vmMissRate;
+			after[l.socket.first * socketsPerHost + l.socket.second] += h.vmMissRate - l.vmMissRate;
+			migrationsPlan += 2;
+		}
+		peakPlan += *max_element(after.begin(), after.end());
+
+		// 3. search
+		begin = now();
+		optimize_placement(vms, room, budget, plan, &stats);
+		searching += now() - begin;
+		migrationsSearch += plan.size();
+
+		peakBefore += stats.peak_before;
+		peakSearch += stats.peak_after;
+		iterations += stats.iterations;
+	}
+
+	printf("%u sockets, %u VMs, %d migrations, %d threads, %d rounds\n", nSockets, (unsigned int)vms.size(), budget, OPTIMIZER_THREADS, nRounds);
+	printf("top-k + plan: %10.1f ms/round\n", planning / nRounds * 1e3);
+	printf("search:       %10.1f ms/round, %lu iterations/round\n", searching / nRounds * 1e3, iterations / nRounds);
+	printf("peak:         %10.1f before, %10.1f top-k + plan, %10.1f search (mean)\n",
+			peakBefore / nRounds, peakPlan / nRounds, peakSearch / nRounds);
+	printf("migrations:   %10.1f top-k + plan, %10.1f search (mean); per 1000 of peak removed %.2f, %.2f\n",
+			(double)migrationsPlan / nRounds, (double)migrationsSearch / nRounds,
+			peakBefore > peakPlan ? 1000.0 * migrationsPlan / (peakBefore - peakPlan) : 0.0,
+			peakBefore > peakSearch ? 1000.0 * migrationsSearch / (peakBefore - peakSearch) : 0.0);
+
+	return 0;
+}
+
+/*
+ *	How often the hottest VM of a socket changes from round to round under
+ *	bursty tenants, ranked by the last sample and by the smoothed rates, and
+ *	how often it is the VM that really is the hottest
+ */
+int benchSmooth(unsigned int nSockets, int nRounds)
+{
+	const unsigned int	vmsPerSocket = 4;
+	const int			burstPercent = 5;		// chance of a spike in a round
+	const double		burstFactor = 4.0;
+	const char*			names[3] = { "last sample", "EWMA", "median" };
+	unsigned int		nVMs = nSockets * vmsPerSocket;
+	unsigned int		seed = 1;
+
+	vector<double>	intensity(nVMs);
+	MissHistory		history[3] = { MissHistory(SMOOTH_NONE), MissHistory(SMOOTH_EWMA), MissHistory(SMOOTH_MEDIAN) };
+	vector<int>		top[3];
+	long			changes[3] = { 0, 0, 0 }, right[3] = { 0, 0, 0 };
+	double			begin, elapsed[3] = { 0, 0, 0 };
+
+	for ( int e = 0; e < 3; e++ ) {
+		history[e].resize(nVMs);
+		top[e].assign(nSockets, -1);
+	}
+
+	for ( int r = 0; r < nRounds; r++ ) {
+
+		// the tenants change places half way through
+		if ( r == 0 || r == nRounds / 2 ) {
+			for ( unsigned int vm = 0; vm < nVMs; vm++ ) {
+				intensity[vm] = 1.0 + rand_r(&seed) % 120;
+			}
+		}
+
+		for ( unsigned int socket = 0; socket < nSockets; socket++ ) {
+			double rate[vmsPerSocket], best[3] = { -1, -1, -1 };
+			int hottest = 0, pick[3] = { 0, 0, 0 };
+
+			for ( unsigned int k = 0; k < vmsPerSocket; k++ ) {
+				unsigned int vm = socket * vmsPerSocket + k;
+				double insts = 800 + rand_r(&seed) % 400;
+				double noise = 0.8 + (rand_r(&seed) % 41) / 100.0;
+				double misses;
+
+				if ( (int)(rand_r(&seed) % 100) < burstPercent )
+					noise *= burstFactor;
+				misses = intensity[vm] * noise * insts / 1000;
+				rate[k] = misses * 10000 / (insts * 500000 / 1000000);
+
+				if ( intensity[vm] > intensity[socket * vmsPerSocket + hottest] )
+					hottest = k;
+
+				for ( int e = 0; e < 3; e++ ) {
+					double smoothed;
+
+					begin = now();
+					smoothed = history[e].add(vm, insts, misses, rate[k], r);
+					elapsed[e] += now() - begin;
+
+					if ( smoothed > best[e] ) {
+						best[e] = smoothed;
+						pick[e] = k;
+					}
+				}
+			}
+
+			for ( int e = 0; e < 3; e++ ) {
+				if ( top[e][socket] >= 0 && top[e][socket] != pick[e] )
+					changes[e]++;
+				if ( pick[e] == hottest )
+					right[e]++;
+				top[e][socket] = pick[e];
+			}
+		}
+	}
+
+	printf("%u sockets, %u VMs per socket, %d rounds, %d%% bursts of x%.0f\n", nSockets, vmsPerSocket, nRounds, burstPercent, burstFactor);
+	for ( int e = 0; e < 3; e++ ) {
+		printf("%-12s %8.2f changes/socket/hour (5 s rounds), hottest %5.1f%% of rounds, %6.1f ns/sample\n",
+				names[e], changes[e] / (double)nSockets * 720 / nRounds, 100.0 * right[e] / ((double)nSockets * nRounds),
+				elapsed[e] / ((double)nVMs * nRounds) * 1e9);
+	}
+
+	return 0;
+}
+
+/*
+ *	Page migration of a driver on memory of this process: a range stands for
+ *	a VM, touched on the node the process runs on, moved to the node holding
+ *	the least of it in batches. The copy of the whole range is what a local
+ *	live migration costs at least.
+ */
+int benchPages(unsigned int megabytes, int batch)
+{
+	size_t		length = (size_t)megabytes << 20;
+	size_t		pageSize = sysconf(_SC_PAGESIZE);
+	vector<int>	before, after;
+	unsigned int	node = 0;
+	int			moved, total = 0, batches = 0;
+	double		begin, copy, elapsed, slowest = 0.0;
+	char		*range, *target;
+
+	range = (char*)memalign(pageSize, length);
+	target = (char*)memalign(pageSize, length);
+	if ( range == NULL || target == NULL ) {
+		cerr << "Cannot allocate " << megabytes << " MB" << endl;
+		return 1;
+	}
+	memset(range, 1, length);
+	memset(target, 0, length);
+
+	begin = now();
+	memcpy(target, range, length);
+	copy = now() - begin;
+
+	if ( process_numa_pages(range, length, before) != 0 )
+		return 1;
+	for ( unsigned int n = 1; n < before.size(); n++ ) {
+		if ( before[n] < before[node] )
+			node = n;
+	}
+
+	begin = now();
+	do {
+		double start = now();
+
+		if ( process_migrate_pages(range, length, node, batch, moved) != 0 )
+			return 1;
+		slowest = max(slowest, now() - start);
+		total += moved;
+		batches++;
+	} while ( moved == batch );
+	elapsed = now() - begin;
+
+	if ( process_numa_pages(range, length, after) != 0 )
+		return 1;
+
+	printf("%u MB, %zu pages, %d nodes, batches of %d pages to node %u\n", megabytes, length / pageSize, (int)before.size(), batch, node);
+	for ( unsigned int n = 0; n < before.size() || n < after.size(); n++ ) {
+		printf("node %u: %8d pages before, %8d after\n", n, n < before.size() ? before[n] : 0, n < after.size() ? after[n] : 0);
+	}
+	printf("moved %d pages in %d batches, %.1f ms (%.0f pages/s), slowest batch %.2f ms\n",
+			total, batches, elapsed * 1000, elapsed > 0 ? total / elapsed : 0.0, slowest * 1000);
+	printf("copy of the whole range %.1f ms\n", copy * 1000);
+
+	free(range);
+	free(target);
+
+	return 0;
+}
+
+static phase_metrics_t	metricsBench;
+static int				metricsLaps;
+static vector<double>	metricsCPU;		// [lane] sec of cpu the laps took
+
+// a lane of its own, the laps spread over the hosts and phases
+static void* lapThread(void *arg)
+{
+	unsigned int lane = (unsigned int)(unsigned long)arg;
+	struct timespec begin, end;
+	double mark = now();
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &begin);
+	for ( int i = 0; i < metricsLaps; i++ ) {
+		phase_lap(&metricsBench, lane, 1 + i % metricsBench.num_hosts, i % NUM_PHASES, &mark);
+	}
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+	metricsCPU[lane] = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+
+	return NULL;
+}
+
+/*
+ *	Cost of timing a phase: a read of the clock alone, and a lap into the
+ *	histograms in cpu time of its thread, with every thread writing at
+ *	once; then the cost of the report the endpoint serves
+ */
+int benchMetrics(unsigned int nThreads, int nLaps)
+{
+	const unsigned int	nHosts = 1000;
+	vector<pthread_t>	threads(nThreads);
+	phase_summary_t		s;
+	double	begin, clock, laps = 0.0, report, mark = 0.0;
+	size_t	length;
+
+	metricsLaps = nLaps;
+	metricsCPU.assign(nThreads, 0.0);
+	create_metrics(&metricsBench, nHosts, nThreads);
+
+	begin = now();
+	for ( int i = 0; i < nLaps; i++ ) {
+		mark += now();
+	}
+	clock = (now() - begin) / nLaps;
+
+	for ( unsigned int t = 0; t < nThreads; t++ ) {
+		if ( pthread_create(&threads[t], NULL, lapThread, (void*)(unsigned long)t) != 0 ) {
+			perror("pthread_create() error");
+			return 1;
+		}
+	}
+	for ( unsigned int t = 0; t < nThreads; t++ ) {
+		pthread_join(threads[t], NULL);
+		laps += metricsCPU[t] / nLaps / nThreads;
+	}
+
+	begin = now();
+	length = metrics_report(&metricsBench).size();
+	report = now() - begin;
+
+	summarize_phase(&metricsBench, -1, PHASE_COLLECT, &s);
+
+	printf("%u threads, %d laps each over %u hosts (checksum %.0f)\n", nThreads, nLaps, nHosts, mark > 0 ? 1.0 : 0.0);
+	printf("clock:  %6.1f ns\n", clock * 1e9);
+	printf("lap:    %6.1f ns of cpu per lap, all threads at once\n", laps * 1e9);
+	printf("report: %6.1f ms, %zu bytes; collect %lu samples, p50 %.3f ms, p99 %.3f ms\n", report * 1000, length, s.samples, s.p50, s.p99);
+
+	destroy_metrics(&metricsBench);
+
+	return 0;
+}
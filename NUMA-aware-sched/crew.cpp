@@ -60,10 +60,10 @@ int create_crew(struct crew_tag *crew, int size, void* (*threadFunc)(void*))
 int wait_crew(struct crew_tag *crew)
 {
 	int worker_index;
-	int status;
+	void* result;
 
 	for (worker_index = 0; worker_index < crew->worker_size; worker_index++) {
-		pthread_join(crew->worker[worker_index].thread, (void **)&status);
+		pthread_join(crew->worker[worker_index].thread, &result);
 	}
 
 	return 0;
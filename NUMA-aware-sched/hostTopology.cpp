@@ -0,0 +1,83 @@
+#include <sstream>
+#include <algorithm>
+
+#include "hostTopology.h"
+
+string cpuset_string(vector<unsigned int> cpus)
+{
+	ostringstream oss;
+	size_t i = 0, j;
+
+	sort(cpus.begin(), cpus.end());
+	cpus.erase(unique(cpus.begin(), cpus.end()), cpus.end());
+
+	while ( i < cpus.size() ) {
+		// the run of consecutive cpus from i
+		for ( j = i; j + 1 < cpus.size() && cpus[j+1] == cpus[j] + 1; j++ )
+			;
+
+		if ( i > 0 )
+			oss << ",";
+		oss << cpus[i];
+		if ( j > i )
+			oss << "-" << cpus[j];
+
+		i = j + 1;
+	}
+
+	return oss.str();
+}
+
+int find_socket(const hostTopology& topology, const string& cpuset)
+{
+	for ( unsigned int s = 0; s < topology.socketCPUs.size(); s++ ) {
+		if ( topology.socketCPUs[s] == cpuset )
+			return s;
+	}
+	return -1;
+}
+
+bool same_socket(const hostTopology& a, const hostTopology& b, unsigned int socket)
+{
+	return socket < a.socketCPUs.size() && socket < b.socketCPUs.size()
+		&& a.socketCPUs[socket] == b.socketCPUs[socket];
+}
+
+void vcpu_sockets(const hostTopology& topology, unsigned int home, unsigned int nVCPUs, vector<unsigned int>& sockets)
+{
+	unsigned int nSockets = topology.socketCPUs.size();
+	unsigned int cores;
+
+	// not a socket of this host
+	if ( home >= nSockets || home >= topology.numOfCores.size() ) {
+		sockets.clear();
+		return;
+	}
+	cores = topology.numOfCores[home] ? topology.numOfCores[home] : 1;
+
+	sockets.resize(nVCPUs);
+	for ( unsigned int v = 0; v < nVCPUs; v++ ) {
+		sockets[v] = ( nVCPUs <= cores ) ? home : (home + v / cores) % nSockets;
+	}
+}
+
+void uniform_topology(unsigned int nSockets, unsigned int coresPerSocket, unsigned int nodeMemory, hostTopology *topology)
+{
+	topology->socketCPUs.clear();
+	topology->numOfCores.assign(nSockets, coresPerSocket);
+	topology->socketNode.clear();
+	topology->nodeMemory.assign(nSockets, nodeMemory);
+
+	for ( unsigned int s = 0; s < nSockets; s++ ) {
+		vector<unsigned int> cpus;
+
+		for ( unsigned int c = 0; c < coresPerSocket; c++ ) {
+			cpus.push_back(s * coresPerSocket + c);
+		}
+
+		topology->socketCPUs.push_back(cpuset_string(cpus));
+		topology->socketNode.push_back(s);
+	}
+
+	topology->llcCPUs = topology->socketCPUs;
+}
@@ -0,0 +1,67 @@
+#include "migrationCost.h"
+
+#define MB			(1024.0 * 1024.0)
+#define PAGE_SIZE	(PAGE_SIZE_KB * 1024.0)
+
+void estimate_migration(double memory, double dirtyRate, migration_cost_t *cost)
+{
+	double bandwidth = LINK_BANDWIDTH * MB;		// bytes/s
+	double dirty = dirtyRate * PAGE_SIZE;		// bytes/s
+	double toSend = memory * MB, t;
+
+	cost->duration = 0.0;
+	cost->bytes = 0.0;
+	cost->rounds = 0;
+
+	// pre-copy while the guest runs
+	while ( cost->rounds < PRECOPY_MAX_ROUNDS
+			&& toSend > STOP_COPY_PAGES * PAGE_SIZE
+			&& cost->bytes + toSend < PRECOPY_MAX_FACTOR * memory * MB ) {
+		t = toSend / bandwidth;
+		cost->duration += t;
+		cost->bytes += toSend;
+		cost->rounds++;
+
+		// dirtied during the round, never more than the whole memory
+		toSend = dirty * t;
+		if ( toSend > memory * MB )
+			toSend = memory * MB;
+	}
+
+	// stop and copy the rest
+	t = toSend / bandwidth;
+	cost->duration += t;
+	cost->bytes += toSend;
+	cost->downtime = t * 1000.0 + RESUME_OVERHEAD;
+}
+
+void estimate_repin(double memory, double pageRate, migration_cost_t *cost)
+{
+	cost->duration = memory * MB / PAGE_SIZE / pageRate;
+	cost->downtime = 0.0;
+	cost->bytes = 0.0;
+	cost->rounds = 0;
+}
+
+double observed_dirty_rate(double memory, double duration)
+{
+	migration_cost_t cost;
+	double lo = 0.0, hi = LINK_BANDWIDTH * MB / PAGE_SIZE, mid;
+
+	// the duration grows with the dirty rate up to about the link speed,
+	// where sending three times the memory cuts the pre-copy short
+	estimate_migration(memory, lo, &cost);
+	if ( duration <= cost.duration )
+		return 0.0;
+
+	for ( int i = 0; i < 40; i++ ) {
+		mid = (lo + hi) / 2;
+		estimate_migration(memory, mid, &cost);
+		if ( cost.duration < duration )
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return (lo + hi) / 2;
+}
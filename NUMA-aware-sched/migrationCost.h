@@ -0,0 +1,39 @@
+#ifndef _MIGRATION_COST_
+#define _MIGRATION_COST_
+
+// Pre-copy live migration (xm migrate -l)
+#define LINK_BANDWIDTH			112.0	// MB/s, 1 GbE
+#define PAGE_SIZE_KB			4
+#define PRECOPY_MAX_ROUNDS		29		// then stop and copy
+#define PRECOPY_MAX_FACTOR		3		// or once this many times the memory was sent
+#define STOP_COPY_PAGES			50		// or once fewer pages are dirty
+#define RESUME_OVERHEAD			20.0	// ms the guest is paused besides the last copy
+#define DIRTY_RATE_DEFAULT		2560.0	// pages/s (10 MB/s) until one is observed
+
+typedef struct migration_cost_tag {
+	double	duration;	// sec
+	double	downtime;	// ms
+	double	bytes;		// sent over the link
+	int		rounds;		// pre-copy rounds
+} migration_cost_t;
+
+/*
+ *	Cost of migrating a VM of memory MB that dirties dirtyRate pages/s.
+ *	Every pre-copy round sends what the last one left dirty: the first the
+ *	whole memory, the next dirtyRate x the time the last took. The guest is
+ *	paused for the last round.
+ */
+void	estimate_migration(double memory, double dirtyRate, migration_cost_t *cost);
+
+/*
+ *	Cost of moving a VM of memory MB to another socket of its host: the
+ *	vCPUs are repinned at once and its pages follow at pageRate pages/s
+ *	while it keeps running, nothing crossing the link. Every page is
+ *	counted as remote, as after a live migration.
+ */
+void	estimate_repin(double memory, double pageRate, migration_cost_t *cost);
+
+// Dirty rate (pages/s) for which a migration of memory MB takes duration sec
+double	observed_dirty_rate(double memory, double duration);
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef _MIGRATION_EXECUTOR_H_
+#define _MIGRATION_EXECUTOR_H_
+
+#include <pthread.h>
+#include <list>
+#include <map>
+#include <set>
+
+using namespace std;
+
+// Migrations a host takes part in at once, leaving or arriving
+#ifndef EXECUTOR_HOST_LIMIT
+#define EXECUTOR_HOST_LIMIT		2
+#endif
+
+// Migrations between the same two hosts at once, either way
+#ifndef EXECUTOR_LINK_LIMIT
+#define EXECUTOR_LINK_LIMIT		2
+#endif
+
+typedef struct migration_job_tag {
+	unsigned int	vm;
+	unsigned int	srcHostID;
+	unsigned int	destHostID;		// the same host: the VM changes sockets only
+	int				socket;			// to pin it to on the destination, -1: as it is
+	int				after;			// VM whose migration makes room for this one, -1: none
+	unsigned long	epoch;			// planned in
+	double			queued;			// monotonic sec
+	double			started;
+	int				worker;			// index of the worker running it, -1: not running
+} migration_job_t;
+
+// runs a job on a worker; 0 or -1
+typedef int		(*migration_func_t)(const migration_job_t *job);
+// called on the worker once the job ran, or was cancelled, before its VM and hosts are free again
+typedef void	(*migration_done_t)(const migration_job_t *job, int status);
+
+/*
+ *	Migrations in flight, run by a small pool of workers.
+ *
+ *	A job is queued until both of its hosts and the link between them have
+ *	room for it, then the first free worker runs it; the queue is taken in
+ *	order, but a job whose hosts are busy does not hold up the ones behind
+ *	it. A VM is in flight from the time it is submitted until its callback
+ *	returned, and cannot be submitted again in between, so the planner can
+ *	go on to the next epoch while the migrations of the last one still run.
+ *
+ *	A job submitted after the one of its after VM waits until that one is
+ *	done, so a chain or a cycle of moves runs in the order the room of its
+ *	hosts allows. When that one fails, the jobs waiting on it are cancelled
+ *	(done with -1, never run), and so on down the chain. A job only learns
+ *	of a failure while it is queued, so the jobs of a chain are submitted
+ *	together with submit_migrations, all of them or none.
+ */
+typedef struct migration_executor_tag {
+	int				worker_size;
+	pthread_t		*worker;
+	migration_func_t	run;
+	migration_done_t	done;
+
+	pthread_mutex_t	mutex;
+	pthread_cond_t	go;			// a job queued or a slot freed
+
+	list<migration_job_t>	queue;
+	set<unsigned int>		in_flight;	// VMs queued or running
+	unsigned int	*host_active;		// [hostID] jobs running
+	map< pair<unsigned int, unsigned int>, unsigned int >	link_active;	// (lower, higher hostID)
+	unsigned int	num_hosts;
+	unsigned int	running;
+	int				indexed;	// workers that took their index
+	bool			exit;
+
+	unsigned long	completed;
+	unsigned long	failed;
+	unsigned long	cancelled;
+	double			max_wait;	// sec a job was queued, longest so far
+} migration_executor_t, *migration_executor_p;
+
+int		create_executor(struct migration_executor_tag *ex, int size, unsigned int nHosts, migration_func_t run, migration_done_t done);
+// lets the running jobs finish and drops the queued ones
+void	destroy_executor(struct migration_executor_tag *ex);
+// -1 if the VM is in flight already or the executor is closing
+int		submit_migration(struct migration_executor_tag *ex, const migration_job_t *job);
+// n jobs at once, or none of them if any VM is in flight already; the after VM of a job is one of them, or none
+int		submit_migrations(struct migration_executor_tag *ex, const migration_job_t *jobs, int n);
+bool	migration_in_flight(struct migration_executor_tag *ex, unsigned int vm);
+// jobs queued and running now
+void	executor_load(struct migration_executor_tag *ex, unsigned int *queued, unsigned int *running);
+
+#endif
@@ -0,0 +1,78 @@
+#include <algorithm>
+
+#include "missHistory.h"
+
+MissHistory::MissHistory(int estimator, double alpha, int window)
+{
+	m_estimator = estimator;
+	m_alpha = alpha;
+	m_window = min(max(window, 1), HISTORY_DEPTH);
+}
+
+void MissHistory::resize(size_t nVMs)
+{
+	m_ring.assign(nVMs * HISTORY_DEPTH, miss_sample_t());
+	m_head.assign(nVMs, HISTORY_DEPTH - 1);
+	m_count.assign(nVMs, 0);
+	m_ewma.assign(nVMs, 0.0);
+}
+
+double MissHistory::add(unsigned int vm, double numRetiredInsts, double numLLCMisses, double missRate, double timestamp)
+{
+	unsigned char head = (m_head[vm] + 1) % HISTORY_DEPTH;
+	miss_sample_t& s = m_ring[vm * HISTORY_DEPTH + head];
+
+	s.numRetiredInsts = numRetiredInsts;
+	s.numLLCMisses = numLLCMisses;
+	s.missRate = missRate;
+	s.timestamp = timestamp;
+
+	m_head[vm] = head;
+	if ( m_count[vm] < HISTORY_DEPTH )
+		m_count[vm]++;
+
+	// the first sample starts the average
+	m_ewma[vm] = ( m_count[vm] == 1 ) ? missRate : m_alpha * missRate + (1 - m_alpha) * m_ewma[vm];
+
+	return smoothed(vm);
+}
+
+double MissHistory::smoothed(unsigned int vm) const
+{
+	if ( m_count[vm] == 0 )
+		return 0.0;
+
+	switch ( m_estimator ) {
+	case SMOOTH_EWMA:
+		return m_ewma[vm];
+	case SMOOTH_MEDIAN:
+		return median(vm);
+	default:
+		return sample(vm, 0).missRate;
+	}
+}
+
+double MissHistory::median(unsigned int vm) const
+{
+	double rates[HISTORY_DEPTH];
+	int n = min((int)m_count[vm], m_window);
+
+	if ( n == 0 )
+		return 0.0;
+
+	for ( int i = 0; i < n; i++ ) {
+		rates[i] = sample(vm, i).missRate;
+	}
+
+	nth_element(rates, rates + n / 2, rates + n);
+	if ( n % 2 )
+		return rates[n / 2];
+
+	// the mean of the two middle ones
+	return (rates[n / 2] + *max_element(rates, rates + n / 2)) / 2;
+}
+
+const miss_sample_t& MissHistory::sample(unsigned int vm, int i) const
+{
+	return m_ring[vm * HISTORY_DEPTH + (m_head[vm] + HISTORY_DEPTH - i) % HISTORY_DEPTH];
+}
@@ -0,0 +1,65 @@
+#ifndef _MISS_HISTORY_
+#define _MISS_HISTORY_
+
+#include <vector>
+
+using namespace std;
+
+#define HISTORY_DEPTH		8		// samples kept per VM
+#define EWMA_ALPHA			0.3		// weight of the newest sample
+#define MEDIAN_WINDOW		5		// newest samples the median is taken over
+
+// Estimators of the miss rate of a VM
+#define SMOOTH_NONE			0		// the last sample
+#define SMOOTH_EWMA			1
+#define SMOOTH_MEDIAN		2
+
+typedef struct miss_sample_tag {
+	double	numRetiredInsts;
+	double	numLLCMisses;
+	double	missRate;
+	double	timestamp;		// sec, monotonic
+} miss_sample_t;
+
+/*
+ *	The last HISTORY_DEPTH counter samples of every VM in one flat ring
+ *	buffer per VM, indexed by the VM key, with an exponentially weighted
+ *	moving average kept on the side.
+ *
+ *	A single sample of a bursty tenant would rank it as the hottest VM for
+ *	one round only; the smoothed rate lets the spike pass. The samples of a
+ *	VM are only added by the thread running the local round of its host.
+ */
+class MissHistory {
+
+public:
+	MissHistory(int estimator = SMOOTH_MEDIAN, double alpha = EWMA_ALPHA, int window = MEDIAN_WINDOW);
+	~MissHistory() {}
+
+	void	resize(size_t nVMs);
+
+	// add a sample; returns the smoothed miss rate
+	double	add(unsigned int vm, double numRetiredInsts, double numLLCMisses, double missRate, double timestamp);
+
+	double	smoothed(unsigned int vm) const;
+	double	ewma(unsigned int vm) const		{ return m_ewma[vm]; }
+	double	median(unsigned int vm) const;
+
+	int		count(unsigned int vm) const	{ return m_count[vm]; }
+	// i = 0 is the newest
+	const miss_sample_t&	sample(unsigned int vm, int i) const;
+
+	int		estimator() const	{ return m_estimator; }
+
+private:
+	int		m_estimator;
+	double	m_alpha;
+	int		m_window;
+
+	vector<miss_sample_t>	m_ring;		// [vm * HISTORY_DEPTH + slot]
+	vector<unsigned char>	m_head;		// [vm] slot of the newest sample
+	vector<unsigned char>	m_count;	// [vm]
+	vector<double>			m_ewma;		// [vm]
+};
+
+#endif
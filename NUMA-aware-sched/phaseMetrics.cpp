@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <sstream>
+#include <iomanip>
+
+#include "phaseMetrics.h"
+
+static void*	metricsServerThread(void *arg);
+
+const char*	phase_names[NUM_PHASES] = {
+	"collect", "parse", "rank", "adjust", "barrier", "select", "admit", "queue", "migrate"
+};
+
+static double monotonic()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 0..3 us one each, then METRICS_SUB_BUCKETS per power of two
+static unsigned int bucket_of(unsigned long us)
+{
+	unsigned int octave, b;
+
+	if ( us < METRICS_SUB_BUCKETS )
+		return us;
+
+	octave = 63 - __builtin_clzl(us);
+	b = METRICS_SUB_BUCKETS * (octave - 1) + ( (us >> (octave - 2)) & (METRICS_SUB_BUCKETS - 1) );
+
+	return b < METRICS_BUCKETS ? b : METRICS_BUCKETS - 1;
+}
+
+// the highest us that falls into bucket b
+static unsigned long bucket_top(unsigned int b)
+{
+	unsigned int octave, sub;
+
+	if ( b < METRICS_SUB_BUCKETS )
+		return b;
+
+	octave = b / METRICS_SUB_BUCKETS + 1;
+	sub = b % METRICS_SUB_BUCKETS;
+
+	return ( (unsigned long)(METRICS_SUB_BUCKETS + sub + 1) << (octave - 2) ) - 1;
+}
+
+/*
+ *	No lane has a histogram yet
+ */
+int create_metrics(struct phase_metrics_tag *m, unsigned int nHosts, unsigned int nLanes)
+{
+	// hostID starts from 1; host 0 is the global thread's
+	m->num_hosts = nHosts;
+	m->num_lanes = nLanes;
+	m->block = new phase_histogram_t* [nLanes * (nHosts+1)];
+	for ( unsigned int i = 0; i < nLanes * (nHosts+1); i++ ) {
+		m->block[i] = NULL;
+	}
+
+	m->listen_sock = -1;
+	m->exit = false;
+
+	return 0;
+}
+
+void destroy_metrics(struct phase_metrics_tag *m)
+{
+	if ( m->listen_sock >= 0 ) {
+		m->exit = true;
+		// wakes the server out of accept
+		shutdown(m->listen_sock, SHUT_RDWR);
+		pthread_join(m->server, NULL);
+		close(m->listen_sock);
+		unlink(m->path.c_str());
+		m->listen_sock = -1;
+	}
+
+	for ( unsigned int i = 0; i < m->num_lanes * (m->num_hosts+1); i++ ) {
+		delete [] m->block[i];
+	}
+	delete [] m->block;
+}
+
+/*
+ *	Listen on the Unix socket at path, replacing one a scheduler that
+ *	is gone left behind, and answer on a thread of its own
+ */
+int serve_metrics(struct phase_metrics_tag *m, const char *path)
+{
+	struct sockaddr_un addr;
+	int sock, status;
+
+	if ( strlen(path) >= sizeof(addr.sun_path) )
+		return -1;
+
+	if ( (sock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1 ) {
+		perror("socket() error");
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+
+	if ( bind(sock, (struct sockaddr*)&addr, sizeof(addr)) == -1 ) {
+		perror("bind() error");
+		close(sock);
+		return -1;
+	}
+
+	if ( listen(sock, 5) == -1 ) {
+		perror("listen() error");
+		close(sock);
+		unlink(path);
+		return -1;
+	}
+
+	m->path = path;
+	m->listen_sock = sock;
+
+	status = pthread_create(&m->server, NULL, metricsServerThread, (void*)m);
+	if ( status != 0 ) {
+		perror("pthread_create() error");
+		m->listen_sock = -1;
+		close(sock);
+		unlink(path);
+		return -1;
+	}
+
+	return 0;
+}
+
+void phase_lap(struct phase_metrics_tag *m, unsigned int lane, unsigned int hostID, int phase, double *mark)
+{
+	double now = monotonic();
+
+	record_phase(m, lane, hostID, phase, now - *mark);
+	*mark = now;
+}
+
+void record_phase(struct phase_metrics_tag *m, unsigned int lane, unsigned int hostID, int phase, double seconds)
+{
+	phase_histogram_t **slot, *h;
+	unsigned long us;
+	unsigned int b;
+
+	if ( lane >= m->num_lanes || hostID > m->num_hosts || phase < 0 || phase >= NUM_PHASES )
+		return;
+
+	slot = &m->block[lane * (m->num_hosts+1) + hostID];
+	if ( *slot == NULL ) {
+		h = new phase_histogram_t [NUM_PHASES];
+		memset(h, 0, sizeof(phase_histogram_t) * NUM_PHASES);
+		// zeroed before the reader can see it
+		__atomic_store_n(slot, h, __ATOMIC_RELEASE);
+	}
+
+	h = &(*slot)[phase];
+	us = seconds > 0.0 ? (unsigned long)(seconds * 1e6) : 0;
+	b = bucket_of(us);
+
+	// the only writer; the reader takes whatever it sees
+	__atomic_store_n(&h->count[b], h->count[b] + 1, __ATOMIC_RELAXED);
+	if ( us > h->max )
+		__atomic_store_n(&h->max, us, __ATOMIC_RELAXED);
+}
+
+void summarize_phase(struct phase_metrics_tag *m, int hostID, int phase, phase_summary_t *summary)
+{
+	unsigned long	count[METRICS_BUCKETS], samples = 0, top = 0, seen = 0;
+	unsigned int	first, last, b;
+	phase_histogram_t *h;
+	bool	median = false;
+
+	memset(count, 0, sizeof(count));
+	first = ( hostID < 0 ) ? 0 : hostID;
+	last = ( hostID < 0 ) ? m->num_hosts : hostID;
+
+	for ( unsigned int lane = 0; lane < m->num_lanes; lane++ ) {
+		for ( unsigned int host = first; host <= last && host <= m->num_hosts; host++ ) {
+			h = __atomic_load_n(&m->block[lane * (m->num_hosts+1) + host], __ATOMIC_ACQUIRE);
+			if ( h == NULL )
+				continue;
+
+			h += phase;
+			for ( b = 0; b < METRICS_BUCKETS; b++ ) {
+				count[b] += __atomic_load_n(&h->count[b], __ATOMIC_RELAXED);
+			}
+			top = std::max(top, __atomic_load_n(&h->max, __ATOMIC_RELAXED));
+		}
+	}
+
+	// the ranks out of the same counts they are looked up in
+	for ( b = 0; b < METRICS_BUCKETS; b++ ) {
+		samples += count[b];
+	}
+
+	summary->samples = samples;
+	summary->p50 = summary->p99 = summary->max = 0.0;
+
+	for ( b = 0; b < METRICS_BUCKETS && samples > 0; b++ ) {
+		seen += count[b];
+		if ( !median && seen * 2 >= samples ) {
+			summary->p50 = std::min(bucket_top(b), top) / 1000.0;
+			median = true;
+		}
+		if ( seen * 100 >= samples * 99 ) {
+			summary->p99 = std::min(bucket_top(b), top) / 1000.0;
+			break;
+		}
+	}
+	summary->max = top / 1000.0;
+}
+
+/*
+ *	# phase host samples p50_ms p99_ms max_ms
+ *	Every phase over all hosts, then host by host; the global thread's
+ *	phases are its own, over all hosts only
+ */
+string metrics_report(struct phase_metrics_tag *m)
+{
+	ostringstream oss;
+	phase_summary_t s;
+
+	oss << "# phase host samples p50_ms p99_ms max_ms" << endl;
+	oss << fixed << setprecision(3);
+
+	for ( int phase = 0; phase < NUM_PHASES; phase++ ) {
+		summarize_phase(m, -1, phase, &s);
+		if ( s.samples == 0 )
+			continue;
+		oss << phase_names[phase] << " all " << s.samples << " " << s.p50 << " " << s.p99 << " " << s.max << endl;
+
+		for ( unsigned int hostID = 1; hostID <= m->num_hosts; hostID++ ) {
+			summarize_phase(m, hostID, phase, &s);
+			if ( s.samples == 0 )
+				continue;
+			oss << phase_names[phase] << " " << hostID << " " << s.samples << " " << s.p50 << " " << s.p99 << " " << s.max << endl;
+		}
+	}
+
+	return oss.str();
+}
+
+string metrics_summary(struct phase_metrics_tag *m)
+{
+	ostringstream oss;
+	phase_summary_t s;
+
+	oss << setprecision(3);
+
+	for ( int phase = 0; phase < NUM_PHASES; phase++ ) {
+		summarize_phase(m, -1, phase, &s);
+		if ( s.samples == 0 )
+			continue;
+		oss << ( oss.tellp() > 0 ? ", " : "" ) << phase_names[phase] << " " << s.p50 << "/" << s.p99 << "/" << s.max;
+	}
+
+	return oss.str();
+}
+
+/*
+ *	One report per connection
+ */
+static void* metricsServerThread(void *arg)
+{
+	phase_metrics_p m = (phase_metrics_t*)arg;
+	string report;
+	size_t sent;
+	ssize_t n;
+	int sock;
+
+	while ( !m->exit ) {
+		if ( (sock = accept(m->listen_sock, NULL, NULL)) == -1 ) {
+			if ( m->exit )
+				break;
+			// a signal meant for the scheduler, SIGINT at shutdown
+			if ( errno == EINTR )
+				continue;
+			perror("accept() error");
+			continue;
+		}
+
+		report = metrics_report(m);
+		for ( sent = 0; sent < report.size(); sent += n ) {
+			// a reader gone early does not raise SIGPIPE
+			n = send(sock, report.data() + sent, report.size() - sent, MSG_NOSIGNAL);
+			if ( n <= 0 )
+				break;
+		}
+		close(sock);
+	}
+
+	return NULL;
+}
@@ -0,0 +1,546 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+#include <algorithm>
+
+#include "placementOptimizer.h"
+
+#define TOURNAMENT		8		// bins drawn to pick a cold one
+#define COOLING_FLOOR	1e-3	// last temperature, relative to the first
+
+typedef struct anneal_tag {
+	// shared, read only
+	const vector<placement_vm_t>	*vms;
+	const vector< vector<int> >		*members;	// [bin] VMs that start there
+	const vector<double>			*load;		// [bin] before any move
+	const vector<double>			*room;		// [bin] free now
+	unsigned int	nBins;
+	int				maxMoves;
+	double			deadline;
+
+	unsigned int	seed;
+
+	// best placement of the thread, (VM, bin) of the VMs that moved
+	vector< pair<int, unsigned int> >	moves;
+	double			peak;
+	double			spread;
+	unsigned long	iterations;
+} anneal_t;
+
+static void*	annealThread(void *arg);
+static int		order_moves(const vector<placement_vm_t>& vms, const vector<double>& room, const vector< pair<int, unsigned int> >& moves, vector<placement_move_t>& plan);
+static unsigned int	find(vector<unsigned int>& parent, unsigned int b);
+
+static double monotonic()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// indexes of the plan, by the gain of their group, largest first, and a group together
+struct by_gain {
+	const vector<placement_move_t>& plan;
+
+	by_gain(const vector<placement_move_t>& p) : plan(p) {}
+	bool operator()(size_t a, size_t b) const
+	{
+		if ( plan[a].gain != plan[b].gain )
+			return plan[a].gain > plan[b].gain;
+		return plan[a].group < plan[b].group;
+	}
+};
+
+int optimize_placement(const vector<placement_vm_t>& vms, const vector<double>& room, int budget, vector<placement_move_t>& plan, placement_stats_t* stats)
+{
+	unsigned int	nBins = room.size();
+	vector< vector<int> >	members(nBins);
+	vector<double>	load(nBins, 0.0), after;
+	vector<unsigned int>	parent(nBins);
+	vector<double>	gain;
+	anneal_t		anneal[OPTIMIZER_THREADS];
+	pthread_t		thread[OPTIMIZER_THREADS];
+	int		started = 0, best = -1;
+	double	start = monotonic();
+
+	plan.clear();
+
+	for ( size_t i = 0; i < vms.size(); i++ ) {
+		members[vms[i].bin].push_back(i);
+		load[vms[i].bin] += vms[i].missRate;
+	}
+
+	stats->peak_before = stats->peak_after = nBins ? *max_element(load.begin(), load.end()) : 0.0;
+	stats->groups = 0;
+	stats->dropped = 0;
+	stats->iterations = 0;
+
+	if ( budget >= 1 && vms.size() >= 2 ) {
+		for ( int t = 0; t < OPTIMIZER_THREADS; t++ ) {
+			anneal[t].vms = &vms;
+			anneal[t].members = &members;
+			anneal[t].load = &load;
+			anneal[t].room = &room;
+			anneal[t].nBins = nBins;
+			anneal[t].maxMoves = budget;
+			anneal[t].deadline = start + OPTIMIZER_TIME_BUDGET / 1000.0;
+			anneal[t].seed = 2 * t + 1;
+
+			if ( pthread_create(&thread[t], NULL, annealThread, (void*)&anneal[t]) != 0 ) {
+				perror("pthread_create() error");
+				break;
+			}
+			started++;
+		}
+
+		for ( int t = 0; t < started; t++ ) {
+			pthread_join(thread[t], NULL);
+			stats->iterations += anneal[t].iterations;
+
+			if ( best < 0 || anneal[t].peak < anneal[best].peak
+					|| (anneal[t].peak == anneal[best].peak && anneal[t].spread < anneal[best].spread) )
+				best = t;
+		}
+	}
+
+	if ( best < 0 || anneal[best].peak >= stats->peak_before ) {
+		stats->elapsed = (monotonic() - start) * 1000.0;
+		return 0;
+	}
+
+	// 1. an order in which every bin has room at every step
+	stats->dropped = anneal[best].moves.size() - order_moves(vms, room, anneal[best].moves, plan);
+
+	// 2. groups: the moves that share bins, directly or through others
+	for ( unsigned int b = 0; b < nBins; b++ ) {
+		parent[b] = b;
+	}
+	after = load;
+	for ( size_t k = 0; k < plan.size(); k++ ) {
+		parent[find(parent, plan[k].from)] = find(parent, plan[k].to);
+		after[plan[k].from] -= vms[plan[k].vm].missRate;
+		after[plan[k].to] += vms[plan[k].vm].missRate;
+	}
+
+	// 3. the drop of the highest bin of each group
+	vector<double>	before(nBins, -1.0), highest(nBins, -1.0);
+	for ( size_t k = 0; k < plan.size(); k++ ) {
+		unsigned int bins[2] = { plan[k].from, plan[k].to };
+
+		for ( int i = 0; i < 2; i++ ) {
+			unsigned int g = find(parent, bins[i]);
+			before[g] = max(before[g], load[bins[i]]);
+			highest[g] = max(highest[g], after[bins[i]]);
+		}
+	}
+	for ( size_t k = 0; k < plan.size(); k++ ) {
+		unsigned int g = find(parent, plan[k].from);
+		plan[k].group = g;
+		plan[k].gain = before[g] - highest[g];
+	}
+
+	// 4. groups that take nothing off their peak are not worth their migrations
+	vector<placement_move_t>	kept;
+	vector<size_t>	order(plan.size());
+	vector<int>		index(plan.size(), -1);
+
+	for ( size_t k = 0; k < plan.size(); k++ ) {
+		order[k] = k;
+	}
+	stable_sort(order.begin(), order.end(), by_gain(plan));
+
+	for ( size_t i = 0; i < order.size(); i++ ) {
+		size_t k = order[i];
+
+		if ( plan[k].gain <= 0.0 ) {
+			after[plan[k].from] += vms[plan[k].vm].missRate;
+			after[plan[k].to] -= vms[plan[k].vm].missRate;
+			continue;
+		}
+		if ( i == 0 || plan[order[i-1]].group != plan[k].group )
+			stats->groups++;
+
+		index[k] = kept.size();
+		kept.push_back(plan[k]);
+		kept.back().group = stats->groups - 1;
+	}
+
+	// the order within a group holds; the indexes of the plan change
+	for ( size_t k = 0; k < kept.size(); k++ ) {
+		if ( kept[k].after >= 0 )
+			kept[k].after = index[kept[k].after];
+		kept[k].vm = vms[kept[k].vm].vm;
+	}
+	plan.swap(kept);
+
+	stats->peak_after = *max_element(after.begin(), after.end());
+	stats->elapsed = (monotonic() - start) * 1000.0;
+
+	return plan.size();
+}
+
+/*
+ *	Moves of the VMs in an order the room of the bins allows: each one at
+ *	once while its bin has room, or after a move out of its bin that leaves
+ *	enough, each move making room for one other at most. Returns the number
+ *	of moves ordered; plan[k].after indexes the plan.
+ */
+static int order_moves(const vector<placement_vm_t>& vms, const vector<double>& room, const vector< pair<int, unsigned int> >& moves, vector<placement_move_t>& plan)
+{
+	vector<double>	base = room;
+	vector<char>	done(moves.size(), 0);
+	vector<char>	lent;			// [plan] its room went to a later move
+	bool	progress = true;
+
+	plan.clear();
+
+	while ( progress ) {
+		progress = false;
+
+		for ( size_t m = 0; m < moves.size(); m++ ) {
+			const placement_vm_t& v = vms[moves[m].first];
+			unsigned int to = moves[m].second;
+			int after = -1;
+
+			if ( done[m] )
+				continue;
+
+			if ( v.size > base[to] ) {
+				// a move out of the bin, done first, that frees enough
+				for ( size_t k = 0; k < plan.size() && after < 0; k++ ) {
+					if ( !lent[k] && plan[k].from == to && v.size <= base[to] + vms[plan[k].vm].size )
+						after = k;
+				}
+				if ( after < 0 )
+					continue;
+
+				lent[after] = 1;
+				base[to] += vms[plan[after].vm].size;
+			}
+
+			placement_move_t move;
+			move.vm = moves[m].first;
+			move.from = v.bin;
+			move.to = to;
+			move.after = after;
+			move.group = 0;
+			move.gain = 0.0;
+
+			base[to] -= v.size;
+			plan.push_back(move);
+			lent.push_back(0);
+			done[m] = 1;
+			progress = true;
+		}
+	}
+
+	return plan.size();
+}
+
+static unsigned int find(vector<unsigned int>& parent, unsigned int b)
+{
+	while ( parent[b] != b ) {
+		parent[b] = parent[parent[b]];
+		b = parent[b];
+	}
+
+	return b;
+}
+
+/*
+ *	Annealing state of one thread: the bin every VM is in now, its start
+ *	bin unless it moved, and the room each bin has left once the moves are
+ *	done. Any set of moves within the budget and the room is a placement;
+ *	which of them wait for which is worked out afterwards.
+ *
+ *	The energy is the peak, kept in a max segment tree over the bins, plus
+ *	the sum of the squared loads over the total load, which orders the
+ *	placements of the same peak by how evenly the rest is spread.
+ */
+class Annealer {
+
+public:
+	Annealer(anneal_t *a) : m_a(a), m_vms(*a->vms), m_members(*a->members)
+	{
+		const vector<double>& load = *a->load;
+
+		m_bin.resize(m_vms.size());
+		for ( size_t i = 0; i < m_vms.size(); i++ ) {
+			m_bin[i] = m_vms[i].bin;
+		}
+		m_pos.assign(m_vms.size(), -1);
+		m_room = *a->room;
+		m_seed = a->seed;
+
+		for ( m_leaves = 1; m_leaves < a->nBins; m_leaves *= 2 )
+			;
+		m_tree.assign(2 * m_leaves, -1.0);
+
+		m_total = m_squares = 0.0;
+		for ( unsigned int b = 0; b < a->nBins; b++ ) {
+			m_tree[m_leaves + b] = load[b];
+			m_total += load[b];
+			m_squares += load[b] * load[b];
+		}
+		for ( unsigned int i = m_leaves - 1; i > 0; i-- ) {
+			m_tree[i] = max(m_tree[2*i], m_tree[2*i+1]);
+		}
+		if ( m_total <= 0.0 )
+			m_total = 1.0;
+	}
+
+	void run()
+	{
+		double t0 = temperature(), t;
+		unsigned long i, n = OPTIMIZER_ITERATIONS;
+
+		m_a->moves.clear();
+		m_a->peak = peak();
+		m_a->spread = spread();
+
+		for ( i = 0; i < n; i++ ) {
+			if ( (i & 255) == 0 && monotonic() > m_a->deadline )
+				break;
+
+			t = t0 * pow(COOLING_FLOOR, (double)i / n);
+			if ( !step(t) )
+				continue;
+
+			if ( peak() < m_a->peak || (peak() == m_a->peak && spread() < m_a->spread) ) {
+				m_a->moves.clear();
+				for ( size_t k = 0; k < m_moved.size(); k++ ) {
+					m_a->moves.push_back(make_pair(m_moved[k], m_bin[m_moved[k]]));
+				}
+				m_a->peak = peak();
+				m_a->spread = spread();
+			}
+		}
+
+		m_a->iterations = i;
+	}
+
+private:
+	unsigned int random(unsigned int n)		{ return rand_r(&m_seed) % n; }
+	double uniform()	{ return rand_r(&m_seed) / ((double)RAND_MAX + 1.0); }
+
+	double load(unsigned int bin) const	{ return m_tree[m_leaves + bin]; }
+	double peak() const		{ return m_tree[1]; }
+	double spread() const	{ return m_squares / m_total; }
+	double energy() const	{ return peak() + spread(); }
+
+	// one annealing step; true if it was taken
+	bool step(double t)
+	{
+		int vm[3];
+		unsigned int to[3];
+		unsigned int r = random(6);
+		int u, v, w;
+
+		// nothing moved yet to send back or elsewhere
+		if ( r >= 4 && m_moved.empty() )
+			r = 0;
+
+		if ( r < 2 ) {
+			// move: a VM of a hot bin to a cold one
+			u = pick(hot());
+			to[0] = cold();
+			if ( u < 0 || to[0] == m_bin[u] )
+				return false;
+			vm[0] = u;
+			return attempt(vm, to, 1, t);
+		}
+
+		if ( r == 2 ) {
+			// swap: a VM of a hot bin with one of a cold bin
+			u = pick(hot());
+			v = pick(cold());
+			if ( u < 0 || v < 0 || m_bin[u] == m_bin[v] )
+				return false;
+			vm[0] = u; to[0] = m_bin[v];
+			vm[1] = v; to[1] = m_bin[u];
+			return attempt(vm, to, 2, t);
+		}
+
+		if ( r == 3 ) {
+			// rotate: the hot VM to the first cold bin, one of it to the second, one of that back to the hot bin
+			u = pick(hot());
+			v = pick(cold());
+			w = pick(cold());
+			if ( u < 0 || v < 0 || w < 0 || m_bin[u] == m_bin[v] || m_bin[v] == m_bin[w] || m_bin[w] == m_bin[u] )
+				return false;
+			vm[0] = u; to[0] = m_bin[v];
+			vm[1] = v; to[1] = m_bin[w];
+			vm[2] = w; to[2] = m_bin[u];
+			return attempt(vm, to, 3, t);
+		}
+
+		u = m_moved[random(m_moved.size())];
+		vm[0] = u;
+
+		// back: where it started; elsewhere: another cold bin
+		to[0] = ( r == 4 ) ? m_vms[u].bin : cold();
+		if ( to[0] == m_bin[u] )
+			return false;
+		return attempt(vm, to, 1, t);
+	}
+
+	// vm[i] to bin to[i], all or none
+	bool attempt(const int *vm, const unsigned int *to, int n, double t)
+	{
+		double before = energy(), delta;
+		int moved = m_moved.size();
+		bool fits = true;
+
+		for ( int i = 0; i < n; i++ ) {
+			moved += (to[i] != m_vms[vm[i]].bin) - (m_bin[vm[i]] != m_vms[vm[i]].bin);
+			m_room[m_bin[vm[i]]] += m_vms[vm[i]].size;
+			m_room[to[i]] -= m_vms[vm[i]].size;
+		}
+		// a bin over its room already may not get any fuller
+		for ( int i = 0; i < n; i++ ) {
+			if ( m_room[to[i]] < 0.0 && m_room[to[i]] < (*m_a->room)[to[i]] )
+				fits = false;
+		}
+		if ( !fits || moved > m_a->maxMoves ) {
+			for ( int i = 0; i < n; i++ ) {
+				m_room[m_bin[vm[i]]] -= m_vms[vm[i]].size;
+				m_room[to[i]] += m_vms[vm[i]].size;
+			}
+			return false;
+		}
+
+		for ( int i = 0; i < n; i++ ) {
+			add(m_bin[vm[i]], -m_vms[vm[i]].missRate);
+			add(to[i], m_vms[vm[i]].missRate);
+		}
+		delta = energy() - before;
+
+		if ( delta > 0.0 && uniform() >= exp(-delta / t) ) {
+			for ( int i = 0; i < n; i++ ) {
+				add(to[i], -m_vms[vm[i]].missRate);
+				add(m_bin[vm[i]], m_vms[vm[i]].missRate);
+				m_room[m_bin[vm[i]]] -= m_vms[vm[i]].size;
+				m_room[to[i]] += m_vms[vm[i]].size;
+			}
+			return false;
+		}
+
+		for ( int i = 0; i < n; i++ ) {
+			relocate(vm[i], to[i]);
+		}
+
+		return true;
+	}
+
+	void add(unsigned int bin, double change)
+	{
+		unsigned int j = m_leaves + bin;
+		double before = m_tree[j];
+
+		m_tree[j] += change;
+		m_squares += m_tree[j] * m_tree[j] - before * before;
+
+		for ( j /= 2; j > 0; j /= 2 ) {
+			m_tree[j] = max(m_tree[2*j], m_tree[2*j+1]);
+		}
+	}
+
+	// keeps m_moved the VMs away from their start bin
+	void relocate(int u, unsigned int to)
+	{
+		int k = m_pos[u];
+
+		m_bin[u] = to;
+
+		if ( to != m_vms[u].bin && k < 0 ) {
+			m_pos[u] = m_moved.size();
+			m_moved.push_back(u);
+		} else if ( to == m_vms[u].bin && k >= 0 ) {
+			m_moved[k] = m_moved.back();
+			m_pos[m_moved[k]] = k;
+			m_moved.pop_back();
+			m_pos[u] = -1;
+		}
+	}
+
+	// a VM that still is in its start bin and may move, or -1
+	int pick(unsigned int bin)
+	{
+		const vector<int>& m = m_members[bin];
+
+		for ( int tries = 0; tries < 4 && !m.empty(); tries++ ) {
+			int i = m[random(m.size())];
+			if ( m_pos[i] < 0 && !m_vms[i].pinned )
+				return i;
+		}
+
+		return -1;
+	}
+
+	// the most loaded bin, now and then one a little below it
+	unsigned int hot()
+	{
+		unsigned int i = 1;
+
+		while ( i < m_leaves ) {
+			i *= 2;
+			if ( m_tree[i+1] > m_tree[i] || (random(8) == 0 && m_tree[i+1] >= 0.0) )
+				i++;
+		}
+
+		return i - m_leaves;
+	}
+
+	unsigned int cold()
+	{
+		unsigned int best = random(m_a->nBins);
+
+		for ( int i = 1; i < TOURNAMENT; i++ ) {
+			unsigned int b = random(m_a->nBins);
+			if ( !m_members[b].empty() && (m_members[best].empty() || load(b) < load(best)) )
+				best = b;
+		}
+
+		return best;
+	}
+
+	// a thousandth of the mean difference between two VMs
+	double temperature()
+	{
+		double sum = 0.0;
+
+		for ( int i = 0; i < 100; i++ ) {
+			sum += fabs(m_vms[random(m_vms.size())].missRate - m_vms[random(m_vms.size())].missRate);
+		}
+
+		return sum > 0.0 ? sum / 100 / 1000 : 1.0;
+	}
+
+	anneal_t	*m_a;
+	const vector<placement_vm_t>&	m_vms;
+	const vector< vector<int> >&	m_members;
+
+	// [bin] loads in the leaves, the larger child in each inner node
+	vector<double>	m_tree;
+	unsigned int	m_leaves;
+	double			m_total;
+	double			m_squares;
+
+	vector<unsigned int>	m_bin;		// [vm] now
+	vector<int>		m_pos;		// [vm] index in m_moved, -1: in its start bin
+	vector<int>		m_moved;
+	vector<double>	m_room;		// [bin] left
+	unsigned int	m_seed;
+};
+
+static void* annealThread(void *arg)
+{
+	anneal_t *a = (anneal_t*)arg;
+	Annealer annealer(a);
+
+	annealer.run();
+
+	return NULL;
+}
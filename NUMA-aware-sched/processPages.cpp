@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <algorithm>
+
+#include "processPages.h"
+
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE	(1 << 1)	// numaif.h, without linking libnuma
+#endif
+
+#define PAGES_PER_CALL	1024	// pages queried or moved by one move_pages(2)
+
+static long move_pages(int count, void **pages, const int *nodes, int *status)
+{
+	return syscall(SYS_move_pages, 0, (unsigned long)count, pages, nodes, status, MPOL_MF_MOVE);
+}
+
+// first page of the range and the number of pages it spans
+static void page_range(void *addr, size_t length, char **first, size_t *nPages)
+{
+	size_t pageSize = sysconf(_SC_PAGESIZE);
+	uintptr_t begin = (uintptr_t)addr & ~(pageSize - 1);
+	uintptr_t end = ((uintptr_t)addr + length + pageSize - 1) & ~(pageSize - 1);
+
+	*first = (char*)begin;
+	*nPages = (end - begin) / pageSize;
+}
+
+int process_numa_pages(void *addr, size_t length, vector<int>& numOfPages)
+{
+	size_t pageSize = sysconf(_SC_PAGESIZE);
+	size_t nPages, i;
+	char *first;
+	void *pages[PAGES_PER_CALL];
+	int status[PAGES_PER_CALL];
+
+	page_range(addr, length, &first, &nPages);
+	numOfPages.clear();
+
+	for ( i = 0; i < nPages; i += PAGES_PER_CALL ) {
+		int count = min(nPages - i, (size_t)PAGES_PER_CALL);
+
+		for ( int p = 0; p < count; p++ ) {
+			pages[p] = first + (i + p) * pageSize;
+		}
+
+		// no target nodes: the node of each page comes back in status
+		if ( move_pages(count, pages, NULL, status) != 0 ) {
+			perror("move_pages() error");
+			return -1;
+		}
+
+		for ( int p = 0; p < count; p++ ) {
+			if ( status[p] < 0 )
+				continue;
+			if ( status[p] >= (int)numOfPages.size() )
+				numOfPages.resize(status[p] + 1, 0);
+			numOfPages[status[p]]++;
+		}
+	}
+
+	return 0;
+}
+
+int process_migrate_pages(void *addr, size_t length, unsigned int node, int maxPages, int& moved)
+{
+	size_t pageSize = sysconf(_SC_PAGESIZE);
+	size_t nPages, i;
+	char *first;
+	void *pages[PAGES_PER_CALL];
+	int nodes[PAGES_PER_CALL], status[PAGES_PER_CALL];
+	int count, remote;
+
+	page_range(addr, length, &first, &nPages);
+	moved = 0;
+
+	for ( i = 0; i < nPages && moved < maxPages; i += PAGES_PER_CALL ) {
+		count = min(nPages - i, (size_t)PAGES_PER_CALL);
+
+		for ( int p = 0; p < count; p++ ) {
+			pages[p] = first + (i + p) * pageSize;
+		}
+		if ( move_pages(count, pages, NULL, status) != 0 ) {
+			perror("move_pages() error");
+			return -1;
+		}
+
+		// only the pages that are off the node, as many as are left of the batch
+		remote = 0;
+		for ( int p = 0; p < count && moved + remote < maxPages; p++ ) {
+			if ( status[p] >= 0 && status[p] != (int)node ) {
+				pages[remote] = pages[p];
+				nodes[remote] = node;
+				remote++;
+			}
+		}
+		if ( remote == 0 )
+			continue;
+
+		if ( move_pages(remote, pages, nodes, status) < 0 ) {
+			perror("move_pages() error");
+			return -1;
+		}
+
+		for ( int p = 0; p < remote; p++ ) {
+			if ( status[p] == (int)node )
+				moved++;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,24 @@
+#ifndef _PROCESS_PAGES_
+#define _PROCESS_PAGES_
+
+#include <stddef.h>
+#include <vector>
+
+using namespace std;
+
+/*
+ *	The page migration of a driver, done on a range of memory of this
+ *	process with move_pages(2), so the batching and the rate of a page
+ *	migration can be tried on a machine without Xen. A range stands for
+ *	the memory of a domain; it is walked page by page in address order.
+ *
+ *	All calls return 0 on success and -1 when move_pages(2) fails.
+ */
+
+// pages of the range on each NUMA node, numOfPages[node]; pages not yet touched are not counted
+int		process_numa_pages(void *addr, size_t length, vector<int>& numOfPages);
+
+// moves up to maxPages pages of the range that are off node to it; moved: how many did
+int		process_migrate_pages(void *addr, size_t length, unsigned int node, int maxPages, int& moved);
+
+#endif
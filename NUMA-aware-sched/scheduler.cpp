@@ -16,92 +16,195 @@
 #include <float.h>
 #include <time.h>
 #include "virtualMachine.h"
+#include "vmIndex.h"
 #include "crew.h"
+#include "sshSession.h"
+#include "remoteInterface.h"
+#include "xenInterface.h"
+#include "mockInterface.h"
+#include "agentInterface.h"
+#include "controlPlane.h"
+#include "socketHeap.h"
+#include "swapPlanner.h"
+#include "placementOptimizer.h"
+#include "migrationCost.h"
+#include "missHistory.h"
+#include "cooldownTable.h"
+#include "migrationExecutor.h"
+#include "capacityLedger.h"
+#include "phaseMetrics.h"
 
 #define LLC_MISS_SAMPLE_THRESHOLD           10000
 #define RETIRED_INST_SAMPLE_THRESHOLD       500000
 
 #define LOCAL_LLC_THRESHOLD					50
 #define GLOBAL_LLC_THRESHOLD				1000
+#define MIGRATION_COST_RATE					(GLOBAL_LLC_THRESHOLD / 10.0)	// miss rate x epochs a second of migration costs
+#define DOWNTIME_WEIGHT						10		// a second paused costs this many seconds of pre-copy
+#define REPIN_WEIGHT						0.25	// a second of pages following a repin costs this many: nothing crosses the link
+#define RELIEF_EPOCHS						4		// epochs the relief of a swap is expected to last
 #define	NUMA_THRESHOLD						2000 // 10000
+#define NUMA_PAGE_RATE						16384	// pages/s moved to home nodes per host, 64 MB/s
+#define NUMA_PAGE_BATCH						4096	// pages per call, 16 MB
+#define NUMA_REMOTE_SHARE					0.02	// of its pages a VM may keep off its home node
 
 #define LOCAL_SCHD_TIME_INTERVAL			5	// 10
 #define GLOBAL_SCHD_TIME_INTERVAL			15
-#define	NUM_OF_NUMA_NODES					2
+#define EPOCH_DEADLINE						5000	// ms, hosts reporting later are stale
+#define MOCK_VMS_PER_SOCKET					4
+#define MOCK_CORES_PER_SOCKET				4
+#define DISCOVERY_CREW_SIZE					64
+#ifndef MISS_RATE_ESTIMATOR
+#define MISS_RATE_ESTIMATOR					SMOOTH_MEDIAN	// SMOOTH_NONE, SMOOTH_EWMA or SMOOTH_MEDIAN
+#endif
 #define DEGREE_OF_MIGRATION					4
+#define DIRTY_RATE_MAX_AGE					60	// sec a dirty rate of a VM no round offers is good for
+#define METRICS_LANE_ROUNDS					0		// the local rounds, host by host, and the global thread as host 0
+#define METRICS_LANE_WORKER					1		// + the index of an executor worker
 
 using namespace std;
 
 typedef pair<int , int > virtualMachineKey;
-typedef pair<int , int > socketKey;
 
 struct numaMemoryInfo {
-	int	numOfPages[NUM_OF_NUMA_NODES];
+	vector<int>	numOfPages;		// [node]
 };
 
 // Function prototype
-void*	migrationHelperThread(void *);
+int		runMigration(const migration_job_t* );
+void	migrationDone(const migration_job_t* , int );
 void*	globalWorkerThread(void *);
-void*	localWorkerThread(void *);
+void	localRound(unsigned int , unsigned long );
+void	refreshDirtyRates(unsigned int , const vector<unsigned int>& , const vector<unsigned int>& );
+void	rehomeMemory(unsigned int , const vector< vector< pair<unsigned int, double> > >& );
+double	monotonic();
+unsigned int	location(socketKey );
+vector<unsigned int>	socketsPerHost();
+void*	discoveryThread(void *);
+void	pinInventory(unsigned int );
 void	signalHandler(int );
 int		initialize(unsigned int );
-string	sshCommand(unsigned int , string );
-VirtualMachine* getVM(unsigned int );
 numaMemoryInfo	getNUMAAffinity(int , int );
-unsigned int	getCPUAffinity(VirtualMachine* );
-unsigned int	getLocalID(int , VirtualMachine* );
-string			migrate(int , int, VirtualMachine*, int node = 0 );
-string			setCPUAffinity(int , VirtualMachine* );
+unsigned int	getCPUAffinity(unsigned int );
+unsigned int	getLocalID(unsigned int );
+string			migrate(int , int, unsigned int, int node = 0, int* status = NULL );
+int				enqueueMigration(int , int , unsigned int , unsigned int , unsigned long , int after = -1 );
+int				enqueueGroup(const vector<placement_move_t>& , size_t , size_t , unsigned long );
+string			setCPUAffinity(int , unsigned int , int* status = NULL );
+double			vcpuShare(const counterSample& , unsigned int , unsigned int );
+double			moveBenefit(const vector<unsigned int>& , const vector<unsigned int>& , double );
+double			swapBenefit(unsigned int , double , unsigned int , double );
+double			oneWayBenefit(unsigned int , unsigned int , double , double );
+double			peakRelief(double , double , double );
+void			planned(unsigned int , double );
+double			migrationsPerRelief();
+void			estimateMigration(unsigned int , unsigned int , migration_cost_t* );
 
 // Global variables
-multimap<int, VirtualMachine*> g_hostToVM_map;
-pthread_mutex_t	g_hostToVM_map_mutex;
+VMRegistry		g_vms;				// by key
+VMIndex			g_vmIndex(g_vms);	// by (hostID, localID)
+MissHistory		g_history(MISS_RATE_ESTIMATOR);	// recent samples, by key
+CooldownTable	g_cooldown;			// last migration, by key
+CapacityLedger	g_ledger;			// room of every host, by hostID and key
+
+// Migrations planned so far and the peak miss rate they were to take off; the global thread only
+unsigned long	g_plannedMigrations = 0;
+double			g_plannedRelief = 0.0;
+
+// Summary a host publishes at the end of each local round, [socket] of the host
+struct hostSnapshot {
+	unsigned long	round;		// 0: nothing published yet
+	vector<double>			missRate;
+	vector<unsigned int>	highLLC_VM;		// VM_NONE: no VM on the socket
+	vector<unsigned int>	lowLLC_VM;
+	vector<double>			highLLC_rate;	// miss rate of the VM
+	vector<double>			lowLLC_rate;
+};
+
+int		planPlacement(const vector<hostSnapshot>& , unsigned long );
 
-map<unsigned int, VirtualMachine*>	g_vmMap;
-map<unsigned int, string>			g_vmNameMap;
-map<socketKey, double>				g_missRatePerSocket;
+// [hostID][round & 1]: hosts write round r while the global thread may still read round r-1
+hostSnapshot		(*g_snapshot)[2];
 
-unsigned int**		g_highLLC_VM;
-unsigned int**		g_lowLLC_VM;
-pthread_mutex_t**	g_llc_mutex;
+// Local state kept between the rounds of a host
+struct localState {
+	double	pageTokens;		// pages it may move to home nodes now
+	double	pageStamp;		// when they were counted
+	vector<unsigned int>	rehome;		// VMs repinned to another socket, their memory to follow; g_migration_mutex
+	int		resetCounter;
+};
 
-bool*				g_hostMigrating;
-pthread_cond_t*		g_hostMigrating_go;
-pthread_mutex_t*	g_hostMigrating_mutex;
+localState*			g_localState;		// [hostID]
 
-static crew_t		g_localCrew;
+static control_plane_t	g_controlPlane;
 static crew_t		g_globalCrew;
-static crew_t		g_migrationCrew;
+static migration_executor_t	g_executor;
+static phase_metrics_t	g_metrics;
+static session_pool_t	g_sessionPool;
+RemoteInterface*	g_remote = NULL;
+
+// sockets of the mock hosts, host by host in turn
+const unsigned int	g_mockFleet[] = { 2, 4, 2, 8 };
 
-pthread_mutex_t		g_migration_mutex;
-pthread_cond_t		g_migration_done;
-int					g_migrationCompleteCnt = 0;
-int					g_migrationReqCnt = 0;
+vector<hostTopology>	g_topology;			// [hostID], filled by the discovery crew
+vector<unsigned int>	g_socketBase;		// [hostID] location of socket 0, [g_numHosts+1] number of sockets
+vector<socketKey>		g_socketKeys;		// [location]
+
+vector<vmInfo>*		g_inventory;		// [hostID], filled by the discovery crew
+int*				g_inventoryStatus;
+
+pthread_mutex_t		g_migration_mutex;		// the rehome lists of the hosts
 
 string	g_hostPrefix;
 bool g_exitCond = false;
 unsigned int g_numHosts = 0;
 int g_degreeOfMigration = DEGREE_OF_MIGRATION;
+bool g_placementSearch = false;		// whole-cluster search instead of the top-k pairs
 
 int main(int argc, char *argv[])
 {
 	int status;
+	string driver;
 	
 	// Default number of workers 1
 	g_numHosts = CREW_SIZE;
 		
 	if (argc < 4) {
-		cerr << "usage: " << argv[0] << " [host_prefix] [number of hosts] [degree of migration]" << endl;
+		cerr << "usage: " << argv[0] << " [host_prefix] [number of hosts] [degree of migration] [xen|mock][+agent][+search]" << endl;
 		exit(1);
 	}
 
 	g_hostPrefix = argv[1];
 	g_numHosts = atoi(argv[2]);
 	g_degreeOfMigration = atoi(argv[3]);
+	driver = (argc > 4) ? argv[4] : "xen";
+	g_placementSearch = ( driver.find("+search") != string::npos );
 
 	cout << "Host prefix: " << g_hostPrefix << endl;
 	cout << "Num of hosts: " << g_numHosts << endl;
 	cout << "Degree of migration: " << g_degreeOfMigration << endl;
+	cout << "Driver: " << driver << endl;
+	cout << "Placement: " << ( g_placementSearch ? "search" : "top-k pairs" ) << endl;
+
+	// Select the hypervisor driver
+	if ( driver.compare(0, 4, "mock") == 0 ) {
+		g_remote = new MockInterface(g_numHosts, MOCK_VMS_PER_SOCKET, vector<unsigned int>(g_mockFleet, g_mockFleet + sizeof(g_mockFleet) / sizeof(g_mockFleet[0])), MOCK_CORES_PER_SOCKET);
+
+	} else {
+		// Open the ssh session pool shared by all threads
+		if ( create_session_pool(&g_sessionPool, g_numHosts, SSH_SESSIONS_PER_HOST) ) {
+			cerr << "Failed to create the ssh session pool.." << endl;
+			exit(1);
+		}
+		g_remote = new XenInterface(&g_sessionPool, g_hostPrefix);
+	}
+
+	// Counters are pushed by the monitoring agents instead of polled
+	if ( driver.find("+agent") != string::npos ) {
+		// the agents of mock hosts run locally (server/agent -n <hosts>)
+		string agentHost = ( driver.compare(0, 4, "mock") == 0 ) ? "localhost" : "";
+		g_remote = new AgentInterface(g_remote, g_numHosts, g_hostPrefix, agentHost);
+	}
 
 	// Initalize
 	if ( initialize(g_numHosts) ) {
@@ -109,10 +212,16 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 
-	// Create localCrew thread
-	status = create_crew(&g_localCrew, g_numHosts, localWorkerThread);
+	// Latency of every phase of the rounds, served on a Unix socket
+	create_metrics(&g_metrics, g_numHosts, METRICS_LANE_WORKER + g_degreeOfMigration*2);
+	if ( serve_metrics(&g_metrics, METRICS_SOCKET_PATH) != 0 ) {
+		cerr << "Cannot serve the metrics on " << METRICS_SOCKET_PATH << endl;
+	}
+
+	// Create the control plane running the local rounds
+	status = create_control_plane(&g_controlPlane, min(g_numHosts, (unsigned int)CONTROL_CREW_SIZE), g_numHosts, localRound);
 	if ( status != 0 ) {
-		cerr << "Failed to create local crew " << endl; 
+		cerr << "Failed to create control plane " << endl; 
 	}
 	
 	// Create globalCrew thread
@@ -121,10 +230,10 @@ int main(int argc, char *argv[])
 		cerr << "Failed to create global crew " << endl; 
 	}
 
-	// Create migrationHelper thread
-	status = create_crew(&g_migrationCrew, g_degreeOfMigration*2, migrationHelperThread);
+	// Create the executor running the migrations
+	status = create_executor(&g_executor, g_degreeOfMigration*2, g_numHosts, runMigration, migrationDone);
 	if ( status != 0 ) {
-		cerr << "Failed to create migrationHelper crew " << endl; 
+		cerr << "Failed to create the migration executor " << endl; 
 	}
 
 	// Signal handling
@@ -135,9 +244,19 @@ int main(int argc, char *argv[])
 	sigaction(SIGINT, &sa, NULL);
 
 	// Wait crew thread
-	wait_crew(&g_localCrew);
 	wait_crew(&g_globalCrew);
-	wait_crew(&g_migrationCrew);
+	destroy_executor(&g_executor);
+	destroy_control_plane(&g_controlPlane);
+	destroy_metrics(&g_metrics);
+
+	for ( unsigned int hostID = 1; hostID <= g_numHosts; hostID++ ) {
+		g_remote->stopMonitoring(hostID);
+	}
+
+	delete g_remote;
+	if ( driver.compare(0, 4, "mock") != 0 ) {
+		destroy_session_pool(&g_sessionPool);
+	}
 
 	cout << "Close... " << endl;
 	return 0;
@@ -151,901 +270,1236 @@ void signalHandler(int signo)
 
 		sleep(3);
 		
-		cout << "Request to cancnel migration threads" << endl;
+		// the migrations in flight finish when the executor is destroyed
+		cout << "Request to cancnel the global thread" << endl;
 		if ( pthread_cancel(g_globalCrew.worker[0].thread) != 0 ) {
 			cout << "Cannot kill the global thread" << endl;
 		}
 
-		if ( pthread_cancel(g_migrationCrew.worker[0].thread) != 0 ) {
-		
-			cout << "Cannot kill the migrationHelper thread" << endl;
-		}
-		
-		for ( int i = 0; i < g_localCrew.worker_size; i++ ) {
-			
-			cout << "Request to cancel thread[" << i << "]" << endl;
-
-			if ( pthread_cancel(g_localCrew.worker[i].thread) != 0 ) {
-				cerr << "Cannot kill the local thread[ " << i << "]" << endl;
-			}
-		}
-
 	}
 }
 
 int initialize(unsigned int nHosts)
 {
-	ostringstream os;
-	string remoteCmd;
-	string ret;
-	unsigned int numOfVMs;
-	unsigned int theKey = 0;
+	unsigned int nVMs = 0;
+	crew_t	discoveryCrew;
+	struct timespec begin, end;
 
 	cout << "Initalizing... " << endl;
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+
+	// 1. obtain the topology, and name, localID and cpu-affinity of each virtual machine on all hosts at once
+	g_inventory = new vector<vmInfo> [nHosts+1];
+	g_inventoryStatus = new int [nHosts+1];
+	g_topology.resize(nHosts+1);
+
+	if ( create_crew(&discoveryCrew, min(nHosts, (unsigned int)DISCOVERY_CREW_SIZE), discoveryThread) != 0 ) {
+		cerr << "Failed to create discovery crew " << endl;
+		return -1;
+	}
+	wait_crew(&discoveryCrew);
+
+	// 2. register them in host order
+	for (unsigned int hostID = 1; hostID <= nHosts; hostID++) {
+		nVMs += g_inventory[hostID].size();
+	}
+	g_vms.reserve(nVMs);
+	g_ledger.resize(nHosts, nVMs);
 
-	// check all hosts
 	for (unsigned int hostID = 1; hostID <= nHosts; hostID++) 
 	{
-		// 1. obtain number of virtual machines
-		remoteCmd = "";
-		remoteCmd = "xl list | wc -l";
-		numOfVMs = atoi(sshCommand(hostID, remoteCmd).c_str()) - 2;
-
-		for (unsigned int j = 0; j < numOfVMs; j++) {
-
-			// 2. obtain name for each virtual machine
-			remoteCmd = "";
-			remoteCmd = "xl list | awk 'NR==";
-			stringstream vmid;
-			vmid << (j+3) << " {print $1}'";
-			string vmName = sshCommand(hostID, remoteCmd + vmid.str());
-			vmName.erase(vmName.end()-1);
-
-			// 3. obtain cpu-affinity for each virtual machine
-			remoteCmd = "";
-			remoteCmd = "xl vcpu-list | grep -Rw " + vmName + " | awk '{print $7}'";
-			string cpu_affinity = sshCommand(hostID, remoteCmd);
-			cpu_affinity.erase(cpu_affinity.end()-1); 
-
-			// 4. obtaint locaiID for each virtual machine
-			remoteCmd = "";
-			remoteCmd = "xl list | grep -Rw " + vmName + " | awk '{print $2}'";
-			unsigned int	localID = atoi(sshCommand(hostID, remoteCmd).c_str());
-
-			// Create new VM
-			VirtualMachine* vm;
-			if ( cpu_affinity == "0-3") {
-				vm = new VirtualMachine(theKey, hostID, localID, 0);
-			} else {
-				vm = new VirtualMachine(theKey, hostID, localID, 1);
+		vector<vmInfo>& vms = g_inventory[hostID];
+
+		if ( g_inventoryStatus[hostID] != 0 ) {
+			cerr << "Host[" << hostID << "] cannot list virtual machines or its topology" << endl;
+			return -1;
+		}
+		g_ledger.setHost(hostID, g_topology[hostID]);
+
+		for (unsigned int j = 0; j < vms.size(); j++) {
+			int socket = find_socket(g_topology[hostID], vms[j].cpuAffinity);
+
+			if ( socket < 0 ) {
+				cout << "Host[" << hostID << "] " << vms[j].name << " is not pinned to a socket: " << vms[j].cpuAffinity << endl;
+				socket = 0;
 			}
 
 			// Register VM 
-			g_vmMap.insert(pair<int, VirtualMachine*>(theKey, vm));
-			g_vmNameMap.insert(pair<int, string>(theKey, vmName));
-			g_hostToVM_map.insert(pair<int, VirtualMachine*>(hostID, vm));
-
-			// 
-			theKey ++ ;
+			unsigned int vm = g_vms.add(vms[j].name, hostID, vms[j].localID, socket);
+			g_vms.setMemory(vm, vms[j].memory);
+			g_vms.setNumOfVCPUs(vm, max(vms[j].numOfVCPUs, 1u));
+			g_vmIndex.insert(vm);
+			g_ledger.place(vm, hostID, socket, g_vms.memory(vm), g_vms.numOfVCPUs(vm));
 		}
 
+		hostTopology& topology = g_topology[hostID];
+		cout << "Host[" << hostID << "] " << topology.socketCPUs.size() << " sockets:";
+		for ( unsigned int s = 0; s < topology.socketCPUs.size(); s++ ) {
+			cout << " [" << topology.socketCPUs[s] << "] " << topology.numOfCores[s] << " cores, node " << topology.socketNode[s] << ";";
+		}
+		cout << " " << topology.llcCPUs.size() << " LLC domains, " << topology.nodeMemory.size() << " nodes" << endl;
 		cout << "Host[" << hostID << "] initialize completed.. " << endl;
 	}
 
-	// Verify
-	cout << "Verify VMs" << endl;
-	map<unsigned int, VirtualMachine*>::iterator it;
-	VirtualMachine *vm;
-	for ( it = g_vmMap.begin(); it!= g_vmMap.end(); it++ ) {
-
-		vm = static_cast<VirtualMachine*>(it->second);
-		cout << "[" << it->first << "] " << vm->getLocalID() << endl;
+	// 3. number every socket of the cluster
+	g_socketBase.assign(1, 0);
+	g_socketKeys.clear();
+	for (unsigned int hostID = 0; hostID <= nHosts; hostID++) {
+		for ( unsigned int s = 0; s < g_topology[hostID].socketCPUs.size(); s++ ) {
+			g_socketKeys.push_back(socketKey(hostID, s));
+		}
+		g_socketBase.push_back(g_socketKeys.size());
 	}
 
-	//
-	pthread_mutex_init(&g_hostToVM_map_mutex, NULL);	
+	delete [] g_inventory;
+	delete [] g_inventoryStatus;
 
-	g_highLLC_VM = new unsigned int* [g_numHosts+1];
-	g_lowLLC_VM = new unsigned int* [g_numHosts+1];
-	g_llc_mutex = new pthread_mutex_t* [g_numHosts+1];
+	g_history.resize(g_vms.size());
+	g_cooldown.resize(g_vms.size());
 
-	for ( unsigned int i = 0; i < g_numHosts+1; i++ ) {
-		g_highLLC_VM[i] = new unsigned int [NUM_OF_NUMA_NODES];
-		g_lowLLC_VM[i] = new unsigned int [NUM_OF_NUMA_NODES];
-		g_llc_mutex[i] = new pthread_mutex_t [NUM_OF_NUMA_NODES];
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	cout << "Discovered " << g_vms.size() << " VMs on " << nHosts << " hosts in "
+		 << (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9 << " sec, "
+		 << g_vms.footprint() << " bytes" << endl;
+
+	// Verify
+	cout << "Verify VMs" << endl;
+	for ( unsigned int vm = 0; vm < g_vms.size(); vm++ ) {
+		cout << "[" << vm << "] " << g_vms.localID(vm) << endl;
 	}
 
-	for ( unsigned int i = 0; i < g_numHosts+1; i++ ) {
+	g_snapshot = new hostSnapshot [g_numHosts+1][2];
 
-		for ( unsigned int j = 0; j < NUM_OF_NUMA_NODES; j++) {
-			pthread_mutex_init(&g_llc_mutex[i][j], NULL);
+	for ( unsigned int h = 0; h <= g_numHosts; h++ ) {
+		unsigned int nSockets = g_topology[h].socketCPUs.size();
+
+		for ( int slot = 0; slot < 2; slot++ ) {
+			g_snapshot[h][slot].round = 0;
+			g_snapshot[h][slot].missRate.assign(nSockets, 0.0);
+			g_snapshot[h][slot].highLLC_VM.assign(nSockets, VM_NONE);
+			g_snapshot[h][slot].lowLLC_VM.assign(nSockets, VM_NONE);
+			g_snapshot[h][slot].highLLC_rate.assign(nSockets, 0.0);
+			g_snapshot[h][slot].lowLLC_rate.assign(nSockets, 0.0);
 		}
 	}
 
-	g_hostMigrating = new bool [g_numHosts+1];
-	g_hostMigrating_mutex = new pthread_mutex_t [g_numHosts+1];
-	g_hostMigrating_go = new pthread_cond_t [g_numHosts+1];
+	g_localState = new localState [g_numHosts+1];
 
 	for ( unsigned int i = 0; i <= g_numHosts; i ++) {
-		pthread_mutex_init(&g_hostMigrating_mutex[i], NULL);
-		pthread_cond_init(&g_hostMigrating_go[i], NULL);
-
-		g_hostMigrating[i] = false;
+		g_localState[i].pageTokens = 0.0;
+		g_localState[i].pageStamp = 0.0;
+		g_localState[i].resetCounter = 1;
 	}
 
 	pthread_mutex_init(&g_migration_mutex, NULL);
-	pthread_cond_init(&g_migration_done, NULL);
 
 	return 0;
 }
 
-string sshCommand(unsigned int hostID, string command)
+/*
+ *	Each discovery worker fetches the inventory of every crew-size'th host
+ */
+void* discoveryThread(void* arg)
 {
-	ostringstream oss;
-	string cmd;
-
-	oss << "ssh " << g_hostPrefix << setw(2) << setfill('0') << hostID << " " << command;
-	cmd = oss.str();
+	worker_p mine = (worker_t*)arg;
+	crew_p crew = mine->crew;
 
-	//cout << cmd << endl;
-		
-	FILE* pipe = popen(cmd.c_str(), "r");
+	for ( unsigned int hostID = mine->index+1; hostID <= g_numHosts; hostID += crew->worker_size ) {
+		g_inventoryStatus[hostID] = g_remote->listVMs(hostID, g_inventory[hostID]);
+		if ( g_inventoryStatus[hostID] == 0 ) {
+			g_inventoryStatus[hostID] = g_remote->getTopology(hostID, g_topology[hostID]);
+		}
+		if ( g_inventoryStatus[hostID] == 0 ) {
+			pinInventory(hostID);
+		}
+		g_remote->startMonitoring(hostID);
+	}
 
-	if (!pipe) 
-		return string("ERROR");
+	return NULL;
+}
 
-	char buffer[128];
-	std::string result = "";
+/*
+ *	The other vCPUs of a VM stay wherever Xen left them; pin them all
+ *	around the socket of vCPU 0, so the VM is where the scheduler thinks
+ */
+void pinInventory(unsigned int hostID)
+{
+	const hostTopology& topology = g_topology[hostID];
+	vector<vmInfo>& vms = g_inventory[hostID];
+	vector<unsigned int> sockets;
+	vector<string> cpus;
+
+	for ( unsigned int j = 0; j < vms.size(); j++ ) {
+		int home = find_socket(topology, vms[j].cpuAffinity);
+
+		vcpu_sockets(topology, home < 0 ? 0 : home, max(vms[j].numOfVCPUs, 1u), sockets);
+		cpus.clear();
+		for ( unsigned int v = 0; v < sockets.size(); v++ ) {
+			cpus.push_back(topology.socketCPUs[sockets[v]]);
+		}
 
-	while(!feof(pipe)) 
-	{
-		if(fgets(buffer, 128, pipe) != NULL) {
-			// *(buffer+(strlen(buffer)-1))=0;
-			result += buffer;
+		if ( g_remote->pinVCPUs(hostID, vms[j].name, cpus) != 0 ) {
+			cerr << "[" << hostID << "] Cannot pin the vCPUs of " << vms[j].name << endl;
 		}
 	}
-
-	pclose(pipe);
-	return result;
 }
 
-void* migrationHelperThread(void* arg)
+/*
+ *	A migration of the executor, on one of its workers. The VM takes the
+ *	socket of the VM it swaps with.
+ */
+int runMigration(const migration_job_t* job)
 {
-	int status;
-	worker_p mine = (worker_t*)arg;
-	crew_p crew = mine->crew;
-	work_p	work;
-	req_t	item;
-	string	remoteCmd;
-	stringstream hostID;
+	unsigned int vm = job->vm;
+	int status = 0, pinStatus = 0;
+	unsigned int socket;
+	bool pinned;
+	double mark = monotonic();
 
-	pthread_mutex_lock(&crew->mutex);
+	record_phase(&g_metrics, METRICS_LANE_WORKER + job->worker, job->srcHostID, PHASE_QUEUE, job->started - job->queued);
 
-	/*
-	 *	when crews are created, work queue is empty.
-	 *	so, crew wait until anyone put job into queue
-	 */
-	while (crew->work_count == 0) {
-		pthread_cond_wait(&crew->go, &crew->mutex);
+	// pinned before it leaves, the memory is allocated on the right node; unless the socket has other cpus here
+	pinned = same_socket(g_topology[job->srcHostID], g_topology[job->destHostID], job->socket);
+
+	if ( pinned && g_vms.cpuAffinity(vm) != (unsigned int)job->socket )	{
+
+		cout << "[" << job->srcHostID << "] MigrationHelper: " << setCPUAffinity(job->socket, vm, &pinStatus) << endl;
 	}
-	pthread_mutex_unlock(&crew->mutex);
 
-	while (! g_exitCond) {
-		
-		VirtualMachine* vm;
-		status = pthread_mutex_lock(&crew->mutex);
-		if ( status != 0 ) {
-			cerr << "Lock migrationHelperThread mutex lock" << endl;
-		}
-		
-		if (crew->first == NULL) {
-			status = pthread_cond_wait(&crew->go, &crew->mutex);
-			if ( status != 0 ) {
-				cerr << "Wait for work in migrationHelperThread " << endl;
-			}
+	if ( job->srcHostID == job->destHostID ) {
+		if ( pinStatus != 0 ) {
+			// the pin was the whole move; its vCPUs, memory and room stay where they were
+			status = -1;
+		} else {
+			// the vCPUs moved; the memory follows a batch at a time rather than the whole VM being copied
+			pthread_mutex_lock(&g_migration_mutex);
+			g_localState[job->srcHostID].rehome.push_back(vm);
+			pthread_mutex_unlock(&g_migration_mutex);
 		}
-	
-		work = crew->first;
-		crew->first = work->next;
+	} else {
+		cout << "MigrationHelper: " << migrate(job->srcHostID, job->destHostID, vm, 0, &status) << endl;
 
-		if (crew->first == NULL)
-			crew->last = NULL;
+		// still on the source if it failed, where the socket may not exist; pinned again if the pin before it failed
+		if ( ( !pinned || pinStatus != 0 ) && status == 0 ) {
+			cout << "[" << job->destHostID << "] MigrationHelper: " << setCPUAffinity(job->socket, vm, &pinStatus) << endl;
 
-		memcpy(&item, &work->data, sizeof(work->data));
-			
-		status = pthread_mutex_unlock(&crew->mutex);
-		if ( status != 0 ) {
-			cerr << "Lock migrationHelperThread mutex unlock" << endl;
+			// it moved all the same; wherever its vCPUs run now is where the ledger has it once done
+			if ( pinStatus != 0 && (socket = getCPUAffinity(vm)) < g_topology[job->destHostID].socketCPUs.size() ) {
+				g_vms.setCPUAffinity(vm, socket);
+			}
 		}
+	}
+	phase_lap(&g_metrics, METRICS_LANE_WORKER + job->worker, job->srcHostID, PHASE_MIGRATE, &mark);
 
-		vm = getVM(item.vmKey);
-		
-		if ( vm->getCPUAffinity() != item.adversaryVmAffinity )	{
-	
-			cout << "[" << item.srcHostID << "] MigrationHelper: " << setCPUAffinity(item.adversaryVmAffinity, vm) << endl;
-		}
+	return status;
+}
 
-		cout << "MigrationHelper: " << migrate( item.srcHostID, item.destHostID, vm ) << endl;
+// The VM may be planned again once this returns
+void migrationDone(const migration_job_t* job, int status)
+{
+	double now = monotonic();
 
-		pthread_mutex_lock(&g_migration_mutex);
-		g_migrationCompleteCnt ++;
-		if ( g_migrationCompleteCnt == (g_migrationReqCnt * 2) ) {
-			pthread_cond_signal(&g_migration_done);
-		}
-		pthread_mutex_unlock(&g_migration_mutex);
+	// the room it reserved is its own now, or free again; on another socket if the pin after it failed
+	if ( status == 0 ) {
+		g_ledger.commit(job->vm);
+		if ( g_vms.cpuAffinity(job->vm) != (unsigned int)job->socket )
+			g_ledger.repin(job->vm, g_vms.cpuAffinity(job->vm));
+	} else {
+		g_ledger.release(job->vm, g_vms.cpuAffinity(job->vm));
+	}
+	g_vms.setState(job->vm, VM_RUNNING);
 
-		delete work;
-		
-		status = pthread_mutex_lock(&crew->mutex);
-		crew->work_count--;
-		status = pthread_mutex_unlock(&crew->mutex);
+	cout << "Migration of " << g_vms.name(job->vm) << " " << job->srcHostID << " -> " << job->destHostID
+		 << ( status == 0 ? " done" : " failed" ) << " in " << now - job->started << " s, planned in epoch " << job->epoch
+		 << ", queued " << job->started - job->queued << " s" << endl;
+}
 
+/*
+ *	Hands a migration to the executor; the VM is left out of the plans
+ *	until it is done. after: the VM whose migration it waits for, or -1
+ */
+int enqueueMigration(int srcHostID, int destHostID, unsigned int vm, unsigned int socket, unsigned long round, int after)
+{
+	migration_job_t	job;
+
+	job.vm = vm;
+	job.srcHostID = srcHostID;
+	job.destHostID = destHostID;
+	job.socket = socket;
+	job.after = after;
+	job.epoch = round;
+
+	// before it is queued, it may be done before submit returns
+	g_vms.setState(vm, VM_MIGRATING);
+	if ( submit_migration(&g_executor, &job) != 0 ) {
+		g_ledger.release(vm, g_vms.cpuAffinity(vm));
+		g_vms.setState(vm, VM_RUNNING);
+		return -1;
 	}
-	return NULL;
+
+	return 0;
 }
 
 void* globalWorkerThread(void* arg)
 {
 	worker_p mine = (worker_t*)arg;
-	crew_p crew = mine->crew;
 	unsigned int id = mine->index;
-	map<socketKey, double>		p_missRatePerSocket;	// private
+	vector<unsigned int>		numOfSockets = socketsPerHost();	// [hostID]
+	SocketHeap					p_sockets(numOfSockets);	// private
+	vector<hostSnapshot>		p_snapshot(g_numHosts+1);
+	unsigned long	round;
+	control_stats_t	epoch;
 	socketKey highLLCSocketID[g_degreeOfMigration], lowLLCSocketID[g_degreeOfMigration];
+	vector<socketKey>	highSockets, lowSockets;
+	vector<swap_candidate_t>	highCandidates, lowCandidates;
+	vector<int>			partner;
+	vector< vector<char> >	fits;		// [high][low] both hosts have room for the swap
+	double	highMissRate, lowMissRate, peak;
 	string	remoteCmd;
 	stringstream hostID;
-	req_t	work_item;
-	work_p	request;
-	int		status;
-	unsigned int	prevMigratedHighLLC_VM[g_degreeOfMigration];
-	unsigned int	prevMigratedLowLLC_VM[g_degreeOfMigration];
-	int				migrationThreshold[g_degreeOfMigration];
-	int		cnt = 0;
-	bool	migrationReq[g_degreeOfMigration];
+	unsigned int	queued, running;
+	bool	migrationReq[g_degreeOfMigration], oneWay[g_degreeOfMigration], swappable;
+	double	now, oneWayNet, swapNet, mark;
 
 	for ( int i = 0; i < g_degreeOfMigration; i ++ ) {
-		prevMigratedLowLLC_VM[i] = -1;
-		prevMigratedHighLLC_VM[i] = -1;
-		migrationThreshold[i] = 0;
+		migrationReq[i] = true;
 	}
 
 	while (! g_exitCond) {
 		
 	
-		VirtualMachine* highLLC_VM[g_degreeOfMigration];
-		VirtualMachine* lowLLC_VM[g_degreeOfMigration];
+		unsigned int	highLLC_VM[g_degreeOfMigration];
+		unsigned int	lowLLC_VM[g_degreeOfMigration];
 		unsigned int	lowLLC_VM_affinity[g_degreeOfMigration];
 		unsigned int 	highLLC_VM_affinity[g_degreeOfMigration];
 		
-		pthread_mutex_lock(&crew->mutex);
-		
-		if ( g_missRatePerSocket.size() != (g_numHosts * NUM_OF_NUMA_NODES) ) {
-			pthread_cond_wait(&crew->go, &crew->mutex);
+		// 0. Run the local round of every host, until the epoch deadline
+		mark = monotonic();
+		if ( control_round(&g_controlPlane, EPOCH_DEADLINE, &epoch) != 0 ) {
+			break;
 		}
+		phase_lap(&g_metrics, METRICS_LANE_ROUNDS, 0, PHASE_BARRIER, &mark);
+
+		round = epoch.round;
+		now = monotonic();
+		cout << "Epoch " << round << ": " << epoch.on_time << "/" << g_numHosts << " hosts on time, "
+			 << epoch.late << " late, " << epoch.busy << " busy, "
+			 << epoch.late_arrivals << " late arrivals (max " << epoch.max_lateness << " ms), "
+			 << epoch.elapsed << " ms" << endl;
 		cout << "[" << id << "] Global thread wake up ! " << endl;
+		cout << "[" << id << "] Phases (p50/p99/max ms): " << metrics_summary(&g_metrics) << endl;
 
-		p_missRatePerSocket.clear();
-		p_missRatePerSocket.insert(g_missRatePerSocket.begin(), g_missRatePerSocket.end());
-		g_missRatePerSocket.clear();
-
-		pthread_mutex_unlock(&crew->mutex);
+		executor_load(&g_executor, &queued, &running);
+		cout << "[" << id << "] Migrations: " << queued << " queued, " << running << " running, " << g_executor.completed << " done, "
+			 << g_executor.failed << " failed, longest wait " << g_executor.max_wait << " s" << endl;
 
-		// 1. Lookup the VMs
-		vector< pair<double, socketKey > >  vt;
-		vector< pair<double, socketKey > >::iterator it_vt;
-		vector< pair<double, socketKey > >::reverse_iterator rit_vt;
-		map<socketKey, double>::iterator it_map;
+		// 0.1 Take the snapshots the hosts published in this round; late hosts are stale and left out
+		for ( unsigned int h = 1; h <= g_numHosts; h++ ) {
 
-		/*
-		for (it_map = p_missRatePerSocket.begin(); it_map != p_missRatePerSocket.end(); it_map++)
-		{
-			vt.push_back(make_pair(it_map->second, it_map->first));
-		}
+			// a late host may still be writing its slot
+			if ( ! g_controlPlane.on_time[h] ) {
+				p_sockets.removeHost(h);
+				continue;
+			}
 
-		sort(vt.rbegin(), vt.rend());
+			p_snapshot[h] = g_snapshot[h][round & 1];
+			if ( p_snapshot[h].round != round ) {
+				p_sockets.removeHost(h);
+				continue;
+			}
 
-		cout << "[" << id << "] Global LLC sorting. " << vt.size() << endl;
-		for (it_vt = vt.begin(); it_vt != vt.end(); it_vt++ ) {
-			socketKey key = static_cast<socketKey>(it_vt->second);
-			cout << "Socket [" << key.first << "][" << key.second << "]: " << it_vt->first << endl;
+			// a socket without VMs has none to trade
+			for ( unsigned int j = 0; j < numOfSockets[h]; j++ ) {
+				if ( p_snapshot[h].highLLC_VM[j] == VM_NONE )
+					p_sockets.remove(h, j);
+				else
+					p_sockets.update(h, j, p_snapshot[h].missRate[j]);
+			}
 		}
-		*/
 
-		/*
-		it_vt = vt.begin();
-		rit_vt = vt.rbegin();
-		highLLCSocketID[0] = it_vt->second;
-		lowLLCSocketID[0] = rit_vt->second;
-
-		// FIX: must avoid the hard coded parts
-		cnt = 0;
-		do { 
-			if ( cnt > g_numHosts || cnt >= vt.size() ) {
-				cout << "high- migrationReq[1] false: " << cnt << endl;
-				migrationReq[1] = false;
-				break;
+		if ( g_placementSearch ) {
+			// 1. Search the placement of every VM reported in this epoch; it queues the moves it admits
+			planPlacement(p_snapshot, round);
+
+			for ( int i = 0; i < g_degreeOfMigration; i++ ) {
+				migrationReq[i] = false;
 			}
-			highLLCSocketID[1] = (++it_vt)->second;
-			cnt ++; 
-		} while ( highLLCSocketID[1].first == highLLCSocketID[0].first || highLLCSocketID[1].first == lowLLCSocketID[0].first ); 
-		
-		cnt = 0;
-		do { 
-			if ( cnt > g_numHosts || cnt >= vt.size()  ) {
-				cout << "low- migrationReq[1] false: " <<  cnt <<  endl;
-				migrationReq[1] = false;
-				break;
+		} else {
+			// 1. The most and the least loaded sockets, each pair on hosts of its own
+			cout << "[" << id << "] Global LLC selection. " << p_sockets.size() << " sockets" << endl;
+			p_sockets.select(g_degreeOfMigration, highSockets, lowSockets);
+
+			// 1.1 Pair them up so the swaps leave the lowest peak behind
+			highCandidates.resize(highSockets.size());
+			lowCandidates.resize(lowSockets.size());
+
+			for ( unsigned int i = 0; i < highSockets.size(); i++ ) {
+				socketKey key = highSockets[i];
+				highCandidates[i].socket = key;
+				highCandidates[i].missRate = p_sockets.score(key.first, key.second);
+				highCandidates[i].vm = p_snapshot[key.first].highLLC_VM[key.second];
+				highCandidates[i].vmMissRate = p_snapshot[key.first].highLLC_rate[key.second];
+
+				key = lowSockets[i];
+				lowCandidates[i].socket = key;
+				lowCandidates[i].missRate = p_sockets.score(key.first, key.second);
+				lowCandidates[i].vm = p_snapshot[key.first].lowLLC_VM[key.second];
+				lowCandidates[i].vmMissRate = p_snapshot[key.first].lowLLC_rate[key.second];
 			}
-			lowLLCSocketID[1] = (++rit_vt)->second;
-			cnt ++;
-		} while ( lowLLCSocketID[1].first == lowLLCSocketID[0].first || lowLLCSocketID[1].first == highLLCSocketID[0].first ); 
-		*/
-
-		//
-		for ( int i = 0; i < g_degreeOfMigration; i ++ ) {
 
-			highLLCSocketID[i].first = -1;
-			highLLCSocketID[i].second = -1;
-			lowLLCSocketID[i].first = -1;
-			lowLLCSocketID[i].second = -1;
+			// 1.2 only pairs whose hosts have room for the hot VM alone, or for both VMs at once
+			fits.assign(highCandidates.size(), vector<char>(lowCandidates.size(), 0));
+			for ( unsigned int i = 0; i < highCandidates.size(); i++ ) {
+				const swap_candidate_t& high = highCandidates[i];
 
-			vt.clear();
-			for (it_map = p_missRatePerSocket.begin(); it_map != p_missRatePerSocket.end(); it_map++)
-			{
+				for ( unsigned int j = 0; j < lowCandidates.size(); j++ ) {
+					const swap_candidate_t& low = lowCandidates[j];
 
-				socketKey key = it_map->first;
-				bool	insert = true;
-
-				for (int j = 0; j < i+1; j ++ ) {
-					if ( key.first == highLLCSocketID[j].first  || key.first == lowLLCSocketID[j].first ) {
-						insert = false;
-					}
-				}
-						
-				if ( insert ) {
-					vt.push_back(make_pair(it_map->second, it_map->first));
+					fits[i][j] = g_vms.contains(high.vm) && g_vms.contains(low.vm)
+						&& ( g_ledger.moveFits(high.vm, low.socket.first, g_vms.cpuAffinity(low.vm))
+							 || g_ledger.swapFits(high.vm, low.socket.first, g_vms.cpuAffinity(low.vm), low.vm, high.socket.first, g_vms.cpuAffinity(high.vm)) );
 				}
-
 			}
 
-			sort(vt.rbegin(), vt.rend());
-			
-			cout << "[" << i << "] Global LLC sorting. " << vt.size() << endl;
-			for (it_vt = vt.begin(); it_vt != vt.end(); it_vt++ ) {
-				socketKey key = static_cast<socketKey>(it_vt->second);
-				cout << "Socket [" << key.first << "][" << key.second << "]: " << it_vt->first << endl;
+			peak = plan_swaps(highCandidates, lowCandidates, partner, &fits);
+			if ( ! highCandidates.empty() ) {
+				cout << "[" << id << "] Swap plan: peak " << highCandidates[0].missRate << " -> " << peak << endl;
 			}
 
+			for ( int i = 0 ; i < g_degreeOfMigration; i++) {
 
-			it_vt = vt.begin();
-			rit_vt = vt.rbegin();
-			highLLCSocketID[i] = it_vt->second;
-			lowLLCSocketID[i] = rit_vt->second;
-		}
-
-	
-		//
-
-		/*
-		cnt = 0;
-		for (it_vt = vt.begin(); it_vt != vt.end(); it_vt++ ) {
-
-			if ( cnt >= g_degreeOfMigration ) break;
-
-			highLLCSocketID[cnt++] = it_vt->second;
-		}
-
-		cnt = 0;
-		for (rit_vt = vt.rbegin(); rit_vt != vt.rend(); rit_vt++ ) {
-
-			if ( cnt >= g_degreeOfMigration ) break;
+				// fewer hosts reported in this epoch than needed, or better left alone
+				if ( i >= (int)highSockets.size() || partner[i] < 0 ) {
+					highLLCSocketID[i] = lowLLCSocketID[i] = socketKey(-1, -1);
+					migrationReq[i] = false;
+					continue;
+				}
 
-			lowLLCSocketID[cnt++] = rit_vt->second;
-		}
-		*/
+				highLLCSocketID[i] = highSockets[i];
+				lowLLCSocketID[i] = lowSockets[partner[i]];
 
-		for ( int i = 0 ; i < g_degreeOfMigration; i++) {
-			cout << i << ". High LLC SocketID [" << highLLCSocketID[i].first  << "][" << highLLCSocketID[i].second << "]: " << p_missRatePerSocket[highLLCSocketID[i]] << endl;
-			cout << i << ". Low LLC SocketID [" << lowLLCSocketID[i].first  << "][" << lowLLCSocketID[i].second << "]: " << p_missRatePerSocket[lowLLCSocketID[i]] << endl;
-		}
+				cout << i << ". High LLC SocketID [" << highLLCSocketID[i].first  << "][" << highLLCSocketID[i].second << "]: " << p_sockets.score(highLLCSocketID[i].first, highLLCSocketID[i].second) << endl;
+				cout << i << ". Low LLC SocketID [" << lowLLCSocketID[i].first  << "][" << lowLLCSocketID[i].second << "]: " << p_sockets.score(lowLLCSocketID[i].first, lowLLCSocketID[i].second) << endl;
+			}
 
-		/////
+			/////
 		
-		for ( int i = 0 ; i < g_degreeOfMigration; i++) {
+			for ( int i = 0 ; i < g_degreeOfMigration; i++) {
 
-			if ( highLLCSocketID[i].first == lowLLCSocketID[i].first) {
+				if ( migrationReq[i] != true ) continue;
 
-				if ( highLLCSocketID[i].second == lowLLCSocketID[i].second ) {
-					//goto exit;
-					cerr << "SocketID same !! " << endl;
-					migrationReq[i] = false;
+				if ( highLLCSocketID[i].first == lowLLCSocketID[i].first) {
+
+					if ( highLLCSocketID[i].second == lowLLCSocketID[i].second ) {
+						//goto exit;
+						cerr << "SocketID same !! " << endl;
+						migrationReq[i] = false;
+					}
 				}
-			}
 
-			if ( (p_missRatePerSocket[highLLCSocketID[i]] - p_missRatePerSocket[lowLLCSocketID[i]]) < GLOBAL_LLC_THRESHOLD ) {
-				cout << "Does not meet the swap requirements" << endl;
-				migrationReq[i] = false;
-				//goto exit;
 			}
-		}
 		
-		// 2. Get two candidate VMs
-		for ( int i = 0; i < g_degreeOfMigration; i++ ) {
+			// 2. Get two candidate VMs
+			for ( int i = 0; i < g_degreeOfMigration; i++ ) {
 
-			if ( migrationReq[i] == true  ) {
-				pthread_mutex_lock(&g_llc_mutex[highLLCSocketID[i].first][highLLCSocketID[i].second]);
-				highLLC_VM[i] = getVM(g_highLLC_VM[highLLCSocketID[i].first][highLLCSocketID[i].second]);
-				pthread_mutex_unlock(&g_llc_mutex[highLLCSocketID[i].first][highLLCSocketID[i].second]);
+				if ( migrationReq[i] == true  ) {
+					highLLC_VM[i] = p_snapshot[highLLCSocketID[i].first].highLLC_VM[highLLCSocketID[i].second];
+					lowLLC_VM[i] = p_snapshot[lowLLCSocketID[i].first].lowLLC_VM[lowLLCSocketID[i].second];
+				}
 
-				pthread_mutex_lock(&g_llc_mutex[lowLLCSocketID[i].first][lowLLCSocketID[i].second]);
-				lowLLC_VM[i] = getVM(g_lowLLC_VM[lowLLCSocketID[i].first][lowLLCSocketID[i].second]);
-				pthread_mutex_unlock(&g_llc_mutex[lowLLCSocketID[i].first][lowLLCSocketID[i].second]);
 			}
-
+			phase_lap(&g_metrics, METRICS_LANE_ROUNDS, 0, PHASE_SELECT, &mark);
 		}
 
 		for ( int i = 0 ; i < g_degreeOfMigration; i++) {
 
-			if ( highLLC_VM[i] == NULL || lowLLC_VM[i] == NULL ) {
-				cout << i << " " << g_highLLC_VM[highLLCSocketID[i].first][highLLCSocketID[i].second] << " : " << g_lowLLC_VM[lowLLCSocketID[i].first][lowLLCSocketID[i].second] << endl;
+			if ( migrationReq[i] == true && ( !g_vms.contains(highLLC_VM[i]) || !g_vms.contains(lowLLC_VM[i]) ) ) {
+				cout << i << " " << p_snapshot[highLLCSocketID[i].first].highLLC_VM[highLLCSocketID[i].second] << " : " << p_snapshot[lowLLCSocketID[i].first].lowLLC_VM[lowLLCSocketID[i].second] << endl;
 				migrationReq[i] = false;
 				//goto exit;
 			}
-			
-			if ( migrationReq[i] == true ) {			
-				if ( ( prevMigratedHighLLC_VM[i] == highLLC_VM[i]->getKey() ) && ( prevMigratedLowLLC_VM[i] == lowLLC_VM[i]->getKey() ) && ( migrationThreshold[i] < 5 ) ) {
-					migrationThreshold[i] ++ ;
-					cout << "VM[" << prevMigratedHighLLC_VM[i] << "] and VM[" << prevMigratedLowLLC_VM[i] << "] were already migrated in the last time." << endl;
+
+			// still on its way from an earlier epoch
+			if ( migrationReq[i] == true && ( g_vms.state(highLLC_VM[i]) != VM_RUNNING || g_vms.state(lowLLC_VM[i]) != VM_RUNNING ) ) {
+				cout << "VM[" << highLLC_VM[i] << "] or VM[" << lowLLC_VM[i] << "] is migrating" << endl;
+				migrationReq[i] = false;
+			}
+
+			// the hot VM may not be cooling down from its last move, or about to go straight back; nor the cold one to swap
+			if ( migrationReq[i] == true ) {
+				if ( !g_cooldown.admit(highLLC_VM[i], location(lowLLCSocketID[i]), now) ) {
+					cout << "VM[" << highLLC_VM[i] << "] migrated too recently" << endl;
 					migrationReq[i] = false;
-					//goto exit;
 				}
 			}
-			
 
+			// the hot VM alone when the low socket has room for it, one migration instead of two;
+			// to swap, each socket has to hold the other VM while its own is still there
 			if ( migrationReq[i] == true ) {
-				prevMigratedHighLLC_VM[i] = highLLC_VM[i]->getKey();
-				prevMigratedLowLLC_VM[i] = lowLLC_VM[i]->getKey();
-				migrationThreshold[i] = 0;
+				highLLC_VM_affinity[i] = g_vms.cpuAffinity(highLLC_VM[i]);
+				lowLLC_VM_affinity[i] = g_vms.cpuAffinity(lowLLC_VM[i]);
+				highMissRate = p_sockets.score(highLLCSocketID[i].first, highLLCSocketID[i].second);
+				lowMissRate = p_sockets.score(lowLLCSocketID[i].first, lowLLCSocketID[i].second);
+				oneWayNet = swapNet = 0.0;
+
+				if ( g_ledger.moveFits(highLLC_VM[i], lowLLCSocketID[i].first, lowLLC_VM_affinity[i]) ) {
+					oneWayNet = oneWayBenefit(highLLC_VM[i], lowLLCSocketID[i].first, highMissRate, lowMissRate);
+				}
+				swappable = g_cooldown.allows(lowLLC_VM[i], location(highLLCSocketID[i]), now);
+				if ( swappable && g_ledger.swapFits(highLLC_VM[i], lowLLCSocketID[i].first, lowLLC_VM_affinity[i], lowLLC_VM[i], highLLCSocketID[i].first, highLLC_VM_affinity[i]) ) {
+					swapNet = swapBenefit(highLLC_VM[i], highMissRate, lowLLC_VM[i], lowMissRate);
+				}
+
+				// the relief has to pay for the migrations
+				if ( oneWayNet <= 0.0 && swapNet <= 0.0 ) {
+					cout << "Does not meet the swap requirements" << endl;
+					// the cold VM's cooldown took the swap away; it counts only now the pair is dropped
+					if ( !swappable )
+						g_cooldown.suppress(lowLLC_VM[i], location(highLLCSocketID[i]), now);
+					migrationReq[i] = false;
+				}
+				oneWay[i] = ( oneWayNet >= swapNet );
+			}
+
+			// hold the room before anything is queued; an earlier pair may have taken it
+			if ( migrationReq[i] == true ) {
+				if ( oneWay[i] ? !g_ledger.reserve(highLLC_VM[i], lowLLCSocketID[i].first, lowLLC_VM_affinity[i])
+							   : !g_ledger.reserveSwap(highLLC_VM[i], lowLLCSocketID[i].first, lowLLC_VM_affinity[i], lowLLC_VM[i], highLLCSocketID[i].first, highLLC_VM_affinity[i]) ) {
+					cout << "VM[" << highLLC_VM[i] << "] and VM[" << lowLLC_VM[i] << "] do not fit on each other's socket" << endl;
+					migrationReq[i] = false;
+				}
 			}
 
 			if ( migrationReq[i] == true ) {
-				highLLC_VM_affinity[i] = highLLC_VM[i]->getCPUAffinity();
-				lowLLC_VM_affinity[i] = lowLLC_VM[i]->getCPUAffinity();
+				g_cooldown.record(highLLC_VM[i], location(highLLCSocketID[i]), now);
+				if ( !oneWay[i] )
+					g_cooldown.record(lowLLC_VM[i], location(lowLLCSocketID[i]), now);
+
+				planned(oneWay[i] ? 1 : 2, peakRelief(highMissRate, lowMissRate, g_vms.missRate(highLLC_VM[i]) - ( oneWay[i] ? 0.0 : g_vms.missRate(lowLLC_VM[i]) )));
 			}
 		}
 
-		// 3. Swap
+		// 3. Swap, or move; the executor runs them, and the next epoch does not wait for them
 		for ( int i = 0 ; i < g_degreeOfMigration; i++) {
-			if ( migrationReq[i] == true )  {
-				cout << "[" << id << "] Swap " << g_vmNameMap[highLLC_VM[i]->getKey()] << "(" << highLLC_VM[i]->getHostID() << ") and " << g_vmNameMap[lowLLC_VM[i]->getKey()] << "(" << lowLLC_VM[i]->getHostID() << ")" << endl;
-				pthread_mutex_lock(&g_migration_mutex);
-				g_migrationReqCnt++;
-				pthread_mutex_unlock(&g_migration_mutex);
+			if ( migrationReq[i] != true )
+				continue;
+
+			if ( oneWay[i] ) {
+				cout << "[" << id << "] Move " << g_vms.name(highLLC_VM[i]) << "(" << g_vms.hostID(highLLC_VM[i]) << ") to [" << lowLLCSocketID[i].first << "][" << lowLLC_VM_affinity[i] << "]" << endl;
+			} else {
+				cout << "[" << id << "] Swap " << g_vms.name(highLLC_VM[i]) << "(" << g_vms.hostID(highLLC_VM[i]) << ") and " << g_vms.name(lowLLC_VM[i]) << "(" << g_vms.hostID(lowLLC_VM[i]) << ")" << endl;
+			}
+
+			if ( enqueueMigration(highLLCSocketID[i].first, lowLLCSocketID[i].first, highLLC_VM[i], lowLLC_VM_affinity[i], round) != 0 ) {
+				cerr << "[" << id << "] Cannot queue the migration of " << g_vms.name(highLLC_VM[i]) << endl;
+			}
+			if ( !oneWay[i] && enqueueMigration(lowLLCSocketID[i].first, highLLCSocketID[i].first, lowLLC_VM[i], highLLC_VM_affinity[i], round) != 0 ) {
+				cerr << "[" << id << "] Cannot queue the migration of " << g_vms.name(lowLLC_VM[i]) << endl;
 			}
 		}
+		// the search times its own
+		if ( ! g_placementSearch )
+			phase_lap(&g_metrics, METRICS_LANE_ROUNDS, 0, PHASE_ADMIT, &mark);
 
-		// 3.1 send and signal to the migration helper thread
-		{
-			for ( int i = 0 ; i < g_degreeOfMigration; i++) {
-				
-				if ( migrationReq[i] != true ) continue;
+		cout << "[" << id << "] Cooldown: " << g_cooldown.suppressed() << " migrations suppressed, "
+			 << g_cooldown.oscillations() << " of them cycles" << endl;
+		cout << "[" << id << "] Capacity: " << g_ledger.rejected() << " plans did not fit, " << g_ledger.inFlight() << " reservations held" << endl;
+		cout << "[" << id << "] Planned: " << g_plannedMigrations << " migrations for " << g_plannedRelief << " of peak removed, "
+			 << migrationsPerRelief() << " per 1000" << endl;
 
-				pthread_mutex_lock(&g_migrationCrew.mutex);
-
-				//work_item processed.
-				work_item.srcHostID = highLLCSocketID[i].first;
-				work_item.destHostID = lowLLCSocketID[i].first;
-				work_item.localID = highLLC_VM[i]->getLocalID();
-				work_item.vmKey = highLLC_VM[i]->getKey();
-				work_item.adversaryVmAffinity = lowLLC_VM_affinity[i];
-
-				request = new work_t;		
-				memcpy(&request->data, &work_item, sizeof(req_t));
-				request->next = NULL;
-
-				// Adjust queue pointer
-				if (g_migrationCrew.first == NULL) {
-					g_migrationCrew.first = request;
-					g_migrationCrew.last = request;
-				} else {
-					g_migrationCrew.last->next = request;
-					g_migrationCrew.last = request;
-				}
+exit:
+		sleep(GLOBAL_SCHD_TIME_INTERVAL);
 
-				g_migrationCrew.work_count++;
+		for ( int i = 0; i < g_degreeOfMigration; i ++ ) {
+			migrationReq[i] = true;
+		}
 
-				// Signal to migrationCrew
-				status = pthread_cond_signal (&g_migrationCrew.go);
+	}
 
-				if (status != 0) {
-					delete g_migrationCrew.first;
-					g_migrationCrew.first = NULL;
-					g_migrationCrew.work_count = 0;
-					pthread_mutex_unlock(&g_migrationCrew.mutex);
-					exit(1);
-				}
+	cout << "Global thread exit..." << endl;
+	return NULL;
+}
 
-				///////////////////////////////////////////////////
-				//work_item processed.
-				work_item.srcHostID = lowLLCSocketID[i].first;
-				work_item.destHostID = highLLCSocketID[i].first;
-				work_item.localID = lowLLC_VM[i]->getLocalID();
-				work_item.vmKey = lowLLC_VM[i]->getKey();
-				work_item.adversaryVmAffinity = highLLC_VM_affinity[i];
-
-				request = new work_t;		
-				memcpy(&request->data, &work_item, sizeof(req_t));
-				request->next = NULL;
-
-				// Adjust queue pointer
-				if (g_migrationCrew.first == NULL) {
-					g_migrationCrew.first = request;
-					g_migrationCrew.last = request;
-				} else {
-					g_migrationCrew.last->next = request;
-					g_migrationCrew.last = request;
-				}
+/*
+ *	Estimated cost of moving a VM to destHostID. To another host, a live
+ *	migration, from its memory and the dirty rate its host's rounds read
+ *	last (see refreshDirtyRates) or its last migration showed; to another
+ *	socket of its own, a repin, its pages following at NUMA_PAGE_RATE.
+ */
+void estimateMigration(unsigned int vm, unsigned int destHostID, migration_cost_t* cost)
+{
+	if ( destHostID == g_vms.hostID(vm) )
+		estimate_repin(g_vms.memory(vm), NUMA_PAGE_RATE, cost);
+	else
+		estimate_migration(g_vms.memory(vm), g_vms.dirtyRate(vm), cost);
+}
 
-				g_migrationCrew.work_count++;
+/*
+ *	Net benefit of a group of moves, vms[i] to destHostIDs[i]: what the
+ *	moves take off the peak over RELIEF_EPOCHS, less the cost of every one
+ *	of them. Move only when it is positive.
+ */
+double moveBenefit(const vector<unsigned int>& vms, const vector<unsigned int>& destHostIDs, double relief)
+{
+	migration_cost_t	cost;
+	ostringstream	names;
+	double	seconds = 0.0, penalty;
+	bool	repin;
+
+	for ( unsigned int i = 0; i < vms.size(); i++ ) {
+		repin = ( destHostIDs[i] == g_vms.hostID(vms[i]) );
+		estimateMigration(vms[i], destHostIDs[i], &cost);
+		seconds += ( repin ? REPIN_WEIGHT : 1.0 ) * cost.duration + DOWNTIME_WEIGHT * cost.downtime / 1000.0;
+		names << ( i ? ", " : "" ) << g_vms.name(vms[i]);
+
+		cout << ( repin ? "Repin cost " : "Migration cost " ) << g_vms.name(vms[i]) << ": " << g_vms.memory(vms[i]) << " MB, "
+			 << g_vms.dirtyRate(vms[i]) << " pages/s -> " << cost.duration << " s, "
+			 << cost.downtime << " ms down, " << cost.bytes / (1024 * 1024) << " MB in " << cost.rounds << " rounds" << endl;
+	}
 
-				// Signal to migrationCrew
-				status = pthread_cond_signal (&g_migrationCrew.go);
+	penalty = MIGRATION_COST_RATE * seconds;
 
-				if (status != 0) {
-					delete g_migrationCrew.first;
-					g_migrationCrew.first = NULL;
-					g_migrationCrew.work_count = 0;
-					pthread_mutex_unlock(&g_migrationCrew.mutex);
-					exit(1);
-				}
-				
-				pthread_mutex_unlock(&g_migrationCrew.mutex);
-			}
-		}
+	cout << "Move " << names.str() << ": relief " << relief << " x "
+		 << RELIEF_EPOCHS << " epochs, cost " << penalty << ", net " << relief * RELIEF_EPOCHS - penalty << endl;
 
-		// 3.3 Finalize
-		{
-			pthread_mutex_lock(&g_migration_mutex);
-			if ( g_migrationCompleteCnt != (g_migrationReqCnt * 2) ) {
-				pthread_cond_wait(&g_migration_done, &g_migration_mutex);
-			}
-			g_migrationCompleteCnt = 0;
-			g_migrationReqCnt = 0;
-			pthread_mutex_unlock(&g_migration_mutex);
+	return relief * RELIEF_EPOCHS - penalty;
+}
 
-			cout << "Swap completed... " << endl;
-		}
+// The VMs of two sockets trade places
+double swapBenefit(unsigned int highVM, double highMissRate, unsigned int lowVM, double lowMissRate)
+{
+	unsigned int	vms[2] = { highVM, lowVM };
+	unsigned int	destHostIDs[2] = { g_vms.hostID(lowVM), g_vms.hostID(highVM) };
+	return moveBenefit(vector<unsigned int>(vms, vms + 2), vector<unsigned int>(destHostIDs, destHostIDs + 2), peakRelief(highMissRate, lowMissRate, g_vms.missRate(highVM) - g_vms.missRate(lowVM)));
+}
 
+// Only the VM of the hotter socket moves, to a socket of destHostID
+double oneWayBenefit(unsigned int highVM, unsigned int destHostID, double highMissRate, double lowMissRate)
+{
+	return moveBenefit(vector<unsigned int>(1, highVM), vector<unsigned int>(1, destHostID), peakRelief(highMissRate, lowMissRate, g_vms.missRate(highVM)));
+}
 
-		/*
-		// 3.2 
-		{
-			// migrate the VM
+// What taking moved off the high side and putting it on the low one takes off the higher of the two
+double peakRelief(double highMissRate, double lowMissRate, double moved)
+{
+	return max(highMissRate, lowMissRate) - max(highMissRate - moved, lowMissRate + moved);
+}
 
-			if ( lowLLC_VM->getCPUAffinity() != highLLC_VM_affinity ) 	{
-			
-				cout << "[" << lowLLCSocketID.first << "][" << lowLLCSocketID.second << "] Global: " << setCPUAffinity( highLLC_VM_affinity, lowLLC_VM) << endl;
-			}
+void planned(unsigned int migrations, double relief)
+{
+	g_plannedMigrations += migrations;
+	g_plannedRelief += relief;
+}
 
-			cout << "[" << id << "] Global: " << migrate(lowLLCSocketID.first, highLLCSocketID.first, lowLLC_VM) << endl;
+// Migrations planned per 1000 of peak miss rate they were to take off
+double migrationsPerRelief()
+{
+	return g_plannedRelief > 0.0 ? 1000.0 * g_plannedMigrations / g_plannedRelief : 0.0;
+}
 
-		}
-		
-		// 3.3 Finalize
-		{
-			pthread_mutex_lock(&g_migration_mutex);
-			g_migrationCompleteCnt++;
+/*
+ *	Search a placement of every VM of the hosts reported in this epoch that
+ *	lowers the most loaded socket, moving at most two VMs per pair the
+ *	migration crew can take, one way, in swaps or in rotations; queues the
+ *	groups of moves that are worth it and fit. Returns the migrations queued.
+ */
+int planPlacement(const vector<hostSnapshot>& snapshot, unsigned long round)
+{
+	vector<placement_vm_t>		vms;
+	vector<placement_move_t>	plan;
+	vector<double>		room(g_socketKeys.size(), 0.0);
+	placement_stats_t	stats;
+	placement_vm_t		v;
+	size_t	first, last;
+	int		queued = 0;
+	double	now = monotonic(), mark = now;
+
+	// vCPU slots free on the sockets of the hosts that reported in this epoch; the others take no VM
+	for ( unsigned int b = 0; b < g_socketKeys.size(); b++ ) {
+		if ( snapshot[g_socketKeys[b].first].round == round )
+			room[b] = g_ledger.freeVCPUs(g_socketKeys[b].first, g_socketKeys[b].second);
+	}
 
-			if ( g_migrationCompleteCnt != 2 ) {
-				pthread_cond_wait(&g_migration_done, &g_migration_mutex);
-			}
-			g_migrationCompleteCnt = 0;
-			pthread_mutex_unlock(&g_migration_mutex);
+	// the miss rates the local rounds of this epoch left in the registry
+	for ( unsigned int vm = 0; vm < g_vms.size(); vm++ ) {
+		if ( snapshot[g_vms.hostID(vm)].round != round )
+			continue;
 
-			cout << "Swap completed... " << endl;
-		}
-		*/
-exit:
-		sleep(GLOBAL_SCHD_TIME_INTERVAL);
-		
-		for ( unsigned int i = 0; i <= g_numHosts; i++) {
-			pthread_cond_signal(&g_hostMigrating_go[i]);
-		}
+		// one in flight still loads the socket it is leaving, but is not planned again
+		v.vm = vm;
+		v.bin = location(socketKey(g_vms.hostID(vm), g_vms.cpuAffinity(vm)));
+		v.missRate = g_vms.missRate(vm);
+		v.size = g_vms.numOfVCPUs(vm);
+		v.pinned = g_cooldown.cooling(vm, now) || g_vms.state(vm) != VM_RUNNING;
+		vms.push_back(v);
+	}
 
-		for ( int i = 0; i < g_degreeOfMigration; i ++ ) {
-			migrationReq[i] = true;
-		}
+	optimize_placement(vms, room, g_degreeOfMigration * 2, plan, &stats);
+	phase_lap(&g_metrics, METRICS_LANE_ROUNDS, 0, PHASE_SELECT, &mark);
 
+	cout << "Placement search: " << vms.size() << " VMs, peak " << stats.peak_before << " -> " << stats.peak_after
+		 << ", " << plan.size() << " moves in " << stats.groups << " groups, " << stats.dropped << " without room, "
+		 << stats.iterations << " iterations in " << stats.elapsed << " ms" << endl;
+
+	// each group goes as a whole or not at all
+	for ( first = 0; first < plan.size(); first = last ) {
+		for ( last = first; last < plan.size() && plan[last].group == plan[first].group; last++ )
+			;
+		queued += enqueueGroup(plan, first, last, round);
 	}
+	phase_lap(&g_metrics, METRICS_LANE_ROUNDS, 0, PHASE_ADMIT, &mark);
 
-	cout << "Global thread exit..." << endl;
-	return NULL;
+	if ( queued > 0 ) {
+		cout << queued << " migrations queued" << endl;
+	}
+
+	return queued;
 }
 
-void* localWorkerThread(void *arg)
+/*
+ *	Admits the moves plan[first .. last-1] of a group as a whole: every VM
+ *	free to move, the relief worth all of the migrations and room held on
+ *	the sockets for every step; then queues them together, each after the
+ *	one it waits for.
+ *	Returns the migrations queued.
+ */
+int enqueueGroup(const vector<placement_move_t>& plan, size_t first, size_t last, unsigned long round)
 {
-	worker_p mine = (worker_t*)arg;
-	crew_p crew = mine->crew;
-	unsigned int hostID = mine->index+1;
-	printf("Crew %d starting\n", hostID);
+	vector<unsigned int>	vms, destHostIDs;
+	vector<ledger_move_t>	moves;
+	vector<migration_job_t>	jobs;
+	ledger_move_t	move;
+	migration_job_t	job;
+	double	now = monotonic();
+
+	for ( size_t k = first; k < last; k++ ) {
+		const placement_move_t& m = plan[k];
+		socketKey from = g_socketKeys[m.from], to = g_socketKeys[m.to];
+
+		cout << k << ". Move VM[" << m.vm << "] of [" << from.first << "][" << from.second << "] to ["
+			 << to.first << "][" << to.second << "]";
+		if ( m.after >= 0 )
+			cout << " after VM[" << plan[m.after].vm << "]";
+		cout << ", gain " << m.gain << endl;
+
+		if ( !g_cooldown.admit(m.vm, m.to, now) ) {
+			cout << "VM[" << m.vm << "] migrated too recently" << endl;
+			return 0;
+		}
+
+		move.vm = m.vm;
+		move.hostID = to.first;
+		move.socket = to.second;
+		move.after = ( m.after < 0 ) ? -1 : m.after - (int)first;
+		vms.push_back(m.vm);
+		destHostIDs.push_back(to.first);
+		moves.push_back(move);
+	}
 
+	if ( moveBenefit(vms, destHostIDs, plan[first].gain) <= 0.0 ) {
+		cout << "Does not meet the move requirements" << endl;
+		return 0;
+	}
+
+	if ( !g_ledger.reserveMoves(moves) ) {
+		cout << "The moves of group " << plan[first].group << " do not fit" << endl;
+		return 0;
+	}
+
+	for ( size_t k = first; k < last; k++ ) {
+		g_cooldown.record(plan[k].vm, plan[k].from, now);
+	}
+	planned(vms.size(), plan[first].gain);
+
+	for ( size_t k = first; k < last; k++ ) {
+		const placement_move_t& m = plan[k];
+
+		job.vm = m.vm;
+		job.srcHostID = g_socketKeys[m.from].first;
+		job.destHostID = g_socketKeys[m.to].first;
+		job.socket = g_socketKeys[m.to].second;
+		job.after = m.after < 0 ? -1 : (int)plan[m.after].vm;
+		job.epoch = round;
+		jobs.push_back(job);
+
+		// before it is queued, it may be done before submit returns
+		g_vms.setState(m.vm, VM_MIGRATING);
+	}
+
+	// all at once: a move must not start after the one it waits for failed unseen
+	if ( submit_migrations(&g_executor, &jobs[0], jobs.size()) != 0 ) {
+		cerr << "Cannot queue the migrations of group " << plan[first].group << endl;
+		for ( size_t k = first; k < last; k++ ) {
+			g_ledger.release(plan[k].vm, g_vms.cpuAffinity(plan[k].vm));
+			g_vms.setState(plan[k].vm, VM_RUNNING);
+		}
+		return 0;
+	}
+
+	return jobs.size();
+}
+
+/*
+ *	One scheduling round of a host, run on its coroutine on the control
+ *	plane. Every remote call may suspend it, so no lock is held across one
+ */
+void localRound(unsigned int hostID, unsigned long round)
+{
 	map<int, double>		vmMapPerHost;
 	map<int, double>::iterator it_vmMap;
 	map<int, double>		missRatePerSocket;
-	vector< pair<unsigned int, double> >	vmVector[NUM_OF_NUMA_NODES];
+	vector<unsigned int>	vcpuSocket;		// [vcpu] of a VM
+	const hostTopology&	topology = g_topology[hostID];
+	unsigned int	nSockets = topology.socketCPUs.size();
+	vector< vector< pair<unsigned int, double> > >	vmVector(nSockets);
 	vector< pair<unsigned int, double> >::iterator	vmVector_it;
-	string	remoteCmd;
-	int		numaInterval = 1;
-	int		resetCounter = 1;
-	int		numOfVMsPerSocket[NUM_OF_NUMA_NODES] = {0, 0};
+	int&	resetCounter = g_localState[hostID].resetCounter;
+	vector<int>		numOfVMsPerSocket(nSockets, 0);
+	vector<unsigned int>	onHost, offered, arrived;
 
-	remoteCmd = "";	
-	remoteCmd = "xenonmon-set.py Inst_LLC -t 7200 -n 1 ";
-	cout << sshCommand(hostID, remoteCmd) << endl;
+	vector<counterSample>	samples;
+	struct timespec	now;
+	double	mark = monotonic();
 
-	while (! g_exitCond) {
+	// arrived under a domain ID the migration could not read
+	g_vmIndex.detached(hostID, arrived);
+	for ( unsigned int i = 0; i < arrived.size(); i++ ) {
+		unsigned int localID;
+
+		if ( g_remote->getLocalID(hostID, g_vms.name(arrived[i]), localID) == 0 ) {
+			g_vmIndex.relocate(arrived[i], hostID, localID);
+		}
+	}
 
-		remoteCmd = "";
-		remoteCmd = "xenonmon-do.py Inst_LLC -t 7200 -n 1 2> /dev/null";
-		istringstream result(sshCommand(hostID, remoteCmd));
-		string line;
+	g_remote->readCounters(hostID, samples);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	phase_lap(&g_metrics, METRICS_LANE_ROUNDS, hostID, PHASE_COLLECT, &mark);
 
-		pair<int, int> socketKey;
-		unsigned int localID;
-		double numOfRetiredInsts;
-		double numOfLLCMisses;
-		double missRate = 0.0;
-		VirtualMachine* vm;
-
-		vmVector[0].clear();	
-		vmVector[1].clear();
-		numOfVMsPerSocket[0] = numOfVMsPerSocket[1] = 0;
-
-		for ( int i = 0 ; i < NUM_OF_NUMA_NODES; i ++ ) {
-			socketKey = make_pair(hostID, i);
-			g_missRatePerSocket[socketKey] = 0;
+	unsigned int localID;
+	double numOfRetiredInsts;
+	double numOfLLCMisses;
+	double missRate = 0.0;
+	unsigned int vm;
+
+	missRatePerSocket.clear();
+	vmMapPerHost.clear();
+
+	// For each virtual machine
+	for ( unsigned int s = 0; s < samples.size(); s++ ) {
+
+		// 1. Obtain # of retired insts and # of LLC misses.
+		localID = samples[s].localID;
+		numOfRetiredInsts = samples[s].numRetiredInsts;
+		numOfLLCMisses = samples[s].numLLCMisses;
+		missRate = 0.0;
+
+		// cout << "Input Stream: " << localID << "\t" << numOfRetiredInsts << "\t" << numOfLLCMisses << endl;
+
+		vm = g_vmIndex.lookup(hostID, localID);
+		if ( vm == VM_NONE ) {
+			continue;
 		}
-	
-		missRatePerSocket.clear();
-		vmMapPerHost.clear();
-	
-		// For each virtual machine ( a line idicates a virtual machine )
-		while (getline(result, line)) {
 
-			// 1. Obtain # of retired insts and # of LLC misses.
-			istringstream iss(line);
-			
-			localID = 0;
-			numOfRetiredInsts = 0.0;
-			numOfLLCMisses = 0.0;
+		if ( ( numOfLLCMisses < 20 ) && ( numOfRetiredInsts < 20 ) ) {
 			missRate = 0.0;
+		} else {
+			missRate = (numOfLLCMisses * LLC_MISS_SAMPLE_THRESHOLD) / ( (numOfRetiredInsts * RETIRED_INST_SAMPLE_THRESHOLD) / 1000000);
+		}
 
-			iss >> localID >> numOfRetiredInsts >> numOfLLCMisses;
-			// cout << "Input Stream: " << localID << "\t" << numOfRetiredInsts << "\t" << numOfLLCMisses << endl;
-			if ( localID == 0 ) continue;	// Except for Domain-0
-	
-			map<unsigned int, VirtualMachine*>::iterator it;
-
-			for ( it = g_vmMap.begin(); it != g_vmMap.end(); it++ ) {
-				
-				vm = static_cast<VirtualMachine*>(it->second);
-
-				if ( ( vm->getHostID() == hostID ) && ( vm->getLocalID() == localID ) ) {
-					
-					if ( ( numOfLLCMisses < 20 ) && ( numOfRetiredInsts < 20 ) ) {
-						missRate = 0.0;
-					} else {
-						missRate = (numOfLLCMisses * LLC_MISS_SAMPLE_THRESHOLD) / ( (numOfRetiredInsts * RETIRED_INST_SAMPLE_THRESHOLD) / 1000000);
-					}
+		// a single sample is too noisy to rank on; the VM is scored by its recent history
+		missRate = g_history.add(vm, numOfRetiredInsts, numOfLLCMisses, missRate, now.tv_sec + now.tv_nsec / 1e9);
 
-					vm->setNumRetiredInsts(numOfRetiredInsts);
-					vm->setNumLLCMisses(numOfLLCMisses);
+		g_vms.setNumRetiredInsts(vm, numOfRetiredInsts);
+		g_vms.setNumLLCMisses(vm, numOfLLCMisses);
+		g_vms.setMissRate(vm, missRate);
 
-					/*
-					if ( vm->getCPUAffinity() != getCPUAffinity(vm) ) {
-						vm->setCPUAffinity(getCPUAffinity(vm));
-						
-						cerr << endl;
-						cerr << "[" << hostID << "] Adjust " << g_vmNameMap[vm->getKey()] << " CPU affinity !!!!!!!!" << endl;
-						cerr << endl;
-					}
-					*/
+		/*
+		if ( g_vms.cpuAffinity(vm) != getCPUAffinity(vm) ) {
+			g_vms.setCPUAffinity(vm, getCPUAffinity(vm));
+			
+			cerr << endl;
+			cerr << "[" << hostID << "] Adjust " << g_vms.name(vm) << " CPU affinity !!!!!!!!" << endl;
+			cerr << endl;
+		}
+		*/
 
-					missRatePerSocket[vm->getCPUAffinity()] += missRate;
-					pthread_mutex_lock(&g_globalCrew.mutex);
-					socketKey = make_pair(hostID, vm->getCPUAffinity());
-					g_missRatePerSocket[socketKey] += missRate;
-					pthread_mutex_unlock(&g_globalCrew.mutex);
-					vmVector[vm->getCPUAffinity()].push_back(pair<int, double>(vm->getKey(), missRate));
+		if ( g_vms.cpuAffinity(vm) >= nSockets ) {
+			cerr << "[" << hostID << "] " << g_vms.name(vm) << " is on socket " << g_vms.cpuAffinity(vm) << " of " << nSockets << endl;
+			continue;
+		}
 
-					numOfVMsPerSocket[vm->getCPUAffinity()] ++ ;
-				}
-			}
+		// every socket its vCPUs run on carries their part of the misses
+		vcpu_sockets(topology, g_vms.cpuAffinity(vm), g_vms.numOfVCPUs(vm), vcpuSocket);
+		for ( unsigned int v = 0; v < vcpuSocket.size(); v++ ) {
+			missRatePerSocket[vcpuSocket[v]] += missRate * vcpuShare(samples[s], v, vcpuSocket.size());
 		}
+		vmVector[g_vms.cpuAffinity(vm)].push_back(pair<int, double>(vm, missRate));
 
-		if (vmVector[0].size() != 4 || vmVector[1].size() !=4 ) {
-			cout << "[" << hostID << "][0] Number of virtual mahcines: " << vmVector[0].size() << endl;
-			cout << "[" << hostID << "][1] Number of virtual mahcines: " << vmVector[1].size() << endl;
-			vmMapPerHost.clear();
+		numOfVMsPerSocket[g_vms.cpuAffinity(vm)] ++ ;
+	}
+	phase_lap(&g_metrics, METRICS_LANE_ROUNDS, hostID, PHASE_PARSE, &mark);
+
+	// Summary of the round; the VMs ranked in the last round stand until this one ranks its own
+	hostSnapshot snapshot = g_snapshot[hostID][(round - 1) & 1];
+	snapshot.round = round;
+	for ( unsigned int i = 0; i < nSockets; i ++ ) {
+		snapshot.missRate[i] = missRatePerSocket[i];
+	}
+
+	for ( unsigned int i = 0; i < nSockets; i ++ ) {
+		if ( vmVector[i].empty() ) {
+			cout << "[" << hostID << "][" << i << "] Number of virtual mahcines: 0" << endl;
+		}
+		sort(vmVector[i].begin(), vmVector[i].end(), Compare());
+	}
+	
+	cout << "Host [" << hostID << "] after sorting. " << endl;
+	for ( unsigned int i = 0; i < nSockets; i ++ ) {
+		for ( vmVector_it = vmVector[i].begin(); vmVector_it != vmVector[i].end(); vmVector_it++ ) {
+			cout << g_vms.name(vmVector_it->first) << ": " << static_cast<double>(vmVector_it->second) << endl;
+		}
+	}
+
+	for ( unsigned int i = 0; i < nSockets; i ++ ) {
+		if ( vmVector[i].empty() ) continue;
+		cout << "[" << i << "]High\t" << g_vms.name(vmVector[i].begin()->first) << ":" << vmVector[i].begin()->second << endl;
+		cout << "[" << i << "]Low\t" << g_vms.name(vmVector[i].rbegin()->first) << ":" << vmVector[i].rbegin()->second << endl;
+	}
+
+	// register; an empty socket has no VM to offer
+
+	for ( unsigned int i = 0; i < nSockets; i ++ ) {
+		if ( vmVector[i].empty() ) {
+			snapshot.highLLC_VM[i] = snapshot.lowLLC_VM[i] = VM_NONE;
+			snapshot.highLLC_rate[i] = snapshot.lowLLC_rate[i] = 0.0;
 			continue;
 		}
+		snapshot.highLLC_VM[i] = vmVector[i].begin()->first;
+		snapshot.lowLLC_VM[i] = vmVector[i].rbegin()->first;
+		snapshot.highLLC_rate[i] = vmVector[i].begin()->second;
+		snapshot.lowLLC_rate[i] = vmVector[i].rbegin()->second;
+	}
 
-		sort(vmVector[0].begin(), vmVector[0].end(), Compare());
-		sort(vmVector[1].begin(), vmVector[1].end(), Compare());
-		
-		cout << "Host [" << hostID << "] after sorting. " << endl;
-		for ( int i = 0; i < NUM_OF_NUMA_NODES; i ++ ) {
-			for ( vmVector_it = vmVector[i].begin(); vmVector_it != vmVector[i].end(); vmVector_it++ ) {
-				cout << g_vmNameMap[static_cast<unsigned int>(vmVector_it->first)] << ": " << static_cast<double>(vmVector_it->second) << endl;
-			}
+	// what their migrations would cost, before they are offered
+	for ( unsigned int i = 0; i < nSockets; i ++ ) {
+		for ( vmVector_it = vmVector[i].begin(); vmVector_it != vmVector[i].end(); vmVector_it++ ) {
+			onHost.push_back(vmVector_it->first);
 		}
+	}
+	offered = snapshot.highLLC_VM;
+	offered.insert(offered.end(), snapshot.lowLLC_VM.begin(), snapshot.lowLLC_VM.end());
+	refreshDirtyRates(hostID, offered, onHost);
+
+	// publish; the global thread reads it once the round is complete
+	g_snapshot[hostID][round & 1] = snapshot;
+	phase_lap(&g_metrics, METRICS_LANE_ROUNDS, hostID, PHASE_RANK, &mark);
+	
+	rehomeMemory(hostID, vmVector);
+	phase_lap(&g_metrics, METRICS_LANE_ROUNDS, hostID, PHASE_ADJUST, &mark);
+
+	resetCounter ++ ;
+}
 
-		for ( int i = 0; i < NUM_OF_NUMA_NODES; i ++ ) {
-			cout << "[" << i << "]High\t" << g_vmNameMap[static_cast<unsigned int>(vmVector[i].begin()->first)] << ":" << vmVector[i].begin()->second << endl;
-			cout << "[" << i << "]Low\t" << g_vmNameMap[static_cast<unsigned int>(vmVector[i].rbegin()->first)] << ":" << vmVector[i].rbegin()->second << endl;
+/*
+ *	Re-reads the dirty rates the cost model of the global thread works
+ *	from, so it never waits on a host for them: of the VMs the round offers
+ *	it once they are older than a global period, of the others once older
+ *	than DIRTY_RATE_MAX_AGE. The stale ones of the host are read together,
+ *	in one call, over the same second.
+ */
+void refreshDirtyRates(unsigned int hostID, const vector<unsigned int>& offered, const vector<unsigned int>& vms)
+{
+	vector<unsigned int>	stale, localIDs;
+	vector<dirtyRateSample>	rates;
+	double	now = monotonic(), maxAge;
+
+	for ( unsigned int i = 0; i < vms.size(); i++ ) {
+		maxAge = ( find(offered.begin(), offered.end(), vms[i]) != offered.end() ) ? GLOBAL_SCHD_TIME_INTERVAL : DIRTY_RATE_MAX_AGE;
+		if ( now - g_vms.dirtyStamp(vms[i]) > maxAge ) {
+			stale.push_back(vms[i]);
+			localIDs.push_back(g_vms.localID(vms[i]));
 		}
+	}
 
-		// register 
+	if ( stale.empty() || g_remote->getDirtyRates(hostID, localIDs, rates) != 0 )
+		return;
 
-		for ( int i = 0; i < NUM_OF_NUMA_NODES; i ++ ) {
-			pthread_mutex_lock(&g_llc_mutex[hostID][i]);
-			g_highLLC_VM[hostID][i] = vmVector[i].begin()->first;
-			g_lowLLC_VM[hostID][i] = vmVector[i].rbegin()->first;
-			pthread_mutex_unlock(&g_llc_mutex[hostID][i]);
+	for ( unsigned int i = 0; i < rates.size(); i++ ) {
+		for ( unsigned int j = 0; j < stale.size(); j++ ) {
+			if ( localIDs[j] == rates[i].localID ) {
+				g_vms.setDirtyRate(stale[j], rates[i].dirtyRate, now);
+				break;
+			}
 		}
-		
-		if ( numaInterval % 5 == 0 ) {
+	}
+}
 
-			for ( int i = 0; i < NUM_OF_NUMA_NODES; i ++ ) {
+/*
+ *	Moves the pages the hot VMs of a host, and the VMs it repinned to
+ *	another socket, have off the node of their socket back to it, hottest
+ *	VM first, a batch at a time, no faster than NUMA_PAGE_RATE on average.
+ *	Only the remote pages move, so it costs the same whatever the size of
+ *	the VM, and the VM keeps running. A repinned VM not done yet waits for
+ *	the next round.
+ */
+void rehomeMemory(unsigned int hostID, const vector< vector< pair<unsigned int, double> > >& vmVector)
+{
+	localState&	state = g_localState[hostID];
+	const hostTopology&	topology = g_topology[hostID];
+	vector< pair<unsigned int, double> >	candidates;
+	vector<unsigned int>	repinned, left;
+	double	now = monotonic();
+
+	// a round's worth of pages at most, so an idle spell does not turn into a burst
+	state.pageTokens = min(state.pageTokens + NUMA_PAGE_RATE * (now - state.pageStamp), (double)NUMA_PAGE_RATE * LOCAL_SCHD_TIME_INTERVAL);
+	state.pageStamp = now;
+
+	pthread_mutex_lock(&g_migration_mutex);
+	repinned.swap(state.rehome);
+	pthread_mutex_unlock(&g_migration_mutex);
+
+	for ( unsigned int i = 0; i < vmVector.size(); i++ ) {
+		for ( unsigned int j = 0; j < vmVector[i].size(); j++ ) {
+			if ( vmVector[i][j].second > NUMA_THRESHOLD )
+				candidates.push_back(vmVector[i][j]);
+		}
+	}
+	for ( unsigned int i = 0; i < repinned.size(); i++ ) {
+		unsigned int vm = repinned[i];
 
-				for ( vmVector_it = vmVector[i].begin(); vmVector_it != vmVector[i].end(); vmVector_it++) {
+		// gone to another host since, memory and all; a hot one is in already
+		if ( !g_vms.contains(vm) || g_vms.hostID(vm) != hostID || g_vms.missRate(vm) > NUMA_THRESHOLD )
+			continue;
+		candidates.push_back(pair<unsigned int, double>(vm, g_vms.missRate(vm)));
+	}
+	sort(candidates.begin(), candidates.end(), Compare());
 
-					if ( vmVector_it->second > NUMA_THRESHOLD ) {
+	for ( unsigned int i = 0; i < candidates.size(); i++ ) {
+		unsigned int vm = candidates[i].first;
+		unsigned int socket = g_vms.cpuAffinity(vm);
+		bool queued = candidates[i].second <= NUMA_THRESHOLD;
+		int total = 0, remote, moved, pages = 0;
 
-						vm = getVM(g_highLLC_VM[hostID][i]);
-						numaMemoryInfo memInfo = getNUMAAffinity(hostID, vm->getLocalID());
+		if ( state.pageTokens < NUMA_PAGE_BATCH ) {
+			if ( queued )
+				left.push_back(vm);
+			continue;
+		}
 
-						if ( ( vm->getCPUAffinity() == 0 ) && ( memInfo.numOfPages[0] != 262144 ) ) {
+		// leaving the host, its memory goes with it
+		if ( socket >= topology.socketNode.size() || g_vms.state(vm) != VM_RUNNING )
+			continue;
 
-							cout << "[" << hostID << "] NUMA migration: " << migrate(hostID, hostID, vm) << endl;
-							break;
+		unsigned int node = topology.socketNode[socket];
+		numaMemoryInfo memInfo = getNUMAAffinity(hostID, g_vms.localID(vm));
 
-						} else if ( ( vm->getCPUAffinity() == 1 ) && ( memInfo.numOfPages[1] != 262144 ) ) {
+		for ( unsigned int n = 0; n < memInfo.numOfPages.size(); n++ ) {
+			total += memInfo.numOfPages[n];
+		}
+		if ( node >= memInfo.numOfPages.size() || total == 0 )
+			continue;
 
-							cout << "[" << hostID << "] NUMA migration: " << migrate(hostID, hostID, vm) << endl;
-							break;
-						}
-					}
-				}
-			}
+		remote = total - memInfo.numOfPages[node];
+		if ( remote <= total * NUMA_REMOTE_SHARE )
+			continue;
 
-			numaInterval = 1;
+		while ( remote > 0 && state.pageTokens >= NUMA_PAGE_BATCH ) {
+			if ( g_remote->migratePages(hostID, g_vms.localID(vm), node, NUMA_PAGE_BATCH, moved) != 0 || moved <= 0 ) {
+				cerr << "[" << hostID << "] Cannot move the pages of " << g_vms.name(vm) << " to node " << node << endl;
+				break;
+			}
+			state.pageTokens -= moved;
+			remote -= moved;
+			pages += moved;
 		}
 
-		numaInterval ++;
-		resetCounter ++ ;
-exit:
-		pthread_barrier_wait(&crew->barrier);
-		pthread_cond_signal(&g_globalCrew.go);
+		cout << "[" << hostID << "] NUMA pages: " << g_vms.name(vm) << " " << pages << " to node " << node
+			<< ", " << max(remote, 0) << " of " << total << " left off it" << endl;
 
-		pthread_mutex_lock(&g_hostMigrating_mutex[hostID]);
-		pthread_cond_wait(&g_hostMigrating_go[hostID], &g_hostMigrating_mutex[hostID]);
-		pthread_mutex_unlock(&g_hostMigrating_mutex[hostID]);
+		if ( queued && remote > total * NUMA_REMOTE_SHARE )
+			left.push_back(vm);
+	}
 
+	if ( !left.empty() ) {
+		pthread_mutex_lock(&g_migration_mutex);
+		state.rehome.insert(state.rehome.end(), left.begin(), left.end());
+		pthread_mutex_unlock(&g_migration_mutex);
 	}
-	
-	remoteCmd = "";
-	remoteCmd = "xenonmon-unset.py Inst_LLC -t 7200 -n 1";
-	cout << sshCommand(hostID, remoteCmd) << endl;
-	cout << "Host [" << hostID << "] thread exit..." << endl;
+}
 
-	return NULL;
+double monotonic()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// a socket of the cluster as one number, for the cooldown table and the placement search
+unsigned int location(socketKey socket)
+{
+	return g_socketBase[socket.first] + socket.second;
+}
+
+// [hostID]
+vector<unsigned int> socketsPerHost()
+{
+	vector<unsigned int> numOfSockets(g_numHosts+1);
+
+	for ( unsigned int h = 0; h <= g_numHosts; h++ ) {
+		numOfSockets[h] = g_socketBase[h+1] - g_socketBase[h];
+	}
+
+	return numOfSockets;
 }
 
 numaMemoryInfo getNUMAAffinity(int hostID, int localID)
 {
 	numaMemoryInfo memInfo;
-	string remoteCmd;
-	stringstream ss_localID;
-	istringstream iss;
-	string line;
+	vector<int> numOfPages;
 
-	ss_localID.str("");
-	ss_localID << localID;
+	memInfo.numOfPages.assign(g_topology[hostID].nodeMemory.size(), 0);
 
-	remoteCmd = "";
-	remoteCmd = "./getNUMA-affinity.sh " + ss_localID.str();
-	istringstream cmdResult(sshCommand(hostID, remoteCmd));
-	
-	getline(cmdResult, line);
-	iss.str(line);
-	iss >> memInfo.numOfPages[0] >> memInfo.numOfPages[1];
+	if ( g_remote->getNUMAPages(hostID, localID, numOfPages) != 0 ) {
+		cerr << "[" << hostID << "] Cannot read NUMA pages of " << localID << endl;
+		return memInfo;
+	}
+
+	for ( unsigned int i = 0; i < numOfPages.size() && i < memInfo.numOfPages.size(); i++ ) {
+		memInfo.numOfPages[i] = numOfPages[i];
+	}
 
 	return memInfo;
 }
 
 
-VirtualMachine* getVM(unsigned int key)
+unsigned int getCPUAffinity(unsigned int vm)
 {
-	map<unsigned int, VirtualMachine*>::iterator it;
-	it = g_vmMap.find(key);
+	string cpu_affinity;
 
-	if ( it == g_vmMap.end() ) {
-		return NULL;
-	} else {
-		return it->second;
+	if ( g_remote->getCPUAffinity(g_vms.hostID(vm), g_vms.name(vm), cpu_affinity) != 0 ) {
+		cout << "[" << g_vms.hostID(vm) << "] Cannot read CPU affinity of " << g_vms.name(vm) << endl;
+		return -1;
 	}
+
+	int socket = find_socket(g_topology[g_vms.hostID(vm)], cpu_affinity);
+	if ( socket < 0 ) {
+		cout << "[" << g_vms.hostID(vm) << "] Res: " << cpu_affinity << endl;
+	}
+	return socket;
 }
 
-unsigned int getCPUAffinity(VirtualMachine* vm)
+unsigned int getLocalID(unsigned int vm)
 {
-	string remoteCmd, cpu_affinity;
-	remoteCmd = "";
-	remoteCmd = "xm vcpu-list | grep -Rw " + g_vmNameMap[vm->getKey()] + " | awk '{print $7}'";
-	cpu_affinity = sshCommand(vm->getHostID(), remoteCmd);
+	unsigned int localID = 0;
 
-	if ( ( cpu_affinity != "0-3\n" ) && ( cpu_affinity != "4-7\n") ) {
-		cout << "[" << vm->getHostID() << "] Req: " << remoteCmd << endl;
-		cout << "[" << vm->getHostID() << "] Res: " << cpu_affinity << endl;
+	g_remote->getLocalID(g_vms.hostID(vm), g_vms.name(vm), localID);
+	return localID;
+}
 
-		//return 3;
+string migrate(int srcHostID, int destHostID, unsigned int vm, int node, int* status)
+{
+	ostringstream oss;
+	
+	oss << "migrate " << g_vms.name(vm) << " " << srcHostID << " -> " << destHostID;
+	if ( node == 1 ) {
+		oss << " (node 1)";
 	}
-	cpu_affinity.erase(cpu_affinity.end()-1); 
 
-	if ( cpu_affinity == "0-3" ) {
-		return 0;
-	} else if ( cpu_affinity == "4-7") {
-		return 1;
+	struct timespec begin, end;
+	double elapsed;
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	int result = g_remote->migrate(srcHostID, destHostID, g_vms.name(vm), node);
+	if ( status != NULL ) {
+		*status = result;
 	}
 
-	return -1;
-}
+	if ( result != 0 ) {
+		oss << " failed";
+	} else {
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		elapsed = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
 
-unsigned int getLocalID(VirtualMachine* vm)
-{
-	string remoteCmd;
+		// the dirty rate that explains the time it took
+		if ( elapsed > 1.0 ) {
+			g_vms.setDirtyRate(vm, observed_dirty_rate(g_vms.memory(vm), elapsed), monotonic());
+		}
+	}
+
+	// the domain ID changes with the host; a VM that did not leave keeps both
+	if ( result == 0 ) {
+		unsigned int localID;
 
-	remoteCmd = "";
-	remoteCmd = "xm list | grep -Rw " + g_vmNameMap[vm->getKey()] + " | awk '{print $2}'";
-	return atoi(sshCommand(vm->getHostID(), remoteCmd).c_str());
+		if ( g_remote->getLocalID(destHostID, g_vms.name(vm), localID) == 0 ) {
+			g_vmIndex.relocate(vm, destHostID, localID);
+		} else {
+			// the next round of the host looks it up again
+			g_vmIndex.detach(vm, destHostID);
+			oss << ", domain ID not known yet";
+		}
+	}
+
+	return oss.str();
 }
 
-string migrate(int srcHostID, int destHostID, VirtualMachine* vm, int node)
+/*
+ *	Pin every vCPU of the VM around socket affinity of its host, all in one
+ *	driver call; the registry and the ledger follow only if it worked
+ */
+string setCPUAffinity( int affinity, unsigned int vm, int* status)
 {
-	stringstream hostID;
-	string remoteCmd;
-	
-	hostID.str("");
-	hostID << setw(2) << setfill('0') << destHostID;
+	ostringstream oss;
 
-	remoteCmd = "";
-	if ( node == 1) {
-		remoteCmd = "xm migrate -l -n 1 " + g_vmNameMap[vm->getKey()] + " " + g_hostPrefix + hostID.str();
-	} else {
-		remoteCmd = "xm migrate -l " + g_vmNameMap[vm->getKey()] + " " + g_hostPrefix + hostID.str();
+	if ( status != NULL ) {
+		*status = -1;
+	}
+	const hostTopology& topology = g_topology[g_vms.hostID(vm)];
+	vector<unsigned int> sockets;
+	vector<string> cpus;
+
+	// a socket of another host; the VM stays as it is
+	if ( affinity < 0 || (unsigned int)affinity >= topology.socketCPUs.size() ) {
+		oss << "vcpu-pin " << g_vms.name(vm) << " to socket " << affinity << " of " << topology.socketCPUs.size() << " failed";
+		return oss.str();
+	}
+
+	vcpu_sockets(topology, affinity, g_vms.numOfVCPUs(vm), sockets);
+	for ( unsigned int v = 0; v < sockets.size(); v++ ) {
+		cpus.push_back(topology.socketCPUs[sockets[v]]);
+	}
+
+	oss << "vcpu-pin " << g_vms.name(vm) << " " << cpus.size() << " vCPUs " << cpus[0];
+	if ( cpus.back() != cpus[0] ) {
+		oss << " to " << cpus.back();
 	}
-	sshCommand(srcHostID, remoteCmd); 
 
-	vm->setHostID(destHostID);
-	vm->setLocalID( getLocalID(vm) );
+	if ( g_remote->pinVCPUs(g_vms.hostID(vm), g_vms.name(vm), cpus) != 0 ) {
+		oss << " failed";
+		return oss.str();
+	}
+	g_vms.setCPUAffinity(vm, affinity);
+	g_ledger.repin(vm, affinity);
 
-	return remoteCmd;
+	if ( status != NULL ) {
+		*status = 0;
+	}
+	return oss.str();
 }
 
-string setCPUAffinity( int affinity, VirtualMachine* vm)
+/*
+ *	Part of the misses of a domain on one of its vCPUs; an even part when
+ *	they are not counted one by one
+ */
+double vcpuShare(const counterSample& sample, unsigned int vcpu, unsigned int nVCPUs)
 {
-	string remoteCmd;
-	remoteCmd = "";
-	
-	// must use xm insted of xl
-	if ( affinity == 0 ) {
-		remoteCmd = "xm vcpu-pin " + g_vmNameMap[vm->getKey()] + " 0 0-3";
-	} else {
-		remoteCmd = "xm vcpu-pin " + g_vmNameMap[vm->getKey()] + " 0 4-7";
-	}
+	if ( sample.vcpus.empty() || sample.numLLCMisses <= 0.0 )
+		return 1.0 / nVCPUs;
 
-	sshCommand(vm->getHostID(), remoteCmd); 
-	vm->setCPUAffinity(affinity);
+	for ( unsigned int i = 0; i < sample.vcpus.size(); i++ ) {
+		if ( sample.vcpus[i].vcpu == vcpu )
+			return sample.vcpus[i].numLLCMisses / sample.numLLCMisses;
+	}
 
-	return remoteCmd;
+	return 0.0;
 }
 
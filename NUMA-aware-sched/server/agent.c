@@ -0,0 +1,428 @@
+#define _GNU_SOURCE		// pipe2, accept4
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <arpa/inet.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <errno.h>
+
+#include "sock.h"
+#include "agent.h"
+#include "sampleCodec.h"
+
+//#define DEBUG
+#ifdef DEBUG
+	#define DPRINTF(fmt, s...)  printf(fmt,##s)
+#else
+	#define DPRINTF(fmt, s...)
+#endif
+
+// Global variable
+static agent_t my_agent;
+
+// Function prototype
+void*	acceptThread(void *);
+int		runAgent(int port);
+int		sampleCommand(struct agent_tag *this);
+int		startSampler(struct agent_tag *this);
+int		parseSample(struct agent_tag *this, const char *line);
+int		sampleFake(struct agent_tag *this);
+int		sendBatch(struct agent_tag *this);
+int		flushClient(struct client_tag *client);
+
+/*
+ *	Monitoring agent entry point
+ *
+ *	The agent samples the performance counters of the local domains every
+ *	period and streams per-VM deltas to every connected scheduler.
+ *	With -n it forks N agents on port+1 .. port+N so that one machine can
+ *	stand in for N hosts.
+ */
+int main(int argc, char *argv[])
+{
+	int opt, i, nHosts = 0, status;
+	int port;
+	pid_t pid;
+
+	memset(&my_agent, 0x00, sizeof(agent_t));
+	my_agent.period = AGENT_DEFAULT_PERIOD;
+	my_agent.command = AGENT_DEFAULT_COMMAND;
+
+	while ((opt = getopt(argc, argv, "p:c:f:n:")) != -1) {
+		switch (opt) {
+		case 'p':
+			my_agent.period = atoi(optarg);
+			break;
+		case 'c':
+			my_agent.command = optarg;
+			break;
+		case 'f':
+			my_agent.num_fake_vms = atoi(optarg);
+			break;
+		case 'n':
+			nHosts = atoi(optarg);
+			break;
+		default:
+			optind = argc;
+			break;
+		}
+	}
+
+	if (optind >= argc) {
+		fprintf(stderr, "usage: %s [-p period ms] [-c sample command] [-f fake VMs] [-n hosts] <port>\n", argv[0]);
+		exit(1);
+	}
+
+	port = atoi(argv[optind]);
+
+	if (my_agent.period <= 0 || my_agent.num_fake_vms > AGENT_MAX_VMS) {
+		fprintf(stderr, "Invalid period(%d) or number of fake VMs(%d)\n", my_agent.period, my_agent.num_fake_vms);
+		exit(1);
+	}
+
+	// a scheduler going away must not kill the agent
+	signal(SIGPIPE, SIG_IGN);
+
+	if (nHosts == 0) {
+		return runAgent(port);
+	}
+
+	// Local stand-in: one agent process per host
+	for (i = 1; i <= nHosts; i++) {
+		pid = fork();
+		if (pid < 0) {
+			perror("fork() error");
+			exit(1);
+		}
+		if (pid == 0) {
+			my_agent.seed = i;
+			exit(runAgent(port + i));
+		}
+	}
+
+	for (i = 0; i < nHosts; i++) {
+		wait(&status);
+	}
+
+	return 0;
+}
+
+int runAgent(int port)
+{
+	int status;
+	struct timeval begin, end;
+	long elapsed;
+
+	status = pthread_mutex_init(&my_agent.mutex, NULL);
+	if (status != 0)
+		return status;
+
+	my_agent.serv_sock = init_sock(port);
+	fcntl(my_agent.serv_sock, F_SETFD, FD_CLOEXEC);
+
+	status = pthread_create(&my_agent.accept_thread, NULL, acceptThread, NULL);
+	if (status != 0) {
+		perror("pthread_create() error");
+		return status;
+	}
+
+	printf("Agent listening on %d (period %dms, %s)\n", port, my_agent.period,
+			my_agent.num_fake_vms ? "fake counters" : my_agent.command);
+
+	while (1) {
+
+		gettimeofday(&begin, NULL);
+
+		// 1) Sample the counters of the last period
+		if (my_agent.num_fake_vms > 0) {
+			status = sampleFake(&my_agent);
+		} else {
+			status = sampleCommand(&my_agent);
+		}
+
+		// 2) Push them to the connected schedulers; nothing when the sampler had no new batch
+		if (status == 0) {
+			my_agent.seq++;
+			sendBatch(&my_agent);
+		}
+
+		// 3) Sleep for the rest of the period
+		gettimeofday(&end, NULL);
+		elapsed = 1000000L * (end.tv_sec - begin.tv_sec) + end.tv_usec - begin.tv_usec;
+		if (elapsed < my_agent.period * 1000L) {
+			usleep(my_agent.period * 1000L - elapsed);
+		}
+	}
+
+	return 0;
+}
+
+/*
+ *	Accept scheduler connections
+ */
+void* acceptThread(void *arg)
+{
+	int clnt_sock;
+	struct sockaddr_in clnt_addr;
+	socklen_t clnt_addr_size = sizeof(clnt_addr);
+
+	while (1) {
+
+		// writes never block the period loop, and the sampler does not inherit it
+		clnt_sock = accept4(my_agent.serv_sock, (struct sockaddr *)&clnt_addr, &clnt_addr_size, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (clnt_sock < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("accept() error");
+			break;
+		}
+
+		pthread_mutex_lock(&my_agent.mutex);
+		if (my_agent.num_clients < AGENT_MAX_CLIENTS) {
+			client_p client = &my_agent.clients[my_agent.num_clients++];
+
+			client->sock = clnt_sock;
+			client->offset = client->pending = 0;
+			client->stalls = 0;
+			DPRINTF("Scheduler connect... (%d)\n", clnt_sock);
+		} else {
+			close(clnt_sock);
+		}
+		pthread_mutex_unlock(&my_agent.mutex);
+	}
+
+	return NULL;
+}
+
+/*
+ *	The last batch the sampler finished, without waiting for it: 0 if there
+ *	is a new one, 1 if not yet, -1 if it cannot run.
+ *
+ *	The sampler prints a line per domain, <domid> <insts> <misses>, and ends
+ *	a batch with any other line (a blank one) or by exiting. It is started
+ *	once and kept running, so one that streams batches is never started
+ *	again; one that prints a single batch and exits is restarted at once,
+ *	and runs while the period loop sleeps instead of in it.
+ */
+int sampleCommand(struct agent_tag *this)
+{
+	char buf[4096];
+	ssize_t nRead;
+	ssize_t i;
+	int status = 1;
+
+	if (this->sampler == 0 && startSampler(this) != 0)
+		return -1;
+
+	while ((nRead = read(this->sampler_fd, buf, sizeof(buf))) > 0) {
+		for (i = 0; i < nRead; i++) {
+			if (buf[i] != '\n') {
+				// a line too long for a sample is not one
+				if (this->line_len < sizeof(this->line) - 1)
+					this->line[this->line_len++] = buf[i];
+				continue;
+			}
+			this->line[this->line_len] = '\0';
+			this->line_len = 0;
+
+			if (parseSample(this, this->line) != 0 && this->num_pending > 0) {
+				memcpy(this->samples, this->pending, sizeof(sample_t) * this->num_pending);
+				this->num_samples = this->num_pending;
+				this->num_pending = 0;
+				status = 0;
+			}
+		}
+	}
+
+	if (nRead < 0 && (errno == EAGAIN || errno == EINTR))
+		return status;
+
+	// exited: what it printed last is a batch too, and the next one starts now
+	if (this->line_len > 0) {
+		this->line[this->line_len] = '\0';
+		this->line_len = 0;
+		parseSample(this, this->line);
+	}
+	if (this->num_pending > 0) {
+		memcpy(this->samples, this->pending, sizeof(sample_t) * this->num_pending);
+		this->num_samples = this->num_pending;
+		this->num_pending = 0;
+		status = 0;
+	}
+
+	close(this->sampler_fd);
+	waitpid(this->sampler, NULL, 0);
+	this->sampler = 0;
+
+	if (startSampler(this) != 0 && status != 0)
+		return -1;
+	return status;
+}
+
+/*
+ *	Run the sampler command with its stdout on a non-blocking pipe
+ */
+int startSampler(struct agent_tag *this)
+{
+	int fd[2];
+	pid_t pid;
+
+	if (pipe2(fd, O_CLOEXEC) != 0)
+		return -1;
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork() error");
+		close(fd[0]);
+		close(fd[1]);
+		return -1;
+	}
+
+	if (pid == 0) {
+		dup2(fd[1], STDOUT_FILENO);
+		execl("/bin/sh", "sh", "-c", this->command, (char*)NULL);
+		_exit(127);
+	}
+
+	close(fd[1]);
+	fcntl(fd[0], F_SETFL, fcntl(fd[0], F_GETFL) | O_NONBLOCK);
+
+	this->sampler = pid;
+	this->sampler_fd = fd[0];
+	this->line_len = 0;
+	this->num_pending = 0;
+
+	return 0;
+}
+
+/*
+ *	One line of the sampler into the batch being read; -1 if it is not a
+ *	sample, which ends the batch
+ */
+int parseSample(struct agent_tag *this, const char *line)
+{
+	unsigned int localID;
+	double insts, misses;
+
+	if (sscanf(line, "%u %lf %lf", &localID, &insts, &misses) != 3)
+		return -1;
+	if (localID == 0 || this->num_pending >= AGENT_MAX_VMS)	// Except for Domain-0
+		return 0;
+
+	this->pending[this->num_pending].localID = localID;
+	this->pending[this->num_pending].insts = insts;
+	this->pending[this->num_pending].misses = misses;
+	this->num_pending++;
+
+	return 0;
+}
+
+/*
+ *	Synthetic counters for domains 1 .. num_fake_vms
+ */
+int sampleFake(struct agent_tag *this)
+{
+	int i;
+	double intensity;
+
+	if (this->seq == 0) {
+		for (i = 0; i < this->num_fake_vms; i++) {
+			this->intensity[i] = 1.0 + (rand_r(&this->seed) % 120);
+		}
+	}
+
+	this->num_samples = this->num_fake_vms;
+	for (i = 0; i < this->num_fake_vms; i++) {
+		intensity = this->intensity[i] * (0.8 + (rand_r(&this->seed) % 41) / 100.0);
+
+		this->samples[i].localID = i + 1;
+		this->samples[i].insts = 800 + rand_r(&this->seed) % 400;
+		this->samples[i].misses = intensity * this->samples[i].insts / 1000;
+	}
+
+	return 0;
+}
+
+/*
+ *	Encode one batch (see sampleCodec.h) and hand it to every client that
+ *	finished the last one; dropping the ones that went away, or that took
+ *	nothing for AGENT_MAX_STALLS periods
+ */
+int sendBatch(struct agent_tag *this)
+{
+	uint8_t message[SAMPLE_BATCH_MAX(AGENT_MAX_VMS)];
+	struct timeval now;
+	size_t len;
+	int i, written, n;
+
+	gettimeofday(&now, NULL);
+
+	len = encode_batch_begin(message, (uint32_t)this->seq, 1000000ULL * now.tv_sec + now.tv_usec);
+	for (i = 0; i < this->num_samples; i++) {
+		len += encode_record(message + len, this->samples[i].localID,
+							(uint64_t)(this->samples[i].insts + 0.5), (uint64_t)(this->samples[i].misses + 0.5));
+	}
+	encode_batch_end(message, len, this->num_samples);
+
+	pthread_mutex_lock(&this->mutex);
+	for (i = 0; i < this->num_clients; i++) {
+		client_p client = &this->clients[i];
+
+		written = flushClient(client);
+
+		// the rest of the last batch went out; this one is next
+		if (written >= 0 && client->pending == 0) {
+			memcpy(client->buffer, message, len);
+			client->pending = len;
+			n = flushClient(client);
+			written = (n < 0) ? n : written + n;
+		}
+
+		if (written >= 0) {
+			client->stalls = (written == 0 && client->pending > 0) ? client->stalls + 1 : 0;
+			if (client->stalls < AGENT_MAX_STALLS)
+				continue;
+		}
+
+		DPRINTF("Scheduler gone (%d)\n", client->sock);
+		close(client->sock);
+		this->clients[i] = this->clients[--this->num_clients];
+		i--;
+	}
+	pthread_mutex_unlock(&this->mutex);
+
+	return 0;
+}
+
+/*
+ *	Write what the socket takes of the pending batch, none of it left
+ *	once all went; the bytes written, or -1 if the client is gone
+ */
+int flushClient(struct client_tag *client)
+{
+	ssize_t nWrite;
+	int written = 0;
+
+	while (client->offset < client->pending) {
+		nWrite = send(client->sock, client->buffer + client->offset, client->pending - client->offset, MSG_NOSIGNAL);
+
+		if (nWrite < 0 && errno == EINTR)
+			continue;
+		if (nWrite < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return written;
+		if (nWrite <= 0)
+			return -1;
+		client->offset += nWrite;
+		written += nWrite;
+	}
+
+	client->offset = client->pending = 0;
+	return written;
+}
@@ -0,0 +1,62 @@
+#ifndef _AGENT_H_
+#define _AGENT_H_
+
+#include <pthread.h>
+#include <sys/types.h>
+#include "sampleCodec.h"
+
+#define AGENT_MAX_VMS			256
+#define AGENT_MAX_CLIENTS		8
+#define AGENT_MAX_STALLS		10		// periods in a row a client may take no bytes before it is dropped
+#define AGENT_DEFAULT_PERIOD	1000	// ms
+#define AGENT_DEFAULT_COMMAND	"xenonmon-do.py Inst_LLC -t 7200 -n 1 2> /dev/null"
+
+typedef struct sample_tag {
+	unsigned int	localID;
+	double			insts;		// retired instructions during the period
+	double			misses;		// LLC misses during the period
+} sample_t, *sample_p;
+
+/*
+ *	A scheduler connection; non-blocking, so one that stops reading cannot
+ *	hold up the period loop. The rest of a batch it took only part of is
+ *	kept and written before anything else; the batches it has no room for
+ *	meanwhile are skipped, which its seq shows.
+ */
+typedef struct client_tag {
+	int			sock;
+	size_t		offset;				// of the first byte of pending not written yet
+	size_t		pending;			// bytes of the batch in buffer
+	int			stalls;				// periods in a row it took no bytes
+	uint8_t		buffer[SAMPLE_BATCH_MAX(AGENT_MAX_VMS)];
+} client_t, *client_p;
+
+typedef struct agent_tag {
+	int			serv_sock;
+	pthread_t	accept_thread;
+
+	int			period;				// ms
+	const char	*command;			// local sampler
+	int			num_fake_vms;		// > 0: synthetic counters
+
+	// the sampler runs beside the period loop; restarted when it exits
+	pid_t		sampler;			// 0: not running
+	int			sampler_fd;			// its stdout, non-blocking
+	char		line[256];			// of its output, not ended yet
+	size_t		line_len;
+	int			num_pending;		// samples of the batch being read
+	sample_t	pending[AGENT_MAX_VMS];
+	unsigned int	seed;
+	double		intensity[AGENT_MAX_VMS];
+
+	unsigned long	seq;
+	int			num_samples;
+	sample_t	samples[AGENT_MAX_VMS];
+
+	pthread_mutex_t	mutex;			// protects clients
+	int			num_clients;
+	client_t	clients[AGENT_MAX_CLIENTS];
+
+} agent_t, *agent_p;
+
+#endif
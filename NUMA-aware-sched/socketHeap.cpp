@@ -0,0 +1,178 @@
+#include "socketHeap.h"
+
+// hostID starts from 1
+SocketHeap::SocketHeap(unsigned int nHosts, unsigned int nSockets)
+{
+	vector<unsigned int> numOfSockets(nHosts+1, nSockets);
+
+	numOfSockets[0] = 0;
+	init(numOfSockets);
+}
+
+SocketHeap::SocketHeap(const vector<unsigned int>& numOfSockets)
+{
+	init(numOfSockets);
+}
+
+void SocketHeap::init(const vector<unsigned int>& numOfSockets)
+{
+	unsigned int n = 0;
+
+	m_base.clear();
+	m_host.clear();
+	for ( unsigned int h = 0; h < numOfSockets.size(); h++ ) {
+		m_base.push_back(n);
+		n += numOfSockets[h];
+		m_host.resize(n, h);
+	}
+	m_base.push_back(n);
+
+	m_score.assign(n, 0.0);
+	m_maxPos.assign(n, -1);
+	m_minPos.assign(n, -1);
+
+	m_max.reserve(n);
+	m_min.reserve(n);
+}
+
+void SocketHeap::update(unsigned int hostID, unsigned int socket, double score)
+{
+	unsigned int i = id(hostID, socket);
+	double prev = m_score[i];
+
+	m_score[i] = score;
+
+	if ( m_maxPos[i] < 0 ) {
+		push(i);
+		return;
+	}
+
+	if ( score > prev ) {
+		siftUp(m_max, m_maxPos, 1, m_maxPos[i]);
+		siftDown(m_min, m_minPos, -1, m_minPos[i]);
+	} else if ( score < prev ) {
+		siftDown(m_max, m_maxPos, 1, m_maxPos[i]);
+		siftUp(m_min, m_minPos, -1, m_minPos[i]);
+	}
+}
+
+void SocketHeap::remove(unsigned int hostID, unsigned int socket)
+{
+	unsigned int i = id(hostID, socket);
+
+	if ( m_maxPos[i] >= 0 )
+		pop(i);
+}
+
+void SocketHeap::removeHost(unsigned int hostID)
+{
+	for ( unsigned int s = 0; s < m_base[hostID+1] - m_base[hostID]; s++ ) {
+		remove(hostID, s);
+	}
+}
+
+int SocketHeap::select(int degree, vector<socketKey>& high, vector<socketKey>& low)
+{
+	vector<unsigned int> taken;
+	unsigned int hosts[2];
+
+	high.clear();
+	low.clear();
+
+	while ( (int)high.size() < degree && !m_max.empty() ) {
+
+		high.push_back(key(m_max[0]));
+		low.push_back(key(m_min[0]));
+
+		// the hosts of this pair are left out of the next ones
+		hosts[0] = high.back().first;
+		hosts[1] = low.back().first;
+
+		for ( int h = 0; h < 2; h++ ) {
+			for ( unsigned int i = m_base[hosts[h]]; i < m_base[hosts[h]+1]; i++ ) {
+				if ( m_maxPos[i] >= 0 ) {
+					pop(i);
+					taken.push_back(i);
+				}
+			}
+		}
+	}
+
+	for ( size_t t = 0; t < taken.size(); t++ ) {
+		push(taken[t]);
+	}
+
+	return high.size();
+}
+
+void SocketHeap::push(unsigned int id)
+{
+	m_maxPos[id] = m_max.size();
+	m_max.push_back(id);
+	siftUp(m_max, m_maxPos, 1, m_max.size() - 1);
+
+	m_minPos[id] = m_min.size();
+	m_min.push_back(id);
+	siftUp(m_min, m_minPos, -1, m_min.size() - 1);
+}
+
+void SocketHeap::pop(unsigned int id)
+{
+	vector<unsigned int>* heap[2] = { &m_max, &m_min };
+	vector<int>* pos[2] = { &m_maxPos, &m_minPos };
+	int sign[2] = { 1, -1 };
+
+	for ( int h = 0; h < 2; h++ ) {
+		size_t i = (*pos[h])[id];
+		unsigned int last = heap[h]->back();
+
+		heap[h]->pop_back();
+		(*pos[h])[id] = -1;
+
+		if ( last == id )
+			continue;
+
+		// move the last one into the hole, then restore the order either way
+		(*heap[h])[i] = last;
+		(*pos[h])[last] = i;
+		siftUp(*heap[h], *pos[h], sign[h], i);
+		siftDown(*heap[h], *pos[h], sign[h], (*pos[h])[last]);
+	}
+}
+
+void SocketHeap::siftUp(vector<unsigned int>& heap, vector<int>& pos, int sign, size_t i)
+{
+	unsigned int id = heap[i];
+
+	while ( i > 0 ) {
+		size_t parent = (i - 1) / 2;
+		if ( sign * m_score[heap[parent]] >= sign * m_score[id] )
+			break;
+		heap[i] = heap[parent];
+		pos[heap[i]] = i;
+		i = parent;
+	}
+
+	heap[i] = id;
+	pos[id] = i;
+}
+
+void SocketHeap::siftDown(vector<unsigned int>& heap, vector<int>& pos, int sign, size_t i)
+{
+	unsigned int id = heap[i];
+	size_t n = heap.size();
+
+	while ( 2 * i + 1 < n ) {
+		size_t child = 2 * i + 1;
+		if ( child + 1 < n && sign * m_score[heap[child + 1]] > sign * m_score[heap[child]] )
+			child++;
+		if ( sign * m_score[id] >= sign * m_score[heap[child]] )
+			break;
+		heap[i] = heap[child];
+		pos[heap[i]] = i;
+		i = child;
+	}
+
+	heap[i] = id;
+	pos[id] = i;
+}
@@ -0,0 +1,63 @@
+#ifndef _SOCKET_HEAP_
+#define _SOCKET_HEAP_
+
+#include <vector>
+
+using namespace std;
+
+typedef pair<int , int > socketKey;		// (hostID, socket)
+
+/*
+ *	Miss rate of every socket in an indexed max-heap and an indexed
+ *	min-heap, so a score is updated or removed in O(log S) and the most and
+ *	least loaded sockets are always on top.
+ *
+ *	select() takes the top D pairs on distinct hosts in O(D log S): the
+ *	sockets of the hosts of each chosen pair are popped while the next
+ *	pair is chosen, and pushed back afterwards.
+ */
+class SocketHeap {
+
+public:
+	SocketHeap(unsigned int nHosts, unsigned int nSockets);
+	// numOfSockets[hostID] sockets on each host
+	SocketHeap(const vector<unsigned int>& numOfSockets);
+	~SocketHeap() {}
+
+	void	update(unsigned int hostID, unsigned int socket, double score);
+	void	remove(unsigned int hostID, unsigned int socket);
+	void	removeHost(unsigned int hostID);
+
+	bool	contains(unsigned int hostID, unsigned int socket) const	{ return m_maxPos[id(hostID, socket)] >= 0; }
+	double	score(unsigned int hostID, unsigned int socket) const	{ return m_score[id(hostID, socket)]; }
+	size_t	size() const	{ return m_max.size(); }
+
+	// pair i is (high[i], low[i]); no host is in two pairs. Returns the number of pairs.
+	int		select(int degree, vector<socketKey>& high, vector<socketKey>& low);
+
+private:
+	unsigned int	id(unsigned int hostID, unsigned int socket) const	{ return m_base[hostID] + socket; }
+	socketKey		key(unsigned int id) const	{ return socketKey(m_host[id], id - m_base[m_host[id]]); }
+
+	void	init(const vector<unsigned int>& numOfSockets);
+
+	void	push(unsigned int id);
+	void	pop(unsigned int id);
+
+	// sign 1: max-heap, -1: min-heap
+	void	siftUp(vector<unsigned int>& heap, vector<int>& pos, int sign, size_t i);
+	void	siftDown(vector<unsigned int>& heap, vector<int>& pos, int sign, size_t i);
+
+	vector<unsigned int>	m_base;		// [hostID] id of socket 0, [nHosts+1] number of ids
+
+	// [id]
+	vector<unsigned int>	m_host;
+	vector<double>			m_score;
+	vector<int>				m_maxPos;	// -1: not in the heaps
+	vector<int>				m_minPos;
+
+	vector<unsigned int>	m_max;		// ids
+	vector<unsigned int>	m_min;
+};
+
+#endif
@@ -0,0 +1,368 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <sstream>
+
+#include "sshSession.h"
+#include "controlPlane.h"
+
+#define SESSION_MARKER		"__SCHED_EOC_"
+
+// Slot checked out by a command
+typedef struct checkout_tag {
+	session_pool_t	*pool;
+	unsigned int	hostID;
+	session_t		*session;
+	bool			framed;		// a command is in flight on the session
+	bool			sent;		// the whole command was written to the session
+} checkout_t;
+
+static int		run_command(checkout_t *checkout, const string& hostName, const string& command, double deadline, string& output);
+static void		release_session(void *arg);
+static int		open_session(session_t *session, const string& hostName);
+static void		close_session(session_t *session, int sig);
+static int		write_all(int fd, const char *buf, size_t len);
+
+static double monotonic()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ *	Create an empty pool; sessions are connected lazily on first use
+ */
+int create_session_pool(struct session_pool_tag *pool, unsigned int nHosts, int poolSize)
+{
+	pthread_condattr_t attr;
+	int status;
+
+	pool->num_hosts = nHosts;
+	pool->pool_size = poolSize;
+
+	// hostID starts from 1
+	pool->session = new session_t* [nHosts+1];
+	pool->mutex = new pthread_mutex_t [nHosts+1];
+	pool->idle = new pthread_cond_t [nHosts+1];
+
+	// command deadlines are on the monotonic clock
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+
+	for ( unsigned int i = 0; i <= nHosts; i++ ) {
+		pool->session[i] = new session_t [poolSize];
+		memset(pool->session[i], 0x00, sizeof(session_t)*poolSize);
+
+		status = pthread_mutex_init(&pool->mutex[i], NULL);
+		if (status != 0)
+			return status;
+
+		status = pthread_cond_init(&pool->idle[i], &attr);
+		if (status != 0)
+			return status;
+	}
+	pthread_condattr_destroy(&attr);
+
+	// a dead ssh process must not kill the scheduler on write()
+	signal(SIGPIPE, SIG_IGN);
+
+	return 0;
+}
+
+void destroy_session_pool(struct session_pool_tag *pool)
+{
+	for ( unsigned int i = 0; i <= pool->num_hosts; i++ ) {
+		for ( int j = 0; j < pool->pool_size; j++ ) {
+			close_session(&pool->session[i][j], SIGTERM);
+		}
+		delete [] pool->session[i];
+		pthread_mutex_destroy(&pool->mutex[i]);
+		pthread_cond_destroy(&pool->idle[i]);
+	}
+
+	delete [] pool->session;
+	delete [] pool->mutex;
+	delete [] pool->idle;
+}
+
+/*
+ *	Run a command on a pooled session of the host within timeout (ms).
+ *	A broken channel is reconnected up to SSH_COMMAND_RETRIES times with a
+ *	growing backoff; a command still running at the deadline has its ssh
+ *	process killed and is not retried, since it may have taken effect.
+ *	With COMMAND_ONCE neither is a command the channel broke under after it
+ *	was sent: the remote shell may be running it still.
+ *	Returns 0 if the command completed (result->status is its exit status),
+ *	or -1 with result->status COMMAND_FAILED or COMMAND_TIMEOUT.
+ */
+int session_command(struct session_pool_tag *pool, unsigned int hostID, const string& hostName, const string& command, int timeout, command_result_t *result, int flags)
+{
+	checkout_t	checkout;
+	struct timespec ts;
+	double	begin, deadline, wait, backoff = SSH_RETRY_BACKOFF / 1000.0;
+	int		status = 0;
+
+	result->status = COMMAND_FAILED;
+	result->output.clear();
+	result->duration = 0.0;
+	result->attempts = 0;
+
+	if ( hostID > pool->num_hosts )
+		return -1;
+
+	begin = monotonic();
+	deadline = begin + timeout / 1000.0;
+	ts.tv_sec = (time_t)deadline;
+	ts.tv_nsec = (long)((deadline - ts.tv_sec) * 1e9);
+
+	checkout.pool = pool;
+	checkout.hostID = hostID;
+	checkout.session = NULL;
+	checkout.framed = false;
+	checkout.sent = false;
+
+	// 1. check out an idle slot, waiting no longer than the deadline
+	pthread_mutex_lock(&pool->mutex[hostID]);
+	pthread_cleanup_push((void (*)(void*))pthread_mutex_unlock, (void*)&pool->mutex[hostID]);
+
+	while ( checkout.session == NULL && status == 0 ) {
+		for ( int i = 0; i < pool->pool_size; i++ ) {
+			if ( !pool->session[hostID][i].busy ) {
+				checkout.session = &pool->session[hostID][i];
+				checkout.session->busy = true;
+				break;
+			}
+		}
+		if ( checkout.session == NULL && control_host() != 0 ) {
+			// a host round must not block its loop on the condition; look again shortly
+			pthread_mutex_unlock(&pool->mutex[hostID]);
+			control_sleep(SSH_SLOT_RECHECK);
+			pthread_mutex_lock(&pool->mutex[hostID]);
+			if ( monotonic() >= deadline )
+				status = ETIMEDOUT;
+		} else if ( checkout.session == NULL ) {
+			status = pthread_cond_timedwait(&pool->idle[hostID], &pool->mutex[hostID], &ts);
+		}
+	}
+
+	pthread_cleanup_pop(1);
+
+	if ( checkout.session == NULL ) {
+		result->status = COMMAND_TIMEOUT;
+		result->duration = monotonic() - begin;
+		return -1;
+	}
+
+	// 2. send the command, reconnecting if the channel was closed
+	pthread_cleanup_push(release_session, (void*)&checkout);
+
+	while ( result->attempts <= SSH_COMMAND_RETRIES ) {
+
+		if ( result->attempts > 0 ) {
+			wait = deadline - monotonic();
+			if ( wait > backoff )
+				wait = backoff;
+			if ( wait > 0 )
+				control_sleep((int)(wait * 1000.0));
+			backoff *= 2;
+		}
+
+		if ( monotonic() >= deadline )
+			break;
+
+		result->attempts++;
+		result->status = run_command(&checkout, hostName, command, deadline, result->output);
+
+		if ( result->status != COMMAND_FAILED )
+			break;
+		if ( (flags & COMMAND_ONCE) && checkout.sent )
+			break;
+	}
+
+	// 3. release the slot
+	pthread_cleanup_pop(1);
+
+	result->duration = monotonic() - begin;
+
+	return ( result->status >= 0 ) ? 0 : -1;
+}
+
+/*
+ *	Send one framed command and read its output up to the end-of-command
+ *	marker, which is followed by the exit status of the command.
+ */
+static int run_command(checkout_t *checkout, const string& hostName, const string& command, double deadline, string& output)
+{
+	session_t *session = checkout->session;
+	ostringstream marker, frame;
+	char	buffer[4096];
+	string	data;
+	size_t	pos = string::npos, eol = string::npos;
+	ssize_t	nRead;
+	int		remaining, nReady;
+
+	if ( session->pid == 0 && open_session(session, hostName) != 0 )
+		return COMMAND_FAILED;
+
+	marker << "\n" << SESSION_MARKER << ++session->seq << "__ ";
+
+	// stdin of the command is detached so it cannot eat the next frame
+	frame << "( " << command << " ) < /dev/null; printf '\\n%s%d\\n' '"
+		  << marker.str().substr(1) << "' $?\n";
+
+	checkout->framed = true;
+
+	if ( write_all(session->in, frame.str().c_str(), frame.str().size()) != 0 ) {
+		checkout->framed = false;
+		close_session(session, SIGTERM);
+		return COMMAND_FAILED;
+	}
+	checkout->sent = true;
+
+	while ( true ) {
+		pos = data.find(marker.str());
+		if ( pos != string::npos ) {
+			eol = data.find('\n', pos + marker.str().size());
+			if ( eol != string::npos )
+				break;
+		}
+
+		remaining = (int)((deadline - monotonic()) * 1000.0);
+		if ( remaining <= 0 ) {
+			// the remote command may keep running, but nothing waits for it
+			checkout->framed = false;
+			close_session(session, SIGKILL);
+			return COMMAND_TIMEOUT;
+		}
+
+		// suspends only this host when called from its round
+		nReady = control_poll(session->out, POLLIN, remaining);
+		if ( nReady < 0 && errno == EINTR )
+			continue;
+		if ( nReady == 0 )
+			continue;
+		if ( nReady < 0 )
+			break;
+
+		nRead = read(session->out, buffer, sizeof(buffer));
+		if ( nRead < 0 && errno == EINTR )
+			continue;
+		if ( nRead <= 0 )
+			break;
+		data.append(buffer, nRead);
+	}
+
+	checkout->framed = false;
+
+	if ( pos == string::npos || eol == string::npos ) {
+		close_session(session, SIGTERM);
+		return COMMAND_FAILED;
+	}
+
+	output = data.substr(0, pos);
+
+	return atoi(data.c_str() + pos + marker.str().size());
+}
+
+/*
+ *	Cleanup of a checked-out slot, also run if the caller is cancelled.
+ *	A half-read frame cannot be resumed by the next command.
+ */
+static void release_session(void *arg)
+{
+	checkout_t *checkout = (checkout_t*)arg;
+
+	if ( checkout->framed ) {
+		checkout->framed = false;
+		close_session(checkout->session, SIGKILL);
+	}
+
+	pthread_mutex_lock(&checkout->pool->mutex[checkout->hostID]);
+	checkout->session->busy = false;
+	pthread_cond_signal(&checkout->pool->idle[checkout->hostID]);
+	pthread_mutex_unlock(&checkout->pool->mutex[checkout->hostID]);
+}
+
+static int open_session(session_t *session, const string& hostName)
+{
+	int	toRemote[2], fromRemote[2];
+	pid_t pid;
+
+	// close-on-exec from the start: an ssh another thread forks meanwhile must not
+	// hold this session's stdin open; dup2 in the child clears it on the copies
+	if ( pipe2(toRemote, O_CLOEXEC) != 0 )
+		return -1;
+
+	if ( pipe2(fromRemote, O_CLOEXEC) != 0 ) {
+		close(toRemote[0]);
+		close(toRemote[1]);
+		return -1;
+	}
+
+	pid = fork();
+	if ( pid < 0 ) {
+		perror("fork() error");
+		close(toRemote[0]);	close(toRemote[1]);
+		close(fromRemote[0]); close(fromRemote[1]);
+		return -1;
+	}
+
+	if ( pid == 0 ) {
+		dup2(toRemote[0], STDIN_FILENO);
+		dup2(fromRemote[1], STDOUT_FILENO);
+		close(toRemote[0]);	close(toRemote[1]);
+		close(fromRemote[0]); close(fromRemote[1]);
+
+		execlp("ssh", "ssh", "-T", "-o", "BatchMode=yes", hostName.c_str(), "/bin/sh", (char*)NULL);
+		_exit(127);
+	}
+
+	close(toRemote[0]);
+	close(fromRemote[1]);
+
+	session->pid = pid;
+	session->in = toRemote[1];
+	session->out = fromRemote[0];
+
+	return 0;
+}
+
+static void close_session(session_t *session, int sig)
+{
+	if ( session->pid == 0 )
+		return;
+
+	close(session->in);
+	close(session->out);
+	kill(session->pid, sig);
+	waitpid(session->pid, NULL, 0);
+
+	session->pid = 0;
+}
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+	ssize_t nWrite;
+
+	while ( len > 0 ) {
+		nWrite = write(fd, buf, len);
+		if ( nWrite < 0 && errno == EINTR )
+			continue;
+		if ( nWrite <= 0 )
+			return -1;
+		buf += nWrite;
+		len -= nWrite;
+	}
+
+	return 0;
+}
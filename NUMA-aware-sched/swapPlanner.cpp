@@ -0,0 +1,196 @@
+#include <float.h>
+#include <algorithm>
+
+#include "swapPlanner.h"
+
+#define FORBIDDEN		1e15	// cost of a pair above the peak of the plan
+
+static double	pair_cost(const swap_candidate_t& high, const swap_candidate_t& low);
+static bool		match(const vector< vector<double> >& cost, double peak, vector<int>& owner);
+static bool		augment(int row, const vector< vector<double> >& cost, double peak, vector<int>& owner, vector<char>& visited);
+
+double plan_swaps(const vector<swap_candidate_t>& high, const vector<swap_candidate_t>& low, vector<int>& partner, const vector< vector<char> >* fits)
+{
+	size_t	nRows = high.size(), nCols = low.size() + high.size();
+	vector< vector<double> >	cost(nRows, vector<double>(nCols));
+	vector<double>	costs;
+	vector<int>		assignment, owner(nCols, -1), trial;
+	size_t	lo, hi, mid;
+	double	rowMin, bound = 0.0, peak;
+
+	partner.assign(nRows, -1);
+	if ( nRows == 0 )
+		return 0.0;
+
+	// 1. [high][low] after the swap, then [high][nLow + k] for leaving it alone
+	for ( size_t i = 0; i < nRows; i++ ) {
+		rowMin = DBL_MAX;
+		for ( size_t j = 0; j < nCols; j++ ) {
+			// above every peak, so neither the matching nor the assignment takes it
+			if ( j < low.size() && fits != NULL && !(*fits)[i][j] ) {
+				cost[i][j] = FORBIDDEN;
+				continue;
+			}
+			cost[i][j] = ( j < low.size() ) ? pair_cost(high[i], low[j]) : high[i].missRate;
+			rowMin = min(rowMin, cost[i][j]);
+			costs.push_back(cost[i][j]);
+		}
+		// no plan does better than the best choice of its worst row
+		bound = max(bound, rowMin);
+	}
+
+	// 2. the lowest peak that still lets every high socket have a distinct choice
+	sort(costs.begin(), costs.end());
+	costs.erase(unique(costs.begin(), costs.end()), costs.end());
+
+	lo = lower_bound(costs.begin(), costs.end(), bound) - costs.begin();
+	hi = costs.size() - 1;		// leaving every one alone is always feasible
+
+	// a matching found below the peak stays valid for every higher one
+	while ( lo < hi ) {
+		mid = (lo + hi) / 2;
+		trial = owner;
+		if ( match(cost, costs[mid], trial) ) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+			owner = trial;
+		}
+	}
+	peak = costs[lo];
+
+	// 3. the least total cost within that peak
+	for ( size_t i = 0; i < nRows; i++ ) {
+		for ( size_t j = 0; j < nCols; j++ ) {
+			if ( cost[i][j] > peak )
+				cost[i][j] = FORBIDDEN;
+		}
+	}
+
+	hungarian(cost, assignment);
+
+	for ( size_t i = 0; i < nRows; i++ ) {
+		if ( assignment[i] < (int)low.size() )
+			partner[i] = assignment[i];
+	}
+
+	return peak;
+}
+
+/*
+ *	Shortest augmenting paths with row and column potentials, O(n^2 m)
+ */
+double hungarian(const vector< vector<double> >& cost, vector<int>& assignment)
+{
+	int		n = cost.size(), m = n ? cost[0].size() : 0;
+	vector<double>	u(n+1, 0.0), v(m+1, 0.0), minv(m+1);
+	vector<int>		p(m+1, 0), way(m+1, 0);
+	vector<char>	used(m+1);
+	double	total = 0.0;
+
+	// 1-based; p[j] is the row of column j, column 0 is the row being added
+	for ( int i = 1; i <= n; i++ ) {
+		int j0 = 0, j1, i0;
+		double delta, cur;
+
+		p[0] = i;
+		minv.assign(m+1, DBL_MAX);
+		used.assign(m+1, 0);
+
+		do {
+			used[j0] = 1;
+			i0 = p[j0];
+			delta = DBL_MAX;
+			j1 = 0;
+
+			for ( int j = 1; j <= m; j++ ) {
+				if ( used[j] )
+					continue;
+				cur = cost[i0-1][j-1] - u[i0] - v[j];
+				if ( cur < minv[j] ) {
+					minv[j] = cur;
+					way[j] = j0;
+				}
+				if ( minv[j] < delta ) {
+					delta = minv[j];
+					j1 = j;
+				}
+			}
+
+			for ( int j = 0; j <= m; j++ ) {
+				if ( used[j] ) {
+					u[p[j]] += delta;
+					v[j] -= delta;
+				} else {
+					minv[j] -= delta;
+				}
+			}
+			j0 = j1;
+		} while ( p[j0] != 0 );
+
+		do {
+			j1 = way[j0];
+			p[j0] = p[j1];
+			j0 = j1;
+		} while ( j0 != 0 );
+	}
+
+	assignment.assign(n, -1);
+	for ( int j = 1; j <= m; j++ ) {
+		if ( p[j] != 0 ) {
+			assignment[p[j]-1] = j-1;
+			total += cost[p[j]-1][j-1];
+		}
+	}
+
+	return total;
+}
+
+// The larger of the two socket miss rates once the VMs traded places
+static double pair_cost(const swap_candidate_t& high, const swap_candidate_t& low)
+{
+	double highAfter = high.missRate - high.vmMissRate + low.vmMissRate;
+	double lowAfter = low.missRate - low.vmMissRate + high.vmMissRate;
+
+	return max(highAfter, lowAfter);
+}
+
+/*
+ *	Extend the matching in owner ([column] = row) with pairs costing at most
+ *	peak. Returns true if every row is matched.
+ */
+static bool match(const vector< vector<double> >& cost, double peak, vector<int>& owner)
+{
+	vector<char>	matched(cost.size(), 0), visited;
+	bool	complete = true;
+
+	for ( size_t j = 0; j < owner.size(); j++ ) {
+		if ( owner[j] >= 0 )
+			matched[owner[j]] = 1;
+	}
+
+	for ( size_t i = 0; i < cost.size(); i++ ) {
+		if ( matched[i] )
+			continue;
+		visited.assign(owner.size(), 0);
+		if ( !augment(i, cost, peak, owner, visited) )
+			complete = false;
+	}
+
+	return complete;
+}
+
+static bool augment(int row, const vector< vector<double> >& cost, double peak, vector<int>& owner, vector<char>& visited)
+{
+	for ( size_t j = 0; j < cost[row].size(); j++ ) {
+		if ( cost[row][j] > peak || visited[j] )
+			continue;
+		visited[j] = 1;
+		if ( owner[j] < 0 || augment(owner[j], cost, peak, owner, visited) ) {
+			owner[j] = row;
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,40 @@
+#ifndef _SWAP_PLANNER_
+#define _SWAP_PLANNER_
+
+#include <vector>
+#include "socketHeap.h"
+
+using namespace std;
+
+// A socket and the VM it would give up in a swap
+typedef struct swap_candidate_tag {
+	socketKey		socket;
+	double			missRate;		// of the socket
+	unsigned int	vm;
+	double			vmMissRate;
+} swap_candidate_t;
+
+/*
+ *	Pairs the hot VM of each of the D high sockets with the cold VM of one
+ *	of the D low sockets, or with none, as an assignment problem.
+ *	A pair costs the larger of the two socket miss rates after the swap; an
+ *	unpaired high socket costs its current miss rate.
+ *
+ *	The plan first minimizes the largest cost (the peak the swaps leave
+ *	behind), found by binary search over the costs with a bipartite matching
+ *	as the feasibility test, and then the sum of the costs within that peak
+ *	with the Hungarian method. O(D^3) for D pairs.
+ *
+ *	A pair the hosts have no room for, (*fits)[i][j] == 0, is never planned;
+ *	without fits every pair may be.
+ *
+ *	partner[i] is the index of the low socket of high[i], or -1.
+ *	Returns the peak of the plan.
+ */
+double	plan_swaps(const vector<swap_candidate_t>& high, const vector<swap_candidate_t>& low, vector<int>& partner, const vector< vector<char> >* fits = NULL);
+
+// Min-cost assignment of every row to a distinct column (rows <= columns).
+// Returns the total cost; assignment[row] is the column.
+double	hungarian(const vector< vector<double> >& cost, vector<int>& assignment);
+
+#endif
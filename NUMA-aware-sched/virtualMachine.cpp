@@ -1,17 +1,150 @@
+#include <string.h>
 #include "virtualMachine.h"
+#include "migrationCost.h"
 
-VirtualMachine::VirtualMachine(unsigned int key, unsigned int hostID, unsigned int localID, unsigned int cpuAffinity)
+#define NAME_TABLE_MIN_SLOTS	64
+
+VMRegistry::VMRegistry()
+{
+	m_nameTable.assign(NAME_TABLE_MIN_SLOTS, 0);
+}
+
+VMRegistry::~VMRegistry()
+{
+}
+
+void VMRegistry::reserve(size_t nVMs)
+{
+	m_hostID.reserve(nVMs);
+	m_localID.reserve(nVMs);
+	m_nameID.reserve(nVMs);
+	m_cpuAffinity.reserve(nVMs);
+	m_numOfVCPUs.reserve(nVMs);
+	m_numRetiredInsts.reserve(nVMs);
+	m_numLLCMisses.reserve(nVMs);
+	m_missRate.reserve(nVMs);
+	m_memory.reserve(nVMs);
+	m_dirtyRate.reserve(nVMs);
+	m_dirtyStamp.reserve(nVMs);
+	m_state.reserve(nVMs);
+	m_nameOffset.reserve(nVMs);
+
+	if ( m_nameTable.size() < nVMs * 2 ) {
+		size_t nSlots = m_nameTable.size();
+		while ( nSlots < nVMs * 2 )
+			nSlots *= 2;
+		rehash(nSlots);
+	}
+}
+
+/*
+ *	Returns the key of the new VM
+ */
+unsigned int VMRegistry::add(const string& name, unsigned int hostID, unsigned int localID, unsigned int cpuAffinity)
+{
+	unsigned int key = m_hostID.size();
+
+	m_nameID.push_back(intern(name));
+	m_hostID.push_back(hostID);
+	m_localID.push_back(localID);
+	m_cpuAffinity.push_back(cpuAffinity);
+	m_numOfVCPUs.push_back(1);
+	m_numRetiredInsts.push_back(0.0);
+	m_numLLCMisses.push_back(0.0);
+	m_missRate.push_back(0.0);
+	m_memory.push_back(0);
+	m_dirtyRate.push_back(DIRTY_RATE_DEFAULT);
+	m_dirtyStamp.push_back(0.0);
+	m_state.push_back(VM_RUNNING);
+
+	return key;
+}
+
+unsigned int VMRegistry::intern(const string& name)
+{
+	unsigned int id = find(name);
+	size_t mask, slot;
+
+	if ( id != VM_NONE )
+		return id;
+
+	id = m_nameOffset.size();
+	m_nameOffset.push_back(m_namePool.size());
+	m_namePool.insert(m_namePool.end(), name.c_str(), name.c_str() + name.size() + 1);
+
+	if ( (id + 1) * 2 > m_nameTable.size() ) {
+		rehash(m_nameTable.size() * 2);
+	} else {
+		mask = m_nameTable.size() - 1;
+		slot = hash(name.c_str(), name.size()) & mask;
+		while ( m_nameTable[slot] != 0 )
+			slot = (slot + 1) & mask;
+		m_nameTable[slot] = id + 1;
+	}
+
+	return id;
+}
+
+unsigned int VMRegistry::find(const string& name) const
 {
-	m_key = key;
-	m_hostID = hostID;
-	m_localID = localID;
+	size_t mask = m_nameTable.size() - 1;
+	size_t slot = hash(name.c_str(), name.size()) & mask;
+	unsigned int id;
 
-	// m_name = name;
-	m_cpuAffinity = cpuAffinity;
+	while ( (id = m_nameTable[slot]) != 0 ) {
+		if ( strcmp(&m_namePool[m_nameOffset[id - 1]], name.c_str()) == 0 )
+			return id - 1;
+		slot = (slot + 1) & mask;
+	}
 
-	m_numRetiredInsts = 0.0;
-	m_numLLCMisses = 0.0;
+	return VM_NONE;
+}
 
-	m_state = 0;
+size_t VMRegistry::footprint() const
+{
+	return m_hostID.capacity() * sizeof(unsigned int)
+		 + m_localID.capacity() * sizeof(unsigned int)
+		 + m_nameID.capacity() * sizeof(unsigned int)
+		 + m_cpuAffinity.capacity() * sizeof(unsigned int)
+		 + m_numOfVCPUs.capacity() * sizeof(unsigned int)
+		 + m_numRetiredInsts.capacity() * sizeof(double)
+		 + m_numLLCMisses.capacity() * sizeof(double)
+		 + m_missRate.capacity() * sizeof(double)
+		 + m_memory.capacity() * sizeof(unsigned int)
+		 + m_dirtyRate.capacity() * sizeof(double)
+		 + m_dirtyStamp.capacity() * sizeof(double)
+		 + m_state.capacity() * sizeof(unsigned char)
+		 + m_nameOffset.capacity() * sizeof(unsigned int)
+		 + m_namePool.capacity() * sizeof(char)
+		 + m_nameTable.capacity() * sizeof(unsigned int);
 }
 
+// FNV-1a
+unsigned int VMRegistry::hash(const char* name, size_t len)
+{
+	unsigned int h = 2166136261u;
+
+	for ( size_t i = 0; i < len; i++ ) {
+		h ^= (unsigned char)name[i];
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+// nSlots is a power of 2
+void VMRegistry::rehash(size_t nSlots)
+{
+	size_t mask = nSlots - 1, slot;
+	const char* name;
+
+	m_nameTable.assign(nSlots, 0);
+
+	for ( unsigned int id = 0; id < m_nameOffset.size(); id++ ) {
+		name = &m_namePool[m_nameOffset[id]];
+		slot = hash(name, strlen(name)) & mask;
+		while ( m_nameTable[slot] != 0 )
+			slot = (slot + 1) & mask;
+		m_nameTable[slot] = id + 1;
+	}
+}
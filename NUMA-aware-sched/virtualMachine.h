@@ -2,9 +2,17 @@
 #define _VIRTUAL_MACHINE_
 
 #include <iostream>
+#include <string>
+#include <vector>
 
 using namespace std;
 
+#define VM_NONE			((unsigned int)-1)	// no such VM or name
+
+// state of a VM
+#define VM_RUNNING		0
+#define VM_MIGRATING	1
+
 class Compare : unary_function<pair<unsigned int, double>, bool>
 {
 public:
@@ -15,40 +23,95 @@ public:
 };
 
 
-class VirtualMachine{
+/*
+ *	Registry of the virtual machines as parallel arrays indexed by a dense
+ *	key (0, 1, ...), so a pass over one attribute of every VM reads
+ *	contiguous memory. Names are interned once into a single pool and a VM
+ *	refers to its name by id.
+ *
+ *	VMs are only added while initializing; the arrays do not grow after
+ *	that. The attributes of a VM are written by whichever thread handles
+ *	it at the time (a local round, an executor worker, the index) while
+ *	others read them, so every one is loaded and stored atomically: a
+ *	reader sees the old value or the new one, never a torn one, but two
+ *	attributes are not updated together; hostID and localID change together
+ *	only under the lock of VMIndex.
+ */
+class VMRegistry {
 
 public:
-	VirtualMachine(unsigned int key, unsigned int hostID, unsigned int localID, unsigned int cpuAffinity);
-	//VirtualMachine(unsigned int key, unsigned int hostID, unsigned int localID, string name, string cpuAffinity);
-	~VirtualMachine();
-
-	unsigned int		getKey()	{ return m_key;	}
-	//string	getName() { return m_name; }
-	unsigned int		getHostID()	{ return m_hostID; }
-	unsigned int		getLocalID()	{ return m_localID; }
-	unsigned int		getCPUAffinity()	{ return m_cpuAffinity; }
-	double	getNumRetiredInsts()	{ return m_numRetiredInsts; }
-	double	getNumLLCMisses()	{ return m_numLLCMisses; }
-	int		getState()		{  return m_state; }
-
-	void	setHostID(unsigned int hostID)		{	m_hostID = hostID; }
-	void	setLocalID(unsigned int localID)	{	m_localID = localID; }
-	void	setCPUAffinity(unsigned int cpuAffinity)	{	m_cpuAffinity = cpuAffinity; }
-	void	setNumRetiredInsts(double numRetiredInsts)	{ m_numRetiredInsts = numRetiredInsts; }
-	void	setNumLLCMisses(double numLLCMisses)	{ m_numLLCMisses = numLLCMisses; }
-	void	setState(int state)	{ m_state = state; }
+	VMRegistry();
+	~VMRegistry();
+
+	void			reserve(size_t nVMs);
+	unsigned int	add(const string& name, unsigned int hostID, unsigned int localID, unsigned int cpuAffinity);
+
+	size_t			size() const	{ return m_hostID.size(); }
+	bool			contains(unsigned int key) const	{ return key < m_hostID.size(); }
+
+	// id of a name, added to the pool if it is new
+	unsigned int	intern(const string& name);
+	// id of a name, or VM_NONE
+	unsigned int	find(const string& name) const;
+
+	const char*		name(unsigned int key) const	{ return &m_namePool[m_nameOffset[m_nameID[key]]]; }
+	unsigned int	nameID(unsigned int key) const	{ return m_nameID[key]; }
 
+	unsigned int	hostID(unsigned int key) const	{ return load(m_hostID, key); }
+	unsigned int	localID(unsigned int key) const	{ return load(m_localID, key); }
+	unsigned int	cpuAffinity(unsigned int key) const	{ return load(m_cpuAffinity, key); }
+	unsigned int	numOfVCPUs(unsigned int key) const	{ return load(m_numOfVCPUs, key); }
+	double			numRetiredInsts(unsigned int key) const	{ return load(m_numRetiredInsts, key); }
+	double			numLLCMisses(unsigned int key) const	{ return load(m_numLLCMisses, key); }
+	double			missRate(unsigned int key) const	{ return load(m_missRate, key); }
+	unsigned int	memory(unsigned int key) const	{ return load(m_memory, key); }
+	double			dirtyRate(unsigned int key) const	{ return load(m_dirtyRate, key); }
+	double			dirtyStamp(unsigned int key) const	{ return load(m_dirtyStamp, key); }
+	int				state(unsigned int key) const	{ return load(m_state, key); }
+
+	void	setHostID(unsigned int key, unsigned int hostID)		{ store(m_hostID, key, hostID); }
+	void	setLocalID(unsigned int key, unsigned int localID)		{ store(m_localID, key, localID); }
+	void	setCPUAffinity(unsigned int key, unsigned int cpuAffinity)	{ store(m_cpuAffinity, key, cpuAffinity); }
+	void	setNumOfVCPUs(unsigned int key, unsigned int numOfVCPUs)	{ store(m_numOfVCPUs, key, numOfVCPUs); }
+	void	setNumRetiredInsts(unsigned int key, double numRetiredInsts)	{ store(m_numRetiredInsts, key, numRetiredInsts); }
+	void	setNumLLCMisses(unsigned int key, double numLLCMisses)	{ store(m_numLLCMisses, key, numLLCMisses); }
+	void	setMissRate(unsigned int key, double missRate)	{ store(m_missRate, key, missRate); }
+	void	setMemory(unsigned int key, unsigned int memory)	{ store(m_memory, key, memory); }
+	void	setDirtyRate(unsigned int key, double dirtyRate, double stamp)	{ store(m_dirtyRate, key, dirtyRate); store(m_dirtyStamp, key, stamp); }
+	void	setState(unsigned int key, int state)	{ store(m_state, key, (unsigned char)state); }
+
+	// bytes allocated for the arrays and the name pool
+	size_t	footprint() const;
 
 private:
-	unsigned int	m_key;
-	//string			m_name;		// Key
-	unsigned int	m_hostID;
-	unsigned int	m_localID;
-
-	unsigned int	m_cpuAffinity;
-	double			m_numRetiredInsts;
-	double			m_numLLCMisses;
-	int				m_state;		// 0: Running 1:Migrating
+	static unsigned int	hash(const char* name, size_t len);
+
+	template <typename T>
+	static T	load(const vector<T>& v, unsigned int key)	{ T x; __atomic_load(&v[key], &x, __ATOMIC_RELAXED); return x; }
+	template <typename T>
+	static void	store(vector<T>& v, unsigned int key, T x)	{ __atomic_store(&v[key], &x, __ATOMIC_RELAXED); }
+	void	rehash(size_t nSlots);
+
+	// [key]
+	vector<unsigned int>	m_hostID;
+	vector<unsigned int>	m_localID;
+	vector<unsigned int>	m_nameID;
+	vector<unsigned int>	m_cpuAffinity;	// home socket, of vCPU 0
+	vector<unsigned int>	m_numOfVCPUs;
+	vector<double>			m_numRetiredInsts;
+	vector<double>			m_numLLCMisses;
+	vector<double>			m_missRate;		// of the last local round
+	vector<unsigned int>	m_memory;		// MB
+	vector<double>			m_dirtyRate;	// pages/s, last observed
+	vector<double>			m_dirtyStamp;	// monotonic sec it was observed, 0: never
+	vector<unsigned char>	m_state;		// VM_RUNNING, VM_MIGRATING
+
+	// [name id]
+	vector<unsigned int>	m_nameOffset;	// into m_namePool
+	vector<char>			m_namePool;		// NUL-terminated names
+
+	// open addressing, name id + 1 (0: empty slot), at most half full
+	vector<unsigned int>	m_nameTable;
 };
 
 
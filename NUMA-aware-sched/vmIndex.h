@@ -0,0 +1,41 @@
+#ifndef _VM_INDEX_
+#define _VM_INDEX_
+
+#include <pthread.h>
+#include <tr1/unordered_map>
+#include "virtualMachine.h"
+
+/*
+ *	Index of the virtual machines by (hostID, localID), the key the counter
+ *	samples carry. A VM must be moved with relocate() so the index follows
+ *	its hostID and localID in the registry.
+ */
+class VMIndex {
+
+public:
+	VMIndex(VMRegistry& vms);
+	~VMIndex();
+
+	void			insert(unsigned int vm);
+	// key of the VM, or VM_NONE
+	unsigned int	lookup(unsigned int hostID, unsigned int localID);
+
+	// set the hostID and localID of vm and re-key it
+	void	relocate(unsigned int vm, unsigned int hostID, unsigned int localID);
+	// vm is on hostID under a localID not known yet; out of the index until it is relocated
+	void	detach(unsigned int vm, unsigned int hostID);
+	// the VMs detached to the host
+	void	detached(unsigned int hostID, vector<unsigned int>& vms);
+
+	size_t	size();
+
+private:
+	static unsigned long long	key(unsigned int hostID, unsigned int localID)	{ return ((unsigned long long)hostID << 32) | localID; }
+
+	VMRegistry&		m_vms;
+	tr1::unordered_map<unsigned long long, unsigned int>	m_index;
+	vector<unsigned int>	m_detached;
+	pthread_rwlock_t	m_lock;
+};
+
+#endif
@@ -0,0 +1,425 @@
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+#include <cctype>
+#include <map>
+#include <algorithm>
+#include <unistd.h>
+
+#include "xenInterface.h"
+
+#define INVENTORY_SEPARATOR		"__VCPU_LIST__"
+
+XenInterface::XenInterface(session_pool_t* pool, const string& hostPrefix)
+{
+	m_pool = pool;
+	m_hostPrefix = hostPrefix;
+}
+
+string XenInterface::hostName(unsigned int hostID)
+{
+	ostringstream oss;
+	oss << m_hostPrefix << setw(2) << setfill('0') << hostID;
+	return oss.str();
+}
+
+/*
+ *	Fails on a broken channel, a timeout or a nonzero exit status
+ */
+int XenInterface::command(unsigned int hostID, const string& cmd, string& output, int timeout, int flags)
+{
+	command_result_t result;
+
+	//cout << hostName(hostID) << " " << cmd << endl;
+	if ( session_command(m_pool, hostID, hostName(hostID), cmd, timeout, &result, flags) != 0 ) {
+		cerr << "[" << hostID << "] " << (result.status == COMMAND_TIMEOUT ? "Timeout" : "Channel failed")
+			 << " after " << result.duration << " sec, " << result.attempts << " attempts: " << cmd << endl;
+		return -1;
+	}
+
+	output = result.output;
+
+	if ( result.status != 0 ) {
+		cerr << "[" << hostID << "] Exit status " << result.status
+			 << " in " << result.duration << " sec: " << cmd << endl;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ *	Whole inventory of the host in a single round trip:
+ *	"xl list" and "xl vcpu-list" separated by a marker line
+ */
+int XenInterface::listVMs(unsigned int hostID, vector<vmInfo>& vms)
+{
+	string result, line;
+	vms.clear();
+
+	if ( command(hostID, "xl list && echo " INVENTORY_SEPARATOR " && xl vcpu-list", result) != 0 )
+		return -1;
+
+	istringstream lines(result);
+
+	// 1. name, domid and memory of each domain
+	getline(lines, line);		// header
+	while ( getline(lines, line) && line != INVENTORY_SEPARATOR ) {
+		istringstream iss(line);
+		vmInfo info;
+
+		if ( !(iss >> info.name >> info.localID >> info.memory >> info.numOfVCPUs) )
+			continue;
+		if ( info.localID == 0 ) continue;	// Except for Domain-0
+
+		vms.push_back(info);
+	}
+
+	if ( line != INVENTORY_SEPARATOR )
+		return -1;
+
+	// 2. cpu-affinity of vCPU 0 of each domain
+	getline(lines, line);		// header
+	while ( getline(lines, line) ) {
+		istringstream iss(line);
+		string name, state, time, affinity;
+		unsigned int localID, vcpu, cpu;
+
+		if ( !(iss >> name >> localID >> vcpu >> cpu >> state >> time >> affinity) )
+			continue;
+		if ( vcpu != 0 ) continue;
+
+		for ( unsigned int i = 0; i < vms.size(); i++ ) {
+			if ( vms[i].localID == localID ) {
+				vms[i].cpuAffinity = affinity;
+				break;
+			}
+		}
+	}
+
+	return 0;
+}
+
+int XenInterface::getLocalID(unsigned int hostID, const string& name, unsigned int& localID)
+{
+	string result;
+
+	if ( command(hostID, "xm list | grep -Rw " + name + " | awk '{print $2}'", result) != 0 )
+		return -1;
+
+	// no such domain on the host; dom0 is never one of ours
+	if ( atoi(result.c_str()) <= 0 )
+		return -1;
+
+	localID = atoi(result.c_str());
+	return 0;
+}
+
+int XenInterface::getCPUAffinity(unsigned int hostID, const string& name, string& cpuAffinity)
+{
+	string result;
+
+	if ( command(hostID, "xm vcpu-list | grep -Rw " + name + " | awk '{print $7}'", result) != 0 )
+		return -1;
+
+	istringstream iss(result);
+	if ( !(iss >> cpuAffinity) )
+		return -1;
+
+	return 0;
+}
+
+/*
+ *	Sockets and nodes from "xl info -n": a cpu_topology line
+ *	"cpu: core socket node" per cpu and a numa_info line
+ *	"node: memsize memfree distances" per node. Xen does not show the
+ *	caches to Domain-0, so each socket is taken as one LLC domain.
+ */
+int XenInterface::getTopology(unsigned int hostID, hostTopology& topology)
+{
+	string result, line, section;
+	map<unsigned int, vector<unsigned int> >	cpus;		// [socket]
+	map<unsigned int, vector<unsigned int> >	cores;
+	map<unsigned int, unsigned int>				node;
+	map<unsigned int, vector<unsigned int> >::iterator	it;
+
+	if ( command(hostID, "xl info -n", result) != 0 )
+		return -1;
+
+	topology.socketCPUs.clear();
+	topology.numOfCores.clear();
+	topology.socketNode.clear();
+	topology.nodeMemory.clear();
+
+	istringstream lines(result);
+	while ( getline(lines, line) ) {
+		istringstream iss(line);
+		char colon;
+		unsigned int id, core, socket, nodeID, memsize;
+
+		if ( line.find("cpu_topology") == 0 || line.find("numa_info") == 0 ) {
+			section = line.substr(0, line.find_first_of(" \t:"));
+			continue;
+		}
+
+		// the rows of a table are indented; its header aside, the next "key : value" line ends it
+		if ( !line.empty() && !isspace(line[0]) && line.find("cpu:") != 0 && line.find("node:") != 0 ) {
+			section.clear();
+			continue;
+		}
+
+		if ( section == "cpu_topology" && (iss >> id >> colon >> core >> socket >> nodeID) ) {
+			cpus[socket].push_back(id);
+			if ( find(cores[socket].begin(), cores[socket].end(), core) == cores[socket].end() )
+				cores[socket].push_back(core);
+			if ( node.find(socket) == node.end() )
+				node[socket] = nodeID;
+		} else if ( section == "numa_info" && (iss >> id >> colon >> memsize) ) {
+			if ( topology.nodeMemory.size() <= id )
+				topology.nodeMemory.resize(id + 1, 0);
+			topology.nodeMemory[id] = memsize;
+		}
+	}
+
+	for ( it = cpus.begin(); it != cpus.end(); it++ ) {
+		topology.socketCPUs.push_back(cpuset_string(it->second));
+		topology.numOfCores.push_back(cores[it->first].size());
+		topology.socketNode.push_back(node[it->first]);
+	}
+	topology.llcCPUs = topology.socketCPUs;
+
+	return topology.socketCPUs.empty() ? -1 : 0;
+}
+
+int XenInterface::startMonitoring(unsigned int hostID)
+{
+	string result;
+
+	if ( command(hostID, "xenonmon-set.py Inst_LLC -t 7200 -n 1 ", result) != 0 )
+		return -1;
+
+	cout << result << endl;
+	return 0;
+}
+
+int XenInterface::stopMonitoring(unsigned int hostID)
+{
+	string result;
+
+	if ( command(hostID, "xenonmon-unset.py Inst_LLC -t 7200 -n 1", result) != 0 )
+		return -1;
+
+	cout << result << endl;
+	return 0;
+}
+
+int XenInterface::readCounters(unsigned int hostID, vector<counterSample>& samples)
+{
+	string result, line;
+
+	samples.clear();
+
+	if ( command(hostID, "xenonmon-do.py Inst_LLC -t 7200 -n 1 2> /dev/null", result) != 0 )
+		return -1;
+
+	/*
+	 *	For each virtual machine, a line "domid insts misses", or a line
+	 *	"domid vcpu insts misses" for each of its vCPUs when they are
+	 *	counted one by one
+	 */
+	istringstream lines(result);
+	while ( getline(lines, line) ) {
+		istringstream iss(line);
+		vector<double> field;
+		double value;
+		vcpuSample vcpu;
+
+		while ( iss >> value ) {
+			field.push_back(value);
+		}
+		if ( field.size() < 3 || field[0] == 0 ) continue;	// Except for Domain-0
+
+		if ( samples.empty() || samples.back().localID != (unsigned int)field[0] || field.size() == 3 ) {
+			counterSample sample;
+
+			sample.localID = (unsigned int)field[0];
+			sample.numRetiredInsts = 0.0;
+			sample.numLLCMisses = 0.0;
+			samples.push_back(sample);
+		}
+
+		counterSample& sample = samples.back();
+
+		if ( field.size() == 3 ) {
+			sample.numRetiredInsts = field[1];
+			sample.numLLCMisses = field[2];
+		} else {
+			vcpu.vcpu = (unsigned int)field[1];
+			vcpu.numRetiredInsts = field[2];
+			vcpu.numLLCMisses = field[3];
+
+			sample.numRetiredInsts += vcpu.numRetiredInsts;
+			sample.numLLCMisses += vcpu.numLLCMisses;
+			sample.vcpus.push_back(vcpu);
+		}
+	}
+
+	return 0;
+}
+
+int XenInterface::pinVCPU(unsigned int hostID, const string& name, unsigned int vcpu, const string& cpuAffinity)
+{
+	ostringstream oss;
+	string result;
+
+	// must use xm insted of xl
+	oss << "xm vcpu-pin " << name << " " << vcpu << " " << cpuAffinity;
+
+	return command(hostID, oss.str(), result);
+}
+
+/*
+ *	All the pins of a domain in one round trip; "all" when they are the same
+ */
+int XenInterface::pinVCPUs(unsigned int hostID, const string& name, const vector<string>& cpuAffinity)
+{
+	ostringstream oss;
+	string result;
+	unsigned int vcpu;
+
+	if ( cpuAffinity.empty() )
+		return 0;
+
+	for ( vcpu = 1; vcpu < cpuAffinity.size() && cpuAffinity[vcpu] == cpuAffinity[0]; vcpu++ )
+		;
+
+	if ( vcpu == cpuAffinity.size() ) {
+		oss << "xm vcpu-pin " << name << " all " << cpuAffinity[0];
+	} else {
+		for ( vcpu = 0; vcpu < cpuAffinity.size(); vcpu++ ) {
+			if ( vcpu > 0 )
+				oss << " && ";
+			oss << "xm vcpu-pin " << name << " " << vcpu << " " << cpuAffinity[vcpu];
+		}
+	}
+
+	return command(hostID, oss.str(), result);
+}
+
+int XenInterface::migrate(unsigned int srcHostID, unsigned int destHostID, const string& name, int node)
+{
+	string remoteCmd, result;
+
+	if ( node == 1) {
+		remoteCmd = "xm migrate -l -n 1 " + name + " " + hostName(destHostID);
+	} else {
+		remoteCmd = "xm migrate -l " + name + " " + hostName(destHostID);
+	}
+
+	if ( command(srcHostID, remoteCmd, result, XEN_MIGRATE_TIMEOUT, COMMAND_ONCE) == 0 )
+		return 0;
+
+	// a broken channel or a timeout tells nothing of the migration, which may have gone through or still run
+	return settleMigration(srcHostID, destHostID, name);
+}
+
+/*
+ *	Where a domain whose migration did not report ended up: 0 once it is
+ *	on the destination alone, -1 once on the source alone. While it is on
+ *	both hosts or neither answers, it is looked for again until
+ *	XEN_SETTLE_TIMEOUT, and then taken as not moved.
+ */
+int XenInterface::settleMigration(unsigned int srcHostID, unsigned int destHostID, const string& name)
+{
+	unsigned int localID;
+	bool onSource, onDest;
+
+	for ( int waited = 0; ; waited += XEN_SETTLE_INTERVAL ) {
+		onDest = ( getLocalID(destHostID, name, localID) == 0 );
+		onSource = ( getLocalID(srcHostID, name, localID) == 0 );
+
+		if ( onDest && !onSource ) {
+			cerr << "[" << srcHostID << "] " << name << " arrived on " << destHostID << " anyway" << endl;
+			return 0;
+		}
+		if ( onSource && !onDest )
+			return -1;
+
+		if ( waited >= XEN_SETTLE_TIMEOUT )
+			break;
+		sleep(XEN_SETTLE_INTERVAL);
+	}
+
+	cerr << "[" << srcHostID << "] " << name << " is " << ( onSource ? "on both hosts" : "on neither host" )
+		 << " after " << XEN_SETTLE_TIMEOUT << " sec, taken as not moved" << endl;
+	return -1;
+}
+
+int XenInterface::getNUMAPages(unsigned int hostID, unsigned int localID, vector<int>& numOfPages)
+{
+	ostringstream remoteCmd;
+	string result, line;
+	int pages;
+
+	remoteCmd << "./getNUMA-affinity.sh " << localID;
+	if ( command(hostID, remoteCmd.str(), result) != 0 )
+		return -1;
+
+	istringstream cmdResult(result);
+	getline(cmdResult, line);
+
+	numOfPages.clear();
+	istringstream iss(line);
+	while ( iss >> pages ) {
+		numOfPages.push_back(pages);
+	}
+
+	return numOfPages.empty() ? -1 : 0;
+}
+
+int XenInterface::migratePages(unsigned int hostID, unsigned int localID, unsigned int node, int maxPages, int& moved)
+{
+	ostringstream remoteCmd;
+	string result;
+
+	// the remote pages of the domain, in address order, the number moved on the first line
+	remoteCmd << "./migrateNUMA-pages.sh " << localID << " " << node << " " << maxPages;
+	if ( command(hostID, remoteCmd.str(), result) != 0 )
+		return -1;
+
+	istringstream cmdResult(result);
+	if ( !(cmdResult >> moved) )
+		return -1;
+
+	return 0;
+}
+
+int XenInterface::getDirtyRates(unsigned int hostID, const vector<unsigned int>& localIDs, vector<dirtyRateSample>& rates)
+{
+	ostringstream remoteCmd;
+	string result, line;
+	dirtyRateSample sample;
+
+	rates.clear();
+	if ( localIDs.empty() )
+		return 0;
+
+	// pages the log-dirty mode of the domains counted over the same second, "<domid> <pages/s>" a line
+	remoteCmd << "./getDirtyRates.sh";
+	for ( unsigned int i = 0; i < localIDs.size(); i++ ) {
+		remoteCmd << " " << localIDs[i];
+	}
+	if ( command(hostID, remoteCmd.str(), result) != 0 )
+		return -1;
+
+	istringstream cmdResult(result);
+	while ( getline(cmdResult, line) ) {
+		istringstream iss(line);
+
+		if ( iss >> sample.localID >> sample.dirtyRate )
+			rates.push_back(sample);
+	}
+
+	return 0;
+}
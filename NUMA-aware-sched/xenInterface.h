@@ -0,0 +1,47 @@
+#ifndef _XEN_INTERFACE_
+#define _XEN_INTERFACE_
+
+#include "remoteInterface.h"
+#include "sshSession.h"
+
+#define XEN_COMMAND_TIMEOUT		10000	// ms
+#define XEN_MIGRATE_TIMEOUT		300000	// ms, a live migration copies the whole memory
+#define XEN_SETTLE_INTERVAL		5		// sec between two looks for a domain whose migration did not report
+#define XEN_SETTLE_TIMEOUT		300		// sec, then it is taken as still on its source
+
+/*
+ *	Driver for Xen hosts managed with xl/xm over the ssh session pool
+ */
+class XenInterface : public RemoteInterface {
+
+public:
+	XenInterface(session_pool_t* pool, const string& hostPrefix);
+	~XenInterface() {}
+
+	int	listVMs(unsigned int hostID, vector<vmInfo>& vms);
+	int	getLocalID(unsigned int hostID, const string& name, unsigned int& localID);
+	int	getCPUAffinity(unsigned int hostID, const string& name, string& cpuAffinity);
+	int	getTopology(unsigned int hostID, hostTopology& topology);
+
+	int	startMonitoring(unsigned int hostID);
+	int	stopMonitoring(unsigned int hostID);
+	int	readCounters(unsigned int hostID, vector<counterSample>& samples);
+
+	int	pinVCPU(unsigned int hostID, const string& name, unsigned int vcpu, const string& cpuAffinity);
+	int	pinVCPUs(unsigned int hostID, const string& name, const vector<string>& cpuAffinity);
+	int	migrate(unsigned int srcHostID, unsigned int destHostID, const string& name, int node = 0);
+
+	int	getNUMAPages(unsigned int hostID, unsigned int localID, vector<int>& numOfPages);
+	int	migratePages(unsigned int hostID, unsigned int localID, unsigned int node, int maxPages, int& moved);
+	int	getDirtyRates(unsigned int hostID, const vector<unsigned int>& localIDs, vector<dirtyRateSample>& rates);
+
+private:
+	string	hostName(unsigned int hostID);
+	int		command(unsigned int hostID, const string& cmd, string& output, int timeout = XEN_COMMAND_TIMEOUT, int flags = 0);
+	int		settleMigration(unsigned int srcHostID, unsigned int destHostID, const string& name);
+
+	session_pool_t*	m_pool;
+	string			m_hostPrefix;
+};
+
+#endif
@@ -0,0 +1,337 @@
+#include "capacityLedger.h"
+
+CapacityLedger::CapacityLedger()
+{
+	m_rejected = 0;
+	m_inFlight = 0;
+	pthread_mutex_init(&m_lock, NULL);
+}
+
+CapacityLedger::~CapacityLedger()
+{
+	pthread_mutex_destroy(&m_lock);
+}
+
+void CapacityLedger::resize(unsigned int nHosts, size_t nVMs)
+{
+	vmRoom none = { 0, 0, 0, 0, false, 0, 0 };
+
+	pthread_mutex_lock(&m_lock);
+	// hostID starts from 1
+	m_hosts.resize(nHosts+1);
+	m_vms.assign(nVMs, none);
+	m_inFlight = 0;
+	pthread_mutex_unlock(&m_lock);
+}
+
+void CapacityLedger::setHost(unsigned int hostID, const hostTopology& topology)
+{
+	pthread_mutex_lock(&m_lock);
+
+	hostRoom& host = m_hosts[hostID];
+	unsigned int nSockets = topology.socketCPUs.size();
+
+	host.topology = topology;
+	host.memory = -HOST_MEMORY_RESERVE;
+	for ( unsigned int n = 0; n < topology.nodeMemory.size(); n++ ) {
+		host.memory += topology.nodeMemory[n];
+	}
+	host.memoryUsed = 0;
+	host.memoryReserved = 0;
+
+	host.vcpus.resize(nSockets);
+	host.vcpusUsed.assign(nSockets, 0);
+	host.vcpusReserved.assign(nSockets, 0);
+	for ( unsigned int s = 0; s < nSockets; s++ ) {
+		host.vcpus[s] = topology.numOfCores[s] * VCPU_OVERCOMMIT;
+	}
+
+	pthread_mutex_unlock(&m_lock);
+}
+
+void CapacityLedger::place(unsigned int vm, unsigned int hostID, unsigned int socket, unsigned int memory, unsigned int nVCPUs)
+{
+	pthread_mutex_lock(&m_lock);
+
+	if ( vm < m_vms.size() && valid(hostID, socket) && m_vms[vm].hostID == 0 ) {
+		vmRoom& v = m_vms[vm];
+		hostRoom& host = m_hosts[hostID];
+
+		v.hostID = hostID;
+		v.socket = socket;
+		v.memory = memory;
+		v.nVCPUs = nVCPUs;
+		v.reserved = false;
+
+		host.memoryUsed += memory;
+		charge(host, socket, nVCPUs, host.vcpusUsed, 1);
+	}
+
+	pthread_mutex_unlock(&m_lock);
+}
+
+void CapacityLedger::repin(unsigned int vm, unsigned int socket)
+{
+	pthread_mutex_lock(&m_lock);
+
+	if ( vm < m_vms.size() && !m_vms[vm].reserved && valid(m_vms[vm].hostID, socket) ) {
+		vmRoom& v = m_vms[vm];
+		hostRoom& host = m_hosts[v.hostID];
+
+		charge(host, v.socket, v.nVCPUs, host.vcpusUsed, -1);
+		charge(host, socket, v.nVCPUs, host.vcpusUsed, 1);
+		v.socket = socket;
+	}
+
+	pthread_mutex_unlock(&m_lock);
+}
+
+bool CapacityLedger::swapFits(unsigned int a, unsigned int hostA, unsigned int socketA, unsigned int b, unsigned int hostB, unsigned int socketB)
+{
+	ledger_move_t swap[2] = { { a, hostA, socketA, -1 }, { b, hostB, socketB, -1 } };
+
+	return movesFit(vector<ledger_move_t>(swap, swap + 2));
+}
+
+bool CapacityLedger::reserveSwap(unsigned int a, unsigned int hostA, unsigned int socketA, unsigned int b, unsigned int hostB, unsigned int socketB)
+{
+	ledger_move_t swap[2] = { { a, hostA, socketA, -1 }, { b, hostB, socketB, -1 } };
+
+	return reserveMoves(vector<ledger_move_t>(swap, swap + 2));
+}
+
+bool CapacityLedger::moveFits(unsigned int vm, unsigned int hostID, unsigned int socket)
+{
+	ledger_move_t move = { vm, hostID, socket, -1 };
+
+	return movesFit(vector<ledger_move_t>(1, move));
+}
+
+bool CapacityLedger::reserve(unsigned int vm, unsigned int hostID, unsigned int socket)
+{
+	ledger_move_t move = { vm, hostID, socket, -1 };
+
+	return reserveMoves(vector<ledger_move_t>(1, move));
+}
+
+bool CapacityLedger::movesFit(const vector<ledger_move_t>& moves)
+{
+	bool ok;
+
+	pthread_mutex_lock(&m_lock);
+
+	ok = holdAll(moves);
+	if ( ok ) {
+		for ( size_t k = 0; k < moves.size(); k++ ) {
+			drop(moves[k].vm);
+		}
+	}
+
+	pthread_mutex_unlock(&m_lock);
+
+	return ok;
+}
+
+bool CapacityLedger::reserveMoves(const vector<ledger_move_t>& moves)
+{
+	bool ok;
+
+	pthread_mutex_lock(&m_lock);
+
+	ok = holdAll(moves);
+	if ( !ok )
+		m_rejected++;
+
+	pthread_mutex_unlock(&m_lock);
+
+	return ok;
+}
+
+void CapacityLedger::commit(unsigned int vm)
+{
+	pthread_mutex_lock(&m_lock);
+
+	if ( vm < m_vms.size() && m_vms[vm].reserved ) {
+		vmRoom& v = m_vms[vm];
+		hostRoom& src = m_hosts[v.hostID];
+		unsigned int destHostID = v.destHostID, destSocket = v.destSocket;
+
+		drop(vm);
+
+		charge(src, v.socket, v.nVCPUs, src.vcpusUsed, -1);
+		src.memoryUsed -= v.memory;
+
+		hostRoom& dest = m_hosts[destHostID];
+		charge(dest, destSocket, v.nVCPUs, dest.vcpusUsed, 1);
+		dest.memoryUsed += v.memory;
+
+		v.hostID = destHostID;
+		v.socket = destSocket;
+	}
+
+	pthread_mutex_unlock(&m_lock);
+}
+
+void CapacityLedger::release(unsigned int vm, unsigned int socket)
+{
+	pthread_mutex_lock(&m_lock);
+
+	if ( vm < m_vms.size() && m_vms[vm].reserved ) {
+		vmRoom& v = m_vms[vm];
+		hostRoom& host = m_hosts[v.hostID];
+
+		drop(vm);
+
+		// it may have been pinned for the move before it failed
+		if ( valid(v.hostID, socket) && socket != v.socket ) {
+			charge(host, v.socket, v.nVCPUs, host.vcpusUsed, -1);
+			charge(host, socket, v.nVCPUs, host.vcpusUsed, 1);
+			v.socket = socket;
+		}
+	}
+
+	pthread_mutex_unlock(&m_lock);
+}
+
+int CapacityLedger::freeMemory(unsigned int hostID)
+{
+	int room = 0;
+
+	pthread_mutex_lock(&m_lock);
+	if ( hostID < m_hosts.size() ) {
+		hostRoom& host = m_hosts[hostID];
+		room = host.memory - host.memoryUsed - host.memoryReserved;
+	}
+	pthread_mutex_unlock(&m_lock);
+
+	return room;
+}
+
+int CapacityLedger::freeVCPUs(unsigned int hostID, unsigned int socket)
+{
+	int room = 0;
+
+	pthread_mutex_lock(&m_lock);
+	if ( valid(hostID, socket) ) {
+		hostRoom& host = m_hosts[hostID];
+		room = host.vcpus[socket] - host.vcpusUsed[socket] - host.vcpusReserved[socket];
+	}
+	pthread_mutex_unlock(&m_lock);
+
+	return room;
+}
+
+int CapacityLedger::vcpuCapacity(unsigned int hostID, unsigned int socket)
+{
+	int room = 0;
+
+	pthread_mutex_lock(&m_lock);
+	if ( valid(hostID, socket) ) {
+		hostRoom& host = m_hosts[hostID];
+		room = host.vcpus[socket] - host.vcpusReserved[socket];
+	}
+	pthread_mutex_unlock(&m_lock);
+
+	return room;
+}
+
+/*
+ *	Private; the callers hold the lock
+ */
+bool CapacityLedger::valid(unsigned int hostID, unsigned int socket) const
+{
+	return hostID >= 1 && hostID < m_hosts.size() && socket < m_hosts[hostID].vcpus.size();
+}
+
+bool CapacityLedger::fits(unsigned int vm, unsigned int hostID, unsigned int socket, int credit)
+{
+	vector<int> need;
+	int memory = 0;
+
+	if ( vm >= m_vms.size() || m_vms[vm].hostID == 0 || m_vms[vm].reserved || !valid(hostID, socket) )
+		return false;
+
+	vmRoom& v = m_vms[vm];
+	hostRoom& host = m_hosts[hostID];
+
+	need.assign(host.vcpus.size(), 0);
+	charge(host, socket, v.nVCPUs, need, 1);
+
+	// the VM it waits for leaves this socket, or this host, first
+	if ( credit >= 0 && m_vms[credit].hostID == hostID ) {
+		if ( m_vms[credit].destHostID != hostID )
+			memory = m_vms[credit].memory;
+		charge(host, m_vms[credit].socket, m_vms[credit].nVCPUs, need, -1);
+	}
+
+	// a VM that changes sockets only keeps its memory where it is
+	if ( hostID != v.hostID && host.memoryUsed + host.memoryReserved + v.memory - memory > host.memory )
+		return false;
+
+	for ( unsigned int s = 0; s < need.size(); s++ ) {
+		if ( need[s] > 0 && host.vcpusUsed[s] + host.vcpusReserved[s] + need[s] > host.vcpus[s] )
+			return false;
+	}
+
+	return true;
+}
+
+bool CapacityLedger::holdAll(const vector<ledger_move_t>& moves)
+{
+	size_t k;
+
+	for ( k = 0; k < moves.size(); k++ ) {
+		const ledger_move_t& m = moves[k];
+		int credit = ( m.after >= 0 && m.after < (int)k ) ? (int)moves[m.after].vm : -1;
+
+		if ( !fits(m.vm, m.hostID, m.socket, credit) )
+			break;
+		hold(m.vm, m.hostID, m.socket);
+	}
+
+	if ( k == moves.size() )
+		return true;
+
+	while ( k-- > 0 ) {
+		drop(moves[k].vm);
+	}
+
+	return false;
+}
+
+void CapacityLedger::hold(unsigned int vm, unsigned int hostID, unsigned int socket)
+{
+	vmRoom& v = m_vms[vm];
+	hostRoom& host = m_hosts[hostID];
+
+	v.reserved = true;
+	v.destHostID = hostID;
+	v.destSocket = socket;
+
+	if ( hostID != v.hostID )
+		host.memoryReserved += v.memory;
+	charge(host, socket, v.nVCPUs, host.vcpusReserved, 1);
+	m_inFlight++;
+}
+
+void CapacityLedger::drop(unsigned int vm)
+{
+	vmRoom& v = m_vms[vm];
+	hostRoom& host = m_hosts[v.destHostID];
+
+	if ( v.destHostID != v.hostID )
+		host.memoryReserved -= v.memory;
+	charge(host, v.destSocket, v.nVCPUs, host.vcpusReserved, -1);
+	v.reserved = false;
+	m_inFlight--;
+}
+
+void CapacityLedger::charge(hostRoom& host, unsigned int socket, unsigned int nVCPUs, vector<int>& slots, int n)
+{
+	vector<unsigned int> sockets;
+
+	vcpu_sockets(host.topology, socket, nVCPUs, sockets);
+	for ( unsigned int v = 0; v < sockets.size(); v++ ) {
+		slots[sockets[v]] += n;
+	}
+}
@@ -0,0 +1,119 @@
+#ifndef _CAPACITY_LEDGER_
+#define _CAPACITY_LEDGER_
+
+#include <pthread.h>
+#include <vector>
+#include "hostTopology.h"
+
+using namespace std;
+
+#ifndef VCPU_OVERCOMMIT
+#define VCPU_OVERCOMMIT			8		// vCPUs a core of a socket may run
+#endif
+#ifndef HOST_MEMORY_RESERVE
+#define HOST_MEMORY_RESERVE		1024	// MB of a host kept for dom0
+#endif
+
+// vm to socket of host hostID, once the move after (an index in the list) left; -1: at once
+typedef struct ledger_move_tag {
+	unsigned int	vm;
+	unsigned int	hostID;
+	unsigned int	socket;
+	int				after;
+} ledger_move_t;
+
+/*
+ *	Room every host has for VMs: memory (MB) over all of its nodes, and
+ *	vCPU slots on each of its sockets (LLC domains), less what the VMs on it
+ *	use and what the migrations on their way to it have reserved.
+ *
+ *	A migration reserves its room on the destination before it is queued
+ *	and holds it until it is done: commit then moves the VM there and frees
+ *	the source, release gives the room back. The source stays charged while
+ *	the VM is copied, so two VMs that trade places at once each need room
+ *	for the other on top of themselves. A move that waits for another one
+ *	out of its host may count on the room that one leaves behind, which is
+ *	how a chain or a cycle of moves fits through full hosts. A plan that
+ *	does not fit is dropped before any of its VMs moves.
+ *
+ *	The global thread plans and reserves, the executor workers commit and
+ *	release, the local rounds repin; every call takes the ledger lock.
+ */
+class CapacityLedger {
+
+public:
+	CapacityLedger();
+	~CapacityLedger();
+
+	void	resize(unsigned int nHosts, size_t nVMs);
+	void	setHost(unsigned int hostID, const hostTopology& topology);
+
+	// a VM running on the host, its vCPUs around socket
+	void	place(unsigned int vm, unsigned int hostID, unsigned int socket, unsigned int memory, unsigned int nVCPUs);
+	// its vCPUs moved around another socket of its host; one in flight settles on commit or release
+	void	repin(unsigned int vm, unsigned int socket);
+
+	// true if a fits on socketA of hostA and b on socketB of hostB, both at once
+	bool	swapFits(unsigned int a, unsigned int hostA, unsigned int socketA, unsigned int b, unsigned int hostB, unsigned int socketB);
+	// the same, and holds the room for both; nothing is held when either does not fit
+	bool	reserveSwap(unsigned int a, unsigned int hostA, unsigned int socketA, unsigned int b, unsigned int hostB, unsigned int socketB);
+	// one VM alone
+	bool	moveFits(unsigned int vm, unsigned int hostID, unsigned int socket);
+	bool	reserve(unsigned int vm, unsigned int hostID, unsigned int socket);
+	// the same for a group of moves in order, all or none
+	bool	movesFit(const vector<ledger_move_t>& moves);
+	bool	reserveMoves(const vector<ledger_move_t>& moves);
+
+	// the VM arrived where it had reserved
+	void	commit(unsigned int vm);
+	// it did not leave; socket: where its vCPUs are on its host now
+	void	release(unsigned int vm, unsigned int socket);
+
+	int		freeMemory(unsigned int hostID);
+	int		freeVCPUs(unsigned int hostID, unsigned int socket);
+	// slots of the socket the VMs already on the host may use: all but those reserved by arrivals
+	int		vcpuCapacity(unsigned int hostID, unsigned int socket);
+
+	// plans refused for want of room so far, and reservations held now
+	unsigned long	rejected() const	{ return m_rejected; }
+	unsigned int	inFlight() const	{ return m_inFlight; }
+
+private:
+	struct hostRoom {
+		hostTopology	topology;
+		int				memory;			// MB it gives to VMs
+		int				memoryUsed;
+		int				memoryReserved;
+		vector<int>		vcpus;			// [socket] slots
+		vector<int>		vcpusUsed;
+		vector<int>		vcpusReserved;
+	};
+
+	struct vmRoom {
+		unsigned int	hostID;			// 0: not placed
+		unsigned int	socket;
+		int				memory;
+		unsigned int	nVCPUs;
+		bool			reserved;
+		unsigned int	destHostID;
+		unsigned int	destSocket;
+	};
+
+	bool	valid(unsigned int hostID, unsigned int socket) const;
+	// credit: a VM whose room on the host is counted as free, -1: none
+	bool	fits(unsigned int vm, unsigned int hostID, unsigned int socket, int credit = -1);
+	// holds all of the moves, or none of them
+	bool	holdAll(const vector<ledger_move_t>& moves);
+	void	hold(unsigned int vm, unsigned int hostID, unsigned int socket);
+	void	drop(unsigned int vm);
+	// adds n times the footprint of the VM on socket to slots
+	void	charge(hostRoom& host, unsigned int socket, unsigned int nVCPUs, vector<int>& slots, int n);
+
+	vector<hostRoom>	m_hosts;	// [hostID]
+	vector<vmRoom>		m_vms;		// [vm]
+	unsigned long		m_rejected;
+	unsigned int		m_inFlight;
+	pthread_mutex_t		m_lock;
+};
+
+#endif
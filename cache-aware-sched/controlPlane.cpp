@@ -0,0 +1,537 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include <ucontext.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <map>
+#include <vector>
+
+#include "controlPlane.h"
+
+using namespace std;
+
+#define CONTROL_EVENTS		64		// per epoll_wait()
+#define WAKEUP_ID			0		// epoll data of the eventfd of a loop; hostIDs start from 1
+
+// state of the round of a host
+#define TASK_IDLE			0
+#define TASK_READY			1		// to be switched to by its loop
+#define TASK_WAITING		2		// on an fd, its timer or both
+#define TASK_DONE			3
+
+// Coroutine running the rounds of one host
+typedef struct control_task_tag {
+	unsigned int	hostID;
+	struct control_loop_tag	*loop;
+	ucontext_t		context;
+	char			*stack;		// NULL until its first round
+	int				state;
+	unsigned long	round;
+	bool			ready;		// the fd it waited for turned ready
+	double			wake;		// monotonic sec its timer expires, 0: none
+} control_task_t;
+
+// One event loop and the hosts it runs
+typedef struct control_loop_tag {
+	struct control_plane_tag	*cp;
+	pthread_t		thread;
+	int				epoll;
+	int				wakeup;		// eventfd: hosts queued, or exit
+	ucontext_t		context;	// of the loop thread, the tasks switch back to it
+	vector<unsigned int>	inbox;	// hosts queued by control_round(), under cp->mutex
+	vector<unsigned int>	ready;	// hosts to run on the next pass
+	multimap<double, unsigned int>	timers;	// wake -> hostID
+	unsigned int	active;		// hosts started and not done
+} control_loop_t;
+
+static __thread control_task_t	*t_current = NULL;	// task running on this thread
+
+static void*	controlLoopThread(void *arg);
+static void		startTask(control_task_t *task);
+static void		runTask(control_task_t *task);
+static void		taskEntry();
+static void		suspendTask(control_task_t *task, int timeout);
+static void		resumeTask(control_task_t *task);
+static void		finishTask(control_task_t *task);
+static void		wakeLoop(control_loop_t *loop);
+
+static double monotonic()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ *	Create the event loops; the stack of a host is allocated on its first round
+ */
+int create_control_plane(struct control_plane_tag *cp, int size, unsigned int nHosts, host_func_t func)
+{
+	pthread_condattr_t attr;
+	struct epoll_event event;
+	control_loop_t *loop;
+	int status;
+
+	cp->num_hosts = nHosts;
+	cp->loop_size = size;
+	cp->func = func;
+	cp->pending = 0;
+	cp->round = 0;
+	cp->exit = false;
+
+	cp->loop = new control_loop_t [size];
+
+	for ( int i = 0; i < size; i++ ) {
+		loop = &cp->loop[i];
+		loop->cp = cp;
+		loop->active = 0;
+
+		loop->epoll = epoll_create1(EPOLL_CLOEXEC);
+		if ( loop->epoll < 0 ) {
+			perror("epoll_create1() error");
+			return -1;
+		}
+
+		loop->wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if ( loop->wakeup < 0 ) {
+			perror("eventfd() error");
+			return -1;
+		}
+
+		memset(&event, 0x00, sizeof(event));
+		event.events = EPOLLIN;
+		event.data.u32 = WAKEUP_ID;
+		if ( epoll_ctl(loop->epoll, EPOLL_CTL_ADD, loop->wakeup, &event) != 0 ) {
+			perror("epoll_ctl() error");
+			return -1;
+		}
+	}
+
+	// hostID starts from 1
+	cp->task = new control_task_t [nHosts+1];
+	cp->busy = new bool [nHosts+1];
+	cp->running = new bool [nHosts+1];
+	cp->started = new unsigned long [nHosts+1];
+	cp->finished = new unsigned long [nHosts+1];
+	cp->due = new double [nHosts+1];
+	cp->on_time = new bool [nHosts+1];
+
+	for ( unsigned int i = 0; i <= nHosts; i++ ) {
+		cp->task[i].hostID = i;
+		cp->task[i].loop = ( i > 0 ) ? &cp->loop[(i - 1) % size] : NULL;
+		cp->task[i].stack = NULL;
+		cp->task[i].state = TASK_IDLE;
+		cp->task[i].round = 0;
+		cp->task[i].ready = false;
+		cp->task[i].wake = 0.0;
+
+		cp->busy[i] = false;
+		cp->running[i] = false;
+		cp->started[i] = 0;
+		cp->finished[i] = 0;
+		cp->due[i] = 0.0;
+		cp->on_time[i] = false;
+	}
+	cp->late_arrivals = 0;
+	cp->max_lateness = 0.0;
+
+	status = pthread_mutex_init(&cp->mutex, NULL);
+	if (status != 0)
+		return status;
+
+	// the deadline of a round is on the monotonic clock
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	status = pthread_cond_init(&cp->done, &attr);
+	pthread_condattr_destroy(&attr);
+	if (status != 0)
+		return status;
+
+	for ( int i = 0; i < size; i++ ) {
+		status = pthread_create(&cp->loop[i].thread, NULL, controlLoopThread, (void*)&cp->loop[i]);
+
+		if (status != 0) {
+			perror("pthread_create() error");
+			return status;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ *	The loops finish the rounds they started, then exit
+ */
+void destroy_control_plane(struct control_plane_tag *cp)
+{
+	pthread_mutex_lock(&cp->mutex);
+	cp->exit = true;
+	pthread_mutex_unlock(&cp->mutex);
+
+	for ( int i = 0; i < cp->loop_size; i++ ) {
+		wakeLoop(&cp->loop[i]);
+	}
+	for ( int i = 0; i < cp->loop_size; i++ ) {
+		pthread_join(cp->loop[i].thread, NULL);
+		close(cp->loop[i].epoll);
+		close(cp->loop[i].wakeup);
+	}
+
+	pthread_mutex_destroy(&cp->mutex);
+	pthread_cond_destroy(&cp->done);
+
+	for ( unsigned int i = 0; i <= cp->num_hosts; i++ ) {
+		delete [] cp->task[i].stack;
+	}
+
+	delete [] cp->loop;
+	delete [] cp->task;
+	delete [] cp->busy;
+	delete [] cp->running;
+	delete [] cp->started;
+	delete [] cp->finished;
+	delete [] cp->due;
+	delete [] cp->on_time;
+}
+
+/*
+ *	Run func once for every host that is not still busy with an earlier
+ *	round, and return when all of them finished or deadline (ms) passed.
+ *	cp->on_time tells the hosts that made it; stats may be NULL.
+ */
+int control_round(struct control_plane_tag *cp, int deadline, control_stats_t *stats)
+{
+	struct timespec ts;
+	double	begin, due;
+	unsigned int	nQueued = 0, nBusy = 0, nOnTime = 0;
+	int		status = 0;
+
+	pthread_mutex_lock(&cp->mutex);
+
+	if ( cp->exit ) {
+		pthread_mutex_unlock(&cp->mutex);
+		return -1;
+	}
+
+	begin = monotonic();
+	due = begin + deadline / 1000.0;
+	cp->round++;
+
+	// hostID starts from 1
+	for ( unsigned int hostID = 1; hostID <= cp->num_hosts; hostID++ ) {
+
+		// still in the inbox of its loop from the last round; it runs this one
+		if ( cp->busy[hostID] && !cp->running[hostID] ) {
+			cp->started[hostID] = cp->round;
+			cp->due[hostID] = due;
+			nQueued++;
+			continue;
+		}
+
+		if ( cp->busy[hostID] ) {
+			nBusy++;
+			continue;
+		}
+
+		cp->busy[hostID] = true;
+		cp->started[hostID] = cp->round;
+		cp->due[hostID] = due;
+		cp->task[hostID].loop->inbox.push_back(hostID);
+		nQueued++;
+	}
+	cp->pending = nQueued;
+
+	// one wakeup per loop for the whole round
+	for ( int i = 0; i < cp->loop_size; i++ ) {
+		if ( !cp->loop[i].inbox.empty() )
+			wakeLoop(&cp->loop[i]);
+	}
+
+	ts.tv_sec = (time_t)due;
+	ts.tv_nsec = (long)((due - ts.tv_sec) * 1e9);
+
+	// the caller may be cancelled while waiting
+	pthread_cleanup_push((void (*)(void*))pthread_mutex_unlock, (void*)&cp->mutex);
+
+	while ( cp->pending > 0 && !cp->exit && status == 0 ) {
+		status = pthread_cond_timedwait(&cp->done, &cp->mutex, &ts);
+	}
+
+	for ( unsigned int hostID = 1; hostID <= cp->num_hosts; hostID++ ) {
+		cp->on_time[hostID] = ( cp->finished[hostID] == cp->round );
+		if ( cp->on_time[hostID] )
+			nOnTime++;
+	}
+
+	if ( stats != NULL ) {
+		stats->round = cp->round;
+		stats->queued = nQueued;
+		stats->on_time = nOnTime;
+		stats->late = nQueued - nOnTime;
+		stats->busy = nBusy;
+		stats->late_arrivals = cp->late_arrivals;
+		stats->max_lateness = cp->max_lateness * 1000.0;
+		stats->elapsed = (monotonic() - begin) * 1000.0;
+	}
+	cp->late_arrivals = 0;
+	cp->max_lateness = 0.0;
+
+	pthread_cleanup_pop(1);
+
+	return 0;
+}
+
+int control_poll(int fd, short events, int timeout)
+{
+	control_task_t *task = t_current;
+	struct epoll_event event;
+	struct pollfd pfd;
+
+	if ( task == NULL ) {
+		pfd.fd = fd;
+		pfd.events = events;
+		pfd.revents = 0;
+		return poll(&pfd, 1, timeout);
+	}
+
+	// errors and hangups are reported whether asked for or not
+	memset(&event, 0x00, sizeof(event));
+	event.events = EPOLLONESHOT;
+	if ( events & POLLIN )
+		event.events |= EPOLLIN;
+	if ( events & POLLOUT )
+		event.events |= EPOLLOUT;
+	event.data.u32 = task->hostID;
+
+	if ( epoll_ctl(task->loop->epoll, EPOLL_CTL_ADD, fd, &event) != 0 )
+		return -1;
+
+	task->ready = false;
+	suspendTask(task, timeout);
+	epoll_ctl(task->loop->epoll, EPOLL_CTL_DEL, fd, NULL);
+
+	return task->ready ? 1 : 0;
+}
+
+void control_sleep(int ms)
+{
+	control_task_t *task = t_current;
+
+	if ( task == NULL ) {
+		usleep(ms * 1000);
+		return;
+	}
+
+	suspendTask(task, ms);
+}
+
+unsigned int control_host()
+{
+	return ( t_current != NULL ) ? t_current->hostID : 0;
+}
+
+static void* controlLoopThread(void *arg)
+{
+	control_loop_t *loop = (control_loop_t*)arg;
+	control_plane_p cp = loop->cp;
+	struct epoll_event events[CONTROL_EVENTS];
+	vector<unsigned int> starting, ready;
+	control_task_t *task;
+	uint64_t count;
+	int nEvents, timeout;
+	bool exit = false, woken = true;
+
+	while ( true ) {
+
+		// 1. hosts queued by control_round(); at exit only the ones started are run to the end
+		if ( woken ) {
+			pthread_mutex_lock(&cp->mutex);
+			exit = cp->exit;
+			for ( unsigned int i = 0; i < loop->inbox.size() && !exit; i++ ) {
+				unsigned int hostID = loop->inbox[i];
+
+				// the current round: an entry left over from an earlier one was moved up to it
+				cp->task[hostID].round = cp->started[hostID];
+				cp->running[hostID] = true;
+				starting.push_back(hostID);
+			}
+			loop->inbox.clear();
+			pthread_mutex_unlock(&cp->mutex);
+			woken = false;
+		}
+
+		for ( unsigned int i = 0; i < starting.size(); i++ ) {
+			startTask(&cp->task[starting[i]]);
+		}
+		starting.clear();
+
+		if ( exit && loop->active == 0 )
+			break;
+
+		// 2. every host ready runs until it waits or is done
+		ready.swap(loop->ready);
+		for ( unsigned int i = 0; i < ready.size(); i++ ) {
+			runTask(&cp->task[ready[i]]);
+		}
+		ready.clear();
+
+		// 3. wait for an fd, the nearest timer or a wakeup
+		timeout = -1;
+		if ( !loop->timers.empty() ) {
+			timeout = (int)ceil((loop->timers.begin()->first - monotonic()) * 1000.0);
+			if ( timeout < 0 )
+				timeout = 0;
+		}
+
+		nEvents = epoll_wait(loop->epoll, events, CONTROL_EVENTS, timeout);
+		if ( nEvents < 0 && errno != EINTR ) {
+			perror("epoll_wait() error");
+			break;
+		}
+
+		for ( int i = 0; i < nEvents; i++ ) {
+			if ( events[i].data.u32 == WAKEUP_ID ) {
+				if ( read(loop->wakeup, &count, sizeof(count)) < 0 && errno != EAGAIN )
+					perror("read() error");
+				woken = true;
+				continue;
+			}
+			task = &cp->task[events[i].data.u32];
+			task->ready = true;
+			resumeTask(task);
+		}
+
+		while ( !loop->timers.empty() && loop->timers.begin()->first <= monotonic() ) {
+			task = &cp->task[loop->timers.begin()->second];
+			loop->timers.erase(loop->timers.begin());
+			task->wake = 0.0;
+			resumeTask(task);
+		}
+	}
+
+	return NULL;
+}
+
+static void startTask(control_task_t *task)
+{
+	control_loop_t *loop = task->loop;
+
+	if ( task->stack == NULL )
+		task->stack = new char [CONTROL_STACK_SIZE];
+
+	getcontext(&task->context);
+	task->context.uc_stack.ss_sp = task->stack;
+	task->context.uc_stack.ss_size = CONTROL_STACK_SIZE;
+	task->context.uc_link = &loop->context;
+	makecontext(&task->context, taskEntry, 0);
+
+	task->state = TASK_READY;
+	task->ready = false;
+	task->wake = 0.0;
+	loop->ready.push_back(task->hostID);
+	loop->active++;
+}
+
+// Switch to the task until it waits or is done
+static void runTask(control_task_t *task)
+{
+	t_current = task;
+	swapcontext(&task->loop->context, &task->context);
+	t_current = NULL;
+
+	if ( task->state == TASK_DONE )
+		finishTask(task);
+}
+
+// First frame of a task; returning switches to uc_link, its loop
+static void taskEntry()
+{
+	control_task_t *task = t_current;
+
+	task->loop->cp->func(task->hostID, task->round);
+	task->state = TASK_DONE;
+}
+
+// Back to the loop until the fd registered by the caller is ready or timeout (ms, -1: none) passed
+static void suspendTask(control_task_t *task, int timeout)
+{
+	control_loop_t *loop = task->loop;
+
+	if ( timeout >= 0 ) {
+		task->wake = monotonic() + timeout / 1000.0;
+		loop->timers.insert(pair<double, unsigned int>(task->wake, task->hostID));
+	}
+
+	task->state = TASK_WAITING;
+	swapcontext(&task->context, &loop->context);
+}
+
+// Queue a waiting task for the next pass of its loop, whichever of its fd and timer came first
+static void resumeTask(control_task_t *task)
+{
+	control_loop_t *loop = task->loop;
+	multimap<double, unsigned int>::iterator it, last;
+
+	if ( task->state != TASK_WAITING )
+		return;
+
+	if ( task->wake > 0.0 ) {
+		last = loop->timers.upper_bound(task->wake);
+		for ( it = loop->timers.lower_bound(task->wake); it != last; it++ ) {
+			if ( it->second == task->hostID ) {
+				loop->timers.erase(it);
+				break;
+			}
+		}
+		task->wake = 0.0;
+	}
+
+	task->state = TASK_READY;
+	loop->ready.push_back(task->hostID);
+}
+
+static void finishTask(control_task_t *task)
+{
+	control_plane_p cp = task->loop->cp;
+	unsigned int hostID = task->hostID;
+	double lateness;
+
+	task->state = TASK_IDLE;
+	task->loop->active--;
+
+	pthread_mutex_lock(&cp->mutex);
+
+	cp->busy[hostID] = false;
+	cp->running[hostID] = false;
+	cp->finished[hostID] = task->round;
+
+	lateness = monotonic() - cp->due[hostID];
+	if ( lateness > 0 ) {
+		cp->late_arrivals++;
+		if ( lateness > cp->max_lateness )
+			cp->max_lateness = lateness;
+	}
+
+	if ( task->round == cp->round && cp->pending > 0 && --cp->pending == 0 ) {
+		pthread_cond_signal(&cp->done);
+	}
+
+	pthread_mutex_unlock(&cp->mutex);
+}
+
+static void wakeLoop(control_loop_t *loop)
+{
+	uint64_t one = 1;
+
+	if ( write(loop->wakeup, &one, sizeof(one)) < 0 && errno != EAGAIN )
+		perror("write() error");
+}
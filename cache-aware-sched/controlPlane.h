@@ -0,0 +1,86 @@
+#ifndef _CONTROL_PLANE_H_
+#define _CONTROL_PLANE_H_
+
+#include <pthread.h>
+
+// Number of event loops multiplexing the local work of all hosts
+#ifndef CONTROL_CREW_SIZE
+#define CONTROL_CREW_SIZE	4
+#endif
+
+#define CONTROL_STACK_SIZE	(256 * 1024)	// bytes, of the coroutine of a host
+
+// round numbers start from 1
+typedef void (*host_func_t)(unsigned int hostID, unsigned long round);
+
+/*
+ *	Event-driven control plane. The round of each host runs as a coroutine
+ *	on one of a small fixed number of event loops, host h on loop
+ *	(h-1) % size. Where the round would block on the remote side -- the
+ *	output of an ssh session, a batch from an agent, a backoff -- it calls
+ *	control_poll() or control_sleep(), which park the host on the epoll set
+ *	of its loop and switch to the next host ready to run; the loop resumes
+ *	it when epoll reports the fd or its timer expires. A loop thus keeps
+ *	the remote calls of all its hosts in flight at once, and the number of
+ *	threads does not grow with the number of hosts. func must not hold a
+ *	mutex across a wait: another host of the same loop may ask for it.
+ *
+ *	A round (epoch) ends when every host finished or its deadline passed.
+ *	A host that misses the deadline keeps running but is not on time for
+ *	the round, and it is not queued again until it finished. One queued
+ *	that its loop did not start yet runs the next round instead.
+ */
+typedef struct control_plane_tag {
+	unsigned int	num_hosts;
+	int				loop_size;
+	struct control_loop_tag	*loop;
+	struct control_task_tag	*task;		// [hostID]
+	host_func_t		func;
+
+	pthread_mutex_t	mutex;
+	pthread_cond_t	done;		// last host of the round finished
+
+	unsigned int	pending;	// hosts of the round not finished yet
+	unsigned long	round;		// current round
+	bool			exit;
+
+	// [hostID]
+	bool			*busy;		// queued or running
+	bool			*running;	// started by its loop
+	unsigned long	*started;	// round the host was queued for
+	unsigned long	*finished;	// last round the host finished
+	double			*due;		// deadline of that round
+	bool			*on_time;	// finished the current round before its deadline
+
+	unsigned int	late_arrivals;	// late hosts finished since the last round
+	double			max_lateness;	// sec
+} control_plane_t, *control_plane_p;
+
+// Participation of one round
+typedef struct control_stats_tag {
+	unsigned long	round;
+	unsigned int	queued;			// hosts started in this round, or still waiting from the last one
+	unsigned int	on_time;
+	unsigned int	late;			// queued, but not finished by the deadline
+	unsigned int	busy;			// not queued, still on an earlier round
+	unsigned int	late_arrivals;	// late hosts of earlier rounds finished since then
+	double			max_lateness;	// ms
+	double			elapsed;		// ms
+} control_stats_t;
+
+int		create_control_plane(struct control_plane_tag *cp, int size, unsigned int nHosts, host_func_t func);
+void	destroy_control_plane(struct control_plane_tag *cp);
+int		control_round(struct control_plane_tag *cp, int deadline, control_stats_t *stats);
+
+/*
+ *	Waits of a host round. Called from the round of a host they suspend
+ *	only that host; from any other thread they block it, as poll() and
+ *	usleep() would.
+ */
+// 1: fd is ready for events (POLLIN, POLLOUT) or has an error, 0: timeout (ms, -1: none) passed, -1: error
+int				control_poll(int fd, short events, int timeout);
+void			control_sleep(int ms);
+// the host whose round runs on this thread, 0: none
+unsigned int	control_host();
+
+#endif
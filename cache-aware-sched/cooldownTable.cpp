@@ -0,0 +1,40 @@
+#include "cooldownTable.h"
+
+CooldownTable::CooldownTable(double cooldown, double window)
+{
+	m_cooldown = cooldown;
+	m_window = window;
+	m_suppressed = 0;
+	m_oscillations = 0;
+}
+
+void CooldownTable::resize(size_t nVMs)
+{
+	m_time.assign(nVMs, 0.0);
+	m_until.assign(nVMs, 0.0);
+	m_from.assign(nVMs, 0);
+}
+
+bool CooldownTable::admit(unsigned int vm, unsigned int to, double now)
+{
+	if ( allows(vm, to, now) )
+		return true;
+
+	suppress(vm, to, now);
+	return false;
+}
+
+void CooldownTable::suppress(unsigned int vm, unsigned int to, double now)
+{
+	m_suppressed++;
+	// a cooling VM is refused for that first
+	if ( !cooling(vm, now) && cycle(vm, to, now) )
+		m_oscillations++;
+}
+
+void CooldownTable::record(unsigned int vm, unsigned int from, double now)
+{
+	m_time[vm] = now;
+	m_until[vm] = now + m_cooldown;
+	m_from[vm] = from;
+}
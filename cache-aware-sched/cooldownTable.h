@@ -0,0 +1,63 @@
+#ifndef _COOLDOWN_TABLE_
+#define _COOLDOWN_TABLE_
+
+#include <vector>
+
+using namespace std;
+
+#ifndef MIGRATION_COOLDOWN
+#define MIGRATION_COOLDOWN		60		// sec a VM stays put after a migration
+#endif
+#ifndef OSCILLATION_WINDOW
+#define OSCILLATION_WINDOW		600		// sec a move straight back counts as a cycle
+#endif
+
+/*
+ *	Last migration of every VM in the cluster, indexed by the VM key: when
+ *	it was and where from and to (a socket or a host). A VM is not moved
+ *	again during its cooldown, nor back to where it came from within the
+ *	oscillation window (A -> B -> A), whichever pair of the epoch it turns
+ *	up in. Both checks are O(1).
+ *
+ *	Only the global thread uses the table.
+ */
+class CooldownTable {
+
+public:
+	CooldownTable(double cooldown = MIGRATION_COOLDOWN, double window = OSCILLATION_WINDOW);
+	~CooldownTable() {}
+
+	void	resize(size_t nVMs);
+
+	// true if the VM may move to the location now; counts the refusals
+	bool	admit(unsigned int vm, unsigned int to, double now);
+	// the same, counting nothing; for a move that may not be dropped for it
+	bool	allows(unsigned int vm, unsigned int to, double now) const	{ return !cooling(vm, now) && !cycle(vm, to, now); }
+	// a move it did not allow was dropped: counts the refusal
+	void	suppress(unsigned int vm, unsigned int to, double now);
+	// true if the VM is cooling down
+	bool	cooling(unsigned int vm, double now) const	{ return now < m_until[vm]; }
+	// true if the move would take the VM straight back
+	bool	cycle(unsigned int vm, unsigned int to, double now) const	{ return m_time[vm] > 0.0 && to == m_from[vm] && now - m_time[vm] < m_window; }
+
+	// the VM moves away from a location now
+	void	record(unsigned int vm, unsigned int from, double now);
+
+	// migrations refused so far, and how many of them would have closed a cycle
+	unsigned long	suppressed() const		{ return m_suppressed; }
+	unsigned long	oscillations() const	{ return m_oscillations; }
+
+private:
+	double	m_cooldown;
+	double	m_window;
+
+	// [vm]
+	vector<double>			m_time;		// of the last migration, 0: never moved
+	vector<double>			m_until;	// end of the cooldown
+	vector<unsigned int>	m_from;
+
+	unsigned long	m_suppressed;
+	unsigned long	m_oscillations;
+};
+
+#endif
@@ -0,0 +1,597 @@
+#include <float.h>
+#include <time.h>
+#include <algorithm>
+
+#include "domainPartition.h"
+
+#define FORBIDDEN		1e15	// cost of a relabelling that raises the peak
+#define EPSILON			1e-9	// relative, two peaks closer than this are the same
+
+// Karmarkar-Karp partial partition: k subsets, each with its load and items
+typedef struct kk_tuple_tag {
+	vector<double>			sum;
+	vector< vector<int> >	members;	// item index, or -1-bin for the load of bin
+} kk_tuple_t;
+
+// Complete greedy branch and bound over the items, hottest first
+typedef struct search_tag {
+	const vector<partition_item_t>	*items;
+	vector<int>		order;		// item indices, hottest first
+	vector<double>	rest;		// [i] miss rate of order[i..]
+	vector<double>	load;		// [bin]
+	vector<unsigned int>	capacity;	// [bin] left
+	vector<unsigned int>	assign;		// [item] bin
+	vector<unsigned int>	best;
+	double	peak;		// of best
+	double	bound;		// no partition does better
+	double	deadline;
+	unsigned long	nodes;
+	bool	timeout;
+	unsigned int	moved;		// of best, once the peak is known
+} search_t;
+
+static double	monotonic();
+static double	peak_of(const vector<double>& load);
+static bool		lpt(const vector<partition_item_t>& items, const vector<int>& order, const vector<partition_bin_t>& bins, vector<unsigned int>& assign);
+static bool		kk(const vector<partition_item_t>& items, const vector<partition_bin_t>& bins, vector<unsigned int>& assign);
+static void		branch(search_t *s, size_t i, double peak);
+static void		fewest_moves(search_t *s, size_t i, unsigned int moved);
+static void		keep_in_place(const vector<partition_item_t>& items, const vector<partition_bin_t>& bins, double peak, vector<unsigned int>& assign);
+static double	hungarian(const vector< vector<double> >& cost, vector<int>& assignment);
+
+static double monotonic()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double peak_of(const vector<double>& load)
+{
+	return load.empty() ? 0.0 : *max_element(load.begin(), load.end());
+}
+
+// bin loads and capacities left with the items where assign puts them
+static void loads_of(const vector<partition_item_t>& items, const vector<partition_bin_t>& bins, const vector<unsigned int>& assign, vector<double>& load, vector<int>& capacity)
+{
+	load.resize(bins.size());
+	capacity.resize(bins.size());
+	for ( size_t b = 0; b < bins.size(); b++ ) {
+		load[b] = bins[b].load;
+		capacity[b] = bins[b].capacity;
+	}
+	for ( size_t i = 0; i < items.size(); i++ ) {
+		load[assign[i]] += items[i].missRate;
+		capacity[assign[i]] -= items[i].size;
+	}
+}
+
+int partition_domains(const vector<partition_item_t>& items, const vector<partition_bin_t>& bins, int budget, vector<partition_move_t>& moves, partition_stats_t* stats)
+{
+	size_t	n = items.size(), k = bins.size();
+	vector<unsigned int>	current(n), byLPT, byKK;
+	vector<double>	load;
+	vector<int>		capacity;
+	double	start = monotonic(), total = 0.0, largest = 0.0, lightest = DBL_MAX;
+	search_t	s;
+
+	moves.clear();
+
+	for ( size_t i = 0; i < n; i++ ) {
+		current[i] = items[i].bin;
+		total += items[i].missRate;
+		largest = max(largest, items[i].missRate);
+	}
+	for ( size_t b = 0; b < k; b++ ) {
+		total += bins[b].load;
+		lightest = min(lightest, bins[b].load);
+	}
+
+	loads_of(items, bins, current, load, capacity);
+	stats->peak_before = stats->peak_after = peak_of(load);
+	stats->peak_lpt = stats->peak_kk = -1.0;
+	stats->method = PARTITION_NONE;
+	stats->optimal = false;
+	stats->nodes = 0;
+	stats->elapsed = 0.0;
+
+	if ( k == 0 )
+		return n ? -1 : 0;
+
+	s.items = &items;
+	s.order.resize(n);
+	for ( size_t i = 0; i < n; i++ ) {
+		s.order[i] = i;
+	}
+	for ( size_t i = 1; i < n; i++ ) {
+		// insertion sort, hottest first; the order is stable
+		int t = s.order[i];
+		size_t j = i;
+		for ( ; j > 0 && items[s.order[j-1]].missRate < items[t].missRate; j-- )
+			s.order[j] = s.order[j-1];
+		s.order[j] = t;
+	}
+
+	s.peak = DBL_MAX;
+
+	if ( lpt(items, s.order, bins, byLPT) ) {
+		loads_of(items, bins, byLPT, load, capacity);
+		stats->peak_lpt = peak_of(load);
+		s.best = byLPT;
+		s.peak = stats->peak_lpt;
+		stats->method = PARTITION_LPT;
+	}
+
+	if ( kk(items, bins, byKK) ) {
+		loads_of(items, bins, byKK, load, capacity);
+		stats->peak_kk = peak_of(load);
+		if ( stats->peak_kk < s.peak * (1.0 - EPSILON) ) {
+			s.best = byKK;
+			s.peak = stats->peak_kk;
+			stats->method = PARTITION_KK;
+		}
+	}
+
+	// the current placement is the incumbent if it still fits and beats both
+	loads_of(items, bins, current, load, capacity);
+	if ( *min_element(capacity.begin(), capacity.end()) >= 0 && stats->peak_before <= s.peak ) {
+		s.best = current;
+		s.peak = stats->peak_before;
+		stats->method = PARTITION_NONE;
+	}
+
+	// even spread, or the hottest item on the lightest bin
+	s.bound = max(total / k, n ? largest + lightest : 0.0);
+
+	if ( n > 0 && budget > 0 && s.peak > s.bound * (1.0 + EPSILON) ) {
+		s.rest.assign(n + 1, 0.0);
+		for ( size_t i = n; i-- > 0; ) {
+			s.rest[i] = s.rest[i+1] + items[s.order[i]].missRate;
+		}
+		s.load.resize(k);
+		s.capacity.resize(k);
+		for ( size_t b = 0; b < k; b++ ) {
+			s.load[b] = bins[b].load;
+			s.capacity[b] = bins[b].capacity;
+		}
+		s.assign.assign(n, 0);
+		// a quarter of the budget is kept for fewer repins
+		s.deadline = start + budget * 0.75 / 1000.0;
+		s.nodes = 0;
+		s.timeout = false;
+
+		double before = s.peak;
+		branch(&s, 0, peak_of(s.load));
+
+		stats->nodes = s.nodes;
+		stats->optimal = !s.timeout;
+		if ( s.peak < before )
+			stats->method = PARTITION_COMPLETE;
+	} else {
+		stats->optimal = s.peak <= s.bound * (1.0 + EPSILON);
+	}
+
+	stats->elapsed = (monotonic() - start) * 1000.0;
+
+	if ( s.peak == DBL_MAX )
+		return -1;
+
+	// nothing to gain from moving
+	if ( s.peak >= stats->peak_before * (1.0 - EPSILON) ) {
+		stats->method = PARTITION_NONE;
+		return 0;
+	}
+
+	keep_in_place(items, bins, s.peak, s.best);
+
+	// the same peak in fewer repins, each item tried in its own bin first
+	s.moved = 0;
+	for ( size_t i = 0; i < n; i++ ) {
+		s.moved += s.best[i] != items[i].bin;
+	}
+	s.load.resize(k);
+	s.capacity.resize(k);
+	for ( size_t b = 0; b < k; b++ ) {
+		s.load[b] = bins[b].load;
+		s.capacity[b] = bins[b].capacity;
+	}
+	s.assign.assign(n, 0);
+	s.deadline = max(monotonic(), start + budget / 1000.0);
+	s.timeout = false;
+	fewest_moves(&s, 0, 0);
+	stats->nodes += s.nodes;
+
+	loads_of(items, bins, s.best, load, capacity);
+	stats->peak_after = peak_of(load);
+
+	for ( size_t i = 0; i < n; i++ ) {
+		if ( s.best[i] != items[i].bin ) {
+			partition_move_t move;
+
+			move.vm = items[i].vm;
+			move.from = items[i].bin;
+			move.to = s.best[i];
+			moves.push_back(move);
+		}
+	}
+
+	stats->elapsed = (monotonic() - start) * 1000.0;
+
+	return moves.size();
+}
+
+/*
+ *	Longest processing time first: each item, hottest first, goes to the
+ *	coolest bin that has room for it, its own bin on a tie
+ */
+static bool lpt(const vector<partition_item_t>& items, const vector<int>& order, const vector<partition_bin_t>& bins, vector<unsigned int>& assign)
+{
+	vector<double>	load(bins.size());
+	vector<unsigned int>	capacity(bins.size());
+
+	for ( size_t b = 0; b < bins.size(); b++ ) {
+		load[b] = bins[b].load;
+		capacity[b] = bins[b].capacity;
+	}
+
+	assign.assign(items.size(), 0);
+	for ( size_t k = 0; k < order.size(); k++ ) {
+		const partition_item_t& item = items[order[k]];
+		int best = -1;
+
+		for ( size_t b = 0; b < bins.size(); b++ ) {
+			if ( capacity[b] < item.size )
+				continue;
+			if ( best < 0 || load[b] < load[best] || (load[b] == load[best] && b == item.bin) )
+				best = b;
+		}
+		if ( best < 0 )
+			return false;
+
+		assign[order[k]] = best;
+		load[best] += item.missRate;
+		capacity[best] -= item.size;
+	}
+
+	return true;
+}
+
+static bool by_spread(const kk_tuple_t *a, const kk_tuple_t *b)
+{
+	return (a->sum.front() - a->sum.back()) < (b->sum.front() - b->sum.back());
+}
+
+/*
+ *	Largest differencing, k-way: every item is a tuple of k subsets, one
+ *	holding it, and so is the load of the bins. The two tuples of the
+ *	widest spread merge, the hottest subset of one with the coolest of the
+ *	other, until one tuple is left; the subset holding the load of a bin
+ *	goes to that bin. Capacities are only checked at the end.
+ */
+static bool kk(const vector<partition_item_t>& items, const vector<partition_bin_t>& bins, vector<unsigned int>& assign)
+{
+	size_t	k = bins.size();
+	vector<kk_tuple_t>	tuples(items.size() + 1);
+	vector<kk_tuple_t*>	heap;
+	vector<int>		capacity(k);
+	vector< pair<double, int> >	rank(k);
+
+	for ( size_t i = 0; i <= items.size(); i++ ) {
+		kk_tuple_t& t = tuples[i];
+
+		t.sum.assign(k, 0.0);
+		t.members.assign(k, vector<int>());
+		if ( i < items.size() ) {
+			t.sum[0] = items[i].missRate;
+			t.members[0].push_back(i);
+		} else {
+			for ( size_t b = 0; b < k; b++ ) {
+				rank[b] = make_pair(-bins[b].load, b);
+			}
+			sort(rank.begin(), rank.end());
+			for ( size_t b = 0; b < k; b++ ) {
+				t.sum[b] = -rank[b].first;
+				t.members[b].push_back(-1 - rank[b].second);
+			}
+		}
+		heap.push_back(&t);
+	}
+	make_heap(heap.begin(), heap.end(), by_spread);
+
+	// sums are kept hottest first in every tuple
+	while ( heap.size() > 1 ) {
+		kk_tuple_t *a, *b;
+
+		pop_heap(heap.begin(), heap.end(), by_spread);
+		a = heap.back();
+		heap.pop_back();
+		pop_heap(heap.begin(), heap.end(), by_spread);
+		b = heap.back();
+		heap.pop_back();
+
+		for ( size_t j = 0; j < k; j++ ) {
+			a->sum[j] += b->sum[k-1-j];
+			a->members[j].insert(a->members[j].end(), b->members[k-1-j].begin(), b->members[k-1-j].end());
+		}
+
+		for ( size_t j = 0; j < k; j++ ) {
+			rank[j] = make_pair(-a->sum[j], j);
+		}
+		sort(rank.begin(), rank.end());
+
+		kk_tuple_t merged;
+		merged.sum.resize(k);
+		merged.members.resize(k);
+		for ( size_t j = 0; j < k; j++ ) {
+			merged.sum[j] = a->sum[rank[j].second];
+			merged.members[j].swap(a->members[rank[j].second]);
+		}
+		a->sum.swap(merged.sum);
+		a->members.swap(merged.members);
+
+		heap.push_back(a);
+		push_heap(heap.begin(), heap.end(), by_spread);
+	}
+
+	assign.assign(items.size(), 0);
+	for ( size_t j = 0; j < k; j++ ) {
+		const vector<int>& m = heap[0]->members[j];
+		int bin = -1;
+
+		for ( size_t i = 0; i < m.size(); i++ ) {
+			if ( m[i] < 0 )
+				bin = -1 - m[i];
+		}
+		for ( size_t i = 0; i < m.size(); i++ ) {
+			if ( m[i] >= 0 )
+				assign[m[i]] = bin;
+		}
+	}
+
+	for ( size_t b = 0; b < k; b++ ) {
+		capacity[b] = bins[b].capacity;
+	}
+	for ( size_t i = 0; i < items.size(); i++ ) {
+		if ( (capacity[assign[i]] -= items[i].size) < 0 )
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ *	Item i of the order goes to each bin with room for it, coolest first.
+ *	A branch stops once its peak, or the even spread of what is left,
+ *	reaches the best peak; two bins of the same load and room are one.
+ */
+static void branch(search_t *s, size_t i, double peak)
+{
+	const vector<partition_item_t>& items = *s->items;
+	size_t	k = s->load.size();
+	vector<int>	bins(k);
+	double	total = 0.0;
+
+	if ( s->timeout || s->peak <= s->bound * (1.0 + EPSILON) )
+		return;
+
+	if ( i == s->order.size() ) {
+		if ( peak < s->peak * (1.0 - EPSILON) ) {
+			s->peak = peak;
+			s->best = s->assign;
+		}
+		return;
+	}
+
+	if ( (++s->nodes & 1023) == 0 && monotonic() > s->deadline ) {
+		s->timeout = true;
+		return;
+	}
+
+	for ( size_t b = 0; b < k; b++ ) {
+		total += s->load[b];
+	}
+	if ( max(peak, (total + s->rest[i]) / k) >= s->peak * (1.0 - EPSILON) )
+		return;
+
+	for ( size_t b = 0; b < k; b++ ) {
+		size_t j = b;
+		for ( ; j > 0 && s->load[bins[j-1]] > s->load[b]; j-- )
+			bins[j] = bins[j-1];
+		bins[j] = b;
+	}
+
+	const partition_item_t& item = items[s->order[i]];
+
+	for ( size_t j = 0; j < k; j++ ) {
+		int b = bins[j];
+		double after = s->load[b] + item.missRate;
+
+		if ( after >= s->peak * (1.0 - EPSILON) )
+			break;
+		if ( s->capacity[b] < item.size )
+			continue;
+		if ( j > 0 && s->load[bins[j-1]] == s->load[b] && s->capacity[bins[j-1]] == s->capacity[b] )
+			continue;
+
+		s->assign[s->order[i]] = b;
+		s->load[b] = after;
+		s->capacity[b] -= item.size;
+
+		branch(s, i + 1, max(peak, after));
+
+		s->load[b] -= item.missRate;
+		s->capacity[b] += item.size;
+	}
+}
+
+/*
+ *	Item i of the order stays in its bin, or moves to each other bin with
+ *	room for it, while the peak holds. A branch stops once it moved as many
+ *	items as the best assignment of that peak.
+ */
+static void fewest_moves(search_t *s, size_t i, unsigned int moved)
+{
+	const vector<partition_item_t>& items = *s->items;
+	size_t	k = s->load.size();
+
+	if ( s->timeout || moved >= s->moved )
+		return;
+
+	if ( i == s->order.size() ) {
+		s->moved = moved;
+		s->best = s->assign;
+		return;
+	}
+
+	if ( (++s->nodes & 1023) == 0 && monotonic() > s->deadline ) {
+		s->timeout = true;
+		return;
+	}
+
+	const partition_item_t& item = items[s->order[i]];
+
+	for ( size_t j = 0; j <= k; j++ ) {
+		// its own bin first, then the others in order
+		unsigned int b = ( j == 0 ) ? item.bin : j - 1;
+
+		if ( j > 0 && b == item.bin )
+			continue;
+		if ( s->load[b] + item.missRate > s->peak * (1.0 + EPSILON) || s->capacity[b] < item.size )
+			continue;
+
+		s->assign[s->order[i]] = b;
+		s->load[b] += item.missRate;
+		s->capacity[b] -= item.size;
+
+		fewest_moves(s, i + 1, moved + (b != item.bin));
+
+		s->load[b] -= item.missRate;
+		s->capacity[b] += item.size;
+	}
+}
+
+/*
+ *	The bins of a partition are interchangeable as long as each group of
+ *	items fits the load and room of the bin it goes to: the relabelling
+ *	that leaves the most items where they are wins. Then items go back to
+ *	their own bin while that keeps the peak and fits.
+ */
+static void keep_in_place(const vector<partition_item_t>& items, const vector<partition_bin_t>& bins, double peak, vector<unsigned int>& assign)
+{
+	size_t	n = items.size(), k = bins.size();
+	vector<double>	groupLoad(k, 0.0), load;
+	vector<int>		groupSize(k, 0), capacity, label;
+	vector< vector<double> >	cost(k, vector<double>(k, 0.0));
+	bool	moved = true;
+
+	for ( size_t i = 0; i < n; i++ ) {
+		groupLoad[assign[i]] += items[i].missRate;
+		groupSize[assign[i]] += items[i].size;
+		cost[assign[i]][items[i].bin] -= 1.0;
+	}
+	for ( size_t g = 0; g < k; g++ ) {
+		for ( size_t b = 0; b < k; b++ ) {
+			if ( groupLoad[g] + bins[b].load > peak * (1.0 + EPSILON) || groupSize[g] > (int)bins[b].capacity )
+				cost[g][b] = FORBIDDEN;
+		}
+	}
+
+	// the labels as they are always fit, so any relabelling found is no worse
+	if ( hungarian(cost, label) < FORBIDDEN ) {
+		for ( size_t i = 0; i < n; i++ ) {
+			assign[i] = label[assign[i]];
+		}
+	}
+
+	loads_of(items, bins, assign, load, capacity);
+
+	while ( moved ) {
+		moved = false;
+		for ( size_t i = 0; i < n; i++ ) {
+			const partition_item_t& item = items[i];
+			unsigned int from = assign[i];
+
+			if ( from == item.bin )
+				continue;
+			if ( load[item.bin] + item.missRate > peak * (1.0 + EPSILON) || capacity[item.bin] < (int)item.size )
+				continue;
+
+			load[from] -= item.missRate;
+			capacity[from] += item.size;
+			load[item.bin] += item.missRate;
+			capacity[item.bin] -= item.size;
+			assign[i] = item.bin;
+			moved = true;
+		}
+	}
+}
+
+/*
+ *	Shortest augmenting paths with row and column potentials, O(n^2 m);
+ *	the same as the swap planner of the NUMA-aware scheduler
+ */
+static double hungarian(const vector< vector<double> >& cost, vector<int>& assignment)
+{
+	int		n = cost.size(), m = n ? cost[0].size() : 0;
+	vector<double>	u(n+1, 0.0), v(m+1, 0.0), minv(m+1);
+	vector<int>		p(m+1, 0), way(m+1, 0);
+	vector<char>	used(m+1);
+	double	total = 0.0;
+
+	// 1-based; p[j] is the row of column j, column 0 is the row being added
+	for ( int i = 1; i <= n; i++ ) {
+		int j0 = 0, j1, i0;
+		double delta, cur;
+
+		p[0] = i;
+		minv.assign(m+1, DBL_MAX);
+		used.assign(m+1, 0);
+
+		do {
+			used[j0] = 1;
+			i0 = p[j0];
+			delta = DBL_MAX;
+			j1 = 0;
+
+			for ( int j = 1; j <= m; j++ ) {
+				if ( used[j] )
+					continue;
+				cur = cost[i0-1][j-1] - u[i0] - v[j];
+				if ( cur < minv[j] ) {
+					minv[j] = cur;
+					way[j] = j0;
+				}
+				if ( minv[j] < delta ) {
+					delta = minv[j];
+					j1 = j;
+				}
+			}
+
+			for ( int j = 0; j <= m; j++ ) {
+				if ( used[j] ) {
+					u[p[j]] += delta;
+					v[j] -= delta;
+				} else {
+					minv[j] -= delta;
+				}
+			}
+			j0 = j1;
+		} while ( p[j0] != 0 );
+
+		do {
+			j1 = way[j0];
+			p[j0] = p[j1];
+			j0 = j1;
+		} while ( j0 != 0 );
+	}
+
+	assignment.assign(n, -1);
+	for ( int j = 1; j <= m; j++ ) {
+		if ( p[j] != 0 ) {
+			assignment[p[j]-1] = j-1;
+			total += cost[p[j]-1][j-1];
+		}
+	}
+
+	return total;
+}
@@ -0,0 +1,61 @@
+#ifndef _DOMAIN_PARTITION_
+#define _DOMAIN_PARTITION_
+
+#include <vector>
+
+using namespace std;
+
+#define PARTITION_TIME_BUDGET	20		// ms of complete search per host and round
+
+// Partitioning that gave the result
+#define PARTITION_NONE			0		// the current one is as good
+#define PARTITION_LPT			1		// longest processing time first
+#define PARTITION_KK			2		// multiway Karmarkar-Karp differencing
+#define PARTITION_COMPLETE		3		// branch and bound from the better of the two
+
+// A VM that may be pinned to any LLC domain of its host
+typedef struct partition_item_tag {
+	unsigned int	vm;
+	double			missRate;
+	unsigned int	size;		// vCPUs
+	unsigned int	bin;		// domain it is pinned to now
+} partition_item_t;
+
+typedef struct partition_bin_tag {
+	double			load;		// miss rate of what stays where it is
+	unsigned int	capacity;	// vCPUs left for the items
+} partition_bin_t;
+
+typedef struct partition_move_tag {
+	unsigned int	vm;
+	unsigned int	from;
+	unsigned int	to;
+} partition_move_t;
+
+typedef struct partition_stats_tag {
+	double	peak_before;	// largest domain miss rate now
+	double	peak_lpt;		// -1: did not fit
+	double	peak_kk;
+	double	peak_after;
+	int		method;
+	bool	optimal;		// the search finished within the budget
+	unsigned long	nodes;
+	double	elapsed;		// ms
+} partition_stats_t;
+
+/*
+ *	Assigns the items to the bins so the largest bin load (its load plus
+ *	the miss rates of its items) is the least, without going over the
+ *	vCPU capacity of any bin.
+ *
+ *	LPT and Karmarkar-Karp give a first partition in O(n log n); a complete
+ *	greedy branch and bound then searches for a lower peak for at most
+ *	budget ms. The bins of the result are relabelled, and items moved back
+ *	where the peak allows, so as few items as possible change bins.
+ *
+ *	moves holds the items that change bins; none unless the peak drops.
+ *	Returns the number of moves, or -1 if the items do not fit.
+ */
+int		partition_domains(const vector<partition_item_t>& items, const vector<partition_bin_t>& bins, int budget, vector<partition_move_t>& moves, partition_stats_t* stats);
+
+#endif
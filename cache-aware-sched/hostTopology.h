@@ -0,0 +1,45 @@
+#ifndef _HOST_TOPOLOGY_
+#define _HOST_TOPOLOGY_
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+ *	Sockets, cores, last level caches and NUMA memory of a host, as the
+ *	driver discovers them at startup. A VM is pinned to the cpuset of one
+ *	socket; its index is the socket the scheduler reasons about.
+ */
+struct hostTopology {
+	vector<string>			socketCPUs;		// [socket] cpuset, e.g. "0-3"
+	vector<unsigned int>	numOfCores;		// [socket]
+	vector<unsigned int>	socketNode;		// [socket] NUMA node of its memory
+	vector<string>			llcCPUs;		// [LLC domain] cpuset sharing a last level cache
+	vector<unsigned int>	nodeMemory;		// [node] MB
+};
+
+// "0-3,8-11" for the cpus 0, 1, 2, 3, 8, 9, 10, 11 in any order
+string	cpuset_string(vector<unsigned int> cpus);
+
+// index of the socket with this cpuset, or -1
+int		find_socket(const hostTopology& topology, const string& cpuset);
+
+// the same cpuset for socket on both hosts, so a pin means the same thing on either
+bool	same_socket(const hostTopology& a, const hostTopology& b, unsigned int socket);
+
+/*
+ *	Socket of each vCPU of a VM of nVCPUs vCPUs whose home is socket home:
+ *	all on it when they fit on its cores, so the VM moves as one unit;
+ *	otherwise spread over the next sockets a socketful at a time. None
+ *	when home is not a socket of the host
+ */
+void	vcpu_sockets(const hostTopology& topology, unsigned int home, unsigned int nVCPUs, vector<unsigned int>& sockets);
+
+/*
+ *	A host of nSockets sockets of coresPerSocket cores each, numbered
+ *	socket by socket, one LLC and one NUMA node of nodeMemory MB per socket
+ */
+void	uniform_topology(unsigned int nSockets, unsigned int coresPerSocket, unsigned int nodeMemory, hostTopology *topology);
+
+#endif
@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "migrationExecutor.h"
+
+static void*	executorThread(void *arg);
+
+static double monotonic()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static pair<unsigned int, unsigned int> link_of(const migration_job_t& job)
+{
+	if ( job.srcHostID < job.destHostID )
+		return make_pair(job.srcHostID, job.destHostID);
+	return make_pair(job.destHostID, job.srcHostID);
+}
+
+// both hosts and the link between them have room for the job, and the job it waits for is done
+static bool admissible(struct migration_executor_tag *ex, const migration_job_t& job)
+{
+	if ( job.after >= 0 && ex->in_flight.count(job.after) > 0 )
+		return false;
+
+	if ( ex->host_active[job.srcHostID] >= EXECUTOR_HOST_LIMIT || ex->host_active[job.destHostID] >= EXECUTOR_HOST_LIMIT )
+		return false;
+
+	if ( job.srcHostID != job.destHostID ) {
+		map< pair<unsigned int, unsigned int>, unsigned int >::iterator it = ex->link_active.find(link_of(job));
+		if ( it != ex->link_active.end() && it->second >= EXECUTOR_LINK_LIMIT )
+			return false;
+	}
+
+	return true;
+}
+
+// a job on one host takes one slot of it
+static void occupy(struct migration_executor_tag *ex, const migration_job_t& job, int n)
+{
+	ex->host_active[job.srcHostID] += n;
+	if ( job.srcHostID != job.destHostID ) {
+		ex->host_active[job.destHostID] += n;
+		if ( (ex->link_active[link_of(job)] += n) == 0 )
+			ex->link_active.erase(link_of(job));
+	}
+}
+
+/*
+ *	Drop the queued jobs that wait on vm, and the ones that wait on those.
+ *	Called and returns with the lock held; the callbacks run without it.
+ */
+static void cancel(struct migration_executor_tag *ex, unsigned int vm)
+{
+	list<migration_job_t>	cancelled;
+	list<migration_job_t>::iterator it, next;
+	list<unsigned int>		failed(1, vm);
+
+	while ( !failed.empty() ) {
+		vm = failed.front();
+		failed.pop_front();
+
+		for ( it = ex->queue.begin(); it != ex->queue.end(); it = next ) {
+			next = it;
+			next++;
+			if ( it->after == (int)vm ) {
+				failed.push_back(it->vm);
+				cancelled.splice(cancelled.end(), ex->queue, it);
+			}
+		}
+	}
+
+	if ( cancelled.empty() )
+		return;
+
+	pthread_mutex_unlock(&ex->mutex);
+	for ( it = cancelled.begin(); it != cancelled.end(); it++ ) {
+		it->started = monotonic();
+		it->worker = -1;
+		if ( ex->done != NULL )
+			ex->done(&*it, -1);
+	}
+	pthread_mutex_lock(&ex->mutex);
+
+	for ( it = cancelled.begin(); it != cancelled.end(); it++ ) {
+		ex->in_flight.erase(it->vm);
+		ex->cancelled++;
+	}
+}
+
+/*
+ *	Create the worker pool
+ */
+int create_executor(struct migration_executor_tag *ex, int size, unsigned int nHosts, migration_func_t run, migration_done_t done)
+{
+	int status;
+
+	ex->worker_size = size;
+	ex->run = run;
+	ex->done = done;
+	ex->num_hosts = nHosts;
+	ex->running = 0;
+	ex->indexed = 0;
+	ex->exit = false;
+	ex->completed = 0;
+	ex->failed = 0;
+	ex->cancelled = 0;
+	ex->max_wait = 0.0;
+
+	// hostID starts from 1
+	ex->host_active = new unsigned int [nHosts+1];
+	for ( unsigned int i = 0; i <= nHosts; i++ ) {
+		ex->host_active[i] = 0;
+	}
+
+	status = pthread_mutex_init(&ex->mutex, NULL);
+	if (status != 0)
+		return status;
+
+	status = pthread_cond_init(&ex->go, NULL);
+	if (status != 0)
+		return status;
+
+	ex->worker = new pthread_t [size];
+
+	for ( int i = 0; i < size; i++ ) {
+		status = pthread_create(&ex->worker[i], NULL, executorThread, (void*)ex);
+
+		if (status != 0) {
+			perror("pthread_create() error");
+			ex->worker_size = i;
+			return status;
+		}
+	}
+
+	return 0;
+}
+
+void destroy_executor(struct migration_executor_tag *ex)
+{
+	pthread_mutex_lock(&ex->mutex);
+	ex->exit = true;
+	ex->queue.clear();
+	pthread_cond_broadcast(&ex->go);
+	pthread_mutex_unlock(&ex->mutex);
+
+	for ( int i = 0; i < ex->worker_size; i++ ) {
+		pthread_join(ex->worker[i], NULL);
+	}
+
+	pthread_mutex_destroy(&ex->mutex);
+	pthread_cond_destroy(&ex->go);
+
+	delete [] ex->worker;
+	delete [] ex->host_active;
+}
+
+int submit_migration(struct migration_executor_tag *ex, const migration_job_t *job)
+{
+	int status = -1;
+
+	if ( job->srcHostID > ex->num_hosts || job->destHostID > ex->num_hosts )
+		return -1;
+
+	pthread_mutex_lock(&ex->mutex);
+	if ( !ex->exit && ex->in_flight.insert(job->vm).second ) {
+		ex->queue.push_back(*job);
+		ex->queue.back().queued = monotonic();
+		ex->queue.back().worker = -1;
+		pthread_cond_broadcast(&ex->go);
+		status = 0;
+	}
+	pthread_mutex_unlock(&ex->mutex);
+
+	return status;
+}
+
+int submit_migrations(struct migration_executor_tag *ex, const migration_job_t *jobs, int n)
+{
+	int i, status = -1;
+	double now = monotonic();
+
+	for ( i = 0; i < n; i++ ) {
+		if ( jobs[i].srcHostID > ex->num_hosts || jobs[i].destHostID > ex->num_hosts )
+			return -1;
+	}
+
+	pthread_mutex_lock(&ex->mutex);
+	for ( i = 0; i < n && !ex->exit && ex->in_flight.insert(jobs[i].vm).second; i++ )
+		;
+
+	if ( i == n && !ex->exit ) {
+		for ( i = 0; i < n; i++ ) {
+			ex->queue.push_back(jobs[i]);
+			ex->queue.back().queued = now;
+			ex->queue.back().worker = -1;
+		}
+		pthread_cond_broadcast(&ex->go);
+		status = 0;
+	} else {
+		// the ones taken before the one in flight
+		while ( --i >= 0 ) {
+			ex->in_flight.erase(jobs[i].vm);
+		}
+	}
+	pthread_mutex_unlock(&ex->mutex);
+
+	return status;
+}
+
+bool migration_in_flight(struct migration_executor_tag *ex, unsigned int vm)
+{
+	bool found;
+
+	pthread_mutex_lock(&ex->mutex);
+	found = ex->in_flight.count(vm) > 0;
+	pthread_mutex_unlock(&ex->mutex);
+
+	return found;
+}
+
+void executor_load(struct migration_executor_tag *ex, unsigned int *queued, unsigned int *running)
+{
+	pthread_mutex_lock(&ex->mutex);
+	*queued = ex->queue.size();
+	*running = ex->running;
+	pthread_mutex_unlock(&ex->mutex);
+}
+
+/*
+ *	Take the first queued job there is room for, run it, free its slots
+ */
+static void* executorThread(void *arg)
+{
+	struct migration_executor_tag *ex = (struct migration_executor_tag*)arg;
+	list<migration_job_t>::iterator it;
+	migration_job_t job;
+	int status, index;
+
+	pthread_mutex_lock(&ex->mutex);
+
+	// 0 .. worker_size-1, for the state the callbacks keep per worker
+	index = ex->indexed++;
+
+	while ( !ex->exit ) {
+
+		for ( it = ex->queue.begin(); it != ex->queue.end() && !admissible(ex, *it); it++ )
+			;
+
+		if ( it == ex->queue.end() ) {
+			pthread_cond_wait(&ex->go, &ex->mutex);
+			continue;
+		}
+
+		job = *it;
+		ex->queue.erase(it);
+		occupy(ex, job, 1);
+		ex->running++;
+
+		job.started = monotonic();
+		job.worker = index;
+		if ( job.started - job.queued > ex->max_wait )
+			ex->max_wait = job.started - job.queued;
+
+		pthread_mutex_unlock(&ex->mutex);
+
+		status = ex->run(&job);
+		if ( ex->done != NULL )
+			ex->done(&job, status);
+
+		pthread_mutex_lock(&ex->mutex);
+		occupy(ex, job, -1);
+		ex->running--;
+		ex->in_flight.erase(job.vm);
+		if ( status == 0 ) {
+			ex->completed++;
+		} else {
+			ex->failed++;
+			cancel(ex, job.vm);
+		}
+
+		// the slots it held may let a queued job go
+		pthread_cond_broadcast(&ex->go);
+	}
+
+	pthread_mutex_unlock(&ex->mutex);
+
+	return NULL;
+}
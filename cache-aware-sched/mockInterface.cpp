@@ -0,0 +1,353 @@
+#include <stdlib.h>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#include "mockInterface.h"
+
+#define MOCK_VM_MEMORY			1024	// MB
+#define MOCK_PAGES_PER_MB		256		// 4KB pages
+#define MOCK_NODE_MEMORY		16384	// MB
+
+MockInterface::MockInterface(unsigned int nHosts, unsigned int vmsPerSocket, const vector<unsigned int>& fleet, unsigned int coresPerSocket)
+{
+	unsigned int theKey = 0;
+
+	m_numHosts = nHosts;
+	m_hosts = new mockHost [nHosts+1];
+
+	for ( unsigned int hostID = 0; hostID <= nHosts; hostID++ ) {
+
+		mockHost* host = &m_hosts[hostID];
+		host->nextLocalID = 1;
+		host->seed = hostID;
+		pthread_mutex_init(&host->mutex, NULL);
+
+		if ( hostID == 0 ) continue;
+
+		uniform_topology(fleet[(hostID - 1) % fleet.size()], coresPerSocket, MOCK_NODE_MEMORY, &host->topology);
+		vector<string>& socketCPUs = host->topology.socketCPUs;
+
+		for ( unsigned int j = 0; j < vmsPerSocket * socketCPUs.size(); j++ ) {
+			mockVM vm;
+			ostringstream name;
+
+			name << "vm" << setw(4) << setfill('0') << theKey++;
+			vm.info.name = name.str();
+			vm.info.localID = host->nextLocalID++;
+			vm.info.memory = MOCK_VM_MEMORY;
+			vm.info.cpuAffinity = socketCPUs[j % socketCPUs.size()];
+			vm.info.numOfVCPUs = 2 << (j % 3);		// 2, 4 or 8
+			vm.vcpuAffinity.assign(vm.info.numOfVCPUs, vm.info.cpuAffinity);
+
+			// a mix of cache friendly and cache thrashing tenants
+			vm.missIntensity = 1.0 + (rand_r(&host->seed) % 120);
+
+			// from idle to writing 100 MB/s
+			vm.dirtyRate = rand_r(&host->seed) % (100 * MOCK_PAGES_PER_MB);
+
+			vm.numOfPages.assign(host->topology.nodeMemory.size(), 0);
+			vm.numOfPages[homeNode(host, vm.info.cpuAffinity)] = MOCK_VM_MEMORY * MOCK_PAGES_PER_MB;
+
+			host->vms.push_back(vm);
+		}
+	}
+}
+
+MockInterface::~MockInterface()
+{
+	for ( unsigned int hostID = 0; hostID <= m_numHosts; hostID++ ) {
+		pthread_mutex_destroy(&m_hosts[hostID].mutex);
+	}
+	delete [] m_hosts;
+}
+
+int MockInterface::findVM(mockHost* host, const string& name)
+{
+	for ( unsigned int i = 0; i < host->vms.size(); i++ ) {
+		if ( host->vms[i].info.name == name )
+			return i;
+	}
+	return -1;
+}
+
+int MockInterface::findVM(mockHost* host, unsigned int localID)
+{
+	for ( unsigned int i = 0; i < host->vms.size(); i++ ) {
+		if ( host->vms[i].info.localID == localID )
+			return i;
+	}
+	return -1;
+}
+
+int MockInterface::homeNode(mockHost* host, const string& cpuAffinity)
+{
+	int socket = find_socket(host->topology, cpuAffinity);
+
+	return socket < 0 ? 0 : host->topology.socketNode[socket];
+}
+
+int MockInterface::listVMs(unsigned int hostID, vector<vmInfo>& vms)
+{
+	if ( !validHost(hostID) )
+		return -1;
+
+	mockHost* host = &m_hosts[hostID];
+	vms.clear();
+
+	pthread_mutex_lock(&host->mutex);
+	for ( unsigned int i = 0; i < host->vms.size(); i++ ) {
+		vms.push_back(host->vms[i].info);
+	}
+	pthread_mutex_unlock(&host->mutex);
+
+	return 0;
+}
+
+int MockInterface::getLocalID(unsigned int hostID, const string& name, unsigned int& localID)
+{
+	int idx, status = -1;
+
+	if ( !validHost(hostID) )
+		return -1;
+
+	mockHost* host = &m_hosts[hostID];
+
+	pthread_mutex_lock(&host->mutex);
+	if ( (idx = findVM(host, name)) >= 0 ) {
+		localID = host->vms[idx].info.localID;
+		status = 0;
+	}
+	pthread_mutex_unlock(&host->mutex);
+
+	return status;
+}
+
+int MockInterface::getCPUAffinity(unsigned int hostID, const string& name, string& cpuAffinity)
+{
+	int idx, status = -1;
+
+	if ( !validHost(hostID) )
+		return -1;
+
+	mockHost* host = &m_hosts[hostID];
+
+	pthread_mutex_lock(&host->mutex);
+	if ( (idx = findVM(host, name)) >= 0 ) {
+		cpuAffinity = host->vms[idx].info.cpuAffinity;
+		status = 0;
+	}
+	pthread_mutex_unlock(&host->mutex);
+
+	return status;
+}
+
+int MockInterface::getTopology(unsigned int hostID, hostTopology& topology)
+{
+	if ( !validHost(hostID) )
+		return -1;
+
+	// fixed once the host is made up
+	topology = m_hosts[hostID].topology;
+	return 0;
+}
+
+int MockInterface::readCounters(unsigned int hostID, vector<counterSample>& samples)
+{
+	if ( !validHost(hostID) )
+		return -1;
+
+	mockHost* host = &m_hosts[hostID];
+	samples.clear();
+
+	pthread_mutex_lock(&host->mutex);
+	for ( unsigned int i = 0; i < host->vms.size(); i++ ) {
+		counterSample sample;
+		double noise = 0.8 + (rand_r(&host->seed) % 41) / 100.0;		// +-20%
+
+		sample.localID = host->vms[i].info.localID;
+		sample.numRetiredInsts = 800 + rand_r(&host->seed) % 400;
+		sample.numLLCMisses = host->vms[i].missIntensity * noise * sample.numRetiredInsts / 1000;
+
+		// the lower vCPUs of a guest are the busier ones
+		unsigned int n = host->vms[i].info.numOfVCPUs;
+		for ( unsigned int v = 0; v < n; v++ ) {
+			vcpuSample vcpu;
+			double share = 2.0 * (n - v) / (n * (n + 1));
+
+			vcpu.vcpu = v;
+			vcpu.numRetiredInsts = sample.numRetiredInsts * share;
+			vcpu.numLLCMisses = sample.numLLCMisses * share;
+			sample.vcpus.push_back(vcpu);
+		}
+
+		samples.push_back(sample);
+	}
+	pthread_mutex_unlock(&host->mutex);
+
+	return 0;
+}
+
+int MockInterface::pinVCPU(unsigned int hostID, const string& name, unsigned int vcpu, const string& cpuAffinity)
+{
+	int idx, status = -1;
+
+	if ( !validHost(hostID) )
+		return -1;
+
+	mockHost* host = &m_hosts[hostID];
+
+	// memory stays where it is, like a real vcpu-pin
+	pthread_mutex_lock(&host->mutex);
+	if ( (idx = findVM(host, name)) >= 0 && vcpu < host->vms[idx].vcpuAffinity.size() ) {
+		host->vms[idx].vcpuAffinity[vcpu] = cpuAffinity;
+		if ( vcpu == 0 ) {
+			host->vms[idx].info.cpuAffinity = cpuAffinity;
+		}
+		status = 0;
+	}
+	pthread_mutex_unlock(&host->mutex);
+
+	return status;
+}
+
+int MockInterface::pinVCPUs(unsigned int hostID, const string& name, const vector<string>& cpuAffinity)
+{
+	int idx, status = -1;
+
+	if ( !validHost(hostID) )
+		return -1;
+
+	mockHost* host = &m_hosts[hostID];
+
+	pthread_mutex_lock(&host->mutex);
+	if ( (idx = findVM(host, name)) >= 0 && cpuAffinity.size() == host->vms[idx].vcpuAffinity.size() ) {
+		host->vms[idx].vcpuAffinity = cpuAffinity;
+		host->vms[idx].info.cpuAffinity = cpuAffinity[0];
+		status = 0;
+	}
+	pthread_mutex_unlock(&host->mutex);
+
+	return status;
+}
+
+int MockInterface::migrate(unsigned int srcHostID, unsigned int destHostID, const string& name, int node)
+{
+	int idx;
+
+	if ( !validHost(srcHostID) || !validHost(destHostID) )
+		return -1;
+
+	mockHost* src = &m_hosts[srcHostID];
+	mockHost* dest = &m_hosts[destHostID];
+
+	// lock in host order to avoid deadlock between crossing migrations
+	pthread_mutex_lock(&m_hosts[srcHostID < destHostID ? srcHostID : destHostID].mutex);
+	if ( srcHostID != destHostID ) {
+		pthread_mutex_lock(&m_hosts[srcHostID < destHostID ? destHostID : srcHostID].mutex);
+	}
+
+	idx = findVM(src, name);
+	if ( idx >= 0 ) {
+		mockVM vm = src->vms[idx];
+		src->vms.erase(src->vms.begin() + idx);
+
+		// memory is re-allocated on the home node of the vCPUs, among the nodes of the destination
+		int total = 0;
+		for ( unsigned int i = 0; i < vm.numOfPages.size(); i++ ) {
+			total += vm.numOfPages[i];
+		}
+		vm.numOfPages.assign(dest->topology.nodeMemory.size(), 0);
+		vm.numOfPages[homeNode(dest, vm.info.cpuAffinity)] = total;
+		vm.info.localID = dest->nextLocalID++;
+
+		dest->vms.push_back(vm);
+	}
+
+	if ( srcHostID != destHostID ) {
+		pthread_mutex_unlock(&m_hosts[srcHostID < destHostID ? destHostID : srcHostID].mutex);
+	}
+	pthread_mutex_unlock(&m_hosts[srcHostID < destHostID ? srcHostID : destHostID].mutex);
+
+	return idx >= 0 ? 0 : -1;
+}
+
+int MockInterface::getNUMAPages(unsigned int hostID, unsigned int localID, vector<int>& numOfPages)
+{
+	int idx, status = -1;
+
+	if ( !validHost(hostID) )
+		return -1;
+
+	mockHost* host = &m_hosts[hostID];
+
+	pthread_mutex_lock(&host->mutex);
+	if ( (idx = findVM(host, localID)) >= 0 ) {
+		numOfPages = host->vms[idx].numOfPages;
+		status = 0;
+	}
+	pthread_mutex_unlock(&host->mutex);
+
+	return status;
+}
+
+int MockInterface::migratePages(unsigned int hostID, unsigned int localID, unsigned int node, int maxPages, int& moved)
+{
+	int idx, status = -1;
+
+	moved = 0;
+	if ( !validHost(hostID) )
+		return -1;
+
+	mockHost* host = &m_hosts[hostID];
+
+	pthread_mutex_lock(&host->mutex);
+	if ( (idx = findVM(host, localID)) >= 0 && node < host->vms[idx].numOfPages.size() ) {
+		vector<int>& numOfPages = host->vms[idx].numOfPages;
+
+		// from the node holding most of the rest first
+		while ( moved < maxPages ) {
+			unsigned int from = node;
+
+			for ( unsigned int i = 0; i < numOfPages.size(); i++ ) {
+				if ( i != node && numOfPages[i] > 0 && (from == node || numOfPages[i] > numOfPages[from]) )
+					from = i;
+			}
+			if ( from == node )
+				break;
+
+			int pages = min(numOfPages[from], maxPages - moved);
+			numOfPages[from] -= pages;
+			numOfPages[node] += pages;
+			moved += pages;
+		}
+		status = 0;
+	}
+	pthread_mutex_unlock(&host->mutex);
+
+	return status;
+}
+
+int MockInterface::getDirtyRates(unsigned int hostID, const vector<unsigned int>& localIDs, vector<dirtyRateSample>& rates)
+{
+	dirtyRateSample sample;
+	int idx;
+
+	if ( !validHost(hostID) )
+		return -1;
+
+	mockHost* host = &m_hosts[hostID];
+	rates.clear();
+
+	pthread_mutex_lock(&host->mutex);
+	for ( unsigned int i = 0; i < localIDs.size(); i++ ) {
+		if ( (idx = findVM(host, localIDs[i])) < 0 )
+			continue;
+		sample.localID = localIDs[i];
+		sample.dirtyRate = host->vms[idx].dirtyRate;
+		rates.push_back(sample);
+	}
+	pthread_mutex_unlock(&host->mutex);
+
+	return 0;
+}
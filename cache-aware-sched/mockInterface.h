@@ -0,0 +1,64 @@
+#ifndef _MOCK_INTERFACE_
+#define _MOCK_INTERFACE_
+
+#include <pthread.h>
+#include "remoteInterface.h"
+
+struct mockVM {
+	vmInfo			info;
+	vector<string>	vcpuAffinity;	// [vcpu]
+	double			missIntensity;	// LLC misses per 1000 retired insts
+	vector<int>		numOfPages;		// per NUMA node
+	double			dirtyRate;		// pages/s
+};
+
+struct mockHost {
+	vector<mockVM>	vms;
+	unsigned int	nextLocalID;
+	unsigned int	seed;
+	hostTopology	topology;
+	pthread_mutex_t	mutex;
+};
+
+/*
+ *	In-process driver that simulates a cluster of Xen hosts.
+ *	Every call completes in microseconds, so the scheduler can be exercised
+ *	at thousands of hosts without a real cluster.
+ *
+ *	Host h has fleet[(h-1) % fleet.size()] sockets of coresPerSocket cores,
+ *	each running vmsPerSocket VMs.
+ */
+class MockInterface : public RemoteInterface {
+
+public:
+	MockInterface(unsigned int nHosts, unsigned int vmsPerSocket, const vector<unsigned int>& fleet, unsigned int coresPerSocket);
+	~MockInterface();
+
+	int	listVMs(unsigned int hostID, vector<vmInfo>& vms);
+	int	getLocalID(unsigned int hostID, const string& name, unsigned int& localID);
+	int	getCPUAffinity(unsigned int hostID, const string& name, string& cpuAffinity);
+	int	getTopology(unsigned int hostID, hostTopology& topology);
+
+	int	startMonitoring(unsigned int hostID)	{ return validHost(hostID) ? 0 : -1; }
+	int	stopMonitoring(unsigned int hostID)		{ return validHost(hostID) ? 0 : -1; }
+	int	readCounters(unsigned int hostID, vector<counterSample>& samples);
+
+	int	pinVCPU(unsigned int hostID, const string& name, unsigned int vcpu, const string& cpuAffinity);
+	int	pinVCPUs(unsigned int hostID, const string& name, const vector<string>& cpuAffinity);
+	int	migrate(unsigned int srcHostID, unsigned int destHostID, const string& name, int node = 0);
+
+	int	getNUMAPages(unsigned int hostID, unsigned int localID, vector<int>& numOfPages);
+	int	migratePages(unsigned int hostID, unsigned int localID, unsigned int node, int maxPages, int& moved);
+	int	getDirtyRates(unsigned int hostID, const vector<unsigned int>& localIDs, vector<dirtyRateSample>& rates);
+
+private:
+	bool	validHost(unsigned int hostID)	{ return hostID >= 1 && hostID <= m_numHosts; }
+	int		findVM(mockHost* host, const string& name);
+	int		findVM(mockHost* host, unsigned int localID);
+	int		homeNode(mockHost* host, const string& cpuAffinity);
+
+	unsigned int	m_numHosts;
+	mockHost*		m_hosts;		// [hostID], hostID starts from 1
+};
+
+#endif
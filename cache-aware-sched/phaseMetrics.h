@@ -0,0 +1,91 @@
+#ifndef _PHASE_METRICS_H_
+#define _PHASE_METRICS_H_
+
+#include <pthread.h>
+#include <string>
+
+using namespace std;
+
+// Unix socket the metrics are served on
+#ifndef METRICS_SOCKET_PATH
+#define METRICS_SOCKET_PATH		"/tmp/scheduler-metrics.sock"
+#endif
+
+// 4 buckets per power of two of us, up to 2^30 us (18 min); p50/p99 within 1/4 of the truth
+#define METRICS_SUB_BUCKETS		4
+#define METRICS_BUCKETS			(METRICS_SUB_BUCKETS * 30)
+
+// Phases of a scheduling round
+enum {
+	PHASE_COLLECT = 0,	// counters of a host read, over ssh or from its agent
+	PHASE_PARSE,		// its samples turned into miss rates
+	PHASE_RANK,			// its VMs sorted, their stale dirty rates read, its snapshot published
+	PHASE_ADJUST,		// its own moves: pages to home nodes, or vCPUs over its LLC domains
+	PHASE_BARRIER,		// the global thread waiting for the local rounds of the epoch
+	PHASE_SELECT,		// global sorting and pairing, or the placement search
+	PHASE_ADMIT,		// cost, cooldown and room of the moves, queueing them
+	PHASE_QUEUE,		// a migration waiting for its hosts
+	PHASE_MIGRATE,		// a migration running
+	NUM_PHASES
+};
+
+extern const char*	phase_names[NUM_PHASES];
+
+// Latencies of one phase
+typedef struct phase_histogram_tag {
+	unsigned int	count[METRICS_BUCKETS];
+	unsigned long	max;		// us
+} phase_histogram_t;
+
+// Of any number of histograms, merged
+typedef struct phase_summary_tag {
+	unsigned long	samples;
+	double			p50;		// ms
+	double			p99;
+	double			max;
+} phase_summary_t;
+
+/*
+ *	Latency of every phase of the scheduling rounds, per host, in
+ *	histograms that take no lock.
+ *
+ *	Every histogram is written by one lane, and a lane by one thread at a
+ *	time: the caller makes sure of it. The local rounds of a host never
+ *	overlap, so lane 0 holds them, host by host, and the global thread's
+ *	phases under host 0; each worker of the executor has a lane of its own.
+ *	A writer bumps its counters with plain stores the reader may see a
+ *	little late, never torn. The histograms of a lane and host are made by
+ *	their writer on first use, so hosts that never migrate cost nothing.
+ *
+ *	serve_metrics answers every connection to its Unix socket with p50,
+ *	p99 and max of each phase over all hosts and per host, then closes it:
+ *		socat - UNIX-CONNECT:/tmp/scheduler-metrics.sock
+ */
+typedef struct phase_metrics_tag {
+	unsigned int	num_hosts;
+	unsigned int	num_lanes;
+	phase_histogram_t	**block;	// [lane * (num_hosts+1) + hostID] -> [NUM_PHASES], NULL: nothing yet
+
+	int				listen_sock;	// -1: not serving
+	pthread_t		server;
+	string			path;
+	bool			exit;
+} phase_metrics_t, *phase_metrics_p;
+
+int		create_metrics(struct phase_metrics_tag *m, unsigned int nHosts, unsigned int nLanes);
+// stops serving; every writer has to be done
+void	destroy_metrics(struct phase_metrics_tag *m);
+int		serve_metrics(struct phase_metrics_tag *m, const char *path);
+
+// adds now - *mark to the phase of the host, and moves the mark to now
+void	phase_lap(struct phase_metrics_tag *m, unsigned int lane, unsigned int hostID, int phase, double *mark);
+void	record_phase(struct phase_metrics_tag *m, unsigned int lane, unsigned int hostID, int phase, double seconds);
+
+// the phase over every lane; one host, or all of them (hostID -1)
+void	summarize_phase(struct phase_metrics_tag *m, int hostID, int phase, phase_summary_t *summary);
+// the text the endpoint serves
+string	metrics_report(struct phase_metrics_tag *m);
+// p50/p99/max ms of every phase over all hosts, on one line for the log
+string	metrics_summary(struct phase_metrics_tag *m);
+
+#endif
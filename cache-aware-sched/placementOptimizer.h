@@ -0,0 +1,72 @@
+#ifndef _PLACEMENT_OPTIMIZER_
+#define _PLACEMENT_OPTIMIZER_
+
+#include <vector>
+
+using namespace std;
+
+// Number of threads annealing from different seeds
+#ifndef OPTIMIZER_THREADS
+#define OPTIMIZER_THREADS		4
+#endif
+#define OPTIMIZER_TIME_BUDGET	200			// ms
+#define OPTIMIZER_ITERATIONS	200000		// per thread
+
+// A VM, the bin (socket or host) it is on, its LLC miss rate and the room it takes in a bin
+typedef struct placement_vm_tag {
+	unsigned int	vm;
+	unsigned int	bin;
+	double			missRate;
+	double			size;		// vCPUs or MB, in the unit of the room of the bins
+	bool			pinned;		// stays where it is
+} placement_vm_t;
+
+/*
+ *	vm moves from bin from to bin to. A move with after >= 0 needs the room
+ *	plan[after] leaves behind in its bin, and starts once that one is done;
+ *	the moves of a group (a chain of one-way moves, or a cycle of k of them,
+ *	a swap being a cycle of two) only lower the peak all together.
+ */
+typedef struct placement_move_tag {
+	unsigned int	vm;
+	unsigned int	from;
+	unsigned int	to;
+	int				after;		// index in the plan, -1: there is room now
+	unsigned int	group;
+	double			gain;		// drop of the highest bin of its group
+} placement_move_t;
+
+typedef struct placement_stats_tag {
+	double			peak_before;
+	double			peak_after;
+	unsigned int	groups;
+	unsigned int	dropped;		// moves the room of their bins could not be ordered for
+	unsigned long	iterations;		// all threads
+	double			elapsed;		// ms
+} placement_stats_t;
+
+/*
+ *	Search a placement of the VMs that minimizes the largest miss-rate sum
+ *	of a bin, moving at most budget VMs, none into a bin without room for
+ *	it once the moves are done; room[bin] is what it has free now, and a
+ *	bin that is over it already gets no fuller.
+ *
+ *	Each thread anneals from the current placement with its own seed: a
+ *	step moves a VM of a hot bin to a cold one, swaps it with a VM of a cold
+ *	bin, rotates three VMs over a hot and two cold bins, sends a moved VM
+ *	elsewhere or back home, scored by the sum of the squared bin loads; the
+ *	best placement by peak (then by that sum) of all threads is taken.
+ *
+ *	The moves of that placement are then ordered so every bin has room at
+ *	every step: a move goes at once when its bin has room now, or after a
+ *	move out of that bin frees enough. Moves that cannot be ordered that way
+ *	(a cycle through full bins) are dropped, and peak_after is the peak the
+ *	moves left in the plan reach.
+ *
+ *	The plan is ordered by group, the largest gain first, and within a group
+ *	each move comes after the one it waits for. Bins are 0 .. nBins-1.
+ *	Returns the number of moves.
+ */
+int		optimize_placement(const vector<placement_vm_t>& vms, const vector<double>& room, int budget, vector<placement_move_t>& plan, placement_stats_t* stats);
+
+#endif
@@ -1,12 +1,78 @@
 #ifndef _REMOTE_INTERFACE_
 #define _REMOTE_INTERFACE_
 
+#include <string>
+#include <vector>
+
+#include "hostTopology.h"
+
+using namespace std;
+
+// A guest domain as reported by the hypervisor
+struct vmInfo {
+	string			name;
+	unsigned int	localID;		// domid
+	unsigned int	memory;			// MB
+	string			cpuAffinity;	// cpuset of vCPU 0, e.g. "0-3"
+	unsigned int	numOfVCPUs;
+};
+
+// Counter values of one vCPU of a domain
+struct vcpuSample {
+	unsigned int	vcpu;
+	double			numRetiredInsts;
+	double			numLLCMisses;
+};
+
+// Counter values of a domain for the last sampling period
+struct counterSample {
+	unsigned int	localID;
+	double			numRetiredInsts;
+	double			numLLCMisses;
+	vector<vcpuSample>	vcpus;		// empty when only the domain is counted
+};
+
+// Pages a domain dirtied per second, lately
+struct dirtyRateSample {
+	unsigned int	localID;
+	double			dirtyRate;
+};
+
+/*
+ *	Hypervisor driver.
+ *	All calls return 0 on success and -1 when the host could not be reached
+ *	or the answer could not be parsed.
+ */
 class RemoteInterface {
 
 public:
-	RemoteInterface();
+	RemoteInterface() {}
+	virtual ~RemoteInterface() {}
+
+	// inventory
+	virtual int	listVMs(unsigned int hostID, vector<vmInfo>& vms) = 0;
+	virtual int	getLocalID(unsigned int hostID, const string& name, unsigned int& localID) = 0;
+	virtual int	getCPUAffinity(unsigned int hostID, const string& name, string& cpuAffinity) = 0;
+	virtual int	getTopology(unsigned int hostID, hostTopology& topology) = 0;
+
+	// performance counters
+	virtual int	startMonitoring(unsigned int hostID) = 0;
+	virtual int	stopMonitoring(unsigned int hostID) = 0;
+	virtual int	readCounters(unsigned int hostID, vector<counterSample>& samples) = 0;
+
+	// actions
+	virtual int	pinVCPU(unsigned int hostID, const string& name, unsigned int vcpu, const string& cpuAffinity) = 0;
+	// cpuAffinity[vcpu] for every vCPU of the domain, in a single call
+	virtual int	pinVCPUs(unsigned int hostID, const string& name, const vector<string>& cpuAffinity) = 0;
+	virtual int	migrate(unsigned int srcHostID, unsigned int destHostID, const string& name, int node = 0) = 0;
+
+	// number of pages of the domain on each NUMA node
+	virtual int	getNUMAPages(unsigned int hostID, unsigned int localID, vector<int>& numOfPages) = 0;
+	// moves up to maxPages pages of the domain from the other nodes to node, the domain running; moved: how many did
+	virtual int	migratePages(unsigned int hostID, unsigned int localID, unsigned int node, int maxPages, int& moved) = 0;
 
-private:
+	// dirty rates of the domains localIDs, all measured together in a single call; a domain gone is left out
+	virtual int	getDirtyRates(unsigned int hostID, const vector<unsigned int>& localIDs, vector<dirtyRateSample>& rates) = 0;
 
 };
 
@@ -15,85 +15,169 @@
 
 #include <time.h>
 #include "virtualMachine.h"
+#include "vmIndex.h"
 #include "crew.h"
+#include "sshSession.h"
+#include "remoteInterface.h"
+#include "xenInterface.h"
+#include "mockInterface.h"
+#include "agentInterface.h"
+#include "controlPlane.h"
+#include "placementOptimizer.h"
+#include "migrationCost.h"
+#include "missHistory.h"
+#include "cooldownTable.h"
+#include "domainPartition.h"
+#include "migrationExecutor.h"
+#include "capacityLedger.h"
+#include "phaseMetrics.h"
 
 #define LLC_MISS_SAMPLE_THRESHOLD           10000
 #define RETIRED_INST_SAMPLE_THRESHOLD       500000
 
 #define LOCAL_LLC_THRESHOLD					50
 #define GLOBAL_LLC_THRESHOLD				500
+#define MIGRATION_COST_RATE					(GLOBAL_LLC_THRESHOLD / 10.0)	// miss rate x epochs a second of migration costs
+#define DOWNTIME_WEIGHT						10		// a second paused costs this many seconds of pre-copy
+#define RELIEF_EPOCHS						4		// epochs the relief of a swap is expected to last
 
 #define LOCAL_SCHD_TIME_INTERVAL			10
+#define EPOCH_DEADLINE						5000	// ms, hosts reporting later are stale
 #define GLOBAL_SCHD_TIME_INTERVAL			15
-#define	NUM_OF_NUMA_NODES					2
+#define MOCK_VMS_PER_SOCKET					4
+#define MOCK_CORES_PER_SOCKET				4
+#define DISCOVERY_CREW_SIZE					64
+#define MIGRATION_CREW_SIZE					8	// migrations run at once, at most, within the executor limits
+#ifndef MISS_RATE_ESTIMATOR
+#define MISS_RATE_ESTIMATOR					SMOOTH_MEDIAN	// SMOOTH_NONE, SMOOTH_EWMA or SMOOTH_MEDIAN
+#endif
+#define MIGRATION_BUDGET					4	// VMs moved per epoch by the placement search
+#define DIRTY_RATE_MAX_AGE					60	// sec a dirty rate of a VM no round offers is good for
+#define METRICS_LANE_ROUNDS					0	// the local rounds, host by host, and the global thread as host 0
+#define METRICS_LANE_WORKER					1	// + the index of an executor worker
 
 using namespace std;
 
 typedef pair<int , int > virtualMachineKey;
 
 struct numaMemoryInfo {
-	int	numOfPages[NUM_OF_NUMA_NODES];
+	vector<int>	numOfPages;		// [node]
 };
 
 // Function prototype
-void*	migrationHelperThread(void *);
+int		runMigration(const migration_job_t* );
+void	migrationDone(const migration_job_t* , int );
 void*	globalWorkerThread(void *);
-void*	localWorkerThread(void *);
+void	localRound(unsigned int , unsigned long );
+void	refreshDirtyRates(unsigned int , const vector<unsigned int>& , const vector<unsigned int>& );
+double	monotonic();
+void*	discoveryThread(void *);
+void	pinInventory(unsigned int );
 void	signalHandler(int );
 int		initialize(unsigned int );
-string	sshCommand(unsigned int , string );
-VirtualMachine* getVM(unsigned int );
 numaMemoryInfo	getNUMAAffinity(int , int );
-unsigned int	getCPUAffinity(VirtualMachine* );
-unsigned int	getLocalID(int , VirtualMachine* );
-string			migrate(int , int, VirtualMachine*, int node = 0 );
-string			setCPUAffinity(int , VirtualMachine* );
+unsigned int	getCPUAffinity(unsigned int );
+unsigned int	getLocalID(unsigned int );
+string			migrate(int , int, unsigned int, int node = 0, int* status = NULL );
+string			setCPUAffinity(int , unsigned int , int* status = NULL );
+double			vcpuShare(const counterSample& , unsigned int , unsigned int );
+int		enqueueMigration(int , int , unsigned int , unsigned long , int after = -1 );
+int		enqueueGroup(const vector<placement_move_t>& , size_t , size_t , unsigned long );
+unsigned int	landingSocket(unsigned int , unsigned int );
+double			moveBenefit(const vector<unsigned int>& , double );
+double			swapBenefit(unsigned int , double , unsigned int , double );
+double			oneWayBenefit(unsigned int , double , double );
+double			peakRelief(double , double , double );
+void			planned(unsigned int , double );
+double			migrationsPerRelief();
+void			estimateMigration(unsigned int , migration_cost_t* );
 
 // Global variables
-multimap<int, VirtualMachine*> g_hostToVM_map;
-pthread_mutex_t	g_hostToVM_map_mutex;
-
-map<unsigned int, VirtualMachine*>	g_vmMap;
-map<unsigned int, string>			g_vmNameMap;
-map<int, double>					g_missRatePerHost;
+VMRegistry		g_vms;				// by key
+VMIndex			g_vmIndex(g_vms);	// by (hostID, localID)
+MissHistory		g_history(MISS_RATE_ESTIMATOR);	// recent samples, by key
+CooldownTable	g_cooldown;			// last migration, by key
+CapacityLedger	g_ledger;			// room of every host, by hostID and key
+
+// Migrations planned so far and the peak miss rate they were to take off; the global thread only
+unsigned long	g_plannedMigrations = 0;
+double			g_plannedRelief = 0.0;
+
+// Summary a host publishes at the end of each local round
+struct hostSnapshot {
+	unsigned long	round;		// 0: nothing published yet
+	double			missRate;
+	unsigned int	highLLC_VM;
+	unsigned int	lowLLC_VM;
+};
 
-unsigned int* g_highLLC_VM;
-unsigned int* g_lowLLC_VM;
-pthread_mutex_t*	g_llc_mutex;
+void	searchPlacement(const vector<hostSnapshot>& , unsigned long );
 
-bool*				g_hostMigrating;
-pthread_cond_t*		g_hostMigrating_go;
-pthread_mutex_t*	g_hostMigrating_mutex;
+// [hostID][round & 1]: hosts write round r while the global thread may still read round r-1
+hostSnapshot		(*g_snapshot)[2];
 
-static crew_t		g_localCrew;
+static control_plane_t	g_controlPlane;
 static crew_t		g_globalCrew;
-static crew_t		g_migrationCrew;
+static migration_executor_t	g_executor;
+static phase_metrics_t	g_metrics;
+static session_pool_t	g_sessionPool;
+RemoteInterface*	g_remote = NULL;
+
+// sockets of the mock hosts, host by host in turn
+const unsigned int	g_mockFleet[] = { 2, 4, 2, 8 };
 
-pthread_mutex_t		g_migration_mutex;
-pthread_cond_t		g_migration_done;
-int					g_migrationCompleteCnt = 0;
+vector<hostTopology>	g_topology;			// [hostID], filled by the discovery crew
+
+vector<vmInfo>*		g_inventory;		// [hostID], filled by the discovery crew
+int*				g_inventoryStatus;
 
 string	g_hostPrefix;
 bool g_exitCond = false;
 unsigned int g_numHosts = 0;
+bool g_placementSearch = false;		// whole-cluster search instead of the top and bottom hosts
 
 int main(int argc, char *argv[])
 {
 	int status;
+	string driver;
 	
 	// Default number of workers 1
 	g_numHosts = CREW_SIZE;
 		
 	if (argc < 3) {
-		cerr << "usage: " << argv[0] << " [host_prefix] [number of hosts]" << endl;
+		cerr << "usage: " << argv[0] << " [host_prefix] [number of hosts] [xen|mock][+agent][+search]" << endl;
 		exit(1);
 	}
 
 	g_hostPrefix = argv[1];
 	g_numHosts = atoi(argv[2]);
+	driver = (argc > 3) ? argv[3] : "xen";
+	g_placementSearch = ( driver.find("+search") != string::npos );
 
 	cout << "Host prefix: " << g_hostPrefix << endl;
 	cout << "Num of hosts: " << g_numHosts << endl;
+	cout << "Driver: " << driver << endl;
+	cout << "Placement: " << ( g_placementSearch ? "search" : "top and bottom hosts" ) << endl;
+
+	// Select the hypervisor driver
+	if ( driver.compare(0, 4, "mock") == 0 ) {
+		g_remote = new MockInterface(g_numHosts, MOCK_VMS_PER_SOCKET, vector<unsigned int>(g_mockFleet, g_mockFleet + sizeof(g_mockFleet) / sizeof(g_mockFleet[0])), MOCK_CORES_PER_SOCKET);
+
+	} else {
+		// Open the ssh session pool shared by all threads
+		if ( create_session_pool(&g_sessionPool, g_numHosts, SSH_SESSIONS_PER_HOST) ) {
+			cerr << "Failed to create the ssh session pool.." << endl;
+			exit(1);
+		}
+		g_remote = new XenInterface(&g_sessionPool, g_hostPrefix);
+	}
+
+	// Counters are pushed by the monitoring agents instead of polled
+	if ( driver.find("+agent") != string::npos ) {
+		// the agents of mock hosts run locally (server/agent -n <hosts>)
+		string agentHost = ( driver.compare(0, 4, "mock") == 0 ) ? "localhost" : "";
+		g_remote = new AgentInterface(g_remote, g_numHosts, g_hostPrefix, agentHost);
+	}
 
 	// Initalize
 	if ( initialize(g_numHosts) ) {
@@ -101,10 +185,16 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 
-	// Create localCrew thread
-	status = create_crew(&g_localCrew, g_numHosts, localWorkerThread);
+	// Latency of every phase of the rounds, served on a Unix socket
+	create_metrics(&g_metrics, g_numHosts, METRICS_LANE_WORKER + MIGRATION_CREW_SIZE);
+	if ( serve_metrics(&g_metrics, METRICS_SOCKET_PATH) != 0 ) {
+		cerr << "Cannot serve the metrics on " << METRICS_SOCKET_PATH << endl;
+	}
+
+	// Create the control plane running the local rounds
+	status = create_control_plane(&g_controlPlane, min(g_numHosts, (unsigned int)CONTROL_CREW_SIZE), g_numHosts, localRound);
 	if ( status != 0 ) {
-		cerr << "Failed to create local crew " << endl; 
+		cerr << "Failed to create control plane " << endl; 
 	}
 	
 	// Create globalCrew thread
@@ -113,10 +203,10 @@ int main(int argc, char *argv[])
 		cerr << "Failed to create global crew " << endl; 
 	}
 
-	// Create migrationHelper thread
-	status = create_crew(&g_migrationCrew, 1, migrationHelperThread);
+	// Create the executor running the migrations
+	status = create_executor(&g_executor, MIGRATION_CREW_SIZE, g_numHosts, runMigration, migrationDone);
 	if ( status != 0 ) {
-		cerr << "Failed to create migrationHelper crew " << endl; 
+		cerr << "Failed to create the migration executor " << endl; 
 	}
 
 	// Signal handling
@@ -127,9 +217,19 @@ int main(int argc, char *argv[])
 	sigaction(SIGINT, &sa, NULL);
 
 	// Wait crew thread
-	wait_crew(&g_localCrew);
 	wait_crew(&g_globalCrew);
-	wait_crew(&g_migrationCrew);
+	destroy_executor(&g_executor);
+	destroy_control_plane(&g_controlPlane);
+	destroy_metrics(&g_metrics);
+
+	for ( unsigned int hostID = 1; hostID <= g_numHosts; hostID++ ) {
+		g_remote->stopMonitoring(hostID);
+	}
+
+	delete g_remote;
+	if ( driver.compare(0, 4, "mock") != 0 ) {
+		destroy_session_pool(&g_sessionPool);
+	}
 
 	cout << "Close... " << endl;
 	return 0;
@@ -143,241 +243,239 @@ void signalHandler(int signo)
 
 		sleep(3);
 		
-		cout << "Request to cancnel migration threads" << endl;
+		// the migrations in flight finish when the executor is destroyed
+		cout << "Request to cancnel the global thread" << endl;
 		if ( pthread_cancel(g_globalCrew.worker[0].thread) != 0 ) {
 			cout << "Cannot kill the global thread" << endl;
 		}
 
-		if ( pthread_cancel(g_migrationCrew.worker[0].thread) != 0 ) {
-		
-			cout << "Cannot kill the migrationHelper thread" << endl;
-		}
-		
-		for ( int i = 0; i < g_localCrew.worker_size; i++ ) {
-			
-			cout << "Request to cancel thread[" << i << "]" << endl;
-
-			if ( pthread_cancel(g_localCrew.worker[i].thread) != 0 ) {
-				cerr << "Cannot kill the local thread[ " << i << "]" << endl;
-			}
-		}
-
 	}
 }
 
 int initialize(unsigned int nHosts)
 {
-	ostringstream os;
-	string remoteCmd;
-	string ret;
-	unsigned int numOfVMs;
-	unsigned int theKey = 0;
+	unsigned int nVMs = 0;
+	crew_t	discoveryCrew;
+	struct timespec begin, end;
 
 	cout << "Initalizing... " << endl;
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+
+	// 1. obtain name, localID and cpu-affinity of each virtual machine on all hosts at once
+	g_inventory = new vector<vmInfo> [nHosts+1];
+	g_inventoryStatus = new int [nHosts+1];
+	g_topology.resize(nHosts+1);
+
+	if ( create_crew(&discoveryCrew, min(nHosts, (unsigned int)DISCOVERY_CREW_SIZE), discoveryThread) != 0 ) {
+		cerr << "Failed to create discovery crew " << endl;
+		return -1;
+	}
+	wait_crew(&discoveryCrew);
+
+	// 2. register them in host order
+	for (unsigned int hostID = 1; hostID <= nHosts; hostID++) {
+		nVMs += g_inventory[hostID].size();
+	}
+	g_vms.reserve(nVMs);
+	g_ledger.resize(nHosts, nVMs);
 
-	// check all hosts
 	for (unsigned int hostID = 1; hostID <= nHosts; hostID++) 
 	{
-		// 1. obtain number of virtual machines
-		remoteCmd = "";
-		remoteCmd = "xl list | wc -l";
-		numOfVMs = atoi(sshCommand(hostID, remoteCmd).c_str()) - 2;
-
-		for (unsigned int j = 0; j < numOfVMs; j++) {
-
-			// 2. obtain name for each virtual machine
-			remoteCmd = "";
-			remoteCmd = "xl list | awk 'NR==";
-			stringstream vmid;
-			vmid << (j+3) << " {print $1}'";
-			string vmName = sshCommand(hostID, remoteCmd + vmid.str());
-			vmName.erase(vmName.end()-1);
-
-			// 3. obtain cpu-affinity for each virtual machine
-			remoteCmd = "";
-			remoteCmd = "xl vcpu-list | grep -Rw " + vmName + " | awk '{print $7}'";
-			string cpu_affinity = sshCommand(hostID, remoteCmd);
-			cpu_affinity.erase(cpu_affinity.end()-1); 
-
-			// 4. obtaint locaiID for each virtual machine
-			remoteCmd = "";
-			remoteCmd = "xl list | grep -Rw " + vmName + " | awk '{print $2}'";
-			unsigned int	localID = atoi(sshCommand(hostID, remoteCmd).c_str());
-
-			// Create new VM
-			VirtualMachine* vm;
-			if ( cpu_affinity == "0-3") {
-				vm = new VirtualMachine(theKey, hostID, localID, 0);
-			} else {
-				vm = new VirtualMachine(theKey, hostID, localID, 1);
+		vector<vmInfo>& vms = g_inventory[hostID];
+
+		if ( g_inventoryStatus[hostID] != 0 ) {
+			cerr << "Host[" << hostID << "] cannot list virtual machines or its topology" << endl;
+			return -1;
+		}
+		g_ledger.setHost(hostID, g_topology[hostID]);
+
+		for (unsigned int j = 0; j < vms.size(); j++) {
+			int socket = find_socket(g_topology[hostID], vms[j].cpuAffinity);
+
+			if ( socket < 0 ) {
+				cout << "Host[" << hostID << "] " << vms[j].name << " is not pinned to a socket: " << vms[j].cpuAffinity << endl;
+				socket = 0;
 			}
 
 			// Register VM 
-			g_vmMap.insert(pair<int, VirtualMachine*>(theKey, vm));
-			g_vmNameMap.insert(pair<int, string>(theKey, vmName));
-			g_hostToVM_map.insert(pair<int, VirtualMachine*>(hostID, vm));
-
-			// 
-			theKey ++ ;
+			unsigned int vm = g_vms.add(vms[j].name, hostID, vms[j].localID, socket);
+			g_vms.setMemory(vm, vms[j].memory);
+			g_vms.setNumOfVCPUs(vm, max(vms[j].numOfVCPUs, 1u));
+			g_vmIndex.insert(vm);
+			g_ledger.place(vm, hostID, socket, g_vms.memory(vm), g_vms.numOfVCPUs(vm));
 		}
 
+		hostTopology& topology = g_topology[hostID];
+		cout << "Host[" << hostID << "] " << topology.socketCPUs.size() << " sockets:";
+		for ( unsigned int s = 0; s < topology.socketCPUs.size(); s++ ) {
+			cout << " [" << topology.socketCPUs[s] << "] " << topology.numOfCores[s] << " cores, node " << topology.socketNode[s] << ";";
+		}
+		cout << " " << topology.llcCPUs.size() << " LLC domains, " << topology.nodeMemory.size() << " nodes" << endl;
 		cout << "Host[" << hostID << "] initialize completed.. " << endl;
 	}
 
-	// Verify
-	cout << "Verify VMs" << endl;
-	map<unsigned int, VirtualMachine*>::iterator it;
-	VirtualMachine *vm;
-	for ( it = g_vmMap.begin(); it!= g_vmMap.end(); it++ ) {
-
-		vm = static_cast<VirtualMachine*>(it->second);
-		cout << "[" << it->first << "] " << vm->getLocalID() << endl;
-	}
-
-	//
-	pthread_mutex_init(&g_hostToVM_map_mutex, NULL);	
-
-	g_highLLC_VM = new unsigned int [g_numHosts+1];
-	g_lowLLC_VM = new unsigned int [g_numHosts+1];
-	g_llc_mutex = new pthread_mutex_t [g_numHosts+1];
+	delete [] g_inventory;
+	delete [] g_inventoryStatus;
 
-	g_hostMigrating = new bool [g_numHosts+1];
-	g_hostMigrating_mutex = new pthread_mutex_t [g_numHosts+1];
-	g_hostMigrating_go = new pthread_cond_t [g_numHosts+1];
+	g_history.resize(g_vms.size());
+	g_cooldown.resize(g_vms.size());
 
-	for ( unsigned int i = 0; i <= g_numHosts; i ++) {
-		pthread_mutex_init(&g_llc_mutex[i], NULL);
-		pthread_mutex_init(&g_hostMigrating_mutex[i], NULL);
-		pthread_cond_init(&g_hostMigrating_go[i], NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	cout << "Discovered " << g_vms.size() << " VMs on " << nHosts << " hosts in "
+		 << (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9 << " sec, "
+		 << g_vms.footprint() << " bytes" << endl;
 
-		g_hostMigrating[i] = false;
+	// Verify
+	cout << "Verify VMs" << endl;
+	for ( unsigned int vm = 0; vm < g_vms.size(); vm++ ) {
+		cout << "[" << vm << "] " << g_vms.localID(vm) << endl;
 	}
 
-	pthread_mutex_init(&g_migration_mutex, NULL);
-	pthread_cond_init(&g_migration_done, NULL);
+	g_snapshot = new hostSnapshot [g_numHosts+1][2];
+	memset(g_snapshot, 0x00, sizeof(hostSnapshot) * 2 * (g_numHosts+1));
+
 
 	return 0;
 }
 
-string sshCommand(unsigned int hostID, string command)
+/*
+ *	Each discovery worker fetches the inventory of every crew-size'th host
+ */
+void* discoveryThread(void* arg)
 {
-	ostringstream oss;
-	string cmd;
-
-	oss << "ssh " << g_hostPrefix << setw(2) << setfill('0') << hostID << " " << command;
-	cmd = oss.str();
-
-	//cout << cmd << endl;
-		
-	FILE* pipe = popen(cmd.c_str(), "r");
-
-	if (!pipe) 
-		return string("ERROR");
-
-	char buffer[128];
-	std::string result = "";
+	worker_p mine = (worker_t*)arg;
+	crew_p crew = mine->crew;
 
-	while(!feof(pipe)) 
-	{
-		if(fgets(buffer, 128, pipe) != NULL) {
-			// *(buffer+(strlen(buffer)-1))=0;
-			result += buffer;
+	for ( unsigned int hostID = mine->index+1; hostID <= g_numHosts; hostID += crew->worker_size ) {
+		g_inventoryStatus[hostID] = g_remote->listVMs(hostID, g_inventory[hostID]);
+		if ( g_inventoryStatus[hostID] == 0 ) {
+			g_inventoryStatus[hostID] = g_remote->getTopology(hostID, g_topology[hostID]);
+		}
+		if ( g_inventoryStatus[hostID] == 0 ) {
+			pinInventory(hostID);
 		}
+		g_remote->startMonitoring(hostID);
 	}
 
-	pclose(pipe);
-	return result;
+	return NULL;
 }
 
-void* migrationHelperThread(void* arg)
+/*
+ *	The other vCPUs of a VM stay wherever Xen left them; pin them all
+ *	around the socket of vCPU 0, so the VM is where the scheduler thinks
+ */
+void pinInventory(unsigned int hostID)
 {
-	int status;
-	worker_p mine = (worker_t*)arg;
-	crew_p crew = mine->crew;
-	work_p	work;
-	req_t	item;
-	string	remoteCmd;
-	stringstream hostID;
-
-	while (! g_exitCond) {
-		
-		VirtualMachine* vm;
-		status = pthread_mutex_lock(&crew->mutex);
-		if ( status != 0 ) {
-			cerr << "Lock migrationHelperThread mutex lock" << endl;
+	const hostTopology& topology = g_topology[hostID];
+	vector<vmInfo>& vms = g_inventory[hostID];
+	vector<unsigned int> sockets;
+	vector<string> cpus;
+
+	for ( unsigned int j = 0; j < vms.size(); j++ ) {
+		int home = find_socket(topology, vms[j].cpuAffinity);
+
+		vcpu_sockets(topology, home < 0 ? 0 : home, max(vms[j].numOfVCPUs, 1u), sockets);
+		cpus.clear();
+		for ( unsigned int v = 0; v < sockets.size(); v++ ) {
+			cpus.push_back(topology.socketCPUs[sockets[v]]);
 		}
-		
-		if (crew->first == NULL) {
-			status = pthread_cond_wait(&crew->go, &crew->mutex);
-			if ( status != 0 ) {
-				cerr << "Wait for work in migrationHelperThread " << endl;
-			}
-		}
-	
-		work = crew->first;
-		crew->first = work->next;
-
-		if (crew->first == NULL)
-			crew->last = NULL;
 
-		memcpy(&item, &work->data, sizeof(work->data));
-			
-		status = pthread_mutex_unlock(&crew->mutex);
-		if ( status != 0 ) {
-			cerr << "Lock migrationHelperThread mutex unlock" << endl;
+		if ( g_remote->pinVCPUs(hostID, vms[j].name, cpus) != 0 ) {
+			cerr << "[" << hostID << "] Cannot pin the vCPUs of " << vms[j].name << endl;
 		}
+	}
+}
+
+/*
+ *	A migration of the executor, on one of its workers
+ */
+int runMigration(const migration_job_t* job)
+{
+	int status;
+	double mark = monotonic();
 
-		vm = getVM(item.vmKey);
-		cout << "MigrationHelper: " << migrate( item.srcHostID, item.destHostID, vm ) << endl;
+	record_phase(&g_metrics, METRICS_LANE_WORKER + job->worker, job->srcHostID, PHASE_QUEUE, job->started - job->queued);
 
-		pthread_mutex_lock(&g_migration_mutex);
-		g_migrationCompleteCnt ++;
-		pthread_cond_signal(&g_migration_done);
-		pthread_mutex_unlock(&g_migration_mutex);
+	cout << "MigrationHelper: " << migrate(job->srcHostID, job->destHostID, job->vm, 0, &status) << endl;
+	phase_lap(&g_metrics, METRICS_LANE_WORKER + job->worker, job->srcHostID, PHASE_MIGRATE, &mark);
 
-		//free(work);
-		delete work;
-		
-		status = pthread_mutex_lock(&crew->mutex);
-		crew->work_count--;
-		status = pthread_mutex_unlock(&crew->mutex);
+	return status;
+}
 
-	}
-	return NULL;
+// The VM may be planned again once this returns
+void migrationDone(const migration_job_t* job, int status)
+{
+	double now = monotonic();
+
+	// the room it reserved is its own now, or free again
+	if ( status == 0 )
+		g_ledger.commit(job->vm);
+	else
+		g_ledger.release(job->vm, g_vms.cpuAffinity(job->vm));
+	g_vms.setState(job->vm, VM_RUNNING);
+
+	cout << "Migration of " << g_vms.name(job->vm) << " " << job->srcHostID << " -> " << job->destHostID
+		 << ( status == 0 ? " done" : " failed" ) << " in " << now - job->started << " s, planned in epoch " << job->epoch
+		 << ", queued " << job->started - job->queued << " s" << endl;
 }
 
 void* globalWorkerThread(void* arg)
 {
-	worker_p mine = (worker_t*)arg;
-	crew_p crew = mine->crew;
 	map<int, double>		p_missRatePerHost;	// private
+	vector<hostSnapshot>	p_snapshot(g_numHosts+1);
+	unsigned long	round;
+	control_stats_t	epoch;
 	int highLLCHostID = 1, lowLLCHostID = 1;
 	string	remoteCmd;
 	stringstream hostID;
-	req_t	work_item;
-	work_p	request;
-	int		status;
-	unsigned int		prevMigratedHighLLC_VM = -1;
-	unsigned int		prevMigratedLowLLC_VM = -1;
-	int		migrationThreshold = 0;
+	unsigned int	queued, running;
+	double	now, highRate, lowRate, oneWayNet, swapNet, mark;
+	bool	swappable, oneWay;
 
 	while (! g_exitCond) {
 	
-		VirtualMachine* highLLC_VM;
-		VirtualMachine* lowLLC_VM;
-		
-		pthread_mutex_lock(&crew->mutex);
+		unsigned int	highLLC_VM;
+		unsigned int	lowLLC_VM;
 		
-		if ( g_missRatePerHost.size() != g_numHosts ) {
-			pthread_cond_wait(&crew->go, &crew->mutex);
+		// 0. Run the local round of every host, until the epoch deadline
+		mark = monotonic();
+		if ( control_round(&g_controlPlane, EPOCH_DEADLINE, &epoch) != 0 ) {
+			break;
 		}
+		phase_lap(&g_metrics, METRICS_LANE_ROUNDS, 0, PHASE_BARRIER, &mark);
+
+		round = epoch.round;
+		now = monotonic();
+		cout << "Epoch " << round << ": " << epoch.on_time << "/" << g_numHosts << " hosts on time, "
+			 << epoch.late << " late, " << epoch.busy << " busy, "
+			 << epoch.late_arrivals << " late arrivals (max " << epoch.max_lateness << " ms), "
+			 << epoch.elapsed << " ms" << endl;
 		cout << "Global thread wake up ! " << endl;
+		cout << "Phases (p50/p99/max ms): " << metrics_summary(&g_metrics) << endl;
 
+		executor_load(&g_executor, &queued, &running);
+		cout << "Migrations: " << queued << " queued, " << running << " running, " << g_executor.completed << " done, "
+			 << g_executor.failed << " failed, longest wait " << g_executor.max_wait << " s" << endl;
+
+		// 0.1 Take the snapshots the hosts published in this round; late hosts are stale and left out
 		p_missRatePerHost.clear();
-		p_missRatePerHost.insert(g_missRatePerHost.begin(), g_missRatePerHost.end());
-		g_missRatePerHost.clear();
+		for ( unsigned int h = 1; h <= g_numHosts; h++ ) {
 
-		pthread_mutex_unlock(&crew->mutex);
+			if ( ! g_controlPlane.on_time[h] )
+				continue;
+
+			p_snapshot[h] = g_snapshot[h][round & 1];
+			if ( p_snapshot[h].round == round ) {
+				p_missRatePerHost[h] = p_snapshot[h].missRate;
+			}
+		}
+
+		if ( g_placementSearch ) {
+			// 1. Search the placement of every VM reported in this epoch
+			searchPlacement(p_snapshot, round);
+			sleep(LOCAL_SCHD_TIME_INTERVAL);
+			continue;
+		}
 
 		// 1. Lookup the VMs
 		vector< pair<double, int> >  vt;
@@ -395,6 +493,12 @@ void* globalWorkerThread(void* arg)
 		for (it_vt = vt.begin(); it_vt != vt.end(); it_vt++ ) {
 			cout << "Host [" << it_vt->second << "]: " << it_vt->first << endl;
 		}
+		phase_lap(&g_metrics, METRICS_LANE_ROUNDS, 0, PHASE_SELECT, &mark);
+
+		if ( vt.size() < 2 ) {
+			cout << "Not enough hosts in the epoch" << endl;
+			goto exit;
+		}
 
 		highLLCHostID = vt.begin()->second;
 		lowLLCHostID = vt.rbegin()->second;
@@ -406,391 +510,750 @@ void* globalWorkerThread(void* arg)
 			goto exit;
 		}
 
-		if ( (p_missRatePerHost[highLLCHostID] - p_missRatePerHost[lowLLCHostID]) < GLOBAL_LLC_THRESHOLD ) {
-			cout << "Does not meet the swap requirements" << endl;
-			goto exit;
-		}
 		
 		// 2. Get two candidate VMs
-		pthread_mutex_lock(&g_llc_mutex[highLLCHostID]);
-		highLLC_VM = getVM(g_highLLC_VM[highLLCHostID]);
-		pthread_mutex_unlock(&g_llc_mutex[highLLCHostID]);
-
-		pthread_mutex_lock(&g_llc_mutex[lowLLCHostID]);
-		lowLLC_VM = getVM(g_lowLLC_VM[lowLLCHostID]);
-		pthread_mutex_unlock(&g_llc_mutex[lowLLCHostID]);
+		highLLC_VM = p_snapshot[highLLCHostID].highLLC_VM;
+		lowLLC_VM = p_snapshot[lowLLCHostID].lowLLC_VM;
 
-		if ( highLLC_VM == NULL || lowLLC_VM == NULL ) {
-			cout << g_highLLC_VM[highLLCHostID] << " : " << g_lowLLC_VM[lowLLCHostID] << endl;
+		if ( !g_vms.contains(highLLC_VM) || !g_vms.contains(lowLLC_VM) ) {
+			cout << p_snapshot[highLLCHostID].highLLC_VM << " : " << p_snapshot[lowLLCHostID].lowLLC_VM << endl;
 			goto exit;
 		}
 
-		if ( highLLC_VM->getHostID() == lowLLC_VM->getHostID() ) {
+		if ( g_vms.hostID(highLLC_VM) == g_vms.hostID(lowLLC_VM) ) {
 			cout << "Error !!! host is same" << endl;
 			goto exit;
 		}
 
-		if ( ( prevMigratedHighLLC_VM == highLLC_VM->getKey() ) && ( prevMigratedLowLLC_VM == lowLLC_VM->getKey() ) && ( migrationThreshold < 5 ) ) {
-			migrationThreshold ++ ;
-			cout << "VM[" << prevMigratedHighLLC_VM << "] and VM[" << prevMigratedLowLLC_VM << "] were already migrated in the last time." << endl;
+		// still on its way from an earlier epoch
+		if ( g_vms.state(highLLC_VM) != VM_RUNNING || g_vms.state(lowLLC_VM) != VM_RUNNING ) {
+			cout << "VM[" << highLLC_VM << "] or VM[" << lowLLC_VM << "] is migrating" << endl;
 			goto exit;
-
 		}
-		prevMigratedHighLLC_VM = highLLC_VM->getKey();
-		prevMigratedLowLLC_VM = lowLLC_VM->getKey();
-		migrationThreshold = 0;
 
-		// 3. Swap
-		cout << "Swap " << g_vmNameMap[highLLC_VM->getKey()] << "(" << highLLC_VM->getHostID() << ") and " << g_vmNameMap[lowLLC_VM->getKey()] << "(" << lowLLC_VM->getHostID() << ")" << endl;
+		// the hot VM may not be cooling down from its last move, or about to go straight back; nor the cold one to swap
+		if ( !g_cooldown.admit(highLLC_VM, lowLLCHostID, now) ) {
+			cout << "VM[" << highLLC_VM << "] migrated too recently" << endl;
+			goto exit;
+		}
+		// counted below, if the pair is dropped for it
+		swappable = g_cooldown.allows(lowLLC_VM, highLLCHostID, now);
 
-		// 3.1 send and signal to the migration helper thread
-		{
-			pthread_mutex_lock(&g_migrationCrew.mutex);
-
-			//work_item processed.
-			work_item.srcHostID = highLLCHostID;
-			work_item.destHostID = lowLLCHostID;
-			work_item.localID = highLLC_VM->getLocalID();
-			work_item.vmKey = highLLC_VM->getKey();
-
-			request = new work_t;		
-			memcpy(&request->data, &work_item, sizeof(req_t));
-			request->next = NULL;
-
-			// Adjust queue pointer
-			if (g_migrationCrew.first == NULL) {
-				g_migrationCrew.first = request;
-				g_migrationCrew.last = request;
-			} else {
-				g_migrationCrew.last->next = request;
-				g_migrationCrew.last = request;
-			}
+		// 2.1 the hot VM alone when the low host has room for it, one migration instead of two;
+		// to swap, each host has to hold the other VM while its own is still there
+		highRate = p_missRatePerHost[highLLCHostID];
+		lowRate = p_missRatePerHost[lowLLCHostID];
+		oneWayNet = swapNet = 0.0;
 
-			g_migrationCrew.work_count++;
+		if ( g_ledger.moveFits(highLLC_VM, lowLLCHostID, landingSocket(highLLC_VM, lowLLCHostID)) ) {
+			oneWayNet = oneWayBenefit(highLLC_VM, highRate, lowRate);
+		}
+		if ( swappable && g_ledger.swapFits(highLLC_VM, lowLLCHostID, landingSocket(highLLC_VM, lowLLCHostID), lowLLC_VM, highLLCHostID, landingSocket(lowLLC_VM, highLLCHostID)) ) {
+			swapNet = swapBenefit(highLLC_VM, highRate, lowLLC_VM, lowRate);
+		}
 
-			// Signal to migrationCrew
-			status = pthread_cond_signal (&g_migrationCrew.go);
+		// the relief has to pay for the migrations
+		if ( oneWayNet <= 0.0 && swapNet <= 0.0 ) {
+			cout << "Does not meet the swap requirements" << endl;
+			if ( !swappable )
+				g_cooldown.suppress(lowLLC_VM, highLLCHostID, now);
+			goto exit;
+		}
+		oneWay = ( oneWayNet >= swapNet );
 
-			if (status != 0) {
-				delete g_migrationCrew.first;
-				g_migrationCrew.first = NULL;
-				g_migrationCrew.work_count = 0;
-				pthread_mutex_unlock(&g_migrationCrew.mutex);
-				exit(1);
-			}
-			
-			pthread_mutex_unlock(&g_migrationCrew.mutex);
+		// hold the room before anything is queued
+		if ( oneWay ? !g_ledger.reserve(highLLC_VM, lowLLCHostID, landingSocket(highLLC_VM, lowLLCHostID))
+					: !g_ledger.reserveSwap(highLLC_VM, lowLLCHostID, landingSocket(highLLC_VM, lowLLCHostID), lowLLC_VM, highLLCHostID, landingSocket(lowLLC_VM, highLLCHostID)) ) {
+			cout << "VM[" << highLLC_VM << "] and VM[" << lowLLC_VM << "] do not fit on each other's host" << endl;
+			goto exit;
 		}
 
-		// 3.2 
-		{
+		g_cooldown.record(highLLC_VM, highLLCHostID, now);
+		if ( !oneWay )
+			g_cooldown.record(lowLLC_VM, lowLLCHostID, now);
 
-			// migrate the VM
-			cout << "Global: " << migrate(lowLLCHostID, highLLCHostID, lowLLC_VM) << endl;
+		planned(oneWay ? 1 : 2, peakRelief(highRate, lowRate, g_vms.missRate(highLLC_VM) - ( oneWay ? 0.0 : g_vms.missRate(lowLLC_VM) )));
 
+		// 3. Swap, or move
+		if ( oneWay ) {
+			cout << "Move " << g_vms.name(highLLC_VM) << "(" << g_vms.hostID(highLLC_VM) << ") to " << lowLLCHostID << endl;
+		} else {
+			cout << "Swap " << g_vms.name(highLLC_VM) << "(" << g_vms.hostID(highLLC_VM) << ") and " << g_vms.name(lowLLC_VM) << "(" << g_vms.hostID(lowLLC_VM) << ")" << endl;
 		}
-		
-		// 3.3 Finalize
-		{
-			pthread_mutex_lock(&g_migration_mutex);
-			g_migrationCompleteCnt++;
-
-			if ( g_migrationCompleteCnt != 2 ) {
-				pthread_cond_wait(&g_migration_done, &g_migration_mutex);
-			}
-			g_migrationCompleteCnt = 0;
-			pthread_mutex_unlock(&g_migration_mutex);
 
-			cout << "Swap completed... " << endl;
+		// 3.1 hand them to the executor; the next epoch does not wait for them
+		if ( enqueueMigration(highLLCHostID, lowLLCHostID, highLLC_VM, round) != 0 ) {
+			cerr << "Cannot queue the migration of " << g_vms.name(highLLC_VM) << endl;
 		}
-exit:
-
-		for ( unsigned int i = 0; i <= g_numHosts; i++) {
-			pthread_cond_signal(&g_hostMigrating_go[i]);
+		if ( !oneWay && enqueueMigration(lowLLCHostID, highLLCHostID, lowLLC_VM, round) != 0 ) {
+			cerr << "Cannot queue the migration of " << g_vms.name(lowLLC_VM) << endl;
 		}
 
+exit:
+		phase_lap(&g_metrics, METRICS_LANE_ROUNDS, 0, PHASE_ADMIT, &mark);
+		cout << "Cooldown: " << g_cooldown.suppressed() << " migrations suppressed, "
+			 << g_cooldown.oscillations() << " of them cycles" << endl;
+		cout << "Capacity: " << g_ledger.rejected() << " plans did not fit, " << g_ledger.inFlight() << " reservations held" << endl;
+		cout << "Planned: " << g_plannedMigrations << " migrations for " << g_plannedRelief << " of peak removed, "
+			 << migrationsPerRelief() << " per 1000" << endl;
+		sleep(LOCAL_SCHD_TIME_INTERVAL);
+
 	}
 
 	cout << "Global thread exit..." << endl;
 	return NULL;
 }
 
-void* localWorkerThread(void *arg)
+double monotonic()
 {
-	worker_p mine = (worker_t*)arg;
-	crew_p crew = mine->crew;
-	unsigned int hostID = mine->index+1;
-	printf("Crew %d starting\n", hostID);
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
 
-	map<int, double>		missRatePerSocket;
-	vector< pair<unsigned int, double> >	vmVector;
-	vector< pair<unsigned int, double> >::iterator	vmVector_it;
-	unsigned int	cpuAffinity[NUM_OF_NUMA_NODES] = {0, 1};
-	int		cpuAffinityIdx = 0;
-	string	remoteCmd;
-	int		i = 0;
-	int		numOfVMsPerSocket[NUM_OF_NUMA_NODES] = {0, 0};
+/*
+ *	Estimated cost of migrating a VM, from its memory and the dirty rate its
+ *	host's rounds read last (see refreshDirtyRates) or its last migration showed
+ */
+void estimateMigration(unsigned int vm, migration_cost_t* cost)
+{
+	estimate_migration(g_vms.memory(vm), g_vms.dirtyRate(vm), cost);
+}
 
-	remoteCmd = "";	
-	remoteCmd = "xenonmon-set.py Inst_LLC -t 7200 -n 1 ";
-	cout << sshCommand(hostID, remoteCmd) << endl;
+/*
+ *	Net benefit of a group of migrations: what the moves take off the peak
+ *	over RELIEF_EPOCHS, less the cost of every one of them. Move only when
+ *	it is positive.
+ */
+double moveBenefit(const vector<unsigned int>& vms, double relief)
+{
+	migration_cost_t	cost;
+	ostringstream	names;
+	double	seconds = 0.0, penalty;
+
+	for ( unsigned int i = 0; i < vms.size(); i++ ) {
+		estimateMigration(vms[i], &cost);
+		seconds += cost.duration + DOWNTIME_WEIGHT * cost.downtime / 1000.0;
+		names << ( i ? ", " : "" ) << g_vms.name(vms[i]);
+
+		cout << "Migration cost " << g_vms.name(vms[i]) << ": " << g_vms.memory(vms[i]) << " MB, "
+			 << g_vms.dirtyRate(vms[i]) << " pages/s -> " << cost.duration << " s, "
+			 << cost.downtime << " ms down, " << cost.bytes / (1024 * 1024) << " MB in " << cost.rounds << " rounds" << endl;
+	}
 
-	while (! g_exitCond) {
+	penalty = MIGRATION_COST_RATE * seconds;
 
-		remoteCmd = "";
-		remoteCmd = "xenonmon-do.py Inst_LLC -t 7200 -n 1 2> /dev/null";
-		istringstream result(sshCommand(hostID, remoteCmd));
-		string line;
+	cout << "Move " << names.str() << ": relief " << relief << " x "
+		 << RELIEF_EPOCHS << " epochs, cost " << penalty << ", net " << relief * RELIEF_EPOCHS - penalty << endl;
 
-		unsigned int localID;
-		double numOfRetiredInsts;
-		double numOfLLCMisses;
-		double missRate = 0.0;
-		VirtualMachine* vm;
+	return relief * RELIEF_EPOCHS - penalty;
+}
 
-		
-		vmVector.clear();	
-		missRatePerSocket.clear();
-		g_missRatePerHost[hostID] = 0;
-		numOfVMsPerSocket[0] = numOfVMsPerSocket[1] = 0;
-		
-		// For each virtual machine ( a line idicates a virtual machine )
-		while (getline(result, line)) {
+// The VMs of two hosts trade places
+double swapBenefit(unsigned int highVM, double highMissRate, unsigned int lowVM, double lowMissRate)
+{
+	unsigned int	vms[2] = { highVM, lowVM };
+	return moveBenefit(vector<unsigned int>(vms, vms + 2), peakRelief(highMissRate, lowMissRate, g_vms.missRate(highVM) - g_vms.missRate(lowVM)));
+}
 
-			// 1. Obtain # of retired insts and # of LLC misses.
-			istringstream iss(line);
-			
-			localID = 0;
-			numOfRetiredInsts = 0.0;
-			numOfLLCMisses = 0.0;
-			missRate = 0.0;
+// Only the VM of the hotter host moves
+double oneWayBenefit(unsigned int highVM, double highMissRate, double lowMissRate)
+{
+	return moveBenefit(vector<unsigned int>(1, highVM), peakRelief(highMissRate, lowMissRate, g_vms.missRate(highVM)));
+}
 
-			iss >> localID >> numOfRetiredInsts >> numOfLLCMisses;
-			// cout << "Input Stream: " << localID << "\t" << numOfRetiredInsts << "\t" << numOfLLCMisses << endl;
-			if ( localID == 0 ) continue;	// Except for Domain-0
-	
-			map<unsigned int, VirtualMachine*>::iterator it;
-
-			for ( it = g_vmMap.begin(); it != g_vmMap.end(); it++ ) {
-				
-				vm = static_cast<VirtualMachine*>(it->second);
-
-				if ( ( vm->getHostID() == hostID ) && ( vm->getLocalID() == localID ) ) {
-					
-					if ( ( numOfLLCMisses < 20 ) && ( numOfRetiredInsts < 20 ) ) {
-						missRate = 0.0;
-					} else {
-						missRate = (numOfLLCMisses * LLC_MISS_SAMPLE_THRESHOLD) / ( (numOfRetiredInsts * RETIRED_INST_SAMPLE_THRESHOLD) / 1000000);
-					}
-
-					vm->setNumRetiredInsts(numOfRetiredInsts);
-					vm->setNumLLCMisses(numOfLLCMisses);
-					
-					if ( vm->getCPUAffinity() != getCPUAffinity(vm) ) {
-						vm->setCPUAffinity(getCPUAffinity(vm));
-						
-						cerr << endl;
-						cerr << "[" << hostID << "] Adjust " << g_vmNameMap[vm->getKey()] << " CPU affinity !!!!!!!!" << endl;
-						cerr << endl;
-					}
-
-					missRatePerSocket[vm->getCPUAffinity()] += missRate;
-					pthread_mutex_lock(&g_globalCrew.mutex);
-					g_missRatePerHost[hostID] += missRate;
-					pthread_mutex_unlock(&g_globalCrew.mutex);
-					vmVector.push_back(pair<int, double>(vm->getKey(), missRate));
-
-					numOfVMsPerSocket[vm->getCPUAffinity()] ++ ;
-				}
-			}
-		}
+// What taking moved off the high side and putting it on the low one takes off the higher of the two
+double peakRelief(double highMissRate, double lowMissRate, double moved)
+{
+	return max(highMissRate, lowMissRate) - max(highMissRate - moved, lowMissRate + moved);
+}
+
+void planned(unsigned int migrations, double relief)
+{
+	g_plannedMigrations += migrations;
+	g_plannedRelief += relief;
+}
+
+// Migrations planned per 1000 of peak miss rate they were to take off
+double migrationsPerRelief()
+{
+	return g_plannedRelief > 0.0 ? 1000.0 * g_plannedMigrations / g_plannedRelief : 0.0;
+}
+
+/*
+ *	Search a placement of every VM of the hosts reported in this epoch that
+ *	lowers the most loaded host, moving at most MIGRATION_BUDGET VMs, and
+ *	run the swaps of the plan on the migration crew
+ */
+void searchPlacement(const vector<hostSnapshot>& snapshot, unsigned long round)
+{
+	vector<placement_vm_t>		vms;
+	vector<placement_move_t>	plan;
+	vector<double>		room(g_numHosts+1, 0.0);
+	placement_stats_t	stats;
+	placement_vm_t		v;
+	size_t	first, last;
+	int		queued = 0;
+	double	now = monotonic(), mark = now;
+
+	// MB free on the hosts that reported in this epoch; the others take no VM
+	for ( unsigned int h = 1; h <= g_numHosts; h++ ) {
+		if ( snapshot[h].round == round )
+			room[h] = g_ledger.freeMemory(h);
+	}
 
-		if (vmVector.size() != 8 ) {
-			cout << "[" << hostID << "] Number of virtual mahcines: " << vmVector.size() << endl;
+	// the miss rates the local rounds of this epoch left in the registry
+	for ( unsigned int vm = 0; vm < g_vms.size(); vm++ ) {
+		if ( snapshot[g_vms.hostID(vm)].round != round )
 			continue;
+
+		// one in flight still loads the host it is leaving, but is not planned again
+		v.vm = vm;
+		v.bin = g_vms.hostID(vm);
+		v.missRate = g_vms.missRate(vm);
+		v.size = g_vms.memory(vm);
+		v.pinned = g_cooldown.cooling(vm, now) || g_vms.state(vm) != VM_RUNNING;
+		vms.push_back(v);
+	}
+
+	optimize_placement(vms, room, MIGRATION_BUDGET, plan, &stats);
+	phase_lap(&g_metrics, METRICS_LANE_ROUNDS, 0, PHASE_SELECT, &mark);
+
+	cout << "Placement search: " << vms.size() << " VMs, peak " << stats.peak_before << " -> " << stats.peak_after
+		 << ", " << plan.size() << " moves in " << stats.groups << " groups, " << stats.dropped << " without room, "
+		 << stats.iterations << " iterations in " << stats.elapsed << " ms" << endl;
+
+	// each group goes as a whole or not at all
+	for ( first = 0; first < plan.size(); first = last ) {
+		for ( last = first; last < plan.size() && plan[last].group == plan[first].group; last++ )
+			;
+		queued += enqueueGroup(plan, first, last, round);
+	}
+	phase_lap(&g_metrics, METRICS_LANE_ROUNDS, 0, PHASE_ADMIT, &mark);
+
+	if ( queued > 0 ) {
+		cout << queued << " migrations queued" << endl;
+	}
+
+	cout << "Cooldown: " << g_cooldown.suppressed() << " migrations suppressed, "
+		 << g_cooldown.oscillations() << " of them cycles" << endl;
+	cout << "Capacity: " << g_ledger.rejected() << " plans did not fit, " << g_ledger.inFlight() << " reservations held" << endl;
+	cout << "Planned: " << g_plannedMigrations << " migrations for " << g_plannedRelief << " of peak removed, "
+		 << migrationsPerRelief() << " per 1000" << endl;
+}
+
+/*
+ *	Admits the moves plan[first .. last-1] of a group as a whole: every VM
+ *	free to move, the relief worth all of the migrations and room held on
+ *	the hosts for every step; then queues them together, each after the
+ *	one it waits for.
+ *	Returns the migrations queued.
+ */
+int enqueueGroup(const vector<placement_move_t>& plan, size_t first, size_t last, unsigned long round)
+{
+	vector<unsigned int>	vms;
+	vector<ledger_move_t>	moves;
+	vector<migration_job_t>	jobs;
+	ledger_move_t	move;
+	migration_job_t	job;
+	double	now = monotonic();
+
+	for ( size_t k = first; k < last; k++ ) {
+		const placement_move_t& m = plan[k];
+
+		cout << k << ". Move " << g_vms.name(m.vm) << "(" << m.from << ") to " << m.to;
+		if ( m.after >= 0 )
+			cout << " after " << g_vms.name(plan[m.after].vm);
+		cout << ", gain " << m.gain << endl;
+
+		if ( !g_cooldown.admit(m.vm, m.to, now) ) {
+			cout << "VM[" << m.vm << "] migrated too recently" << endl;
+			return 0;
 		}
 
-		sort(vmVector.begin(), vmVector.end(), Compare());
-		
-		cout << "Host [" << hostID << "] after sorting. " << vmVector.size() << endl;
-		for ( vmVector_it = vmVector.begin(); vmVector_it != vmVector.end(); vmVector_it++ ) {
-			cout << g_vmNameMap[static_cast<unsigned int>(vmVector_it->first)] << ": " << static_cast<double>(vmVector_it->second) << endl;
+		move.vm = m.vm;
+		move.hostID = m.to;
+		move.socket = landingSocket(m.vm, m.to);
+		move.after = ( m.after < 0 ) ? -1 : m.after - (int)first;
+		vms.push_back(m.vm);
+		moves.push_back(move);
+	}
+
+	if ( moveBenefit(vms, plan[first].gain) <= 0.0 ) {
+		cout << "Does not meet the move requirements" << endl;
+		return 0;
+	}
+
+	if ( !g_ledger.reserveMoves(moves) ) {
+		cout << "The moves of group " << plan[first].group << " do not fit" << endl;
+		return 0;
+	}
+
+	for ( size_t k = first; k < last; k++ ) {
+		g_cooldown.record(plan[k].vm, plan[k].from, now);
+	}
+	planned(vms.size(), plan[first].gain);
+
+	for ( size_t k = first; k < last; k++ ) {
+		const placement_move_t& m = plan[k];
+
+		job.vm = m.vm;
+		job.srcHostID = m.from;
+		job.destHostID = m.to;
+		job.socket = -1;
+		job.after = m.after < 0 ? -1 : (int)plan[m.after].vm;
+		job.epoch = round;
+		jobs.push_back(job);
+
+		// before it is queued, it may be done before submit returns
+		g_vms.setState(m.vm, VM_MIGRATING);
+	}
+
+	// all at once: a move must not start after the one it waits for failed unseen
+	if ( submit_migrations(&g_executor, &jobs[0], jobs.size()) != 0 ) {
+		cerr << "Cannot queue the migrations of group " << plan[first].group << endl;
+		for ( size_t k = first; k < last; k++ ) {
+			g_ledger.release(plan[k].vm, g_vms.cpuAffinity(plan[k].vm));
+			g_vms.setState(plan[k].vm, VM_RUNNING);
 		}
+		return 0;
+	}
 
-		cout << "High\t" << g_vmNameMap[static_cast<unsigned int>(vmVector.begin()->first)] << ":" << vmVector.begin()->second << endl;
-		cout << "Low\t" << g_vmNameMap[static_cast<unsigned int>(vmVector.rbegin()->first)] << ":" << vmVector.rbegin()->second << endl;
+	return jobs.size();
+}
 
-		// register 
+/*
+ *	Hands a migration to the executor; the VM is left out of the plans
+ *	until it is done. after: the VM whose migration it waits for, or -1
+ */
+int enqueueMigration(int srcHostID, int destHostID, unsigned int vm, unsigned long round, int after)
+{
+	migration_job_t	job;
+
+	job.vm = vm;
+	job.srcHostID = srcHostID;
+	job.destHostID = destHostID;
+	job.socket = -1;
+	job.after = after;
+	job.epoch = round;
+
+	// before it is queued, it may be done before submit returns
+	g_vms.setState(vm, VM_MIGRATING);
+	if ( submit_migration(&g_executor, &job) != 0 ) {
+		g_ledger.release(vm, g_vms.cpuAffinity(vm));
+		g_vms.setState(vm, VM_RUNNING);
+		return -1;
+	}
 
-		pthread_mutex_lock(&g_llc_mutex[hostID]);
-		g_highLLC_VM[hostID] = vmVector.begin()->first;
-		g_lowLLC_VM[hostID] = vmVector.rbegin()->first;
-		pthread_mutex_unlock(&g_llc_mutex[hostID]);
-		
-		// Exception conditions
-		vm = getVM(vmVector.begin()->first);
+	return 0;
+}
 
-		if ( vm == NULL ) {
-			cerr << " VM is NULL .. (1) " << endl;
-			goto exit;
-		} 
+/*
+ *	Socket a VM comes to on another host: the index it has now, unless that
+ *	host has fewer sockets, in which case its local round repins it to 0
+ */
+unsigned int landingSocket(unsigned int vm, unsigned int destHostID)
+{
+	unsigned int socket = g_vms.cpuAffinity(vm);
 
-		if ( vm->getNumLLCMisses() < LOCAL_LLC_THRESHOLD )  {
-			cout << "Does not meet the LOCAL_LLC_THRESHOLD" << endl;
-			goto exit;
+	return ( socket < g_topology[destHostID].socketCPUs.size() ) ? socket : 0;
+}
+
+/*
+ *	One scheduling round of a host, run on its coroutine on the control
+ *	plane. Every remote call may suspend it, so no lock is held across one
+ */
+void localRound(unsigned int hostID, unsigned long round)
+{
+	map<int, double>		missRatePerSocket;
+	vector<unsigned int>	vcpuSocket;		// [vcpu] of a VM
+	double					missRatePerHost;
+	vector< pair<unsigned int, double> >	vmVector;
+	vector< pair<unsigned int, double> >::iterator	vmVector_it;
+	const hostTopology&	topology = g_topology[hostID];
+	unsigned int	nSockets = topology.socketCPUs.size();
+	unsigned int	socket;
+	double	highest, lowest;
+	vector<int>		numOfVMsPerSocket(nSockets, 0);
+	vector<partition_item_t>	items;
+	vector<partition_bin_t>		bins(nSockets);
+	vector<partition_move_t>	moves;
+	partition_stats_t			stats;
+	vector<unsigned int>		onHost, offered, arrived;
+
+	vector<counterSample>	samples;
+	struct timespec	now;
+	double	mark = monotonic();
+
+	// arrived under a domain ID the migration could not read
+	g_vmIndex.detached(hostID, arrived);
+	for ( unsigned int i = 0; i < arrived.size(); i++ ) {
+		unsigned int localID;
+
+		if ( g_remote->getLocalID(hostID, g_vms.name(arrived[i]), localID) == 0 ) {
+			g_vmIndex.relocate(arrived[i], hostID, localID);
 		}
+	}
 
-		if ( abs(missRatePerSocket[0] - missRatePerSocket[1]) < 500 ) {
-			cout << "Does not meet load unbalance" << endl;
-			cout << "Socket[0-3]: " << missRatePerSocket[0] << endl;
-			cout << "Socket[4-7]: " << missRatePerSocket[1] << endl;
-			goto exit;
+	g_remote->readCounters(hostID, samples);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	phase_lap(&g_metrics, METRICS_LANE_ROUNDS, hostID, PHASE_COLLECT, &mark);
+
+	unsigned int localID;
+	double numOfRetiredInsts;
+	double numOfLLCMisses;
+	double missRate = 0.0;
+	unsigned int vm;
+
+	
+	vmVector.clear();	
+	missRatePerSocket.clear();
+	missRatePerHost = 0.0;
+
+	for ( socket = 0; socket < nSockets; socket++ ) {
+		bins[socket].load = 0.0;
+		// the slots held for VMs on their way here are not the VMs' to take
+		bins[socket].capacity = g_ledger.vcpuCapacity(hostID, socket);
+	}
+	
+	// For each virtual machine
+	for ( unsigned int s = 0; s < samples.size(); s++ ) {
+
+		// 1. Obtain # of retired insts and # of LLC misses.
+		localID = samples[s].localID;
+		numOfRetiredInsts = samples[s].numRetiredInsts;
+		numOfLLCMisses = samples[s].numLLCMisses;
+		missRate = 0.0;
+
+		// cout << "Input Stream: " << localID << "\t" << numOfRetiredInsts << "\t" << numOfLLCMisses << endl;
+
+		vm = g_vmIndex.lookup(hostID, localID);
+		if ( vm == VM_NONE ) {
+			continue;
 		}
 
-		if ( vm->getCPUAffinity() != cpuAffinity[cpuAffinityIdx] ) {
-			cpuAffinityIdx = !cpuAffinityIdx;
+		if ( ( numOfLLCMisses < 20 ) && ( numOfRetiredInsts < 20 ) ) {
+			missRate = 0.0;
+		} else {
+			missRate = (numOfLLCMisses * LLC_MISS_SAMPLE_THRESHOLD) / ( (numOfRetiredInsts * RETIRED_INST_SAMPLE_THRESHOLD) / 1000000);
 		}
 
-		cout << "Host [" << hostID << "] Changing CPU-AFFINITY " << endl;
-		for ( vmVector_it = vmVector.begin(); vmVector_it != vmVector.end(); vmVector_it++, i++) {
+		// a single sample is too noisy to rank on; the VM is scored by its recent history
+		missRate = g_history.add(vm, numOfRetiredInsts, numOfLLCMisses, missRate, now.tv_sec + now.tv_nsec / 1e9);
 
-			vm = getVM(vmVector_it->first);
-			cout << "[" << hostID << "] " << g_vmNameMap[vm->getKey()] << " [" << vm->getLocalID() << "]\t CPU-affinity: " << cpuAffinity[cpuAffinityIdx] << endl;
+		g_vms.setNumRetiredInsts(vm, numOfRetiredInsts);
+		g_vms.setNumLLCMisses(vm, numOfLLCMisses);
+		g_vms.setMissRate(vm, missRate);
+		
+		socket = getCPUAffinity(vm);
+		if ( socket < nSockets && g_vms.cpuAffinity(vm) != socket ) {
+			g_vms.setCPUAffinity(vm, socket);
+			g_ledger.repin(vm, socket);
 			
-			if ( cpuAffinity[cpuAffinityIdx] != vm->getCPUAffinity() ) {
+			cerr << endl;
+			cerr << "[" << hostID << "] Adjust " << g_vms.name(vm) << " CPU affinity !!!!!!!!" << endl;
+			cerr << endl;
+		}
 
-				setCPUAffinity(cpuAffinity[cpuAffinityIdx], vm);
-			}
+		// came from a host with more sockets
+		if ( g_vms.cpuAffinity(vm) >= nSockets ) {
+			cout << "[" << hostID << "] " << setCPUAffinity(0, vm) << endl;
+		}
 
-			if ( i != 3 ) {
-				cpuAffinityIdx = !cpuAffinityIdx;
+		// every socket its vCPUs run on carries their part of the misses
+		vcpu_sockets(topology, g_vms.cpuAffinity(vm), g_vms.numOfVCPUs(vm), vcpuSocket);
+		for ( unsigned int v = 0; v < vcpuSocket.size(); v++ ) {
+			missRatePerSocket[vcpuSocket[v]] += missRate * vcpuShare(samples[s], v, vcpuSocket.size());
+		}
+
+		// a VM wider than its socket stays spread as it is, one migrating stays put; the others are repinned whole
+		if ( vcpuSocket.size() > topology.numOfCores[g_vms.cpuAffinity(vm)] || g_vms.state(vm) != VM_RUNNING ) {
+			for ( unsigned int v = 0; v < vcpuSocket.size(); v++ ) {
+				bins[vcpuSocket[v]].load += missRate * vcpuShare(samples[s], v, vcpuSocket.size());
+				if ( bins[vcpuSocket[v]].capacity > 0 )
+					bins[vcpuSocket[v]].capacity--;
 			}
+		} else {
+			partition_item_t item;
+
+			item.vm = vm;
+			item.missRate = missRate;
+			item.size = vcpuSocket.size();
+			item.bin = g_vms.cpuAffinity(vm);
+			items.push_back(item);
 		}
+		missRatePerHost += missRate;
+		vmVector.push_back(pair<int, double>(vm, missRate));
 
-exit:
-		pthread_barrier_wait(&crew->barrier);
-		pthread_cond_signal(&g_globalCrew.go);
+		numOfVMsPerSocket[g_vms.cpuAffinity(vm)] ++ ;
+	}
+	phase_lap(&g_metrics, METRICS_LANE_ROUNDS, hostID, PHASE_PARSE, &mark);
+
+	// Summary of the round; the VMs ranked in the last round stand until this one ranks its own
+	hostSnapshot snapshot = g_snapshot[hostID][(round - 1) & 1];
+	snapshot.round = round;
+	snapshot.missRate = missRatePerHost;
+
+	if ( vmVector.empty() ) {
+		cout << "[" << hostID << "] Number of virtual mahcines: " << vmVector.size() << endl;
+		g_snapshot[hostID][round & 1] = snapshot;
+		phase_lap(&g_metrics, METRICS_LANE_ROUNDS, hostID, PHASE_RANK, &mark);
+		return;
+	}
 
-		pthread_mutex_lock(&g_hostMigrating_mutex[hostID]);
-		pthread_cond_wait(&g_hostMigrating_go[hostID], &g_hostMigrating_mutex[hostID]);
-		pthread_mutex_unlock(&g_hostMigrating_mutex[hostID]);
+	sort(vmVector.begin(), vmVector.end(), Compare());
+	
+	cout << "Host [" << hostID << "] after sorting. " << vmVector.size() << endl;
+	for ( vmVector_it = vmVector.begin(); vmVector_it != vmVector.end(); vmVector_it++ ) {
+		cout << g_vms.name(vmVector_it->first) << ": " << static_cast<double>(vmVector_it->second) << endl;
+	}
 
-		sleep(LOCAL_SCHD_TIME_INTERVAL);
+	cout << "High\t" << g_vms.name(vmVector.begin()->first) << ":" << vmVector.begin()->second << endl;
+	cout << "Low\t" << g_vms.name(vmVector.rbegin()->first) << ":" << vmVector.rbegin()->second << endl;
+
+	// register 
+
+	snapshot.highLLC_VM = vmVector.begin()->first;
+	snapshot.lowLLC_VM = vmVector.rbegin()->first;
+
+	// what their migrations would cost, before they are offered
+	for ( vmVector_it = vmVector.begin(); vmVector_it != vmVector.end(); vmVector_it++ ) {
+		onHost.push_back(vmVector_it->first);
 	}
+	offered.push_back(snapshot.highLLC_VM);
+	offered.push_back(snapshot.lowLLC_VM);
+	refreshDirtyRates(hostID, offered, onHost);
+
+	// publish; the global thread reads it once the round is complete
+	g_snapshot[hostID][round & 1] = snapshot;
+	phase_lap(&g_metrics, METRICS_LANE_ROUNDS, hostID, PHASE_RANK, &mark);
 	
-	remoteCmd = "";
-	remoteCmd = "xenonmon-unset.py Inst_LLC -t 7200 -n 1";
-	cout << sshCommand(hostID, remoteCmd) << endl;
-	cout << "Host [" << hostID << "] thread exit..." << endl;
+	// Exception conditions
+	vm = vmVector.begin()->first;
 
-	return NULL;
+	if ( !g_vms.contains(vm) ) {
+		cerr << " Unknown VM .. (1) " << endl;
+		return;
+	} 
+
+	if ( g_vms.numLLCMisses(vm) < LOCAL_LLC_THRESHOLD )  {
+		cout << "Does not meet the LOCAL_LLC_THRESHOLD" << endl;
+		return;
+	}
+
+	highest = lowest = missRatePerSocket[0];
+	for ( socket = 1; socket < nSockets; socket++ ) {
+		highest = max(highest, missRatePerSocket[socket]);
+		lowest = min(lowest, missRatePerSocket[socket]);
+	}
+
+	if ( highest - lowest < 500 ) {
+		cout << "Does not meet load unbalance" << endl;
+		for ( socket = 0; socket < nSockets; socket++ ) {
+			cout << "Socket[" << topology.socketCPUs[socket] << "]: " << missRatePerSocket[socket] << endl;
+		}
+		return;
+	}
+
+	// the VMs over the sockets so the hottest carries the least, in as few repins as that takes
+	if ( partition_domains(items, bins, PARTITION_TIME_BUDGET, moves, &stats) < 0 ) {
+		cout << "[" << hostID << "] The vCPUs do not fit on the sockets, the placement stays" << endl;
+		phase_lap(&g_metrics, METRICS_LANE_ROUNDS, hostID, PHASE_ADJUST, &mark);
+		return;
+	}
+
+	cout << "Host [" << hostID << "] Partition: peak " << stats.peak_before << " -> " << stats.peak_after
+		<< " (LPT " << stats.peak_lpt << ", KK " << stats.peak_kk << ", " << stats.nodes << " nodes"
+		<< (stats.optimal ? ", optimal" : "") << ", " << stats.elapsed << " ms) " << moves.size() << " repins" << endl;
+
+	for ( unsigned int i = 0; i < moves.size(); i++ ) {
+		cout << "[" << hostID << "] " << setCPUAffinity(moves[i].to, moves[i].vm) << endl;
+	}
+	phase_lap(&g_metrics, METRICS_LANE_ROUNDS, hostID, PHASE_ADJUST, &mark);
+}
+
+/*
+ *	Re-reads the dirty rates the cost model of the global thread works
+ *	from, so it never waits on a host for them: of the VMs the round offers
+ *	it once they are older than a global period, of the others once older
+ *	than DIRTY_RATE_MAX_AGE. The stale ones of the host are read together,
+ *	in one call, over the same second.
+ */
+void refreshDirtyRates(unsigned int hostID, const vector<unsigned int>& offered, const vector<unsigned int>& vms)
+{
+	vector<unsigned int>	stale, localIDs;
+	vector<dirtyRateSample>	rates;
+	double	now = monotonic(), maxAge;
+
+	for ( unsigned int i = 0; i < vms.size(); i++ ) {
+		maxAge = ( find(offered.begin(), offered.end(), vms[i]) != offered.end() ) ? GLOBAL_SCHD_TIME_INTERVAL : DIRTY_RATE_MAX_AGE;
+		if ( now - g_vms.dirtyStamp(vms[i]) > maxAge ) {
+			stale.push_back(vms[i]);
+			localIDs.push_back(g_vms.localID(vms[i]));
+		}
+	}
+
+	if ( stale.empty() || g_remote->getDirtyRates(hostID, localIDs, rates) != 0 )
+		return;
+
+	for ( unsigned int i = 0; i < rates.size(); i++ ) {
+		for ( unsigned int j = 0; j < stale.size(); j++ ) {
+			if ( localIDs[j] == rates[i].localID ) {
+				g_vms.setDirtyRate(stale[j], rates[i].dirtyRate, now);
+				break;
+			}
+		}
+	}
 }
 
 numaMemoryInfo getNUMAAffinity(int hostID, int localID)
 {
 	numaMemoryInfo memInfo;
-	string remoteCmd;
-	stringstream ss_localID;
-	istringstream iss;
-	string line;
+	vector<int> numOfPages;
 
-	ss_localID.str("");
-	ss_localID << localID;
+	memInfo.numOfPages.assign(g_topology[hostID].nodeMemory.size(), 0);
 
-	remoteCmd = "";
-	remoteCmd = "./getNUMA-affinity.sh " + ss_localID.str();
-	istringstream cmdResult(sshCommand(hostID, remoteCmd));
-	
-	getline(cmdResult, line);
-	iss.str(line);
-	iss >> memInfo.numOfPages[0] >> memInfo.numOfPages[1];
+	if ( g_remote->getNUMAPages(hostID, localID, numOfPages) != 0 ) {
+		cerr << "[" << hostID << "] Cannot read NUMA pages of " << localID << endl;
+		return memInfo;
+	}
+
+	for ( unsigned int i = 0; i < numOfPages.size() && i < memInfo.numOfPages.size(); i++ ) {
+		memInfo.numOfPages[i] = numOfPages[i];
+	}
 
 	return memInfo;
 }
 
 
-VirtualMachine* getVM(unsigned int key)
+unsigned int getCPUAffinity(unsigned int vm)
 {
-	map<unsigned int, VirtualMachine*>::iterator it;
-	it = g_vmMap.find(key);
+	string cpu_affinity;
 
-	if ( it == g_vmMap.end() ) {
-		return NULL;
-	} else {
-		return it->second;
+	if ( g_remote->getCPUAffinity(g_vms.hostID(vm), g_vms.name(vm), cpu_affinity) != 0 ) {
+		cout << "[" << g_vms.hostID(vm) << "] Cannot read CPU affinity of " << g_vms.name(vm) << endl;
+		return -1;
+	}
+
+	int socket = find_socket(g_topology[g_vms.hostID(vm)], cpu_affinity);
+	if ( socket < 0 ) {
+		cout << "[" << g_vms.hostID(vm) << "] Res: " << cpu_affinity << endl;
 	}
+	return socket;
 }
 
-unsigned int getCPUAffinity(VirtualMachine* vm)
+unsigned int getLocalID(unsigned int vm)
 {
-	string remoteCmd, cpu_affinity;
-	remoteCmd = "";
-	remoteCmd = "xm vcpu-list | grep -Rw " + g_vmNameMap[vm->getKey()] + " | awk '{print $7}'";
-	cpu_affinity = sshCommand(vm->getHostID(), remoteCmd);
+	unsigned int localID = 0;
 
-	if ( ( cpu_affinity != "0-3\n" ) && ( cpu_affinity != "4-7\n") ) {
-		cout << "[" << vm->getHostID() << "] Req: " << remoteCmd << endl;
-		cout << "[" << vm->getHostID() << "] Res: " << cpu_affinity << endl;
+	g_remote->getLocalID(g_vms.hostID(vm), g_vms.name(vm), localID);
+	return localID;
+}
 
-		//return 3;
+string migrate(int srcHostID, int destHostID, unsigned int vm, int node, int* status)
+{
+	ostringstream oss;
+	
+	oss << "migrate " << g_vms.name(vm) << " " << srcHostID << " -> " << destHostID;
+	if ( node == 1 ) {
+		oss << " (node 1)";
 	}
-	cpu_affinity.erase(cpu_affinity.end()-1); 
 
-	if ( cpu_affinity == "0-3" ) {
-		return 0;
-	} else if ( cpu_affinity == "4-7") {
-		return 1;
+	struct timespec begin, end;
+	double elapsed;
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	int result = g_remote->migrate(srcHostID, destHostID, g_vms.name(vm), node);
+	if ( status != NULL ) {
+		*status = result;
 	}
 
-	return -1;
-}
+	if ( result != 0 ) {
+		oss << " failed";
+	} else {
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		elapsed = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
 
-unsigned int getLocalID(VirtualMachine* vm)
-{
-	string remoteCmd;
+		// the dirty rate that explains the time it took
+		if ( elapsed > 1.0 ) {
+			g_vms.setDirtyRate(vm, observed_dirty_rate(g_vms.memory(vm), elapsed), monotonic());
+		}
+	}
+
+	// the domain ID changes with the host; a VM that did not leave keeps both
+	if ( result == 0 ) {
+		unsigned int localID;
 
-	remoteCmd = "";
-	remoteCmd = "xm list | grep -Rw " + g_vmNameMap[vm->getKey()] + " | awk '{print $2}'";
-	return atoi(sshCommand(vm->getHostID(), remoteCmd).c_str());
+		if ( g_remote->getLocalID(destHostID, g_vms.name(vm), localID) == 0 ) {
+			g_vmIndex.relocate(vm, destHostID, localID);
+		} else {
+			// the next round of the host looks it up again
+			g_vmIndex.detach(vm, destHostID);
+			oss << ", domain ID not known yet";
+		}
+	}
+
+	return oss.str();
 }
 
-string migrate(int srcHostID, int destHostID, VirtualMachine* vm, int node)
+/*
+ *	Pin every vCPU of the VM around socket affinity of its host, all in one
+ *	driver call; the registry and the ledger follow only if it worked
+ */
+string setCPUAffinity( int affinity, unsigned int vm, int* status)
 {
-	stringstream hostID;
-	string remoteCmd;
-	
-	hostID.str("");
-	hostID << setw(2) << setfill('0') << destHostID;
+	ostringstream oss;
 
-	remoteCmd = "";
-	if ( node == 1) {
-		remoteCmd = "xm migrate -l -n 1 " + g_vmNameMap[vm->getKey()] + " " + g_hostPrefix + hostID.str();
-	} else {
-		remoteCmd = "xm migrate -l " + g_vmNameMap[vm->getKey()] + " " + g_hostPrefix + hostID.str();
+	if ( status != NULL ) {
+		*status = -1;
+	}
+	const hostTopology& topology = g_topology[g_vms.hostID(vm)];
+	vector<unsigned int> sockets;
+	vector<string> cpus;
+
+	// a socket of another host; the VM stays as it is
+	if ( affinity < 0 || (unsigned int)affinity >= topology.socketCPUs.size() ) {
+		oss << "vcpu-pin " << g_vms.name(vm) << " to socket " << affinity << " of " << topology.socketCPUs.size() << " failed";
+		return oss.str();
+	}
+
+	vcpu_sockets(topology, affinity, g_vms.numOfVCPUs(vm), sockets);
+	for ( unsigned int v = 0; v < sockets.size(); v++ ) {
+		cpus.push_back(topology.socketCPUs[sockets[v]]);
 	}
-	sshCommand(srcHostID, remoteCmd); 
 
-	vm->setHostID(destHostID);
-	vm->setLocalID( getLocalID(vm) );
+	oss << "vcpu-pin " << g_vms.name(vm) << " " << cpus.size() << " vCPUs " << cpus[0];
+	if ( cpus.back() != cpus[0] ) {
+		oss << " to " << cpus.back();
+	}
 
-	return remoteCmd;
+	if ( g_remote->pinVCPUs(g_vms.hostID(vm), g_vms.name(vm), cpus) != 0 ) {
+		oss << " failed";
+		return oss.str();
+	}
+	g_vms.setCPUAffinity(vm, affinity);
+	g_ledger.repin(vm, affinity);
+
+	if ( status != NULL ) {
+		*status = 0;
+	}
+	return oss.str();
 }
 
-string setCPUAffinity( int affinity, VirtualMachine* vm)
+/*
+ *	Part of the misses of a domain on one of its vCPUs; an even part when
+ *	they are not counted one by one
+ */
+double vcpuShare(const counterSample& sample, unsigned int vcpu, unsigned int nVCPUs)
 {
-	string remoteCmd;
-	remoteCmd = "";
-	
-	// must use xm insted of xl
-	if ( affinity == 0 ) {
-		remoteCmd = "xm vcpu-pin " + g_vmNameMap[vm->getKey()] + " 0 0-3";
-	} else {
-		remoteCmd = "xm vcpu-pin " + g_vmNameMap[vm->getKey()] + " 0 4-7";
-	}
+	if ( sample.vcpus.empty() || sample.numLLCMisses <= 0.0 )
+		return 1.0 / nVCPUs;
 
-	sshCommand(vm->getHostID(), remoteCmd); 
-	vm->setCPUAffinity(affinity);
+	for ( unsigned int i = 0; i < sample.vcpus.size(); i++ ) {
+		if ( sample.vcpus[i].vcpu == vcpu )
+			return sample.vcpus[i].numLLCMisses / sample.numLLCMisses;
+	}
 
-	return remoteCmd;
+	return 0.0;
 }
 
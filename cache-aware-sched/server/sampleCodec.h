@@ -0,0 +1,178 @@
+#ifndef _SAMPLE_CODEC_H_
+#define _SAMPLE_CODEC_H_
+
+/*
+ *	Binary wire format of a batch of counter samples (all integers little-endian)
+ *
+ *	header	(20 bytes)
+ *		magic		2	'S' 'B'
+ *		version		1	SAMPLE_CODEC_VERSION
+ *		flags		1	reserved, 0
+ *		length		4	bytes of records following the header
+ *		timestamp	8	usec since the epoch, end of the sampling period
+ *		seq			4	batch sequence number
+ *	count and records
+ *		count		2	number of records (counted in length)
+ *		record		localID: fixed 4 bytes
+ *					retired insts, LLC misses: LEB128 varints of the counter
+ *					deltas over the period
+ *
+ *	A reader that does not know a version skips the batch using length.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SAMPLE_CODEC_MAGIC0		'S'
+#define SAMPLE_CODEC_MAGIC1		'B'
+#define SAMPLE_CODEC_VERSION	1
+#define SAMPLE_HEADER_SIZE		20
+#define SAMPLE_RECORD_MAX		(4 + 10 + 10)
+#define SAMPLE_BATCH_MAX(n)		(SAMPLE_HEADER_SIZE + 2 + (n) * SAMPLE_RECORD_MAX)
+
+typedef struct sample_batch_tag {
+	uint8_t			version;
+	uint32_t		seq;
+	uint64_t		timestamp;
+	uint16_t		count;
+	const uint8_t	*next;		// next record to decode
+	const uint8_t	*end;
+} sample_batch_t, *sample_batch_p;
+
+static inline void put_le(uint8_t *buf, uint64_t v, int n)
+{
+	int i;
+	for (i = 0; i < n; i++) {
+		buf[i] = (uint8_t)(v >> (8 * i));
+	}
+}
+
+static inline uint64_t get_le(const uint8_t *buf, int n)
+{
+	uint64_t v = 0;
+	int i;
+	for (i = 0; i < n; i++) {
+		v |= (uint64_t)buf[i] << (8 * i);
+	}
+	return v;
+}
+
+static inline size_t put_varint(uint8_t *buf, uint64_t v)
+{
+	size_t n = 0;
+	while (v >= 0x80) {
+		buf[n++] = (uint8_t)(v | 0x80);
+		v >>= 7;
+	}
+	buf[n++] = (uint8_t)v;
+	return n;
+}
+
+/* returns the bytes consumed, 0 if the varint runs past end */
+static inline size_t get_varint(const uint8_t *buf, const uint8_t *end, uint64_t *v)
+{
+	size_t n = 0;
+	int shift = 0;
+
+	*v = 0;
+	while (buf + n < end && shift < 64) {
+		*v |= (uint64_t)(buf[n] & 0x7f) << shift;
+		if ((buf[n++] & 0x80) == 0)
+			return n;
+		shift += 7;
+	}
+	return 0;
+}
+
+/*
+ *	Encoder: begin, one encode_record() per domain, then end
+ */
+static inline size_t encode_batch_begin(uint8_t *buf, uint32_t seq, uint64_t timestamp)
+{
+	buf[0] = SAMPLE_CODEC_MAGIC0;
+	buf[1] = SAMPLE_CODEC_MAGIC1;
+	buf[2] = SAMPLE_CODEC_VERSION;
+	buf[3] = 0;
+	put_le(buf + 8, timestamp, 8);
+	put_le(buf + 16, seq, 4);
+	return SAMPLE_HEADER_SIZE + 2;
+}
+
+static inline size_t encode_record(uint8_t *buf, uint32_t localID, uint64_t insts, uint64_t misses)
+{
+	size_t n;
+
+	put_le(buf, localID, 4);
+	n = 4;
+	n += put_varint(buf + n, insts);
+	n += put_varint(buf + n, misses);
+	return n;
+}
+
+/* len: total bytes written since encode_batch_begin() */
+static inline void encode_batch_end(uint8_t *buf, size_t len, uint16_t count)
+{
+	put_le(buf + 4, len - SAMPLE_HEADER_SIZE, 4);
+	put_le(buf + SAMPLE_HEADER_SIZE, count, 2);
+}
+
+/*
+ *	Decoder: never allocates, records are read in place from the buffer.
+ *	Returns the size of the whole batch, 0 if more bytes are needed, or -1
+ *	if the stream is corrupt. Batches of an unknown version have count 0.
+ */
+static inline long decode_batch(const uint8_t *buf, size_t len, sample_batch_t *batch)
+{
+	uint32_t length;
+
+	if (len < SAMPLE_HEADER_SIZE)
+		return 0;
+
+	if (buf[0] != SAMPLE_CODEC_MAGIC0 || buf[1] != SAMPLE_CODEC_MAGIC1)
+		return -1;
+
+	length = (uint32_t)get_le(buf + 4, 4);
+	if (len < SAMPLE_HEADER_SIZE + (size_t)length)
+		return 0;
+
+	batch->version = buf[2];
+	batch->timestamp = get_le(buf + 8, 8);
+	batch->seq = (uint32_t)get_le(buf + 16, 4);
+	batch->end = buf + SAMPLE_HEADER_SIZE + length;
+
+	if (batch->version != SAMPLE_CODEC_VERSION || length < 2) {
+		batch->count = 0;
+		batch->next = batch->end;
+	} else {
+		batch->count = (uint16_t)get_le(buf + SAMPLE_HEADER_SIZE, 2);
+		batch->next = buf + SAMPLE_HEADER_SIZE + 2;
+	}
+
+	return SAMPLE_HEADER_SIZE + length;
+}
+
+/* returns 1 if a record was decoded, 0 at the end of the batch, -1 if corrupt */
+static inline int decode_record(sample_batch_t *batch, uint32_t *localID, uint64_t *insts, uint64_t *misses)
+{
+	size_t n;
+
+	if (batch->next >= batch->end)
+		return 0;
+
+	if (batch->end - batch->next < 4)
+		return -1;
+	*localID = (uint32_t)get_le(batch->next, 4);
+	batch->next += 4;
+
+	if ((n = get_varint(batch->next, batch->end, insts)) == 0)
+		return -1;
+	batch->next += n;
+
+	if ((n = get_varint(batch->next, batch->end, misses)) == 0)
+		return -1;
+	batch->next += n;
+
+	return 1;
+}
+
+#endif
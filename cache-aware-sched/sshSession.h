@@ -0,0 +1,64 @@
+#ifndef _SSH_SESSION_H_
+#define _SSH_SESSION_H_
+
+#include <string>
+#include <pthread.h>
+#include <sys/types.h>
+
+using namespace std;
+
+// Number of long-lived ssh channels kept open per host
+#ifndef SSH_SESSIONS_PER_HOST
+#define SSH_SESSIONS_PER_HOST	2
+#endif
+
+// Reconnects after a broken channel, with a backoff doubled on each retry
+#ifndef SSH_COMMAND_RETRIES
+#define SSH_COMMAND_RETRIES		2
+#endif
+#define SSH_RETRY_BACKOFF		100		// ms
+#define SSH_SLOT_RECHECK		5		// ms a host round waits before looking for an idle slot again
+
+// status of a command that did not complete
+#define COMMAND_FAILED			-1		// channel failed on every attempt
+#define COMMAND_TIMEOUT			-2		// deadline passed, session killed
+
+// flags of session_command()
+#define COMMAND_ONCE			0x01	// not idempotent: never sent again once it reached the host
+
+/*
+ *	A session is one "ssh -T <host> /bin/sh" process. Commands are written
+ *	to its stdin and the output is read back up to an end-of-command marker,
+ *	so the handshake is paid once per session instead of once per command.
+ *	Run from the round of a host on the control plane, a command waits for
+ *	its output on the epoll set of the host's loop (see control_poll()).
+ */
+typedef struct session_tag {
+	pid_t			pid;		// 0: not connected
+	int				in;			// commands to the remote shell
+	int				out;		// framed output from the remote shell
+	bool			busy;
+	unsigned long	seq;		// marker sequence number
+} session_t, *session_p;
+
+typedef struct session_pool_tag {
+	unsigned int	num_hosts;
+	int				pool_size;
+	session_t		**session;	// [hostID][slot]
+	pthread_mutex_t	*mutex;		// per host
+	pthread_cond_t	*idle;		// per host, signaled when a slot is released
+} session_pool_t, *session_pool_p;
+
+// Outcome of one session_command()
+typedef struct command_result_tag {
+	int				status;		// exit status of the command, COMMAND_FAILED or COMMAND_TIMEOUT
+	string			output;		// stdout of the command
+	double			duration;	// sec, waiting for a slot and every attempt included
+	int				attempts;
+} command_result_t;
+
+int		create_session_pool(struct session_pool_tag *pool, unsigned int nHosts, int poolSize);
+void	destroy_session_pool(struct session_pool_tag *pool);
+int		session_command(struct session_pool_tag *pool, unsigned int hostID, const string& hostName, const string& command, int timeout, command_result_t *result, int flags = 0);
+
+#endif
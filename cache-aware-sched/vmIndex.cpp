@@ -0,0 +1,109 @@
+#include <algorithm>
+
+#include "vmIndex.h"
+
+VMIndex::VMIndex(VMRegistry& vms) : m_vms(vms)
+{
+	pthread_rwlock_init(&m_lock, NULL);
+}
+
+VMIndex::~VMIndex()
+{
+	pthread_rwlock_destroy(&m_lock);
+}
+
+void VMIndex::insert(unsigned int vm)
+{
+	pthread_rwlock_wrlock(&m_lock);
+	m_index[key(m_vms.hostID(vm), m_vms.localID(vm))] = vm;
+	pthread_rwlock_unlock(&m_lock);
+}
+
+unsigned int VMIndex::lookup(unsigned int hostID, unsigned int localID)
+{
+	tr1::unordered_map<unsigned long long, unsigned int>::iterator it;
+	unsigned int vm = VM_NONE;
+
+	pthread_rwlock_rdlock(&m_lock);
+	it = m_index.find(key(hostID, localID));
+	if ( it != m_index.end() ) {
+		vm = it->second;
+	}
+	pthread_rwlock_unlock(&m_lock);
+
+	return vm;
+}
+
+void VMIndex::relocate(unsigned int vm, unsigned int hostID, unsigned int localID)
+{
+	tr1::unordered_map<unsigned long long, unsigned int>::iterator it;
+
+	pthread_rwlock_wrlock(&m_lock);
+
+	// another VM may already own the new key if it was not re-keyed yet
+	it = m_index.find(key(m_vms.hostID(vm), m_vms.localID(vm)));
+	if ( it != m_index.end() && it->second == vm ) {
+		m_index.erase(it);
+	}
+
+	m_vms.setHostID(vm, hostID);
+	m_vms.setLocalID(vm, localID);
+	m_index[key(hostID, localID)] = vm;
+
+	for ( unsigned int i = 0; i < m_detached.size(); i++ ) {
+		if ( m_detached[i] == vm ) {
+			m_detached[i] = m_detached.back();
+			m_detached.pop_back();
+			break;
+		}
+	}
+
+	pthread_rwlock_unlock(&m_lock);
+}
+
+/*
+ *	No sample finds the VM meanwhile; its old key may belong to another VM
+ *	already, and no key it could take is known yet
+ */
+void VMIndex::detach(unsigned int vm, unsigned int hostID)
+{
+	tr1::unordered_map<unsigned long long, unsigned int>::iterator it;
+
+	pthread_rwlock_wrlock(&m_lock);
+
+	it = m_index.find(key(m_vms.hostID(vm), m_vms.localID(vm)));
+	if ( it != m_index.end() && it->second == vm ) {
+		m_index.erase(it);
+	}
+
+	m_vms.setHostID(vm, hostID);
+	m_vms.setLocalID(vm, VM_NONE);
+	if ( find(m_detached.begin(), m_detached.end(), vm) == m_detached.end() ) {
+		m_detached.push_back(vm);
+	}
+
+	pthread_rwlock_unlock(&m_lock);
+}
+
+void VMIndex::detached(unsigned int hostID, vector<unsigned int>& vms)
+{
+	vms.clear();
+
+	pthread_rwlock_rdlock(&m_lock);
+	for ( unsigned int i = 0; i < m_detached.size(); i++ ) {
+		if ( m_vms.hostID(m_detached[i]) == hostID )
+			vms.push_back(m_detached[i]);
+	}
+	pthread_rwlock_unlock(&m_lock);
+}
+
+size_t VMIndex::size()
+{
+	size_t n;
+
+	pthread_rwlock_rdlock(&m_lock);
+	n = m_index.size();
+	pthread_rwlock_unlock(&m_lock);
+
+	return n;
+}